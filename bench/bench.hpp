@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace CTNM::Bench {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+// Fastest of reps runs of fn, in milliseconds
+template <typename Fn> double time_best_ms(const uint32_t reps, Fn &&fn) {
+  double best = 0.0;
+  for (uint32_t r = 0; r < reps; r++) {
+    const auto t0 = std::chrono::steady_clock::now();
+    fn();
+    const double ms = ms_t(std::chrono::steady_clock::now() - t0).count();
+    best = r == 0 ? ms : std::min(best, ms);
+  }
+
+  return best;
+}
+
+// Positional argument i parsed as a number, or fallback when absent
+inline uint64_t get_arg(const int argc, char *argv[], const int i,
+                        const uint64_t fallback) {
+  return i < argc ? std::stoull(argv[i]) : fallback;
+}
+
+} // namespace CTNM::Bench
@@ -0,0 +1,89 @@
+#include "bench.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/fmm_solver.hpp"
+#include "sim/gravity.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace CTNM;
+
+/* FMM force error against direct summation over a sweep of expansion
+ * orders and opening angles, next to the time of each. The reference is
+ * summed for a random subset of targets, and the full direct time is
+ * extrapolated from it. Bodies follow a Plummer sphere so the tree is
+ * uneven. Usage: bench_fmm_accuracy [n] [n_check] [reps] */
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 100000);
+  const size_t n_check =
+      std::min<size_t>(Bench::get_arg(argc, argv, 2, 1000), n);
+  const uint32_t reps = static_cast<uint32_t>(Bench::get_arg(argc, argv, 3, 1));
+
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<Math::vec_d3> p(n), a(n);
+  std::vector<double> gm(n, 1.0 / static_cast<double>(n));
+  for (Math::vec_d3 &q : p) {
+    const double r = 1.0 / std::sqrt(std::pow(u(rng), -2.0 / 3.0) - 1.0),
+                 z = 2.0 * u(rng) - 1.0, phi = 2.0 * M_PI * u(rng),
+                 s = std::sqrt(1.0 - z * z);
+    q = Math::vec_d3{r * s * std::cos(phi), r * s * std::sin(phi), r * z};
+  }
+
+  std::vector<uint32_t> check(n);
+  for (uint32_t i = 0; i < n; i++)
+    check[i] = i;
+  std::shuffle(check.begin(), check.end(), rng);
+  check.resize(n_check);
+
+  std::vector<Math::vec_d3> p_check(n_check), a_ref(n_check);
+  for (size_t k = 0; k < n_check; k++)
+    p_check[k] = p[check[k]];
+
+  Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global();
+  const double ms_direct_check = Bench::time_best_ms(reps, [&]() {
+    std::fill(a_ref.begin(), a_ref.end(), Math::vec_d3{});
+    Sim::accumulate_direct(pool, p, gm, p_check, a_ref, true);
+  });
+  const double ms_direct = ms_direct_check * static_cast<double>(n) /
+                           static_cast<double>(n_check);
+
+  std::printf("%zu bodies, error over %zu, best of %u, %u threads\n", n,
+              n_check, reps, pool.get_thread_ct());
+  std::printf("direct: %.0f ms (extrapolated)\n", ms_direct);
+  std::printf("%6s %6s %10s %8s %12s %12s %12s\n", "theta", "order", "ms",
+              "speedup", "err median", "err p99", "err max");
+
+  Sim::FMM_Solver solver(pool);
+  std::vector<double> errors(n_check);
+  for (const double theta : {0.7, 0.5, 0.35}) {
+    for (uint32_t order = 2; order <= 14; order += 3) {
+      Sim::FMM_Config config;
+      config.order = order;
+      config.theta = theta;
+      solver.set_config(config);
+
+      const double ms = Bench::time_best_ms(reps, [&]() {
+        std::fill(a.begin(), a.end(), Math::vec_d3{});
+        solver.accumulate(p, gm, p, a);
+      });
+
+      for (size_t k = 0; k < n_check; k++)
+        errors[k] = Math::magnitude(a[check[k]] - a_ref[k]) /
+                    Math::magnitude(a_ref[k]);
+      std::sort(errors.begin(), errors.end());
+      std::printf("%6.2f %6u %10.1f %7.1fx %12.2e %12.2e %12.2e\n", theta,
+                  order, ms, ms_direct / ms, errors[n_check / 2],
+                  errors[std::min(n_check - 1, n_check * 99 / 100)],
+                  errors.back());
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/pm_solver.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace CTNM;
+
+/* Particle-mesh solve time over 128^3, 256^3 and 512^3 meshes for the same
+ * uniform particle set, split by stage. Usage: bench_pm_scaling
+ * [n_particles] [reps] [largest mesh] */
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 1 << 21);
+  const uint32_t reps = static_cast<uint32_t>(Bench::get_arg(argc, argv, 2, 3));
+  const uint32_t n_max =
+      static_cast<uint32_t>(Bench::get_arg(argc, argv, 3, 512));
+
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<Math::vec_d3> p(n), a(n);
+  std::vector<double> gm(n, 1.0 / static_cast<double>(n));
+  for (Math::vec_d3 &q : p)
+    q = Math::vec_d3{u(rng), u(rng), u(rng)};
+
+  Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global();
+  std::printf("%zu particles, best of %u, %u threads\n", n, reps,
+              pool.get_thread_ct());
+  std::printf("%8s %10s %10s %10s %12s %12s %8s\n", "mesh", "assign ms",
+              "fft ms", "interp ms", "total ms", "ns / cell", "scaling");
+
+  Sim::PM_Solver solver(pool);
+  double ms_last = 0.0;
+  for (uint32_t n_mesh = 128; n_mesh <= n_max; n_mesh *= 2) {
+    Sim::PM_Config config;
+    config.n_mesh = n_mesh;
+    config.box_size = 1.0;
+    solver.set_config(config);
+
+    // Stage times are taken from the fastest run
+    Sim::PM_Stats best;
+    const double ms = Bench::time_best_ms(reps, [&]() {
+      std::fill(a.begin(), a.end(), Math::vec_d3{});
+      solver.accumulate(p, gm, p, a);
+      if (best.get_ms() == 0.0 || solver.get_stats().get_ms() < best.get_ms())
+        best = solver.get_stats();
+    });
+
+    const double cells = static_cast<double>(n_mesh) * n_mesh * n_mesh;
+    std::printf("%5u^3 %10.1f %10.1f %10.1f %12.1f %12.2f", n_mesh,
+                best.ms_assign, best.ms_fft, best.ms_interpolate, ms,
+                ms * 1e6 / cells);
+    if (ms_last > 0.0)
+      std::printf(" %7.1fx", ms / ms_last);
+    std::printf("\n");
+    ms_last = ms;
+  }
+
+  return 0;
+}
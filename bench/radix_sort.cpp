@@ -0,0 +1,89 @@
+#include "bench.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace CTNM;
+
+/* Parallel LSD radix sort against std::sort on uniform random keys, with
+ * and without a payload. Usage: bench_radix_sort [n] [reps] */
+
+template <typename K>
+static void bench_keys(Parallel::Thread_Pool &pool, const size_t n,
+                       const uint32_t reps, const char *name) {
+  std::mt19937_64 rng(1);
+  std::vector<K> keys(n);
+  for (K &key : keys)
+    key = static_cast<K>(rng());
+
+  std::vector<K> expect = keys, sorted;
+  const double ms_std = Bench::time_best_ms(reps, [&]() {
+    expect = keys;
+    std::sort(expect.begin(), expect.end());
+  });
+  const double ms_radix = Bench::time_best_ms(reps, [&]() {
+    sorted = keys;
+    Parallel::radix_sort(pool, sorted);
+  });
+
+  std::printf("%-14s std::sort %8.1f ms, radix %8.1f ms (%6.1f Mkeys/s), "
+              "%5.1fx%s\n",
+              name, ms_std, ms_radix, static_cast<double>(n) / ms_radix / 1e3,
+              ms_std / ms_radix, sorted == expect ? "" : ", MISMATCH");
+}
+
+static void bench_pairs(Parallel::Thread_Pool &pool, const size_t n,
+                        const uint32_t reps) {
+  std::mt19937_64 rng(2);
+  std::vector<uint64_t> keys(n);
+  for (uint64_t &key : keys)
+    key = rng();
+
+  // std::sort over (key, value) pairs is the usual way to carry a payload
+  std::vector<std::pair<uint64_t, uint32_t>> expect;
+  const double ms_std = Bench::time_best_ms(reps, [&]() {
+    expect.resize(n);
+    for (size_t i = 0; i < n; i++)
+      expect[i] = {keys[i], static_cast<uint32_t>(i)};
+    std::sort(expect.begin(), expect.end());
+  });
+
+  std::vector<uint64_t> sorted;
+  std::vector<uint32_t> values(n);
+  const double ms_radix = Bench::time_best_ms(reps, [&]() {
+    sorted = keys;
+    std::iota(values.begin(), values.end(), 0u);
+    Parallel::radix_sort(pool, sorted, values);
+  });
+
+  // The radix sort is stable and indices ascend, so ties match std::sort
+  bool match = true;
+  for (size_t i = 0; i < n && match; i++)
+    match = sorted[i] == expect[i].first && values[i] == expect[i].second;
+
+  std::printf("%-14s std::sort %8.1f ms, radix %8.1f ms (%6.1f Mkeys/s), "
+              "%5.1fx%s\n",
+              "u64 + u32", ms_std, ms_radix,
+              static_cast<double>(n) / ms_radix / 1e3, ms_std / ms_radix,
+              match ? "" : ", MISMATCH");
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 1 << 24);
+  const uint32_t reps = static_cast<uint32_t>(Bench::get_arg(argc, argv, 2, 5));
+
+  Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global();
+  std::printf("%zu keys, best of %u, %u threads\n", n, reps,
+              pool.get_thread_ct());
+  bench_keys<uint32_t>(pool, n, reps, "u32");
+  bench_keys<uint64_t>(pool, n, reps, "u64");
+  bench_pairs(pool, n, reps);
+  return 0;
+}
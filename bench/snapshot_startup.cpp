@@ -0,0 +1,104 @@
+#include "bench.hpp"
+#include "components.hpp"
+#include "io/snapshot.hpp"
+#include "math_utils.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace CTNM;
+
+/* Startup from a snapshot of n bodies, each a Transform, Physics and Star.
+ * Times opening the map, reading one column in place and a full restore,
+ * cold after the file's pages are dropped and then warm, next to reading
+ * the whole file into memory as a parsing loader would.
+ * Usage: bench_snapshot_startup [n] [path] */
+
+// Drops the file's clean pages so the next read goes to the disk
+static void drop_cache(const std::filesystem::path &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+static double read_whole(const std::filesystem::path &path) {
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<char> data(std::filesystem::file_size(path));
+  const int fd = open(path.c_str(), O_RDONLY);
+  size_t done = 0;
+  while (fd >= 0 && done < data.size()) {
+    const ssize_t n = read(fd, data.data() + done, data.size() - done);
+    if (n <= 0)
+      break;
+    done += static_cast<size_t>(n);
+  }
+  if (fd >= 0)
+    close(fd);
+
+  return Bench::ms_t(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void run(const char *name, const std::filesystem::path &path,
+                const bool cold) {
+  if (cold)
+    drop_cache(path);
+  const double ms_read = read_whole(path);
+
+  if (cold)
+    drop_cache(path);
+  IO::Snapshot_Reader reader;
+  const auto t0 = std::chrono::steady_clock::now();
+  reader.open(path);
+  const auto t1 = std::chrono::steady_clock::now();
+  float sum = 0.0f;
+  for (const Components::Transform &t :
+       reader.get_column<Components::Transform>("Transform"))
+    sum += t.p.x;
+  const auto t2 = std::chrono::steady_clock::now();
+  entt::registry reg;
+  reader.restore(reg);
+  const auto t3 = std::chrono::steady_clock::now();
+
+  std::printf("%-6s %12.2f %10.3f %12.2f %12.2f %10.0f\n", name, ms_read,
+              Bench::ms_t(t1 - t0).count(), Bench::ms_t(t2 - t1).count(),
+              Bench::ms_t(t3 - t2).count(), static_cast<double>(sum));
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 1 << 20);
+  const std::filesystem::path path =
+      argc > 2 ? argv[2] : "bench_snapshot_startup.ctnm";
+
+  entt::registry reg;
+  for (size_t i = 0; i < n; i++) {
+    const entt::entity e = reg.create();
+    const float x = static_cast<float>(i);
+    reg.emplace<Components::Transform>(e, Math::vec_f3{x, 0.0f, 0.0f});
+    reg.emplace<Components::Physics>(e);
+    reg.emplace<Components::Star>(e);
+  }
+
+  IO::Snapshot_Writer writer;
+  const IO::Snapshot_Stats &written = writer.write(path, reg, 0.0);
+  std::printf("%zu bodies, %.1f MB snapshot written in %.1f ms\n", n,
+              static_cast<double>(written.bytes_file) * 1e-6,
+              written.get_ms());
+  std::printf("%-6s %12s %10s %12s %12s %10s\n", "cache", "read all ms",
+              "open ms", "1 column ms", "restore ms", "checksum");
+  run("cold", path, true);
+  run("warm", path, false);
+
+  std::filesystem::remove(path);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "bench.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/spatial_hash.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace CTNM;
+
+/* Spatial_Hash rebuild time split by stage, on uniform and clustered
+ * points at about two per cell, then find_pairs at a cell's radius.
+ * Usage: bench_spatial_hash [n] [reps] */
+
+static void run(const char *name, const std::vector<Math::vec_d3> &p,
+                const double cell, const uint32_t reps) {
+  Sim::Spatial_Hash hash;
+  Sim::Spatial_Hash_Stats best;
+  const double ms = Bench::time_best_ms(reps, [&]() {
+    hash.build(p, cell);
+    if (best.get_ms() == 0.0 || hash.get_stats().get_ms() < best.get_ms())
+      best = hash.get_stats();
+  });
+
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  const double ms_pairs =
+      Bench::time_best_ms(reps, [&]() { hash.find_pairs(cell, pairs); });
+
+  std::printf("%-10s %9.2f %9.2f %9.2f %9.2f %10.1f %10.2f %10zu\n", name, ms,
+              best.ms_keys, best.ms_sort, best.ms_ranges,
+              static_cast<double>(p.size()) / ms * 1e-3, ms_pairs,
+              pairs.size());
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 1000000);
+  const uint32_t reps = static_cast<uint32_t>(Bench::get_arg(argc, argv, 2, 5));
+
+  // A unit cube holding n / 2 cells
+  const double cell = std::cbrt(2.0 / static_cast<double>(n));
+
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::normal_distribution<double> g(0.0, 0.05);
+  std::vector<Math::vec_d3> uniform(n), clustered(n);
+  for (Math::vec_d3 &q : uniform)
+    q = Math::vec_d3{u(rng), u(rng), u(rng)};
+
+  // Gaussian blobs around 64 random centres
+  std::vector<Math::vec_d3> centres(64);
+  for (Math::vec_d3 &c : centres)
+    c = Math::vec_d3{u(rng), u(rng), u(rng)};
+  for (size_t i = 0; i < n; i++)
+    clustered[i] = centres[i % centres.size()] +
+                   Math::vec_d3{g(rng), g(rng), g(rng)};
+
+  std::printf("%zu points, best of %u, %u threads\n", n, reps,
+              Parallel::Thread_Pool::get_global().get_thread_ct());
+  std::printf("%-10s %9s %9s %9s %9s %10s %10s %10s\n", "points", "build ms",
+              "keys", "sort", "ranges", "Mpts/s", "pairs ms", "pairs");
+  run("uniform", uniform, cell, reps);
+  run("clustered", clustered, cell, reps);
+
+  return 0;
+}
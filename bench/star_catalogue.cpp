@@ -0,0 +1,88 @@
+#include "bench.hpp"
+#include "cpu/star_splat.hpp"
+#include "io/star_catalogue.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace CTNM;
+
+/* Star catalogue ingestion of a synthetic Gaia style CSV of n rows, and of
+ * its packed binary form, into star points. Reports rows per second, the
+ * reader's batch memory and the process's peak resident size, which is
+ * reset before each pass on Linux so every pass shows its own.
+ * Usage: bench_star_catalogue [n] [window MB] [path] */
+
+static void reset_peak_rss() {
+#ifdef __linux__
+  std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+static void run(const char *name, IO::Star_Catalogue_Reader &reader,
+                const std::filesystem::path &path) {
+  CPU::Star_Points points;
+  reset_peak_rss();
+  const IO::Star_Catalogue_Stats &stats = reader.load(path, points);
+  std::printf("%-7s %10.1f %10.1f %9.2f %10.1f %10.1f %10.1f\n", name,
+              static_cast<double>(stats.bytes) * 1e-6, stats.get_ms(),
+              stats.get_rows_per_s() * 1e-6,
+              static_cast<double>(stats.peak_batch_bytes) * 1e-6,
+              static_cast<double>(points.size() * 6 * sizeof(float)) * 1e-6,
+              static_cast<double>(stats.peak_rss_bytes) * 1e-6);
+}
+
+int main(int argc, char *argv[]) {
+  const uint64_t n = Bench::get_arg(argc, argv, 1, 4000000);
+  const uint64_t window_mb = Bench::get_arg(argc, argv, 2, 64);
+  const std::filesystem::path csv =
+      argc > 3 ? argv[3] : "bench_star_catalogue.csv";
+  std::filesystem::path packed = csv;
+  packed += ".bin";
+
+  // Nearby stars, a tenth of them without a radial velocity
+  {
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::ofstream file(csv);
+    file << "source_id,ra,dec,parallax,pmra,pmdec,radial_velocity,"
+            "phot_g_mean_mag,bp_rp,teff_gspphot\n";
+    char rv[32], line[256];
+    for (uint64_t i = 0; i < n; i++) {
+      rv[0] = '\0';
+      if (u(rng) >= 0.1)
+        std::snprintf(rv, sizeof(rv), "%.3f", 100.0 * u(rng) - 50.0);
+      const int len = std::snprintf(
+          line, sizeof(line),
+          "%llu,%.9f,%.9f,%.6f,%.4f,%.4f,%s,%.4f,%.4f,%.1f\n",
+          static_cast<unsigned long long>(i), 360.0 * u(rng),
+          180.0 * u(rng) - 90.0, 0.1 + 10.0 * u(rng), 20.0 * u(rng) - 10.0,
+          20.0 * u(rng) - 10.0, rv, 6.0 + 14.0 * u(rng), 3.0 * u(rng),
+          3000.0 + 7000.0 * u(rng));
+      file.write(line, len);
+    }
+  }
+
+  IO::Star_Catalogue_Reader reader;
+  IO::Star_Catalogue_Config config;
+  config.window = window_mb << 20;
+  reader.set_config(config);
+  reader.pack(csv, packed);
+
+  std::printf("%llu rows, %llu MB windows, %u threads\n",
+              static_cast<unsigned long long>(n),
+              static_cast<unsigned long long>(window_mb),
+              Parallel::Thread_Pool::get_global().get_thread_ct());
+  std::printf("%-7s %10s %10s %9s %10s %10s %10s\n", "format", "file MB",
+              "ms", "Mrows/s", "batch MB", "points MB", "peak RSS");
+  run("csv", reader, csv);
+  run("binary", reader, packed);
+
+  std::filesystem::remove(csv);
+  std::filesystem::remove(packed);
+  return 0;
+}
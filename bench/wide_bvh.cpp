@@ -0,0 +1,116 @@
+#include "bench.hpp"
+#include "components.hpp"
+#include "cpu/ray.hpp"
+#include "cpu/scene.hpp"
+#include "cpu/traversal.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+using namespace CTNM;
+
+/* Node memory and single-ray throughput of BVH4 against BVH8, over the
+ * same instances of a UV sphere. Rays leave a pinhole camera through a
+ * 1920x1080 grid, and hit distances must agree between the widths.
+ * Usage: bench_wide_bvh [n_instances] [sphere segments] [reps] */
+
+static Components::Mesh make_sphere(const uint32_t segments) {
+  Components::Mesh mesh;
+  const uint32_t rings = segments / 2;
+  for (uint32_t i = 0; i <= rings; i++)
+    for (uint32_t j = 0; j <= segments; j++) {
+      const float theta = static_cast<float>(M_PI) * i / rings,
+                  phi = 2.0f * static_cast<float>(M_PI) * j / segments;
+      mesh.verticies.push_back(Components::Vertex{
+          Math::vec_f3{std::sin(theta) * std::cos(phi), std::cos(theta),
+                       std::sin(theta) * std::sin(phi)}});
+    }
+
+  for (uint32_t i = 0; i < rings; i++)
+    for (uint32_t j = 0; j < segments; j++) {
+      const uint32_t a = i * (segments + 1) + j, b = a + segments + 1;
+      mesh.indicies.insert(mesh.indicies.end(),
+                           {a, b, a + 1, a + 1, b, b + 1});
+    }
+
+  return mesh;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = Bench::get_arg(argc, argv, 1, 2000);
+  const uint32_t segments =
+      static_cast<uint32_t>(Bench::get_arg(argc, argv, 2, 128));
+  const uint32_t reps = static_cast<uint32_t>(Bench::get_arg(argc, argv, 3, 3));
+  constexpr uint32_t W = 1920, H = 1080;
+
+  entt::registry reg;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+  const Components::Mesh sphere = make_sphere(segments);
+  for (size_t i = 0; i < n; i++) {
+    const entt::entity e = reg.create();
+    reg.emplace<Components::Transform>(
+        e, Math::vec_f3{60.0f + 40.0f * u(rng), 30.0f * u(rng), 30.0f * u(rng)},
+        Math::vec_f3{1.0f, 1.0f, 1.0f} * (1.0f + 0.5f * u(rng)));
+    reg.emplace<Components::Mesh>(e, sphere);
+    reg.emplace<Components::Surface>(e);
+  }
+
+  // Camera at the origin looking down +x
+  std::vector<CPU::Ray> rays(static_cast<size_t>(W) * H);
+  for (uint32_t y = 0; y < H; y++)
+    for (uint32_t x = 0; x < W; x++) {
+      const float sx = (2.0f * (x + 0.5f) / W - 1.0f) * W / H,
+                  sy = 1.0f - 2.0f * (y + 0.5f) / H;
+      rays[static_cast<size_t>(y) * W + x] = CPU::make_ray(
+          Math::vec_f3{0.0f, 0.0f, 0.0f},
+          Math::normalize(Math::vec_f3{1.0f, sy * 0.5f, sx * 0.5f}));
+    }
+
+  Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global();
+  std::printf("%zu spheres of %zu triangles, %ux%u single rays, best of %u, "
+              "%u threads\n",
+              n, sphere.indicies.size() / 3, W, H, reps, pool.get_thread_ct());
+  std::printf("%6s %11s %11s %10s %12s %10s\n", "width", "wide MB",
+              "binary MB", "node B", "Mrays/s", "mismatch");
+
+  CPU::Scene scene;
+  std::vector<CPU::Hit> hits(rays.size()), first(rays.size());
+  for (const uint32_t w : {4u, 8u}) {
+    scene.set_wide_width(w);
+    scene.sync(pool, reg);
+
+    const double ms = Bench::time_best_ms(reps, [&]() {
+      pool.parallel_for(0, rays.size(), 4096,
+                        [&](const size_t b, const size_t e, size_t) {
+                          for (size_t i = b; i < e; i++)
+                            hits[i] = CPU::trace(scene, rays[i]);
+                        });
+    });
+
+    size_t n_mismatch = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+      if (w == 4)
+        first[i] = hits[i];
+      else if (hits[i].t != first[i].t) // Shared edges may tie on prim
+        n_mismatch++;
+    }
+
+    const CPU::Scene_Stats stats = scene.get_stats();
+    std::printf("%6u %11.2f %11.2f %10zu %12.2f %10zu\n", w,
+                static_cast<double>(stats.wide_bytes) / 1e6,
+                static_cast<double>(stats.binary_bytes) / 1e6,
+                w == 8 ? sizeof(CPU::Wide_Node<8>) : sizeof(CPU::Wide_Node<4>),
+                static_cast<double>(rays.size()) / (ms * 1e3), n_mismatch);
+  }
+
+  return 0;
+}
@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <vector>
 
+#include <entt/entt.hpp>
+
 namespace CTNM::Components {
 
 struct Camera {
@@ -21,6 +23,20 @@ struct Transform {
 
 struct Physics {
   CTNM::Math::vec_f3 v = {0.0f, 0.0f, 0.0f}; // Velocity
+  CTNM::Math::vec_f3 a = {0.0f, 0.0f, 0.0f}; // External acceleration
+  float m = 0.0f; // Mass in kg, only bodies with mass attract
+};
+
+/* Makes a Physics entity an SPH gas particle of mass Physics::m */
+struct Gas {
+  float h = 0.0f;   // Smoothing length, 0 lets the simulator pick one
+  float u = 0.0f;   // Specific internal energy, J kg^-1
+  float rho = 0.0f; // Density, written by the simulator
+};
+
+/* Makes a Physics body solid, bodies that touch merge into the heavier */
+struct Collider {
+  float r = 0.0f; // Bounding radius, 0 takes it from the Mesh
 };
 
 struct Vertex {
@@ -34,7 +50,44 @@ struct Mesh {
 };
 
 struct Surface {
-  CTNM::Math::vec_f3 col;
+  CTNM::Math::vec_f3 col; // 0 to 255 per channel, shaders divide by 255
+};
+
+/* Point light splatted straight into the frame. It never has a Mesh, so
+ * Stager builds no BLAS for it, and Surface::col is its colour. Scene
+ * scales that to 0 to 1 when gathering the star points */
+struct Star {
+  float l = 1.0f; // Luminosity in suns
+};
+
+struct Black_Hole {
+  float r_s = 1.0f;                              // Schwarzschild radius
+  float disk_r_in = 3.0f, disk_r_out = 12.0f;    // Multiples of r_s
+  CTNM::Math::vec_f3 disk_n = {0.0f, 1.0f, 0.0f}; // Disk normal
+};
+
+/* Optional on a Black_Hole entity, without it the disk is infinitely thin */
+struct Accretion_Disk {
+  float h_r = 0.05f;      // Scale height over radius
+  float t_max = 1e4f;     // Peak temperature, Kelvin
+  float opacity = 4.0f;   // Optical depth per r_s at the inner edge
+  float brightness = 1.0f;
+};
+
+/* Keplerian elements relative to the parent, angles in radians against the
+ * x-z plane with +y as the pole. While analytic the simulator evaluates the
+ * conic directly, otherwise the body is integrated numerically */
+struct Orbit {
+  entt::entity parent = entt::null; // Null orbits the origin
+  double mu = 0.0;   // Gravitational parameter of the parent, m^3 s^-2
+  double a = 0.0;    // Semi-major axis, negative when hyperbolic
+  double e = 0.0;    // Eccentricity
+  double i = 0.0;    // Inclination
+  double raan = 0.0; // Longitude of the ascending node
+  double argp = 0.0; // Argument of periapsis
+  double m0 = 0.0;   // Mean anomaly at epoch
+  double epoch = 0.0;
+  bool analytic = true;
 };
 
 } // namespace CTNM::Components
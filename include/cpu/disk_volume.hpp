@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../math_utils.hpp"
+#include "geodesic.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace CTNM::CPU {
+
+/* Normalised sRGB colour of a black body, valid for 1000 K - 40000 K */
+Math::vec_f3 get_blackbody_col(const float kelvin);
+
+/* Quality knobs, larger steps and looser opacity limits trade image quality
+ * for frame time */
+struct Disk_March_Config {
+  float step_scale = 0.5f;  // Largest step as a fraction of scale height
+  float max_dtau = 0.1f;    // Largest optical depth per step
+  float min_transmittance = 1e-3f;
+  uint32_t max_steps = 256; // Per segment
+};
+
+struct Disk_Radiance {
+  Math::vec_f3 L = {0.0f, 0.0f, 0.0f};
+  float T = 1.0f; // Transmittance
+
+  Math::vec_f4 composite(const Math::vec_f4 &behind) const {
+    return Math::vec_f4{L.x + T * behind.x, L.y + T * behind.y,
+                        L.z + T * behind.z, 1.0f};
+  }
+};
+
+/* Keplerian disk around a Schwarzschild hole. Temperature follows the
+ * Shakura-Sunyaev profile and every sample is shifted by the Doppler and
+ * gravitational redshift factor g, with intensity scaling as g^4 */
+class Disk_Volume {
+public:
+  Disk_Volume(const Geodesic_Params &lens,
+              const Components::Accretion_Disk &disk, const bool thick);
+  ~Disk_Volume() = default;
+
+  bool is_thick() const;
+
+  /* Emission of an optically thick thin disk at p (relative to the hole),
+   * seen by a photon travelling along d */
+  Math::vec_f3 shade_crossing(const Math::vec_f3 &p,
+                              const Math::vec_f3 &d) const;
+
+  /* Integrates the segment a -> b (world space) front to back into rad,
+   * skipping empty occupancy cells. Thin disks are a single opaque
+   * crossing. Returns the number of samples taken */
+  uint32_t march(const Math::vec_f3 &a, const Math::vec_f3 &b,
+                 const Disk_March_Config &config, Disk_Radiance &rad) const;
+
+private:
+  static constexpr uint32_t GRID_XY = 32, GRID_Z = 8;
+
+  Math::vec_f3 m_center, m_n, m_t1, m_t2; // Disk frame
+  float m_r_s, m_r_in, m_r_out, m_h_r, m_kappa;
+  float m_t_max, m_brightness;
+  bool m_thick;
+
+  Math::vec_f3 m_grid_min, m_cell_size; // Disk frame
+  std::vector<float> m_cell_rho;        // Upper bound on density per cell
+
+  float get_density(const Math::vec_f3 &p_local) const;
+  Math::vec_f3 get_emission(const Math::vec_f3 &p_local,
+                            const Math::vec_f3 &d_local) const;
+  void build_grid();
+};
+
+} // namespace CTNM::CPU
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../math_utils.hpp"
+#include "ray.hpp"
+
+#include <cstdint>
+
+namespace CTNM::CPU {
+
+enum class Geodesic_End : int32_t { None, Horizon, Disk, Escape, Max_Steps };
+
+struct Geodesic_Params {
+  Math::vec_f3 center = {0.0f, 0.0f, 0.0f};
+  Math::vec_f3 disk_n = {0.0f, 1.0f, 0.0f};
+  float r_s = 1.0f;
+  float disk_r_in = 3.0f, disk_r_out = 12.0f; // Absolute radii
+  float r_escape = 100.0f;
+  float tol = 1e-3f; // Relative position error per step
+  uint32_t max_steps = 512;
+  uint32_t max_rejects = 32; // In a row, then the ray ends as Max_Steps
+};
+
+Geodesic_Params make_geodesic_params(const Components::Black_Hole &hole,
+                                     const Components::Transform &transform);
+
+/* Photon state relative to the hole. Rays bend as x'' = -3/2 r_s h^2 x / r^5
+ * with h = |x × x'|, which reproduces Schwarzschild null geodesics */
+template <uint32_t W> struct Geodesic_Packet {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  vfloat x[3], v[3];
+  vfloat h2, step;
+  vint active, end, n_steps;
+  vint n_rejects; // Since the last accepted step
+  vfloat disk_p[3]; // Disk crossing relative to the hole, if end == Disk
+};
+
+template <uint32_t W>
+void init_geodesics(const Geodesic_Params &params, Geodesic_Packet<W> &rays,
+                    const Math::vec_f3 *o, const Math::vec_f3 *d,
+                    const typename Packet_Traits<W>::vint &active);
+
+/* Advances every active lane by one adaptive Bogacki–Shampine 3(2) step.
+ * Rejected lanes retry with a smaller step on the next call, up to
+ * max_rejects times; accepted segments are written to seg_start so callers
+ * can test scene geometry. Returns the mask of lanes that accepted a step */
+template <uint32_t W>
+typename Packet_Traits<W>::vint
+step_geodesics(const Geodesic_Params &params, Geodesic_Packet<W> &rays,
+               typename Packet_Traits<W>::vfloat seg_start[3]);
+
+extern template void init_geodesics<4>(const Geodesic_Params &,
+                                       Geodesic_Packet<4> &,
+                                       const Math::vec_f3 *,
+                                       const Math::vec_f3 *,
+                                       const Packet_Traits<4>::vint &);
+extern template void init_geodesics<8>(const Geodesic_Params &,
+                                       Geodesic_Packet<8> &,
+                                       const Math::vec_f3 *,
+                                       const Math::vec_f3 *,
+                                       const Packet_Traits<8>::vint &);
+extern template Packet_Traits<4>::vint
+step_geodesics<4>(const Geodesic_Params &, Geodesic_Packet<4> &,
+                  Packet_Traits<4>::vfloat[3]);
+extern template Packet_Traits<8>::vint
+step_geodesics<8>(const Geodesic_Params &, Geodesic_Packet<8> &,
+                  Packet_Traits<8>::vfloat[3]);
+
+} // namespace CTNM::CPU
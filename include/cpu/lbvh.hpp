@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace CTNM::CPU {
+
+constexpr uint32_t BVH_INVALID = std::numeric_limits<uint32_t>::max();
+
+struct BVH_Node {
+  Math::AABB bounds;
+  uint32_t children[2] = {BVH_INVALID, BVH_INVALID};
+  uint32_t prim = BVH_INVALID; // Only valid for leaves
+  uint32_t parent = BVH_INVALID;
+
+  bool is_leaf() const { return prim != BVH_INVALID; }
+};
+
+struct LBVH_Stats {
+  size_t n_prims = 0;
+  double ms_morton = 0.0, ms_sort = 0.0, ms_hierarchy = 0.0, ms_bounds = 0.0,
+         ms_total = 0.0;
+
+  double get_ns_per_prim() const {
+    return n_prims == 0 ? 0.0 : ms_total * 1e6 / static_cast<double>(n_prims);
+  }
+};
+
+/* Karras-style linear BVH with one primitive per leaf. Internal nodes occupy
+ * [0, n - 1) and leaves [n - 1, 2n - 1) in Morton order */
+class LBVH {
+public:
+  LBVH() = default;
+  ~LBVH() = default;
+
+  void build(Parallel::Thread_Pool &pool,
+             std::span<const Math::AABB> prim_bounds);
+  /* Recomputes bounds over the existing topology, which only stays good
+   * while primitives move little. Builds if the count changed */
+  void refit(Parallel::Thread_Pool &pool,
+             std::span<const Math::AABB> prim_bounds);
+
+  const std::vector<BVH_Node> &get_nodes() const;
+  uint32_t get_root() const;
+  const Math::AABB &get_bounds() const; // Empty for an empty tree
+  const LBVH_Stats &get_stats() const;
+
+private:
+  std::vector<BVH_Node> m_nodes;
+  std::vector<uint64_t> m_codes;
+  std::vector<uint32_t> m_prims; // Sorted position -> primitive index
+  LBVH_Stats m_stats;
+
+  void emit_hierarchy(Parallel::Thread_Pool &pool);
+  void propagate_bounds(Parallel::Thread_Pool &pool,
+                        std::span<const Math::AABB> prim_bounds);
+};
+
+/* Spreads the low 21 bits of v to every third bit */
+inline uint64_t expand_bits_21(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffull;
+  v = (v | v << 16) & 0x1f0000ff0000ffull;
+  v = (v | v << 8) & 0x100f00f00f00f00full;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+uint64_t get_morton_code(const Math::vec_f3 &p_normalized);
+
+} // namespace CTNM::CPU
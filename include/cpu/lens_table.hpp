@@ -0,0 +1,104 @@
+#pragma once
+
+#include "../parallel/thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace CTNM::CPU {
+
+constexpr uint32_t LENS_TABLE_VERSION = 2;
+constexpr uint32_t LENS_TABLE_ENDIAN = 0x01020304; // Byte swapped if foreign
+
+/* Distances are in multiples of r_s. The table is indexed by observer
+ * distance (log spaced) and the angle alpha between the ray and the
+ * direction to the hole, and holds the swept angle phi of the orbit */
+struct Lens_Table_Config {
+  uint32_t n_r = 64, n_alpha = 512, n_phi = 96;
+  float r_min = 2.0f, r_max = 1000.0f;
+  float phi_max = 3.0f * 3.14159265f; // Covers the first secondary image
+  float tol = 1e-5f;
+};
+
+/* Stored little endian at the start of the file, arrays follow at the
+ * given byte offsets in this order. Little endian hosts only */
+struct Lens_Table_Header {
+  char magic[8] = {'C', 'T', 'N', 'M', 'L', 'E', 'N', 'S'};
+  uint32_t version = LENS_TABLE_VERSION;
+  uint32_t endian = LENS_TABLE_ENDIAN;
+  uint32_t n_r = 0, n_alpha = 0, n_phi = 0;
+  float r_min = 0.0f, r_max = 0.0f, r_far = 0.0f, phi_max = 0.0f;
+  uint64_t beta_offset = 0;    // float, outgoing direction angle
+  uint64_t phi_end_offset = 0; // float, swept angle at escape or capture
+  uint64_t u_offset = 0;       // uint16, r_s / r at each phi sample
+  uint64_t fate_offset = 0;    // uint8, 1 if captured
+  uint64_t bytes = 0;
+};
+
+/* Bilinear corners of one lookup, reused for the radius queries */
+struct Lens_Sample {
+  bool captured = false;
+  float b = 0.0f; // Impact parameter at infinity
+  float beta = 0.0f, phi_end = 0.0f;
+  uint32_t entry[4] = {0, 0, 0, 0};
+  float w[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+struct Lens_Table_Stats {
+  size_t bytes = 0;
+  uint64_t n_steps = 0;
+  double ms_build = 0.0, ms_load = 0.0;
+};
+
+/* Table vs direct integration over random (r_o, alpha, phi) samples.
+ * Angles in radians, radius errors relative */
+struct Lens_Table_Error {
+  size_t n_samples = 0, n_fate_mismatch = 0;
+  double beta_mean = 0.0, beta_p99 = 0.0, beta_max = 0.0;
+  double radius_mean = 0.0, radius_p99 = 0.0, radius_max = 0.0;
+  double ns_lookup = 0.0, ns_integrate = 0.0;
+};
+
+/* Precomputed Schwarzschild deflection. The photon stays in the plane of
+ * the hole, observer and ray, so two parameters fix the whole orbit */
+class Lens_Table {
+public:
+  Lens_Table() = default;
+  ~Lens_Table();
+
+  Lens_Table(const Lens_Table &) = delete;
+  Lens_Table &operator=(const Lens_Table &) = delete;
+
+  void build(Parallel::Thread_Pool &pool, const Lens_Table_Config &config = {});
+  void save(const std::filesystem::path &path) const;
+  void load(const std::filesystem::path &path); // Maps the file read-only
+
+  bool empty() const;
+  const Lens_Table_Header &get_header() const;
+  const Lens_Table_Stats &get_stats() const;
+
+  Lens_Sample lookup(const float r_o, const float alpha) const;
+  float get_radius(const Lens_Sample &sample, const float phi) const;
+
+  Lens_Table_Error measure_error(Parallel::Thread_Pool &pool,
+                                 const size_t n_samples = 4096,
+                                 const uint32_t seed = 1) const;
+
+private:
+  std::vector<std::byte> m_storage;
+  void *m_map = nullptr;
+  size_t m_map_bytes = 0;
+
+  const Lens_Table_Header *m_header = nullptr;
+  const float *m_beta = nullptr, *m_phi_end = nullptr;
+  const uint16_t *m_u = nullptr;
+  const uint8_t *m_fate = nullptr;
+  Lens_Table_Stats m_stats;
+
+  void bind(const std::byte *data, const size_t bytes);
+  void unmap();
+};
+
+} // namespace CTNM::CPU
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "lbvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+/* Mirrors the ray extents used by k_raytracer */
+constexpr float RAY_T_MIN = 0.01f;
+constexpr float RAY_T_MAX = 1000.0f;
+
+struct Ray {
+  Math::vec_f3 o = {0.0f, 0.0f, 0.0f};
+  Math::vec_f3 d = {0.0f, 0.0f, 1.0f};
+  Math::vec_f3 inv_d = {std::numeric_limits<float>::infinity(),
+                        std::numeric_limits<float>::infinity(), 1.0f};
+  float t_min = RAY_T_MIN, t_max = RAY_T_MAX;
+};
+
+struct Hit {
+  float t = std::numeric_limits<float>::infinity();
+  float u = 0.0f, v = 0.0f;
+  uint32_t inst = BVH_INVALID, prim = BVH_INVALID;
+
+  bool exists() const { return inst != BVH_INVALID; }
+};
+
+/* Precomputed Möller–Trumbore edges */
+struct Triangle {
+  Math::vec_f3 v0, e1, e2;
+};
+
+template <uint32_t W> struct Packet_Traits;
+
+template <> struct Packet_Traits<4> {
+  using vfloat = simd::float4;
+  using vint = simd::int4;
+};
+
+template <> struct Packet_Traits<8> {
+  using vfloat = simd::float8;
+  using vint = simd::int8;
+};
+
+template <> struct Packet_Traits<16> {
+  using vfloat = simd::float16;
+  using vint = simd::int16;
+};
+
+template <typename V, typename S> inline V splat(const S s) { return V{} + s; }
+
+template <typename M> inline M select(const M mask, const M a, const M b) {
+  return (a & ~mask) | (b & mask);
+}
+
+/* Lanes are structure-of-arrays; active lanes hold -1 in active */
+template <uint32_t W> struct Ray_Packet {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  vfloat o[3], d[3], inv_d[3];
+  vfloat t_min, t_max;
+  vint active;
+};
+
+template <uint32_t W> struct Hit_Packet {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  vfloat t, u, v;
+  vint inst, prim; // BVH_INVALID reinterpreted as -1 for misses
+};
+
+inline Math::vec_f3 get_inv_dir(const Math::vec_f3 &d) {
+  constexpr float eps = 1e-20f;
+  Math::vec_f3 inv_d;
+  for (int i = 0; i < 3; i++)
+    inv_d[i] = 1.0f / (std::fabs(d[i]) > eps ? d[i] : std::copysign(eps, d[i]));
+
+  return inv_d;
+}
+
+/* Packet form of the clamp above, so axis-parallel lanes stay finite */
+template <typename V> inline V get_inv_dir(const V d) {
+  constexpr float eps = 1e-20f;
+  const V signed_eps = simd_select(splat<V>(eps), splat<V>(-eps), d < 0.0f);
+  return splat<V>(1.0f) / simd_select(d, signed_eps, simd_abs(d) <= eps);
+}
+
+inline Ray make_ray(const Math::vec_f3 &o, const Math::vec_f3 &d,
+                    const float t_min = RAY_T_MIN,
+                    const float t_max = RAY_T_MAX) {
+  return Ray{o, d, get_inv_dir(d), t_min, t_max};
+}
+
+inline bool intersect_box(const Ray &ray, const Math::AABB &box,
+                          float &t_entry) {
+  const Math::vec_f3 t0 = (box.min - ray.o) * ray.inv_d,
+                     t1 = (box.max - ray.o) * ray.inv_d;
+  const Math::vec_f3 t_near = simd_min(t0, t1), t_far = simd_max(t0, t1);
+  t_entry = std::max({t_near.x, t_near.y, t_near.z, ray.t_min});
+  const float t_exit = std::min({t_far.x, t_far.y, t_far.z, ray.t_max});
+  return t_entry <= t_exit;
+}
+
+template <uint32_t W>
+inline typename Ray_Packet<W>::vint
+intersect_box(const Ray_Packet<W> &rays, const Math::AABB &box,
+              typename Ray_Packet<W>::vfloat &t_entry) {
+  using vfloat = typename Ray_Packet<W>::vfloat;
+
+  vfloat t_near = rays.t_min, t_far = rays.t_max;
+  for (int i = 0; i < 3; i++) {
+    const vfloat t0 = (splat<vfloat>(box.min[i]) - rays.o[i]) * rays.inv_d[i],
+                 t1 = (splat<vfloat>(box.max[i]) - rays.o[i]) * rays.inv_d[i];
+    t_near = simd_max(t_near, simd_min(t0, t1));
+    t_far = simd_min(t_far, simd_max(t0, t1));
+  }
+
+  t_entry = t_near;
+  return (t_near <= t_far) & rays.active;
+}
+
+inline bool intersect_triangle(Ray &ray, Hit &hit, const Triangle &tri,
+                               const uint32_t inst, const uint32_t prim) {
+  constexpr float eps = 1e-9f;
+  const Math::vec_f3 p = simd_cross(ray.d, tri.e2);
+  const float det = simd_dot(tri.e1, p);
+  if (std::fabs(det) < eps)
+    return false;
+
+  const float inv_det = 1.0f / det;
+  const Math::vec_f3 s = ray.o - tri.v0;
+  const float u = simd_dot(s, p) * inv_det;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  const Math::vec_f3 q = simd_cross(s, tri.e1);
+  const float v = simd_dot(ray.d, q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+
+  const float t = simd_dot(tri.e2, q) * inv_det;
+  if (t < ray.t_min || t > ray.t_max)
+    return false;
+
+  ray.t_max = t;
+  hit = Hit{t, u, v, inst, prim};
+  return true;
+}
+
+/* One ray against up to W triangles, returns the closest lane hit or -1 */
+template <uint32_t W>
+inline int intersect_triangles(Ray &ray, Hit &hit, const Triangle *tris,
+                               const uint32_t ct) {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  vfloat v0[3], e1[3], e2[3];
+  vint valid{};
+  for (uint32_t lane = 0; lane < W; lane++) {
+    const Triangle &tri = tris[std::min(lane, ct - 1)];
+    for (int i = 0; i < 3; i++) {
+      v0[i][lane] = tri.v0[i];
+      e1[i][lane] = tri.e1[i];
+      e2[i][lane] = tri.e2[i];
+    }
+    valid[lane] = lane < ct ? -1 : 0;
+  }
+
+  const vfloat p[3] = {ray.d.y * e2[2] - ray.d.z * e2[1],
+                       ray.d.z * e2[0] - ray.d.x * e2[2],
+                       ray.d.x * e2[1] - ray.d.y * e2[0]};
+  const vfloat det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  const vfloat inv_det = splat<vfloat>(1.0f) / det;
+
+  const vfloat s[3] = {ray.o.x - v0[0], ray.o.y - v0[1], ray.o.z - v0[2]};
+  const vfloat u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+
+  const vfloat q[3] = {s[1] * e1[2] - s[2] * e1[1],
+                       s[2] * e1[0] - s[0] * e1[2],
+                       s[0] * e1[1] - s[1] * e1[0]};
+  const vfloat v = (q[0] * ray.d.x + q[1] * ray.d.y + q[2] * ray.d.z) * inv_det;
+  const vfloat t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+  const vint mask = valid & (simd_abs(det) > 1e-9f) & (u >= 0.0f) &
+                    (v >= 0.0f) & (u + v <= 1.0f) & (t >= ray.t_min) &
+                    (t <= ray.t_max);
+  if (!simd_any(mask))
+    return -1;
+
+  int best = -1;
+  for (uint32_t lane = 0; lane < W; lane++)
+    if (mask[lane] && (best < 0 || t[lane] < t[best]))
+      best = static_cast<int>(lane);
+
+  ray.t_max = t[best];
+  hit.t = t[best];
+  hit.u = u[best];
+  hit.v = v[best];
+  return best;
+}
+
+/* W rays against one triangle, closer hits shorten each lane's t_max */
+template <uint32_t W>
+inline void intersect_triangle(Ray_Packet<W> &rays, Hit_Packet<W> &hits,
+                               const Triangle &tri, const uint32_t inst,
+                               const uint32_t prim) {
+  using vfloat = typename Ray_Packet<W>::vfloat;
+  using vint = typename Ray_Packet<W>::vint;
+
+  const vfloat e1[3] = {splat<vfloat>(tri.e1.x), splat<vfloat>(tri.e1.y),
+                        splat<vfloat>(tri.e1.z)},
+               e2[3] = {splat<vfloat>(tri.e2.x), splat<vfloat>(tri.e2.y),
+                        splat<vfloat>(tri.e2.z)};
+
+  const vfloat p[3] = {rays.d[1] * e2[2] - rays.d[2] * e2[1],
+                       rays.d[2] * e2[0] - rays.d[0] * e2[2],
+                       rays.d[0] * e2[1] - rays.d[1] * e2[0]};
+  const vfloat det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  const vfloat inv_det = splat<vfloat>(1.0f) / det;
+
+  const vfloat s[3] = {rays.o[0] - tri.v0.x, rays.o[1] - tri.v0.y,
+                       rays.o[2] - tri.v0.z};
+  const vfloat u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+
+  const vfloat q[3] = {s[1] * e1[2] - s[2] * e1[1],
+                       s[2] * e1[0] - s[0] * e1[2],
+                       s[0] * e1[1] - s[1] * e1[0]};
+  const vfloat v =
+      (rays.d[0] * q[0] + rays.d[1] * q[1] + rays.d[2] * q[2]) * inv_det;
+  const vfloat t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+  const vint mask = rays.active & (simd_abs(det) > 1e-9f) & (u >= 0.0f) &
+                    (v >= 0.0f) & (u + v <= 1.0f) & (t >= rays.t_min) &
+                    (t <= rays.t_max);
+  if (!simd_any(mask))
+    return;
+
+  rays.t_max = simd_select(rays.t_max, t, mask);
+  hits.t = simd_select(hits.t, t, mask);
+  hits.u = simd_select(hits.u, u, mask);
+  hits.v = simd_select(hits.v, v, mask);
+  hits.inst = select(mask, hits.inst, splat<vint>(static_cast<int32_t>(inst)));
+  hits.prim = select(mask, hits.prim, splat<vint>(static_cast<int32_t>(prim)));
+}
+
+} // namespace CTNM::CPU
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "disk_volume.hpp"
+#include "geodesic.hpp"
+#include "lens_table.hpp"
+#include "ray.hpp"
+#include "scene.hpp"
+#include "star_octree.hpp"
+#include "star_splat.hpp"
+#include "tile_scheduler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace CTNM::CPU {
+
+struct Framebuffer {
+  uint32_t w = 0, h = 0;
+  std::vector<Math::vec_f4> px;
+  std::vector<uint32_t> steps; // Per pixel step counts, if instrumented
+  // Distance to the first surface, infinite where rays escaped, kept while
+  // there are stars to splat
+  std::vector<float> depth;
+
+  void resize(const uint32_t _w, const uint32_t _h,
+              const bool instrument = false) {
+    w = _w;
+    h = _h;
+    px.assign(static_cast<size_t>(w) * h, Math::vec_f4{0.0f, 0.0f, 0.0f, 1.0f});
+    steps.assign(instrument ? px.size() : 0, 0);
+  }
+};
+
+/* Pinhole camera basis, identical to the one k_raytracer derives */
+struct Camera_Basis {
+  Math::vec_f3 p, forward, right, up;
+  float fl, aspect, w, h;
+
+  Camera_Basis(const Components::Camera &cam, const uint32_t w,
+               const uint32_t h);
+
+  Math::vec_f3 get_dir(const float x, const float y) const;
+};
+
+enum class Ray_Mode { Straight, Geodesic, Table };
+
+struct Render_Stats {
+  uint64_t n_rays = 0;
+  uint64_t n_steps = 0;       // Geodesic integration steps
+  uint64_t n_march_steps = 0; // Disk volume samples
+  uint64_t n_pixels = 0;
+  uint32_t n_passes = 0;
+  bool cut_off = false;
+  double ms = 0.0;
+
+  double get_mrays_per_s() const {
+    return ms <= 0.0 ? 0.0 : static_cast<double>(n_rays) / (ms * 1e3);
+  }
+
+  double get_ns_per_pixel() const {
+    return n_pixels == 0 ? 0.0 : ms * 1e6 / static_cast<double>(n_pixels);
+  }
+
+  double get_march_steps_per_pixel() const {
+    return n_pixels == 0 ? 0.0
+                         : static_cast<double>(n_march_steps) /
+                               static_cast<double>(n_pixels);
+  }
+};
+
+/* CPU port of k_raytracer */
+class Renderer {
+public:
+  Renderer(Parallel::Thread_Pool &pool, const uint32_t packet_w = 8);
+  ~Renderer() = default;
+
+  void set_packet_width(const uint32_t packet_w);
+  uint32_t get_packet_width() const;
+
+  /* Levels > 1 first trace every 2^(levels - 1)th pixel and fill blocks,
+   * halving the stride each pass down to full resolution. Later passes only
+   * trace the pixels earlier ones did not */
+  void set_progressive_levels(const uint32_t levels);
+  /* Geodesic mode bends rays around the first Black_Hole in the scene and
+   * falls back to straight rays when there is none. Table mode bends them
+   * by lookup instead and needs a lens table */
+  void set_ray_mode(const Ray_Mode mode);
+  Ray_Mode get_ray_mode() const;
+  void set_lens_table(const Lens_Table *table);
+
+  /* Per-tile integration tolerances are steered so the average number of
+   * steps per ray settles near this budget */
+  void set_step_budget(const float steps_per_ray);
+  const std::vector<float> &get_tile_tolerances() const;
+
+  void set_march_config(const Disk_March_Config &config);
+  const Disk_March_Config &get_march_config() const;
+
+  // Scene stars are splatted over escaped rays after tracing
+  void set_splat_config(const Splat_Config &config);
+  const Splat_Stats &get_splat_stats() const;
+  // Adds the octree's cut for each view to the scene stars, may be null
+  void set_star_octree(Star_Octree *octree);
+
+  Tile_Scheduler &get_scheduler();
+  const Render_Stats &get_stats() const;
+
+  void render(const Scene &scene, const Components::Camera &cam,
+              Framebuffer &fb);
+
+  /* Shades pixels [x0, x1) x [y0, y1), returns the number of rays traced.
+   * refine skips the samples a pass at twice the stride already traced */
+  uint64_t render_region(const Scene &scene, const Camera_Basis &basis,
+                         Framebuffer &fb, const uint32_t x0, const uint32_t y0,
+                         const uint32_t x1, const uint32_t y1,
+                         const uint32_t stride = 1,
+                         const bool refine = false) const;
+
+private:
+  struct Geodesic_Tally {
+    uint64_t n_rays = 0, n_steps = 0;
+  };
+
+  Tile_Scheduler m_scheduler;
+  uint32_t m_packet_w, m_levels = 1;
+  Ray_Mode m_mode = Ray_Mode::Straight;
+  float m_step_budget = 64.0f;
+  std::vector<float> m_tile_tol;
+  const Lens_Table *m_lens_table = nullptr;
+  Disk_March_Config m_march_config;
+  mutable std::atomic<uint64_t> m_march_steps = 0;
+  Star_Splatter m_splatter;
+  Star_Octree *m_star_octree = nullptr;
+  Star_Points m_star_cut;
+  Render_Stats m_stats;
+
+  Math::vec_f4 composite_disks(const Scene &scene, const Math::vec_f3 &o,
+                               const Math::vec_f3 &d, const Hit &hit,
+                               uint32_t &n_steps) const;
+
+  uint64_t render_geodesic(const Scene &scene, const Camera_Basis &basis,
+                           Framebuffer &fb);
+
+  uint64_t render_lensed_region(const Scene &scene, const Geodesic_Params &lens,
+                                const Disk_Volume &disk,
+                                const Camera_Basis &basis, Framebuffer &fb,
+                                const Tile &tile, const uint32_t stride,
+                                const bool refine) const;
+
+  template <uint32_t W>
+  Geodesic_Tally
+  render_geodesic_region(const Scene &scene, const Geodesic_Params &lens,
+                         const Camera_Basis &basis, Framebuffer &fb,
+                         const Tile &tile, const uint32_t stride,
+                         const bool refine) const;
+
+  template <uint32_t W>
+  uint64_t render_region(const Scene &scene, const Camera_Basis &basis,
+                         Framebuffer &fb, const uint32_t x0, const uint32_t y0,
+                         const uint32_t x1, const uint32_t y1,
+                         const uint32_t stride, const bool refine) const;
+};
+
+Math::vec_f4 shade(const Scene &scene, const Hit &hit);
+
+} // namespace CTNM::CPU
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "disk_volume.hpp"
+#include "geodesic.hpp"
+#include "lbvh.hpp"
+#include "ray.hpp"
+#include "star_splat.hpp"
+#include "wide_bvh.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace CTNM::CPU {
+
+constexpr uint32_t TLAS_MAX_REFITS = 32;
+constexpr uint32_t WIDE_BVH_DEFAULT_W = 4;
+
+/* Column-major 3x4 affine transform */
+struct Affine {
+  Math::vec_f3 c[3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                       {0.0f, 0.0f, 1.0f}};
+  Math::vec_f3 t = {0.0f, 0.0f, 0.0f};
+};
+
+Affine make_affine(const Components::Transform &transform);
+Affine invert(const Affine &a);
+Math::AABB transform_bounds(const Affine &a, const Math::AABB &box);
+
+inline Math::vec_f3 transform_vector(const Affine &a, const Math::vec_f3 &v) {
+  return a.c[0] * v.x + a.c[1] * v.y + a.c[2] * v.z;
+}
+
+inline Math::vec_f3 transform_point(const Affine &a, const Math::vec_f3 &p) {
+  return transform_vector(a, p) + a.t;
+}
+
+/* Bottom level structure, triangles are stored in leaf order. Only the
+ * wide BVH of the chosen width (4 or 8) is kept */
+class Mesh_BVH {
+public:
+  Mesh_BVH() = default;
+  ~Mesh_BVH() = default;
+
+  void build(Parallel::Thread_Pool &pool, const Components::Mesh &mesh,
+             const uint32_t wide_w = WIDE_BVH_DEFAULT_W);
+  // Collapses the built binary tree again at another width
+  void collapse(const uint32_t wide_w);
+
+  const LBVH &get_bvh() const;
+  template <uint32_t N> const Wide_BVH<N> &get_wide_bvh() const {
+    if constexpr (N == 4)
+      return m_wide_bvh4;
+    else
+      return m_wide_bvh8;
+  }
+  const Wide_BVH_Stats &get_wide_stats() const;
+  uint32_t get_wide_width() const;
+  const std::vector<Triangle> &get_triangles() const;
+  const Math::AABB &get_bounds() const;
+  uint64_t get_revision() const;
+  bool is_built() const;
+
+private:
+  LBVH m_bvh;
+  Wide_BVH<4> m_wide_bvh4;
+  Wide_BVH<8> m_wide_bvh8;
+  uint32_t m_wide_w = 0;
+  std::vector<Triangle> m_triangles;
+  Math::AABB m_bounds;
+  uint64_t m_revision = 0;
+  bool m_built = false;
+};
+
+struct Instance {
+  const Mesh_BVH *blas = nullptr;
+  Affine world_to_obj;
+  Math::AABB bounds; // World space
+  Math::vec_f3 col;
+  entt::entity e = entt::null;
+};
+
+struct Scene_Stats {
+  size_t n_instances = 0, n_blases = 0, n_stars = 0;
+  size_t binary_bytes = 0, wide_bytes = 0; // Node memory, all levels
+  uint32_t wide_w = 0;
+};
+
+/* CPU counterpart of Stager + the TLAS build in GPU_Interface::render */
+class Scene {
+public:
+  Scene() = default;
+  ~Scene() = default;
+
+  void sync(Parallel::Thread_Pool &pool, const entt::registry &reg);
+
+  /* Width of the wide BVHs single rays walk, 4 or 8. Both levels are
+   * collapsed again at the next sync */
+  void set_wide_width(const uint32_t wide_w);
+  uint32_t get_wide_width() const;
+
+  const std::vector<Instance> &get_instances() const;
+  const LBVH &get_tlas() const;
+  template <uint32_t N> const Wide_BVH<N> &get_wide_tlas() const {
+    if constexpr (N == 4)
+      return m_wide_tlas4;
+    else
+      return m_wide_tlas8;
+  }
+  const std::vector<Geodesic_Params> &get_lenses() const;
+  const std::vector<Disk_Volume> &get_disks() const; // One per lens
+  const Star_Points &get_stars() const;
+  Scene_Stats get_stats() const;
+  bool empty() const;
+
+private:
+  std::unordered_map<entt::entity, Mesh_BVH> m_blases;
+  std::vector<Instance> m_instances;
+  std::vector<Math::AABB> m_instance_bounds;
+  LBVH m_tlas;
+  std::vector<entt::entity> m_tlas_entities; // Instances m_tlas was built on
+  uint32_t m_n_tlas_refits = 0;
+  uint32_t m_wide_w = WIDE_BVH_DEFAULT_W;
+  Wide_BVH<4> m_wide_tlas4;
+  Wide_BVH<8> m_wide_tlas8;
+  std::vector<Geodesic_Params> m_lenses;
+  std::vector<Disk_Volume> m_disks;
+  Star_Points m_stars;
+};
+
+} // namespace CTNM::CPU
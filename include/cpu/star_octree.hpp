@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../io/read_scheduler.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "star_splat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace CTNM::CPU {
+
+struct Camera_Basis;
+
+constexpr uint32_t STAR_OCTREE_VERSION = 1;
+constexpr uint64_t STAR_OCTREE_ALIGN = 4096; // Leaf blocks start on pages
+
+/* Octree file: the header, n_nodes Star_Octree_Nodes at nodes_offset, then
+ * one block of Star_Octree_Points per leaf */
+struct Star_Octree_Header {
+  char magic[8] = {'C', 'T', 'N', 'M', 'O', 'C', 'T', 'R'};
+  uint32_t version = STAR_OCTREE_VERSION;
+  uint32_t leaf_size = 0;
+  uint64_t n_nodes = 0, n_points = 0;
+  uint64_t nodes_offset = 0;
+  uint64_t bytes = 0; // Whole file
+};
+
+struct Star_Octree_Point {
+  float x, y, z;
+  float r, g, b;
+};
+
+/* A cell and the aggregate emitter standing in for everything below it,
+ * at the luminosity weighted centroid with the summed colour. Every point
+ * below lies within radius of p */
+struct Star_Octree_Node {
+  float p[3];
+  float radius;
+  float flux[3];
+  uint32_t depth;
+  uint32_t first_child, n_children; // Children are adjacent, none for leaves
+  uint64_t n_points;                // Below this cell
+  uint64_t offset;                  // Leaves only, file offset of the block
+};
+
+/* A cell is drawn as its aggregate once stars within it would move by less
+ * than max_error pixels. Refinement stops at budget points per frame,
+ * cells with the largest error going first. Leaves not yet read are drawn
+ * as their aggregate unless wait is set */
+struct Star_LOD_Config {
+  float max_error = 1.0f;                   // Pixels
+  uint64_t budget = 1 << 22;                // Points handed to the splatter
+  uint32_t leaf_size = 256;                 // Points per leaf when building
+  uint64_t cache_bytes = uint64_t(1) << 30; // Leaves held in memory
+  float prefetch_frames = 8.0f; // How far ahead along the camera's motion
+  uint32_t io_depth = 32;       // Leaf reads in flight
+  bool wait = false;            // Block on missing leaves, for offline use
+};
+
+/* n_leaf_points were drawn from cached leaves, bytes_leaves is their size
+ * on disk. Hits and misses count the leaves of this frame's cut, io is
+ * cumulative since open() */
+struct Star_LOD_Stats {
+  uint64_t n_nodes = 0, n_points = 0;
+  uint64_t n_visited = 0, n_culled = 0, n_aggregates = 0, n_leaves = 0;
+  uint64_t n_leaf_points = 0, bytes_leaves = 0;
+  uint64_t n_hits = 0, n_misses = 0, n_prefetches = 0, bytes_cached = 0;
+  IO::Read_Stats io;
+  double ms_build = 0.0, ms_write = 0.0, ms_select = 0.0;
+
+  double get_hit_rate() const {
+    return n_hits + n_misses == 0
+               ? 1.0
+               : static_cast<double>(n_hits) / (n_hits + n_misses);
+  }
+};
+
+/* Level of detail for star fields too large to splat whole. Built once in
+ * Morton order and written out. Opening reads only the nodes, which are
+ * small; leaf blocks are streamed in through a Read_Scheduler when a view
+ * refines down to them, nearest first, and held in an LRU cache of at most
+ * cache_bytes. Leaves the camera is heading for are requested ahead of
+ * time. select() walks the tree a level at a time over the pool, culling
+ * cells outside the frustum, so the cut and the frame cost follow the
+ * screen rather than the catalogue */
+class Star_Octree {
+public:
+  Star_Octree(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Star_Octree();
+
+  Star_Octree(const Star_Octree &) = delete;
+  Star_Octree &operator=(const Star_Octree &) = delete;
+
+  void set_config(const Star_LOD_Config &config);
+  const Star_LOD_Config &get_config() const;
+  const Star_LOD_Stats &get_stats() const;
+
+  // Writes the octree over points to path, it is not opened
+  void build(const Star_Points &points, const std::filesystem::path &path);
+
+  void open(const std::filesystem::path &path);
+  void close();
+  bool empty() const;
+
+  // Appends the cut for this view to out
+  void select(const Camera_Basis &basis, Star_Points &out);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Star_LOD_Config m_config;
+  Star_LOD_Stats m_stats;
+
+  struct Cut_Tally {
+    uint64_t n_visited = 0, n_culled = 0;
+  };
+  struct Leaf {
+    std::vector<std::byte> data; // Star_Octree_Points
+    uint64_t frame = 0;          // Last drawn, or read
+    std::list<uint32_t>::iterator lru;
+  };
+
+  Star_Octree_Header m_header;
+  std::vector<Star_Octree_Node> m_nodes; // Empty when nothing is open
+  std::unique_ptr<IO::Read_Scheduler> m_reader;
+
+  // Leaf cache, most recently used at the front of m_lru
+  std::unordered_map<uint32_t, Leaf> m_cache;
+  std::list<uint32_t> m_lru;
+  uint64_t m_cache_bytes = 0;
+  uint64_t m_frame = 0;
+  Math::vec_f3 m_last_eye = {0.0f, 0.0f, 0.0f};
+  bool m_has_last_eye = false;
+
+  // Per frame scratch
+  std::vector<uint32_t> m_frontier, m_next, m_refine;
+  std::vector<uint32_t> m_aggregates, m_leaves;
+  std::vector<float> m_error, m_distance, m_leaf_distance;
+  std::vector<uint8_t> m_action;
+  std::vector<uint64_t> m_leaf_start;
+  std::vector<const Star_Octree_Point *> m_leaf_points;
+  std::vector<IO::Read_Result> m_reads;
+
+  // Fills m_aggregates and m_leaves, with m_leaf_distance, seen from eye
+  Cut_Tally cut(const Camera_Basis &basis, const Math::vec_f3 &eye);
+  void request(const uint32_t leaf, const float priority);
+  // Moves finished reads into the cache, blocking for one with wait
+  void absorb(const bool wait);
+  const Star_Octree_Point *find(const uint32_t leaf); // Null if not cached
+};
+
+} // namespace CTNM::CPU
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace CTNM::CPU {
+
+struct Camera_Basis;
+struct Framebuffer;
+
+constexpr uint32_t SPLAT_BAND = 16;      // Rows per band
+constexpr uint32_t SPLAT_MAX_RADIUS = 4; // Footprint, at most half a band
+constexpr uint32_t SPLAT_PHASES = 16;    // Sub-pixel offsets tabulated
+constexpr size_t SPLAT_BATCH = 1 << 22;  // Points binned at once
+
+/* Point lights as columns, r, g and b are colour, 0 to 1, times luminosity */
+struct Star_Points {
+  std::vector<float> x, y, z;
+  std::vector<float> r, g, b;
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+  void clear();
+  void resize(const size_t n);
+  void append(const Star_Points &other);
+};
+
+/* A sun at reference_distance sums to exposure over its footprint. Points
+ * whose brightest channel sums to less than faint land on one pixel */
+struct Splat_Config {
+  float psf_sigma = 0.5f; // Gaussian, pixels
+  float exposure = 1.0f;
+  double reference_distance = 3.0856775814913673e17; // 10 pc in metres
+  float faint = 1.0f / 256.0f;
+  float near = 1e-3f; // Closer points are skipped
+};
+
+struct Splat_Stats {
+  uint64_t n_points = 0, n_visible = 0, n_faint = 0;
+  double ms_project = 0.0, ms_bin = 0.0, ms_splat = 0.0;
+
+  double get_ms() const { return ms_project + ms_bin + ms_splat; }
+  double get_mpoints_per_s() const {
+    return get_ms() <= 0.0 ? 0.0
+                           : static_cast<double>(n_points) / (get_ms() * 1e3);
+  }
+};
+
+/* Adds unresolved point lights to a rendered frame through a Gaussian
+ * PSF, wherever Framebuffer::depth shows the sky. Points are projected in
+ * plain loops over the columns, binned into row bands by a counting sort
+ * and splatted band by band, even bands then odd so footprints never
+ * overlap between tasks. The result does not depend on the thread count */
+class Star_Splatter {
+public:
+  Star_Splatter(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Star_Splatter() = default;
+
+  void set_config(const Splat_Config &config);
+  const Splat_Config &get_config() const;
+  const Splat_Stats &get_stats() const;
+
+  void splat(const Star_Points &points, const Camera_Basis &basis,
+             Framebuffer &fb);
+
+private:
+  struct Splat {
+    float x, y;
+    float r, g, b;
+  };
+
+  Parallel::Thread_Pool &m_pool;
+  Splat_Config m_config;
+  Splat_Stats m_stats;
+  uint32_t m_radius = 1;
+  std::vector<float> m_psf; // Weights by phase then tap, each phase sums to 1
+
+  // Per batch scratch
+  std::vector<float> m_sx, m_sy, m_flux;
+  std::vector<uint32_t> m_band;
+  std::vector<uint64_t> m_offsets, m_band_start;
+  std::vector<Splat> m_splats;
+
+  void splat_batch(const Star_Points &points, const size_t begin,
+                   const size_t end, const Camera_Basis &basis,
+                   Framebuffer &fb);
+  uint64_t splat_band(const uint32_t band, Framebuffer &fb); // n_faint
+};
+
+} // namespace CTNM::CPU
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../parallel/thread_pool.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace CTNM::CPU {
+
+struct Tile {
+  uint32_t x0, y0, x1, y1;
+};
+
+struct Tile_Frame_Stats {
+  uint32_t n_tiles = 0, n_passes = 0;
+  uint64_t n_tiles_done = 0, n_steals = 0, n_rays = 0;
+  bool cut_off = false;
+  double ms = 0.0;
+  std::vector<double> tile_ms;       // Summed over passes
+  std::vector<uint32_t> tile_passes; // Passes each tile completed
+};
+
+/* Shades tile for pass, returns the number of rays traced */
+using Tile_Fn = std::function<uint64_t(const Tile &tile, const uint32_t pass)>;
+
+/* Morton ordered tiles distributed over per-thread queues with stealing.
+ * Passes run in order; once the deadline passes, remaining work in every
+ * pass after the first is dropped so the frame always has full coverage */
+class Tile_Scheduler {
+public:
+  Tile_Scheduler(Parallel::Thread_Pool &pool, const uint32_t tile_size = 32);
+  ~Tile_Scheduler() = default;
+
+  void set_tile_size(const uint32_t tile_size);
+  uint32_t get_tile_size() const;
+  void set_deadline(const std::chrono::microseconds budget); // 0 disables
+
+  void run(const uint32_t w, const uint32_t h, const uint32_t n_passes,
+           const Tile_Fn &fn);
+
+  const std::vector<Tile> &get_tiles() const;
+  const Tile_Frame_Stats &get_stats() const;
+
+private:
+  struct Tile_Queue {
+    std::mutex mtx;
+    std::deque<uint32_t> tiles;
+  };
+
+  Parallel::Thread_Pool &m_pool;
+  uint32_t m_tile_size;
+  std::chrono::microseconds m_budget{0};
+
+  uint32_t m_w = 0, m_h = 0;
+  std::vector<Tile> m_tiles;
+  std::vector<std::unique_ptr<Tile_Queue>> m_queues;
+  Tile_Frame_Stats m_stats;
+
+  void layout(const uint32_t w, const uint32_t h);
+  bool pop(const uint32_t worker, uint32_t &tile, bool &stolen);
+};
+
+} // namespace CTNM::CPU
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ray.hpp"
+#include "scene.hpp"
+
+#include <cstdint>
+
+namespace CTNM::CPU {
+
+// Entries kept on the call stack before a traversal spills to the heap
+constexpr uint32_t TRAVERSAL_STACK_SIZE = 128;
+
+/* Single ray, used for incoherent (secondary) rays */
+Hit trace(const Scene &scene, Ray ray);
+
+/* Coherent packet of W rays (4, 8 or 16), e.g. primary visibility */
+template <uint32_t W>
+void trace(const Scene &scene, Ray_Packet<W> &rays, Hit_Packet<W> &hits);
+
+extern template void trace<4>(const Scene &, Ray_Packet<4> &, Hit_Packet<4> &);
+extern template void trace<8>(const Scene &, Ray_Packet<8> &, Hit_Packet<8> &);
+extern template void trace<16>(const Scene &, Ray_Packet<16> &,
+                               Hit_Packet<16> &);
+
+} // namespace CTNM::CPU
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "lbvh.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace CTNM::CPU {
+
+constexpr uint32_t WIDE_LEAF_BIT = 1u << 31;
+constexpr uint32_t WIDE_LEAF_CT_SHIFT = 28;
+constexpr uint32_t WIDE_LEAF_MAX_PRIMS = 8;
+constexpr uint32_t WIDE_LEAF_FIRST_MASK = (1u << WIDE_LEAF_CT_SHIFT) - 1;
+
+/* Child bounds are stored as 8 bit offsets from the node origin in units of
+ * 2^exp, rounded outwards so the decoded boxes stay conservative */
+template <uint32_t N> struct Wide_Node {
+  float origin[3];
+  int8_t exp[3];
+  uint8_t n_children;
+  uint8_t q_min[3][N], q_max[3][N];
+  uint32_t children[N]; // Wide node index, or leaf (see encode_leaf)
+
+  static uint32_t encode_leaf(const uint32_t first, const uint32_t ct) {
+    if (first > WIDE_LEAF_FIRST_MASK)
+      throw std::runtime_error("Failed: Wide_BVH, more primitives than a "
+                               "leaf can address");
+    return WIDE_LEAF_BIT | (ct - 1) << WIDE_LEAF_CT_SHIFT | first;
+  }
+
+  static bool is_leaf(const uint32_t child) {
+    return (child & WIDE_LEAF_BIT) != 0;
+  }
+
+  static uint32_t get_leaf_first(const uint32_t child) {
+    return child & WIDE_LEAF_FIRST_MASK;
+  }
+
+  static uint32_t get_leaf_ct(const uint32_t child) {
+    return ((child & ~WIDE_LEAF_BIT) >> WIDE_LEAF_CT_SHIFT) + 1;
+  }
+};
+
+struct Wide_BVH_Stats {
+  size_t n_nodes = 0, n_leaves = 0;
+  size_t bytes = 0, binary_bytes = 0;
+  double ms_collapse = 0.0;
+};
+
+/* N-wide BVH collapsed from an LBVH, leaves reference contiguous ranges of
+ * Morton-sorted primitive positions */
+template <uint32_t N> class Wide_BVH {
+public:
+  static_assert(N == 4 || N == 8, "Wide BVH supports widths 4 and 8");
+
+  Wide_BVH() = default;
+  ~Wide_BVH() = default;
+
+  void collapse(const LBVH &bvh, const uint32_t max_leaf_prims = 4);
+
+  const std::vector<Wide_Node<N>> &get_nodes() const;
+  const Wide_BVH_Stats &get_stats() const;
+  bool empty() const;
+
+private:
+  std::vector<Wide_Node<N>> m_nodes;
+  Wide_BVH_Stats m_stats;
+};
+
+extern template class Wide_BVH<4>;
+extern template class Wide_BVH<8>;
+
+} // namespace CTNM::CPU
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "components.hpp"
+
+#include <entt/entt.hpp>
+
+namespace CTNM {
+
+Components::Mesh generate_cube_mesh(const float h = 0.5f);
+
+// One falling mesh, a cube unless given, and a camera
+void populate_scene(entt::registry &reg,
+                    Components::Mesh mesh = generate_cube_mesh());
+
+} // namespace CTNM
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../cpu/renderer.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CTNM::IO {
+
+enum class Image_Format {
+  PNG, // 8 bit RGBA through stb_image_write
+  EXR, // Uncompressed 32 bit float RGBA scanlines
+  RAW  // Headerless 32 bit float RGBA, row major
+};
+
+Image_Format parse_image_format(const std::string &name);
+const char *get_extension(const Image_Format format);
+
+void write_png(const std::filesystem::path &path, const CPU::Framebuffer &fb);
+void write_exr(const std::filesystem::path &path, const CPU::Framebuffer &fb);
+void write_raw(const std::filesystem::path &path, const CPU::Framebuffer &fb);
+
+/* Encodes and writes numbered frames on background threads. At most
+ * max_inflight frames are buffered before write() blocks */
+class Frame_Writer {
+public:
+  Frame_Writer(const std::filesystem::path &dir, const Image_Format format,
+               const uint32_t n_threads = 2, const uint32_t max_inflight = 4);
+  ~Frame_Writer();
+
+  void write(const uint64_t frame_id, const CPU::Framebuffer &fb);
+  void flush();
+
+  uint64_t get_frames_written() const;
+  uint64_t get_bytes_written() const;
+
+private:
+  std::filesystem::path m_dir;
+  Image_Format m_format;
+  uint32_t m_max_inflight;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  uint32_t m_inflight = 0; // Always protected by m_mtx
+  std::string m_error;     // First failure, rethrown by flush
+
+  std::atomic<uint64_t> m_frames_written = 0, m_bytes_written = 0;
+
+  Parallel::Thread_Pool m_pool; // Declared last so workers join first
+};
+
+} // namespace CTNM::IO
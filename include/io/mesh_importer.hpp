@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace CTNM::IO {
+
+enum class Mesh_Format {
+  OBJ,  // Wavefront, v and f lines, polygons fanned into triangles
+  PLY,  // ASCII or binary, vertex x y z and a face vertex_indices list
+  GLTF, // glTF 2.0, .gltf with external or embedded buffers, or .glb
+};
+
+Mesh_Format get_mesh_format(const std::filesystem::path &path);
+
+struct Mesh_Import_Config {
+  bool weld = true; // Merge vertices at bit identical positions
+};
+
+struct Mesh_Import_Stats {
+  uint64_t bytes = 0; // Read from disk, including glTF buffers
+  uint64_t n_verticies = 0, n_welded = 0, n_triangles = 0;
+  double ms_map = 0.0, ms_parse = 0.0, ms_weld = 0.0;
+
+  double get_ms() const { return ms_map + ms_parse + ms_weld; }
+  double get_gb_per_s() const {
+    return get_ms() <= 0.0 ? 0.0 : static_cast<double>(bytes) / get_ms() / 1e6;
+  }
+};
+
+/* Reads positions and triangles only, into the Mesh's own vectors, which
+ * are replaced once the whole file has loaded. Files are mapped and cut
+ * into chunks parsed in parallel: OBJ at line breaks after a counting pass,
+ * binary PLY at fixed record strides, glTF by accessor. ASCII PLY is read
+ * serially. glTF node transforms are applied, so the mesh is the whole
+ * default scene in one frame */
+class Mesh_Importer {
+public:
+  Mesh_Importer(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Mesh_Importer() = default;
+
+  void set_config(const Mesh_Import_Config &config);
+  const Mesh_Import_Config &get_config() const;
+  const Mesh_Import_Stats &get_stats() const;
+
+  void load(const std::filesystem::path &path, Components::Mesh &mesh);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Mesh_Import_Config m_config;
+  Mesh_Import_Stats m_stats;
+
+  // Welding scratch, kept between loads
+  std::vector<uint32_t> m_keys, m_order, m_first, m_kept;
+  std::vector<uint64_t> m_xy_keys;
+
+  void load_obj(const char *data, const size_t size, Components::Mesh &mesh);
+  void load_ply(const char *data, const size_t size, Components::Mesh &mesh);
+  void load_gltf(const std::filesystem::path &path, const char *data,
+                 const size_t size, Components::Mesh &mesh);
+  void weld(Components::Mesh &mesh);
+};
+
+} // namespace CTNM::IO
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../parallel/thread_pool.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace CTNM::IO {
+
+struct Read_Scheduler_Config {
+  uint32_t queue_depth = 32; // Reads in flight at once
+  bool use_uring = true;     // Where the platform has io_uring
+};
+
+struct Read_Result {
+  uint64_t key = 0;
+  bool ok = false;
+  std::vector<std::byte> data;
+};
+
+/* outstanding counts queued and in flight reads. bytes_per_s is over the
+ * time at least one read was in flight */
+struct Read_Stats {
+  uint64_t n_requested = 0, n_completed = 0, n_failed = 0;
+  uint64_t n_outstanding = 0, n_in_flight = 0;
+  uint64_t bytes_read = 0;
+  double ms_busy = 0.0;
+  bool uring = false;
+
+  double get_bytes_per_s() const {
+    return ms_busy <= 0.0 ? 0.0
+                          : static_cast<double>(bytes_read) * 1e3 / ms_busy;
+  }
+};
+
+/* Reads byte ranges of one file in the background, lowest priority value
+ * first. On Linux up to queue_depth reads are kept in an io_uring ring
+ * fed by one thread; elsewhere, or when the ring cannot be set up, as
+ * many threads each issue blocking reads. The file is opened uncached
+ * where the platform allows, callers hold what they read */
+class Read_Scheduler {
+public:
+  Read_Scheduler(const std::filesystem::path &path,
+                 const Read_Scheduler_Config &config = {});
+  ~Read_Scheduler();
+
+  Read_Scheduler(const Read_Scheduler &) = delete;
+  Read_Scheduler &operator=(const Read_Scheduler &) = delete;
+
+  /* Queues a read under key, or moves one still queued to the new
+   * priority. Keys already in flight are left alone */
+  void request(const uint64_t key, const uint64_t offset, const uint64_t size,
+               const float priority);
+  // Drops queued reads, those in flight still complete
+  void clear_queued();
+
+  /* Moves finished reads to the back of out and returns how many. With
+   * wait it blocks for at least one unless nothing is outstanding */
+  size_t poll(std::vector<Read_Result> &out, const bool wait = false);
+
+  Read_Stats get_stats() const;
+
+private:
+  struct Pending {
+    float priority;
+    uint64_t seq, key, offset, size;
+  };
+  struct Ring;
+
+  Read_Scheduler_Config m_config;
+  int m_fd = -1;
+  std::unique_ptr<Ring> m_ring; // Null for the thread fallback
+
+  mutable std::mutex m_mtx;
+  std::condition_variable m_cv, m_done_cv;
+  bool m_stopping = false;
+  std::vector<Pending> m_queue;                // Heap, stale entries skipped
+  std::unordered_map<uint64_t, uint64_t> m_seq; // Key to live seq, 0 in flight
+  uint64_t m_next_seq = 1;
+  std::vector<Read_Result> m_done;
+  Read_Stats m_stats;
+  std::chrono::steady_clock::time_point m_busy_start;
+  bool m_driving = false; // drive_ring() is running
+
+  Parallel::Thread_Pool m_pool; // Declared last so workers join first
+
+  static bool is_later(const Pending &a, const Pending &b);
+  // Locked by the caller
+  bool pop(Pending &pending);
+  void finish_read(const uint64_t key, const uint64_t size,
+                   std::vector<std::byte> &&data, const bool ok);
+  void read_one();
+  void drive_ring();
+};
+
+} // namespace CTNM::IO
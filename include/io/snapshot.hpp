@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../parallel/thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace CTNM::IO {
+
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_ENDIAN = 0x01020304; // Byte swapped if foreign
+constexpr uint64_t SNAPSHOT_ALIGN = 4096;        // Of every column
+constexpr uint64_t SNAPSHOT_CHUNK = 1 << 22;     // Raw bytes per chunk
+
+enum class Snapshot_Codec : uint32_t { None = 0, Zstd = 1 };
+
+/* Stored at the start of the file, n_columns Snapshot_Column entries
+ * follow it directly */
+struct Snapshot_Header {
+  char magic[8] = {'C', 'T', 'N', 'M', 'S', 'N', 'A', 'P'};
+  uint32_t version = SNAPSHOT_VERSION;
+  uint32_t endian = SNAPSHOT_ENDIAN;
+  uint64_t n_columns = 0;
+  double time = 0.0; // Simulator time at the snapshot
+  uint64_t bytes = 0;
+};
+
+/* One array of elem_size byte elements. Uncompressed columns hold them as
+ * is at offset; compressed ones start with a uint64 stored size per chunk,
+ * the chunks follow back to back, each SNAPSHOT_CHUNK raw bytes but the
+ * last. A component C is stored as "C.entity", its entities, and "C", the
+ * component of each */
+struct Snapshot_Column {
+  char name[24] = {};
+  uint32_t codec = 0;
+  uint32_t elem_size = 0;
+  uint64_t count = 0;
+  uint64_t offset = 0;
+  uint64_t stored = 0; // Bytes at offset
+};
+
+/* Element of the "Mesh" column, vertices and indices are concatenated in
+ * the "Mesh.verticies" and "Mesh.indicies" columns in entity order */
+struct Snapshot_Mesh {
+  uint64_t n_verticies = 0, n_indicies = 0;
+  uint64_t revision = 0;
+};
+
+struct Snapshot_Config {
+  Snapshot_Codec codec = Snapshot_Codec::None;
+  int level = 1;     // zstd level, low levels keep up with the disk
+  bool sync = false; // fsync before the file replaces the old snapshot
+};
+
+/* ms_registry is copying components out of or into the registry, ms_codec
+ * compressing or decompressing, ms_io writing or mapping */
+struct Snapshot_Stats {
+  uint64_t n_columns = 0, n_components = 0;
+  uint64_t bytes_raw = 0, bytes_file = 0;
+  double ms_registry = 0.0, ms_codec = 0.0, ms_io = 0.0;
+
+  double get_ms() const { return ms_registry + ms_codec + ms_io; }
+};
+
+/* Saves the Camera, Transform, Physics, Gas, Collider, Mesh, Surface,
+ * Black_Hole, Accretion_Disk, Orbit and Star components of every entity.
+ * The file is written beside the target and renamed over it, so an
+ * interrupted checkpoint leaves the previous one intact */
+class Snapshot_Writer {
+public:
+  Snapshot_Writer(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Snapshot_Writer() = default;
+
+  void set_config(const Snapshot_Config &config);
+  const Snapshot_Config &get_config() const;
+  const Snapshot_Stats &get_stats() const;
+
+  const Snapshot_Stats &write(const std::filesystem::path &path,
+                              const entt::registry &reg, const double time);
+
+private:
+  struct Column {
+    Snapshot_Column desc;
+    std::unique_ptr<std::byte[]> raw; // Left uninitialised when grown
+    size_t capacity = 0;
+    std::vector<std::vector<std::byte>> chunks; // Compressed
+    std::vector<uint64_t> chunk_bytes;
+  };
+
+  Parallel::Thread_Pool &m_pool;
+  Snapshot_Config m_config;
+  Snapshot_Stats m_stats;
+
+  std::vector<Column> m_columns; // Buffers kept across checkpoints
+  size_t m_n_columns = 0;
+  std::vector<entt::entity> m_entities;
+  std::vector<const void *> m_sources;
+
+  std::byte *add_column(const char *name, const uint32_t elem_size,
+                        const uint64_t count);
+  template <typename T>
+  void add_component(const entt::registry &reg, const char *name);
+  void add_meshes(const entt::registry &reg);
+};
+
+/* Maps a snapshot read-only. Uncompressed columns are handed out in place,
+ * so opening costs the header alone and pages fault in as they are used;
+ * compressed ones are decoded on first use. Not thread safe */
+class Snapshot_Reader {
+public:
+  Snapshot_Reader(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Snapshot_Reader();
+
+  Snapshot_Reader(const Snapshot_Reader &) = delete;
+  Snapshot_Reader &operator=(const Snapshot_Reader &) = delete;
+
+  void open(const std::filesystem::path &path);
+  void close();
+
+  bool empty() const;
+  const Snapshot_Header &get_header() const;
+  std::span<const Snapshot_Column> get_columns() const;
+  const Snapshot_Stats &get_stats() const;
+
+  // Empty if the snapshot has no such column
+  template <typename T> std::span<const T> get_column(const char *name) {
+    uint64_t count = 0;
+    const std::byte *data = find(name, sizeof(T), &count);
+    return data ? std::span<const T>(reinterpret_cast<const T *>(data), count)
+                : std::span<const T>();
+  }
+
+  /* Adds every component to a registry holding none of the snapshot's
+   * entities, with their ids unchanged so references between them
+   * survive */
+  void restore(entt::registry &reg);
+
+  // Opens, restores and closes. Returns the simulator time of the snapshot
+  double read(const std::filesystem::path &path, entt::registry &reg);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Snapshot_Stats m_stats;
+
+  void *m_map = nullptr;
+  size_t m_map_bytes = 0;
+  const Snapshot_Header *m_header = nullptr;
+  const Snapshot_Column *m_table = nullptr;
+  std::vector<std::vector<std::byte>> m_decoded; // By column, if compressed
+
+  const std::byte *find(const char *name, const uint32_t elem_size,
+                        uint64_t *count);
+  const std::byte *decode(const size_t c);
+  template <typename T>
+  void restore_component(entt::registry &reg, const char *name);
+  void restore_meshes(entt::registry &reg);
+};
+
+} // namespace CTNM::IO
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../cpu/star_splat.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace CTNM::IO {
+
+constexpr uint32_t STAR_CATALOGUE_VERSION = 1;
+constexpr size_t STAR_FIELD_CT = 9;
+constexpr double PARSEC = 3.0856775814913673e16; // m
+constexpr double SOLAR_MASS = 1.98892e30;        // kg
+constexpr double SOLAR_ABS_MAG = 4.83;           // Absolute magnitude
+
+/* One catalogue row in catalogue units, NaN where the value is missing */
+struct Star_Record {
+  static constexpr double NONE = std::numeric_limits<double>::quiet_NaN();
+
+  double ra = NONE, dec = NONE;     // ICRS, degrees
+  double parallax = NONE;           // mas
+  double pmra = NONE, pmdec = NONE; // mas yr^-1, pmra includes cos(dec)
+  double radial_velocity = NONE;    // km s^-1
+  double mag = NONE;                // Apparent magnitude
+  double bp_rp = NONE;              // Colour index
+  double teff = NONE;               // Effective temperature, Kelvin
+};
+
+// In the order of Star_Catalogue_Config::columns
+constexpr std::array<double Star_Record::*, STAR_FIELD_CT> STAR_FIELDS = {
+    &Star_Record::ra,    &Star_Record::dec,   &Star_Record::parallax,
+    &Star_Record::pmra,  &Star_Record::pmdec, &Star_Record::radial_velocity,
+    &Star_Record::mag,   &Star_Record::bp_rp, &Star_Record::teff};
+
+/* Packed catalogue, n_columns Star_Catalogue_Column entries follow the
+ * header and n_rows rows of stride bytes start at data_offset */
+struct Star_Catalogue_Header {
+  char magic[8] = {'C', 'T', 'N', 'M', 'S', 'T', 'A', 'R'};
+  uint32_t version = STAR_CATALOGUE_VERSION;
+  uint32_t n_columns = 0;
+  uint64_t n_rows = 0;
+  uint64_t stride = 0; // Bytes per row
+  uint64_t data_offset = 0;
+};
+
+struct Star_Catalogue_Column {
+  char name[24] = {};
+  uint32_t elem_size = 0; // 4 for float, 8 for double
+  uint32_t offset = 0;    // Within the row
+};
+
+/* Rows without ra, dec or a parallax above min_parallax are dropped, as are
+ * those fainter than mag_limit. Positions and velocities are SI scaled by
+ * scale, with the y axis on the north celestial pole */
+struct Star_Catalogue_Config {
+  std::array<std::string, STAR_FIELD_CT> columns = {
+      "ra",    "dec",           "parallax",        "pmra",
+      "pmdec", "radial_velocity", "phot_g_mean_mag", "bp_rp",
+      "teff_gspphot"};
+  double scale = 1.0;        // Scene units per metre
+  double min_parallax = 0.0; // mas
+  double mag_limit = std::numeric_limits<double>::infinity();
+  float mass = 0.0f; // kg, unless taken from the luminosity
+  bool mass_from_luminosity = false;
+  uint64_t max_rows = UINT64_MAX;  // Kept rows, reading stops after these
+  size_t window = size_t(1) << 26; // Bytes of file parsed per batch
+};
+
+/* ms_parse is splitting and reading rows, ms_convert the unit conversion
+ * and ms_registry creating entities. peak_batch_bytes is the most the
+ * reader held at once, the file itself is only mapped. peak_rss_bytes is
+ * the process's resident high-water mark once reading ends, mapped pages
+ * and whatever the sink kept included */
+struct Star_Catalogue_Stats {
+  uint64_t bytes = 0, n_rows = 0, n_kept = 0, n_batches = 0;
+  uint64_t peak_batch_bytes = 0, peak_rss_bytes = 0;
+  double ms_parse = 0.0, ms_convert = 0.0, ms_registry = 0.0;
+
+  double get_ms() const { return ms_parse + ms_convert + ms_registry; }
+  double get_rows_per_s() const {
+    return get_ms() <= 0.0 ? 0.0
+                           : static_cast<double>(n_rows) * 1e3 / get_ms();
+  }
+};
+
+/* Reads CSV catalogues, Gaia archive exports among them, and the packed
+ * binary form written by pack(). Only the configured columns are parsed.
+ * The file is mapped and walked a window at a time, each split at line
+ * breaks over the pool, and pages behind the window are released, so
+ * catalogues larger than memory stream through a fixed footprint */
+class Star_Catalogue_Reader {
+public:
+  // Returns false to stop reading
+  using Sink = std::function<bool(std::span<const Star_Record>)>;
+
+  Star_Catalogue_Reader(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Star_Catalogue_Reader() = default;
+
+  void set_config(const Star_Catalogue_Config &config);
+  const Star_Catalogue_Config &get_config() const;
+  const Star_Catalogue_Stats &get_stats() const;
+
+  // Every row, a window at a time, nothing is filtered
+  const Star_Catalogue_Stats &stream(const std::filesystem::path &path,
+                                     const Sink &sink);
+
+  /* Creates an entity with Transform, Physics, Surface and Star per kept
+   * row, Surface::col is the black body colour out of 255 */
+  const Star_Catalogue_Stats &load(const std::filesystem::path &path,
+                                   entt::registry &reg);
+  /* Appends kept rows as points instead, for fields too large for the
+   * registry. ms_registry is the time spent appending */
+  const Star_Catalogue_Stats &load(const std::filesystem::path &path,
+                                   CPU::Star_Points &out);
+
+  // Writes the configured columns of every row as doubles
+  const Star_Catalogue_Stats &pack(const std::filesystem::path &path,
+                                   const std::filesystem::path &out);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Star_Catalogue_Config m_config;
+  Star_Catalogue_Stats m_stats;
+
+  // Batch buffers, kept between windows
+  std::vector<Star_Record> m_records;
+  std::vector<uint64_t> m_chunk_rows;
+  std::vector<uint32_t> m_kept;
+  std::vector<entt::entity> m_entities;
+  std::vector<Components::Transform> m_transforms;
+  std::vector<Components::Physics> m_physics;
+  std::vector<Components::Surface> m_surfaces;
+  std::vector<Components::Star> m_stars;
+
+  void stream_csv(const char *data, const size_t size, const Sink &sink);
+  void stream_binary(const char *data, const size_t size, const Sink &sink);
+  void convert(std::span<const Star_Record> records);
+  uint64_t get_batch_bytes() const;
+};
+
+} // namespace CTNM::IO
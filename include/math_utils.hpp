@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include <simd/simd.h>
 
@@ -9,6 +10,7 @@ namespace CTNM::Math {
 
 using vec_f3 = simd::float3;
 using vec_f4 = simd::float4;
+using vec_d3 = simd::double3;
 
 inline bool approx_eq(const float a, const float b) {
   constexpr float abs_tol = 1e-6f;
@@ -23,8 +25,35 @@ inline float magnitude(const vec_f3 &vec) { return simd_length(vec); }
 
 inline float magnitude(const vec_f4 &vec) { return simd_length(vec); }
 
+inline double magnitude(const vec_d3 &vec) { return simd_length(vec); }
+
 inline vec_f3 normalize(const vec_f3 &vec) { return simd_normalize(vec); }
 
 inline vec_f4 normalize(const vec_f4 &vec) { return simd_normalize(vec); }
 
+struct AABB {
+  vec_f3 min = {std::numeric_limits<float>::infinity(),
+                std::numeric_limits<float>::infinity(),
+                std::numeric_limits<float>::infinity()};
+  vec_f3 max = {-std::numeric_limits<float>::infinity(),
+                -std::numeric_limits<float>::infinity(),
+                -std::numeric_limits<float>::infinity()};
+};
+
+inline AABB merge(const AABB &a, const AABB &b) {
+  return AABB{simd_min(a.min, b.min), simd_max(a.max, b.max)};
+}
+
+inline void grow(AABB &box, const vec_f3 &p) {
+  box.min = simd_min(box.min, p);
+  box.max = simd_max(box.max, p);
+}
+
+inline vec_f3 centroid(const AABB &box) { return (box.min + box.max) * 0.5f; }
+
+inline float surface_area(const AABB &box) {
+  const vec_f3 d = simd_max(box.max - box.min, vec_f3{0.0f, 0.0f, 0.0f});
+  return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
 } // namespace CTNM::Math
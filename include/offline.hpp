@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cpu/lens_table.hpp"
+#include "cpu/renderer.hpp"
+#include "cpu/star_octree.hpp"
+#include "io/frame_writer.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/time_warp.hpp"
+#include "simulator.hpp"
+
+#include <cstdint>
+#include <filesystem>
+
+#include <entt/entt.hpp>
+
+namespace CTNM {
+
+struct Offline_Config {
+  uint32_t w = 1920, h = 1080;
+  uint64_t n_frames = 600;
+  float dt = 1.0f / 60.0f; // Seconds per frame, before warp
+  double warp = 1.0;
+  std::filesystem::path out_dir = "frames";
+  IO::Image_Format format = IO::Image_Format::PNG;
+  uint32_t packet_w = 8, n_encoders = 2;
+  uint32_t bvh_w = CPU::WIDE_BVH_DEFAULT_W; // Wide BVH for single rays
+  CPU::Ray_Mode ray_mode = CPU::Ray_Mode::Straight;
+  std::filesystem::path lens_table = {};  // Loaded if present, else built
+  std::filesystem::path resume = {};      // Snapshot replacing the scene
+  std::filesystem::path checkpoint = {};  // Snapshot after the last frame
+  std::filesystem::path mesh = {};        // OBJ, PLY or glTF, else a cube
+  std::filesystem::path stars = {};       // Star catalogue added to the scene
+  std::filesystem::path star_octree = {}; // Loaded if present, else built
+};
+
+struct Offline_Stats {
+  uint64_t n_frames = 0;
+  double ms_sim = 0.0, ms_render = 0.0, ms_total = 0.0;
+
+  double get_fps() const {
+    return ms_total <= 0.0 ? 0.0
+                           : static_cast<double>(n_frames) * 1e3 / ms_total;
+  }
+};
+
+bool is_headless(const int argc, char *argv[]);
+Offline_Config parse_offline_config(const int argc, char *argv[]);
+// Builds the scene the arguments ask for, renders it and prints the stats
+int run_headless(const int argc, char *argv[]);
+
+/* Steps the simulation at a fixed rate and writes every frame to disk
+ * without a window or GPU */
+class Offline_Renderer {
+public:
+  Offline_Renderer(
+      const Offline_Config &config,
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Offline_Renderer() = default;
+
+  const Offline_Stats &run(entt::registry &reg, Simulator &sim);
+  uint64_t get_bytes_written() const;
+  const CPU::Lens_Table &get_lens_table() const;
+  const CPU::Render_Stats &get_render_stats() const;
+  CPU::Scene_Stats get_scene_stats() const;
+  const CPU::Splat_Stats &get_splat_stats() const;
+  const CPU::Star_LOD_Stats &get_star_lod_stats() const;
+  const Sim::Time_Warp_Stats &get_time_warp_stats() const;
+
+private:
+  Offline_Config m_config;
+  Parallel::Thread_Pool &m_pool;
+
+  CPU::Scene m_scene;
+  CPU::Lens_Table m_lens_table;
+  CPU::Star_Octree m_star_octree;
+  CPU::Renderer m_renderer;
+  CPU::Framebuffer m_fb;
+  IO::Frame_Writer m_writer;
+  Sim::Time_Warp m_warp;
+  Offline_Stats m_stats;
+};
+
+} // namespace CTNM
@@ -0,0 +1,315 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace CTNM::Parallel {
+
+constexpr size_t PRIMITIVE_GRAIN = 1 << 16;
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+
+template <typename T, typename Op = std::plus<T>>
+void inclusive_scan(Thread_Pool &pool, std::span<const T> in, std::span<T> out,
+                    Op op = Op{}) {
+  const size_t n = in.size();
+  if (n == 0)
+    return;
+
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<T> chunk_sums(n_chunks);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      T sum = in[b];
+                      for (size_t i = b + 1; i < e; i++)
+                        sum = op(sum, in[i]);
+                      chunk_sums[chunk] = sum;
+                    });
+
+  for (size_t chunk = 1; chunk < n_chunks; chunk++)
+    chunk_sums[chunk] = op(chunk_sums[chunk - 1], chunk_sums[chunk]);
+
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      T sum = chunk == 0 ? in[b]
+                                         : op(chunk_sums[chunk - 1], in[b]);
+                      out[b] = sum;
+                      for (size_t i = b + 1; i < e; i++)
+                        out[i] = sum = op(sum, in[i]);
+                    });
+}
+
+/* Returns the reduction of the entire input */
+template <typename T, typename Op = std::plus<T>>
+T exclusive_scan(Thread_Pool &pool, std::span<const T> in, std::span<T> out,
+                 const T init = T{}, Op op = Op{}) {
+  const size_t n = in.size();
+  if (n == 0)
+    return init;
+
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<T> chunk_sums(n_chunks + 1);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      T sum = in[b];
+                      for (size_t i = b + 1; i < e; i++)
+                        sum = op(sum, in[i]);
+                      chunk_sums[chunk + 1] = sum;
+                    });
+
+  chunk_sums[0] = init;
+  for (size_t chunk = 1; chunk <= n_chunks; chunk++)
+    chunk_sums[chunk] = op(chunk_sums[chunk - 1], chunk_sums[chunk]);
+
+  // Input and output may alias, so read before writing
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      T sum = chunk_sums[chunk];
+                      for (size_t i = b; i < e; i++) {
+                        const T v = in[i];
+                        out[i] = sum;
+                        sum = op(sum, v);
+                      }
+                    });
+
+  return chunk_sums[n_chunks];
+}
+
+/* Sum of fn(i) over [0, n). Compensated within fixed chunks whose partials
+ * then combine pairwise, so the result is the same bits for any thread
+ * count and the error stays O(log n) ulp */
+template <typename Fn>
+double reduce_sum(Thread_Pool &pool, const size_t n, Fn &&fn) {
+  if (n == 0)
+    return 0.0;
+
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<double> partials(n_chunks);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      // Neumaier's variant of Kahan summation
+                      double sum = 0.0, c = 0.0;
+                      for (size_t i = b; i < e; i++) {
+                        const double x = fn(i), t = sum + x;
+                        c += std::fabs(sum) >= std::fabs(x) ? (sum - t) + x
+                                                            : (x - t) + sum;
+                        sum = t;
+                      }
+                      partials[chunk] = sum + c;
+                    });
+
+  for (size_t stride = 1; stride < n_chunks; stride *= 2)
+    for (size_t i = 0; i + stride < n_chunks; i += 2 * stride)
+      partials[i] += partials[i + stride];
+
+  return partials[0];
+}
+
+/* Stable; writes the indices in [0, n) satisfying pred into out */
+template <typename Pred>
+size_t compact_indices(Thread_Pool &pool, const size_t n, Pred &&pred,
+                       std::vector<uint32_t> &out) {
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<size_t> offsets(n_chunks + 1, 0);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      size_t ct = 0;
+                      for (size_t i = b; i < e; i++)
+                        ct += pred(i) ? 1 : 0;
+                      offsets[chunk + 1] = ct;
+                    });
+
+  for (size_t chunk = 1; chunk <= n_chunks; chunk++)
+    offsets[chunk] += offsets[chunk - 1];
+
+  out.resize(offsets[n_chunks]);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      size_t o = offsets[chunk];
+                      for (size_t i = b; i < e; i++)
+                        if (pred(i))
+                          out[o++] = static_cast<uint32_t>(i);
+                    });
+
+  return out.size();
+}
+
+/* Stable; writes the elements satisfying pred into out */
+template <typename T, typename Pred>
+size_t compact(Thread_Pool &pool, std::span<const T> in, std::vector<T> &out,
+               Pred &&pred) {
+  const size_t n = in.size();
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<size_t> offsets(n_chunks + 1, 0);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      size_t ct = 0;
+                      for (size_t i = b; i < e; i++)
+                        ct += pred(in[i]) ? 1 : 0;
+                      offsets[chunk + 1] = ct;
+                    });
+
+  for (size_t chunk = 1; chunk <= n_chunks; chunk++)
+    offsets[chunk] += offsets[chunk - 1];
+
+  out.resize(offsets[n_chunks]);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      size_t o = offsets[chunk];
+                      for (size_t i = b; i < e; i++)
+                        if (pred(in[i]))
+                          out[o++] = in[i];
+                    });
+
+  return out.size();
+}
+
+/* bin_fn maps an element to a bin in [0, n_bins) */
+template <typename T, typename Bin_Fn>
+std::vector<uint32_t> histogram(Thread_Pool &pool, std::span<const T> in,
+                                const size_t n_bins, Bin_Fn &&bin_fn) {
+  const size_t n = in.size();
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+  std::vector<uint32_t> chunk_bins(n_chunks * n_bins, 0);
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      uint32_t *bins = chunk_bins.data() + chunk * n_bins;
+                      for (size_t i = b; i < e; i++)
+                        bins[bin_fn(in[i])]++;
+                    });
+
+  std::vector<uint32_t> bins(n_bins, 0);
+  for (size_t chunk = 0; chunk < n_chunks; chunk++)
+    for (size_t bin = 0; bin < n_bins; bin++)
+      bins[bin] += chunk_bins[chunk * n_bins + bin];
+
+  return bins;
+}
+
+namespace Detail {
+
+struct No_Payload {};
+
+template <typename K>
+inline uint32_t get_digit(const K key, const uint32_t shift) {
+  return static_cast<uint32_t>(key >> shift) & (RADIX_BUCKETS - 1);
+}
+
+template <typename K, typename V>
+void radix_sort(Thread_Pool &pool, std::vector<K> &keys, V *values) {
+  static_assert(std::is_unsigned_v<K>, "Radix sort requires unsigned keys");
+  constexpr bool has_values = !std::is_same_v<V, No_Payload>;
+
+  const size_t n = keys.size();
+  if (n < 2)
+    return;
+
+  const size_t n_chunks = Thread_Pool::get_chunk_ct(n, PRIMITIVE_GRAIN);
+
+  // Digits shared by every key don't affect the order, so skip those passes
+  std::vector<K> chunk_or(n_chunks, K(0)), chunk_and(n_chunks, ~K(0));
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      K k_or = K(0), k_and = ~K(0);
+                      for (size_t i = b; i < e; i++) {
+                        k_or |= keys[i];
+                        k_and &= keys[i];
+                      }
+                      chunk_or[chunk] = k_or;
+                      chunk_and[chunk] = k_and;
+                    });
+
+  K k_or = K(0), k_and = ~K(0);
+  for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+    k_or |= chunk_or[chunk];
+    k_and &= chunk_and[chunk];
+  }
+  const K varying = k_or ^ k_and;
+
+  std::vector<K> keys_alt(n);
+  std::vector<std::conditional_t<has_values, std::remove_cv_t<V>, char>>
+      values_alt(has_values ? n : 0);
+  std::vector<std::array<size_t, RADIX_BUCKETS>> offsets(n_chunks);
+
+  K *src_keys = keys.data(), *dst_keys = keys_alt.data();
+  auto *src_values = values;
+  auto *dst_values = values_alt.data();
+
+  for (uint32_t shift = 0; shift < sizeof(K) * 8; shift += RADIX_BITS) {
+    if (((varying >> shift) & K(RADIX_BUCKETS - 1)) == 0)
+      continue;
+
+    pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                      [&](const size_t b, const size_t e, const size_t chunk) {
+                        std::array<size_t, RADIX_BUCKETS> &counts =
+                            offsets[chunk];
+                        counts.fill(0);
+                        for (size_t i = b; i < e; i++)
+                          counts[get_digit(src_keys[i], shift)]++;
+                      });
+
+    size_t sum = 0;
+    for (uint32_t digit = 0; digit < RADIX_BUCKETS; digit++)
+      for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+        const size_t ct = offsets[chunk][digit];
+        offsets[chunk][digit] = sum;
+        sum += ct;
+      }
+
+    pool.parallel_for(
+        0, n, PRIMITIVE_GRAIN,
+        [&](const size_t b, const size_t e, const size_t chunk) {
+          std::array<size_t, RADIX_BUCKETS> &dst = offsets[chunk];
+          for (size_t i = b; i < e; i++) {
+            const size_t o = dst[get_digit(src_keys[i], shift)]++;
+            dst_keys[o] = src_keys[i];
+            if constexpr (has_values)
+              dst_values[o] = std::move(src_values[i]);
+          }
+        });
+
+    std::swap(src_keys, dst_keys);
+    if constexpr (has_values)
+      std::swap(src_values, dst_values);
+  }
+
+  if (src_keys == keys.data())
+    return;
+
+  // Odd number of passes, result lives in the scratch buffers
+  pool.parallel_for(0, n, PRIMITIVE_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t) {
+                      std::copy(src_keys + b, src_keys + e, keys.data() + b);
+                      if constexpr (has_values)
+                        std::move(src_values + b, src_values + e, values + b);
+                    });
+}
+
+} // namespace Detail
+
+/* Stable LSD radix sort over 32 / 64 bit unsigned keys */
+template <typename K> void radix_sort(Thread_Pool &pool, std::vector<K> &keys) {
+  Detail::radix_sort<K, Detail::No_Payload>(pool, keys, nullptr);
+}
+
+/* Stable LSD radix sort; values are permuted alongside their keys */
+template <typename K, typename V>
+void radix_sort(Thread_Pool &pool, std::vector<K> &keys,
+                std::vector<V> &values) {
+  if (values.size() != keys.size())
+    throw std::runtime_error("Failed: radix_sort, key / value count mismatch");
+
+  Detail::radix_sort<K, V>(pool, keys, values.data());
+}
+
+} // namespace CTNM::Parallel
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CTNM::Parallel {
+
+class Thread_Pool {
+public:
+  Thread_Pool(const uint32_t n_threads = std::thread::hardware_concurrency());
+  ~Thread_Pool();
+
+  Thread_Pool(const Thread_Pool &) = delete;
+  Thread_Pool &operator=(const Thread_Pool &) = delete;
+
+  static Thread_Pool &get_global();
+
+  uint32_t get_thread_ct() const;
+
+  void submit(std::function<void()> task);
+  void dispatch(const size_t n_tasks, const std::function<void(size_t)> &fn);
+
+  /* Chunk boundaries depend only on n and grain, never on the thread count */
+  template <typename F>
+  void parallel_for(const size_t begin, const size_t end, const size_t grain,
+                    F &&fn) {
+    if (end <= begin)
+      return;
+
+    const size_t n_chunks = get_chunk_ct(end - begin, grain);
+    if (n_chunks == 1) {
+      fn(begin, end, size_t(0));
+      return;
+    }
+
+    dispatch(n_chunks, [&](const size_t chunk) {
+      const size_t chunk_begin = begin + chunk * grain;
+      fn(chunk_begin, std::min(end, chunk_begin + grain), chunk);
+    });
+  }
+
+  static size_t get_chunk_ct(const size_t n, const size_t grain) {
+    return n == 0 ? 1 : (n + grain - 1) / grain;
+  }
+
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  bool m_stopping = false;
+
+  void work();
+};
+
+} // namespace CTNM::Parallel
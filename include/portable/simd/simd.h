@@ -0,0 +1,449 @@
+#pragma once
+
+/* Stand-in for Apple's <simd/simd.h> on other platforms, covering the
+ * subset the CPU renderer and simulation use. Vectors are fixed size
+ * structs with the same size and alignment as Apple's, so components and
+ * snapshots keep their layout. Comparisons give lanes of -1 or 0 in an
+ * integer vector of the same lane width, which simd_select and simd_any
+ * read by the sign bit as Apple's do. Only added to the include path when
+ * not building for Apple */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace CTNM::Portable {
+
+template <typename T, int N> struct alignas(sizeof(T) * N) Vec {
+  T v[N];
+
+  T &operator[](const int i) { return v[i]; }
+  const T &operator[](const int i) const { return v[i]; }
+};
+
+template <typename T> struct alignas(sizeof(T) * 2) Vec<T, 2> {
+  union {
+    T v[2];
+    struct {
+      T x, y;
+    };
+  };
+
+  T &operator[](const int i) { return v[i]; }
+  const T &operator[](const int i) const { return v[i]; }
+};
+
+// Padded to four lanes like Apple's
+template <typename T> struct alignas(sizeof(T) * 4) Vec<T, 3> {
+  union {
+    T v[4];
+    struct {
+      T x, y, z;
+    };
+  };
+
+  T &operator[](const int i) { return v[i]; }
+  const T &operator[](const int i) const { return v[i]; }
+};
+
+template <typename T> struct alignas(sizeof(T) * 4) Vec<T, 4> {
+  union {
+    T v[4];
+    struct {
+      T x, y, z, w;
+    };
+  };
+
+  T &operator[](const int i) { return v[i]; }
+  const T &operator[](const int i) const { return v[i]; }
+};
+
+template <typename T>
+using Mask_Lane = std::conditional_t<sizeof(T) == 8, int64_t, int32_t>;
+
+template <typename T, int N, typename F>
+inline Vec<T, N> map(Vec<T, N> a, F f) {
+  for (int i = 0; i < N; i++)
+    a[i] = f(a[i]);
+  return a;
+}
+
+template <typename T, int N, typename F>
+inline Vec<T, N> zip(Vec<T, N> a, const Vec<T, N> &b, F f) {
+  for (int i = 0; i < N; i++)
+    a[i] = f(a[i], b[i]);
+  return a;
+}
+
+template <typename T, int N, typename F>
+inline Vec<Mask_Lane<T>, N> compare(const Vec<T, N> &a, const Vec<T, N> &b,
+                                    F f) {
+  Vec<Mask_Lane<T>, N> mask{};
+  for (int i = 0; i < N; i++)
+    mask[i] = f(a[i], b[i]) ? -1 : 0;
+  return mask;
+}
+
+template <typename T, int N> inline Vec<T, N> broadcast(const T s) {
+  Vec<T, N> a{};
+  for (int i = 0; i < N; i++)
+    a[i] = s;
+  return a;
+}
+
+template <typename S, typename T>
+concept Scalar_For = std::is_arithmetic_v<S> && std::is_convertible_v<S, T>;
+
+#define CTNM_PORTABLE_ARITHMETIC(OP)                                           \
+  template <typename T, int N>                                                 \
+  inline Vec<T, N> operator OP(const Vec<T, N> &a, const Vec<T, N> &b) {       \
+    return zip(a, b, [](const T l, const T r) { return T(l OP r); });          \
+  }                                                                            \
+  template <typename T, int N, Scalar_For<T> S>                                \
+  inline Vec<T, N> operator OP(const Vec<T, N> &a, const S s) {                \
+    return a OP broadcast<T, N>(T(s));                                         \
+  }                                                                            \
+  template <typename T, int N, Scalar_For<T> S>                                \
+  inline Vec<T, N> operator OP(const S s, const Vec<T, N> &a) {                \
+    return broadcast<T, N>(T(s)) OP a;                                         \
+  }                                                                            \
+  template <typename T, int N>                                                 \
+  inline Vec<T, N> &operator OP##=(Vec<T, N> &a, const Vec<T, N> &b) {         \
+    return a = a OP b;                                                         \
+  }                                                                            \
+  template <typename T, int N, Scalar_For<T> S>                                \
+  inline Vec<T, N> &operator OP##=(Vec<T, N> &a, const S s) {                  \
+    return a = a OP s;                                                         \
+  }
+
+CTNM_PORTABLE_ARITHMETIC(+)
+CTNM_PORTABLE_ARITHMETIC(-)
+CTNM_PORTABLE_ARITHMETIC(*)
+CTNM_PORTABLE_ARITHMETIC(/)
+#undef CTNM_PORTABLE_ARITHMETIC
+
+#define CTNM_PORTABLE_BITWISE(OP)                                              \
+  template <typename T, int N>                                                 \
+    requires std::is_integral_v<T>                                             \
+  inline Vec<T, N> operator OP(const Vec<T, N> &a, const Vec<T, N> &b) {       \
+    return zip(a, b, [](const T l, const T r) { return T(l OP r); });          \
+  }                                                                            \
+  template <typename T, int N>                                                 \
+    requires std::is_integral_v<T>                                             \
+  inline Vec<T, N> &operator OP##=(Vec<T, N> &a, const Vec<T, N> &b) {         \
+    return a = a OP b;                                                         \
+  }
+
+CTNM_PORTABLE_BITWISE(&)
+CTNM_PORTABLE_BITWISE(|)
+CTNM_PORTABLE_BITWISE(^)
+#undef CTNM_PORTABLE_BITWISE
+
+#define CTNM_PORTABLE_COMPARE(OP)                                              \
+  template <typename T, int N>                                                 \
+  inline Vec<Mask_Lane<T>, N> operator OP(const Vec<T, N> &a,                  \
+                                          const Vec<T, N> &b) {                \
+    return compare(a, b, [](const T l, const T r) { return l OP r; });         \
+  }                                                                            \
+  template <typename T, int N, Scalar_For<T> S>                                \
+  inline Vec<Mask_Lane<T>, N> operator OP(const Vec<T, N> &a, const S s) {     \
+    return a OP broadcast<T, N>(T(s));                                         \
+  }                                                                            \
+  template <typename T, int N, Scalar_For<T> S>                                \
+  inline Vec<Mask_Lane<T>, N> operator OP(const S s, const Vec<T, N> &a) {     \
+    return broadcast<T, N>(T(s)) OP a;                                         \
+  }
+
+CTNM_PORTABLE_COMPARE(<)
+CTNM_PORTABLE_COMPARE(>)
+CTNM_PORTABLE_COMPARE(<=)
+CTNM_PORTABLE_COMPARE(>=)
+CTNM_PORTABLE_COMPARE(==)
+CTNM_PORTABLE_COMPARE(!=)
+#undef CTNM_PORTABLE_COMPARE
+
+template <typename T, int N> inline Vec<T, N> operator-(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return T(-l); });
+}
+
+template <typename T, int N>
+  requires std::is_integral_v<T>
+inline Vec<T, N> operator~(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return T(~l); });
+}
+
+template <typename To, typename T, int N>
+inline Vec<To, N> convert(const Vec<T, N> &a) {
+  Vec<To, N> b{};
+  for (int i = 0; i < N; i++)
+    b[i] = static_cast<To>(a[i]);
+  return b;
+}
+
+/* The vector functions live here too and are found by argument dependent
+ * lookup, as every one of them takes a Vec */
+template <typename T, int N>
+inline T simd_dot(const Vec<T, N> &a, const Vec<T, N> &b) {
+  T sum = T(0);
+  for (int i = 0; i < N; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+template <typename T, int N> inline T simd_length_squared(const Vec<T, N> &a) {
+  return simd_dot(a, a);
+}
+
+template <typename T, int N> inline T simd_length(const Vec<T, N> &a) {
+  return std::sqrt(simd_dot(a, a));
+}
+
+template <typename T, int N>
+inline T simd_distance(const Vec<T, N> &a, const Vec<T, N> &b) {
+  return simd_length(a - b);
+}
+
+template <typename T, int N>
+inline T simd_distance_squared(const Vec<T, N> &a, const Vec<T, N> &b) {
+  return simd_length_squared(a - b);
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_normalize(const Vec<T, N> &a) {
+  return a * (T(1) / simd_length(a));
+}
+
+template <typename T>
+inline Vec<T, 3> simd_cross(const Vec<T, 3> &a, const Vec<T, 3> &b) {
+  Vec<T, 3> c{};
+  c.x = a.y * b.z - a.z * b.y;
+  c.y = a.z * b.x - a.x * b.z;
+  c.z = a.x * b.y - a.y * b.x;
+  return c;
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_min(const Vec<T, N> &a, const Vec<T, N> &b) {
+  return zip(a, b, [](const T l, const T r) { return std::min(l, r); });
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_max(const Vec<T, N> &a, const Vec<T, N> &b) {
+  return zip(a, b, [](const T l, const T r) { return std::max(l, r); });
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_clamp(const Vec<T, N> &a, const Vec<T, N> &lo,
+                            const Vec<T, N> &hi) {
+  return simd_min(simd_max(a, lo), hi);
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_clamp(const Vec<T, N> &a, const T lo, const T hi) {
+  return map(a, [=](const T l) { return std::min(std::max(l, lo), hi); });
+}
+
+template <typename T, int N> inline Vec<T, N> simd_abs(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return T(std::abs(l)); });
+}
+
+template <typename T, int N> inline Vec<T, N> simd_sqrt(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return std::sqrt(l); });
+}
+
+template <typename T, int N> inline Vec<T, N> simd_rsqrt(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return T(1) / std::sqrt(l); });
+}
+
+template <typename T, int N> inline Vec<T, N> simd_recip(const Vec<T, N> &a) {
+  return map(a, [](const T l) { return T(1) / l; });
+}
+
+template <typename T, int N> inline T simd_reduce_add(const Vec<T, N> &a) {
+  T sum = a[0];
+  for (int i = 1; i < N; i++)
+    sum += a[i];
+  return sum;
+}
+
+template <typename T, int N> inline T simd_reduce_min(const Vec<T, N> &a) {
+  T low = a[0];
+  for (int i = 1; i < N; i++)
+    low = std::min(low, a[i]);
+  return low;
+}
+
+template <typename T, int N> inline T simd_reduce_max(const Vec<T, N> &a) {
+  T high = a[0];
+  for (int i = 1; i < N; i++)
+    high = std::max(high, a[i]);
+  return high;
+}
+
+template <typename I, int N>
+  requires std::is_signed_v<I>
+inline bool simd_any(const Vec<I, N> &mask) {
+  for (int i = 0; i < N; i++)
+    if (mask[i] < 0)
+      return true;
+  return false;
+}
+
+template <typename I, int N>
+  requires std::is_signed_v<I>
+inline bool simd_all(const Vec<I, N> &mask) {
+  for (int i = 0; i < N; i++)
+    if (mask[i] >= 0)
+      return false;
+  return true;
+}
+
+// Lanes of b where the mask is set, else of a
+template <typename T, typename I, int N>
+  requires std::is_signed_v<I>
+inline Vec<T, N> simd_select(Vec<T, N> a, const Vec<T, N> &b,
+                             const Vec<I, N> &mask) {
+  for (int i = 0; i < N; i++)
+    if (mask[i] < 0)
+      a[i] = b[i];
+  return a;
+}
+
+template <typename T, int N>
+inline Vec<T, N> simd_mix(const Vec<T, N> &a, const Vec<T, N> &b,
+                          const Vec<T, N> &t) {
+  return a + (b - a) * t;
+}
+
+template <typename T, int N>
+inline Vec<float, N> simd_float(const Vec<T, N> &a) {
+  return convert<float>(a);
+}
+
+template <typename T, int N>
+inline Vec<double, N> simd_double(const Vec<T, N> &a) {
+  return convert<double>(a);
+}
+
+template <typename T, int N>
+inline Vec<int32_t, N> simd_int(const Vec<T, N> &a) {
+  return convert<int32_t>(a);
+}
+
+} // namespace CTNM::Portable
+
+typedef CTNM::Portable::Vec<float, 2> simd_float2;
+typedef CTNM::Portable::Vec<float, 3> simd_float3;
+typedef CTNM::Portable::Vec<float, 4> simd_float4;
+typedef CTNM::Portable::Vec<float, 8> simd_float8;
+typedef CTNM::Portable::Vec<float, 16> simd_float16;
+typedef CTNM::Portable::Vec<double, 2> simd_double2;
+typedef CTNM::Portable::Vec<double, 3> simd_double3;
+typedef CTNM::Portable::Vec<double, 4> simd_double4;
+typedef CTNM::Portable::Vec<int32_t, 2> simd_int2;
+typedef CTNM::Portable::Vec<int32_t, 3> simd_int3;
+typedef CTNM::Portable::Vec<int32_t, 4> simd_int4;
+typedef CTNM::Portable::Vec<int32_t, 8> simd_int8;
+typedef CTNM::Portable::Vec<int32_t, 16> simd_int16;
+typedef CTNM::Portable::Vec<uint32_t, 2> simd_uint2;
+typedef CTNM::Portable::Vec<uint32_t, 3> simd_uint3;
+typedef CTNM::Portable::Vec<uint32_t, 4> simd_uint4;
+typedef CTNM::Portable::Vec<uint32_t, 8> simd_uint8;
+typedef CTNM::Portable::Vec<uint32_t, 16> simd_uint16;
+typedef CTNM::Portable::Vec<int64_t, 2> simd_long2;
+typedef CTNM::Portable::Vec<int64_t, 3> simd_long3;
+typedef CTNM::Portable::Vec<int64_t, 4> simd_long4;
+typedef CTNM::Portable::Vec<uint8_t, 4> simd_uchar4;
+
+struct simd_quatf {
+  simd_float4 vector;
+};
+
+struct simd_float3x3 {
+  simd_float3 columns[3];
+};
+typedef simd_float3x3 matrix_float3x3;
+
+inline simd_float3 simd_make_float3(const float x, const float y,
+                                    const float z) {
+  return simd_float3{{{x, y, z, 0.0f}}};
+}
+
+inline simd_float4 simd_make_float4(const float x, const float y,
+                                    const float z, const float w) {
+  return simd_float4{{{x, y, z, w}}};
+}
+
+inline simd_double3 simd_make_double3(const double x, const double y,
+                                      const double z) {
+  return simd_double3{{{x, y, z, 0.0}}};
+}
+
+// Rotation of angle radians about a unit axis
+inline simd_quatf simd_quaternion(const float angle, const simd_float3 &axis) {
+  const float s = std::sin(angle * 0.5f);
+  return simd_quatf{simd_make_float4(axis.x * s, axis.y * s, axis.z * s,
+                                    std::cos(angle * 0.5f))};
+}
+
+inline simd_float3x3 simd_matrix3x3(const simd_quatf &q) {
+  const float x = q.vector.x, y = q.vector.y, z = q.vector.z, w = q.vector.w;
+  return simd_float3x3{
+      {simd_make_float3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w),
+                        2.0f * (x * z - y * w)),
+       simd_make_float3(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z),
+                        2.0f * (y * z + x * w)),
+       simd_make_float3(2.0f * (x * z + y * w), 2.0f * (y * z - x * w),
+                        1.0f - 2.0f * (x * x + y * y))}};
+}
+
+inline simd_float3 simd_mul(const simd_float3x3 &m, const simd_float3 &v) {
+  return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z;
+}
+
+namespace simd {
+
+using float2 = simd_float2;
+using float3 = simd_float3;
+using float4 = simd_float4;
+using float8 = simd_float8;
+using float16 = simd_float16;
+using double2 = simd_double2;
+using double3 = simd_double3;
+using double4 = simd_double4;
+using int2 = simd_int2;
+using int3 = simd_int3;
+using int4 = simd_int4;
+using int8 = simd_int8;
+using int16 = simd_int16;
+using uint2 = simd_uint2;
+using uint3 = simd_uint3;
+using uint4 = simd_uint4;
+using uint8 = simd_uint8;
+using uint16 = simd_uint16;
+using long2 = simd_long2;
+using long3 = simd_long3;
+using long4 = simd_long4;
+using uchar4 = simd_uchar4;
+
+#define CTNM_PORTABLE_MATH(NAME)                                               \
+  template <typename T, int N>                                                 \
+  inline CTNM::Portable::Vec<T, N> NAME(const CTNM::Portable::Vec<T, N> &a) {  \
+    return CTNM::Portable::map(a, [](const T l) { return std::NAME(l); });     \
+  }
+
+CTNM_PORTABLE_MATH(sin)
+CTNM_PORTABLE_MATH(cos)
+CTNM_PORTABLE_MATH(sinh)
+CTNM_PORTABLE_MATH(cosh)
+CTNM_PORTABLE_MATH(exp)
+CTNM_PORTABLE_MATH(log)
+CTNM_PORTABLE_MATH(sqrt)
+CTNM_PORTABLE_MATH(cbrt)
+CTNM_PORTABLE_MATH(fabs)
+CTNM_PORTABLE_MATH(floor)
+#undef CTNM_PORTABLE_MATH
+
+} // namespace simd
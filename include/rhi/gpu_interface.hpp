@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../parallel/thread_pool.hpp"
 #include "../window.hpp"
 #include "event.hpp"
 #include "gpu_context.hpp"
@@ -8,11 +9,13 @@
 
 #include <array>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <AppKit/AppKit.hpp>
 #include <Foundation/Foundation.hpp>
@@ -49,16 +52,35 @@ struct Frame_Context {
 
   bool ready = true, tlas_built = false;
   uint64_t revision = 0;
+  size_t tlas_capacity = 0; // Instances the TLAS was built for, padded
   std::mutex mtx;
   std::condition_variable cv;
   std::string label;
 };
 
+/* Packets whose world bounds are off screen, further than the raytracer's
+ * rays reach, or under min_pixels across are left out of the TLAS */
+struct Cull_Config {
+  float min_pixels = 0.5f;
+  float far = 1000.0f; // ray.max_distance in raytracing.metal
+};
+
+struct Cull_Stats {
+  uint64_t n_packets = 0, n_visible = 0;
+  double ms_cull = 0.0;
+};
+
 class GPU_Interface {
 public:
-  GPU_Interface(std::shared_ptr<Window> win);
+  GPU_Interface(
+      std::shared_ptr<Window> win,
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
   ~GPU_Interface();
 
+  void set_cull_config(const Cull_Config &config);
+  const Cull_Config &get_cull_config() const;
+  const Cull_Stats &get_cull_stats() const;
+
   void cycle_frame();
   GPU_Context get_gpu_context();
   void render(std::unordered_map<entt::entity, Render_Packet> &packets,
@@ -70,6 +92,7 @@ public:
 
 private:
   std::shared_ptr<Window> m_win;
+  Parallel::Thread_Pool &m_pool;
 
   MTL_Unique<NS::View> m_metal_view_ns = nullptr;
   MTL_Unique<NS::AutoreleasePool> m_pool_full = nullptr;
@@ -95,7 +118,16 @@ private:
   uint32_t m_slot = 0, m_next_frame = 0;
   bool skip_frame = false;
 
+  Cull_Config m_cull_config;
+  Cull_Stats m_cull_stats;
+  std::vector<const Render_Packet *> m_cull_packets;
+  std::vector<uint8_t> m_cull_flags;
+  std::vector<uint32_t> m_visible; // Compacted indices into m_cull_packets
+
   void cb_fb_resized(const FB_Size fb_size);
+  // Sets m_cull_flags for the entries of m_cull_packets that may be seen
+  void cull_packets(const Components::Camera &cam, const float width,
+                    const float height);
 
   void free_current_frame(const bool end_cmd_buff = false);
 };
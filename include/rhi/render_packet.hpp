@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../components.hpp"
+#include "../math_utils.hpp"
 #include "gpu_context.hpp"
 #include "gpu_types.hpp"
 
@@ -15,6 +16,7 @@ struct AS_Context {
   uint64_t revision = 0;
   MTL::PackedFloat4x3 transform;
   GPU_Types::Surface surface;
+  Math::AABB local_bounds, bounds; // Mesh, then world space
 
   MTL_Unique<MTL::Buffer> buff_verticies = nullptr;
   MTL_Unique<MTL::Buffer> buff_indicies = nullptr;
@@ -45,6 +47,7 @@ public:
   const MTL::AccelerationStructure *get_as(const uint32_t slot) const;
   const MTL::PackedFloat4x3 &get_transform(const uint32_t slot) const;
   const GPU_Types::Surface &get_surface(const uint32_t slot) const;
+  const Math::AABB &get_bounds(const uint32_t slot) const;
 
 private:
   std::array<AS_Context, MAX_FRAMES_INFLIGHT> m_as_contexts;
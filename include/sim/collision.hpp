@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../cpu/scene.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "spatial_hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace CTNM::Sim {
+
+struct Contact {
+  uint32_t i = 0, j = 0; // i < j
+  double s = 0.0;        // First touch as a fraction of the step
+};
+
+struct Collision_Stats {
+  size_t n_bodies = 0, n_large = 0;
+  uint64_t n_candidates = 0, n_contacts = 0;
+  double ms_broadphase = 0.0, ms_narrowphase = 0.0;
+
+  double get_ms() const { return ms_broadphase + ms_narrowphase; }
+};
+
+/* Bodies moving in straight lines from p0 to p1 over a step. Swept spheres
+ * pair up through a spatial hash sized for the typical body; bodies too
+ * big for its cells are checked against it by radius query and against
+ * each other by sweep and prune on one axis. Candidates get a continuous
+ * sphere test, then where a Mesh is present its triangles, culled by a BVH
+ * kept per mesh, against the other body's sphere at closest approach */
+class Collision_Detector {
+public:
+  Collision_Detector(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Collision_Detector() = default;
+
+  const Collision_Stats &get_stats() const;
+
+  /* r is the bounding radius. meshes[i] may be null; otherwise frames[i]
+   * maps its vertices to world space, less the translation, which follows
+   * the body, and its BVH is rebuilt when Mesh::revision changes. out is
+   * ordered by s, then i, then j */
+  void detect(std::span<const Math::vec_d3> p0,
+              std::span<const Math::vec_d3> p1, std::span<const double> r,
+              std::span<const Components::Mesh *const> meshes,
+              std::span<const CPU::Affine> frames, std::vector<Contact> &out);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Collision_Stats m_stats;
+  Spatial_Hash m_hash;
+
+  // Swept spheres, then the bodies the hash holds and those too large for it
+  std::vector<Math::vec_d3> m_centres;
+  std::vector<double> m_reach;
+  std::vector<uint32_t> m_small, m_large;
+  std::vector<Math::vec_d3> m_small_centres;
+  std::vector<std::pair<uint32_t, uint32_t>> m_pairs;
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_chunk_pairs;
+  std::unordered_map<const Components::Mesh *, CPU::Mesh_BVH> m_mesh_bvhs;
+};
+
+} // namespace CTNM::Sim
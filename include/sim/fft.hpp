@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../parallel/thread_pool.hpp"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CTNM::Sim {
+
+/* Real <-> half complex transforms of a cubic power-of-two mesh, in place.
+ * Rows run along z and hold 2 (n/2 + 1) floats so the half spectrum fits
+ * where the real data was. Index (x, y, z) lives at (x n + y) row + z */
+class FFT_3D {
+public:
+  FFT_3D(Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~FFT_3D() = default;
+
+  void resize(const uint32_t n);
+  uint32_t get_size() const;
+  size_t get_row() const; // Floats per row
+  size_t get_mesh_size() const; // Floats in the padded mesh
+
+  void forward(std::span<float> mesh);
+  /* Unnormalised, scales the data by n^3 */
+  void inverse(std::span<float> mesh);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  uint32_t m_n = 0;
+  std::vector<std::complex<float>> m_twiddles; // exp(-2 pi i k / n)
+  std::vector<uint32_t> m_bitrev_n, m_bitrev_half;
+
+  void transform_lines(const bool inverse, std::complex<float> *data);
+  void transform_rows(const bool inverse, std::complex<float> *data);
+};
+
+} // namespace CTNM::Sim
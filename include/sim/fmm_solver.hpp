@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <complex>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CTNM::Sim {
+
+constexpr uint32_t FMM_MAX_ORDER = 20;
+
+struct FMM_Config {
+  uint32_t order = 8;      // Expansion order p, force error ~ theta^(p + 1)
+  double theta = 0.5;      // Opening angle, (r_a + r_b) < theta d accepts
+  uint32_t leaf_size = 64; // Bodies per leaf before it splits
+};
+
+struct FMM_Stats {
+  double ms_build = 0.0, ms_upward = 0.0, ms_traverse = 0.0;
+  double ms_interact = 0.0, ms_downward = 0.0;
+  size_t n_nodes = 0;
+  uint64_t n_m2l = 0, n_p2p_pairs = 0;
+
+  double get_ms() const {
+    return ms_build + ms_upward + ms_traverse + ms_interact + ms_downward;
+  }
+};
+
+/* Fast multipole gravity over an adaptive octree in Morton order. Cells
+ * carry solid harmonic multipoles about their centre of mass; a dual-tree
+ * walk pairs well separated cells for multipole to local conversion and
+ * close leaves for direct sums. The conversions run in parallel over
+ * target cells, so each local expansion has a single writer */
+class FMM_Solver {
+public:
+  FMM_Solver(Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~FMM_Solver() = default;
+
+  void set_config(const FMM_Config &config);
+  const FMM_Config &get_config() const;
+  const FMM_Stats &get_stats() const;
+
+  /* a[i] += pull of every source on p[i], gm = G m */
+  void accumulate(std::span<const Math::vec_d3> src_p,
+                  std::span<const double> src_gm,
+                  std::span<const Math::vec_d3> p, std::span<Math::vec_d3> a);
+
+private:
+  struct Node {
+    Math::vec_d3 z = {0.0, 0.0, 0.0}; // Expansion centre
+    double r = 0.0;                   // Furthest body from z
+    double gm = 0.0;                  // Total source mass
+    uint32_t begin = 0, end = 0;
+    uint32_t parent = 0, first_child = 0, n_children = 0;
+    uint32_t n_targets = 0;
+  };
+
+  Parallel::Thread_Pool &m_pool;
+  FMM_Config m_config;
+  FMM_Stats m_stats;
+
+  // Sources and targets together, sorted by Morton code
+  std::vector<uint64_t> m_codes;
+  std::vector<uint32_t> m_order;
+  std::vector<Math::vec_d3> m_x;
+  std::vector<double> m_gm;
+  std::vector<uint32_t> m_target; // Index into p, UINT32_MAX for sources
+
+  std::vector<Node> m_nodes;      // Breadth first
+  std::vector<uint32_t> m_levels; // First node of each depth
+
+  std::vector<std::complex<double>> m_multipoles, m_locals;
+  std::vector<double> m_expanded; // Multipoles over every m, see expand()
+
+  // Interaction lists per target node, offsets into the source arrays
+  std::vector<uint32_t> m_m2l_start, m_m2l, m_p2p_start, m_p2p;
+
+  void build(std::span<const Math::vec_d3> src_p,
+             std::span<const double> src_gm, std::span<const Math::vec_d3> p);
+  void upward();
+  void traverse();
+  void interact();
+  void downward(std::span<Math::vec_d3> a);
+};
+
+} // namespace CTNM::Sim
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <span>
+
+namespace CTNM::Sim {
+
+/* a[i] += sum_j gm[j] (src[j] - p[i]) / |src[j] - p[i]|^3, skipping sources
+ * that coincide with the target. O(targets x sources). Compensated sums
+ * carry Kahan's correction term, so the result depends far less on the
+ * order sources arrive in */
+void accumulate_direct(Parallel::Thread_Pool &pool,
+                       std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm,
+                       std::span<const Math::vec_d3> p,
+                       std::span<Math::vec_d3> a,
+                       const bool compensated = false);
+
+} // namespace CTNM::Sim
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../components.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <cstdint>
+#include <span>
+
+namespace CTNM::Sim {
+
+constexpr uint32_t KEPLER_ITERATIONS = 4;
+
+/* Position and velocity relative to the parent */
+struct Orbit_State {
+  Math::vec_d3 p = {0.0, 0.0, 0.0};
+  Math::vec_d3 v = {0.0, 0.0, 0.0};
+};
+
+/* Solves M = E - e sin E (e < 1) and M = e sinh H - H (e > 1) four lanes at a
+ * time with Halley's method. Elliptic mean anomalies should be wrapped to
+ * [-pi, pi] */
+void solve_kepler(std::span<const double> mean_anomaly,
+                  std::span<const double> e, std::span<double> anomaly);
+
+/* O(1) in t, no matter how far it lies from the epoch */
+Orbit_State get_orbit_state(const Components::Orbit &orbit, const double t);
+
+void get_orbit_states(Parallel::Thread_Pool &pool,
+                      std::span<const Components::Orbit> orbits,
+                      const double t, std::span<Orbit_State> out);
+
+/* Osculating elements of a state relative to the parent. Circular orbits
+ * measure from the node and equatorial ones from +x */
+Components::Orbit make_orbit(const Orbit_State &state, const double mu,
+                             const double epoch,
+                             const entt::entity parent = entt::null);
+
+} // namespace CTNM::Sim
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "fft.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CTNM::Sim {
+
+struct PM_Config {
+  uint32_t n_mesh = 128; // Cells per side, a power of two >= 16
+  Math::vec_d3 box_min = {0.0, 0.0, 0.0};
+  double box_size = 0.0; // Periodic box side, 0 fits one to the bodies
+  bool tree_pm = false;  // Mesh for long range, short range summed directly
+  double r_split = 1.25; // Force split scale in mesh cells
+  double r_cut = 4.5;    // Short range cut-off in multiples of r_split
+};
+
+struct PM_Stats {
+  double ms_assign = 0.0, ms_fft = 0.0, ms_interpolate = 0.0;
+  double ms_short = 0.0;
+  uint64_t n_short_pairs = 0;
+
+  double get_ms() const {
+    return ms_assign + ms_fft + ms_interpolate + ms_short;
+  }
+};
+
+/* Particle-mesh gravity in a periodic box. Sources are spread onto the mesh
+ * with cloud-in-cell weights, Poisson's equation is solved by FFT and the
+ * potential gradient is interpolated back with the same weights. With
+ * tree_pm the mesh only carries the long range part of the force and pairs
+ * closer than r_cut are summed directly from a chaining mesh */
+class PM_Solver {
+public:
+  PM_Solver(Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~PM_Solver() = default;
+
+  void set_config(const PM_Config &config);
+  const PM_Config &get_config() const;
+  const PM_Stats &get_stats() const;
+
+  /* a[i] += pull of every source on p[i], gm = G m */
+  void accumulate(std::span<const Math::vec_d3> src_p,
+                  std::span<const double> src_gm,
+                  std::span<const Math::vec_d3> p, std::span<Math::vec_d3> a);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  PM_Config m_config;
+  PM_Stats m_stats;
+  FFT_3D m_fft;
+  std::vector<float> m_mesh;
+
+  // Box of the current solve
+  Math::vec_d3 m_origin = {0.0, 0.0, 0.0};
+  double m_box = 1.0, m_h = 1.0;
+
+  // Sources sorted by slab, then by chaining mesh cell
+  std::vector<uint32_t> m_keys, m_order, m_start;
+
+  void fit_box(std::span<const Math::vec_d3> src_p,
+               std::span<const Math::vec_d3> p);
+  void assign(std::span<const Math::vec_d3> src_p,
+              std::span<const double> src_gm);
+  void solve();
+  void interpolate(std::span<const Math::vec_d3> p,
+                   std::span<Math::vec_d3> a) const;
+  void add_short_range(std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm,
+                       std::span<const Math::vec_d3> p,
+                       std::span<Math::vec_d3> a);
+};
+
+} // namespace CTNM::Sim
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../cpu/lbvh.hpp"
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace CTNM::Sim {
+
+constexpr uint32_t SPATIAL_HASH_NONE = UINT32_MAX;
+
+struct Spatial_Hash_Stats {
+  size_t n_points = 0, n_buckets = 0;
+  double ms_keys = 0.0, ms_sort = 0.0, ms_ranges = 0.0;
+
+  double get_ms() const { return ms_keys + ms_sort + ms_ranges; }
+};
+
+/* Points binned into cubic cells of a fixed side, with cells hashed into a
+ * power of two table so unbounded scenes cost memory only for the points.
+ * Rebuilt from scratch each step by a stable sort on the bucket, leaving
+ * each bucket's points contiguous. Slots are positions in that sorted
+ * order, get_order maps them back to the input */
+class Spatial_Hash {
+public:
+  Spatial_Hash(
+      Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~Spatial_Hash() = default;
+
+  void build(std::span<const Math::vec_d3> p, const double cell);
+
+  size_t size() const;
+  bool empty() const;
+  double get_cell() const;
+  const Spatial_Hash_Stats &get_stats() const;
+  std::span<const uint32_t> get_order() const;
+  std::span<const Math::vec_d3> get_points() const; // Sorted
+
+  /* fn(slot) for every point in the cells overlapping the sphere, a
+   * superset of those inside it */
+  template <typename Fn>
+  void for_each_candidate(const Math::vec_d3 &q, const double radius,
+                          Fn &&fn) const;
+
+  /* fn(slot, r2) for every point within radius of q */
+  template <typename Fn>
+  void for_each_in_radius(const Math::vec_d3 &q, const double radius,
+                          Fn &&fn) const {
+    const double r2_max = radius * radius;
+    for_each_candidate(q, radius, [&](const uint32_t k) {
+      const Math::vec_d3 d = m_points[k] - q;
+      const double r2 = simd_dot(d, d);
+      if (r2 <= r2_max)
+        fn(k, r2);
+    });
+  }
+
+  /* Slot of the closest point within radius, SPATIAL_HASH_NONE if none */
+  uint32_t find_nearest(const Math::vec_d3 &q, const double radius) const;
+
+  /* Slot of the first point whose sphere of the given radius the ray enters
+   * before max_t, SPATIAL_HASH_NONE if none. dir need not be normalised, t
+   * is in its units */
+  uint32_t cast_ray(const Math::vec_d3 &origin, const Math::vec_d3 &dir,
+                    const double max_t, const double radius,
+                    double *t_hit = nullptr) const;
+
+  /* Every unordered pair of slots closer than radius once, lower slot
+   * first, in ascending order of the lower slot whatever the thread count */
+  void find_pairs(const double radius,
+                  std::vector<std::pair<uint32_t, uint32_t>> &out) const;
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  Spatial_Hash_Stats m_stats;
+
+  static constexpr double CELL_LIMIT = (1 << 20) - 1;
+
+  double m_cell = 1.0, m_inv_cell = 1.0;
+  Math::vec_d3 m_lo = {0.0, 0.0, 0.0}, m_hi = {0.0, 0.0, 0.0}; // Of the points
+  uint32_t m_bits = 1; // log2 of the bucket count
+
+  std::vector<uint32_t> m_keys, m_order;
+  std::vector<Math::vec_d3> m_points;
+  std::vector<uint64_t> m_cells;         // Packed cell of each slot
+  std::vector<uint32_t> m_bucket_start;  // Slot ranges, one past per bucket
+
+  void get_cell(const Math::vec_d3 &p, int64_t c[3]) const {
+    const Math::vec_d3 s = p * m_inv_cell;
+    for (int d = 0; d < 3; d++)
+      c[d] = static_cast<int64_t>(
+          std::clamp(std::floor(s[d]), -CELL_LIMIT, CELL_LIMIT));
+  }
+
+  // Morton code, unique within the clamped range
+  static uint64_t get_cell_code(const int64_t x, const int64_t y,
+                                const int64_t z) {
+    constexpr int64_t bias = int64_t(1) << 20;
+    return CPU::expand_bits_21(static_cast<uint64_t>(x + bias)) << 2 |
+           CPU::expand_bits_21(static_cast<uint64_t>(y + bias)) << 1 |
+           CPU::expand_bits_21(static_cast<uint64_t>(z + bias));
+  }
+
+  /* The low Morton bits tile space periodically, so nearby cells share
+   * nearby buckets and the sorted points keep their locality */
+  uint32_t get_bucket(const uint64_t code) const {
+    return static_cast<uint32_t>(code & ((uint64_t(1) << m_bits) - 1));
+  }
+};
+
+template <typename Fn>
+void Spatial_Hash::for_each_candidate(const Math::vec_d3 &q,
+                                      const double radius, Fn &&fn) const {
+  if (m_points.empty())
+    return;
+
+  int64_t lo[3], hi[3];
+  get_cell(q - radius, lo);
+  get_cell(q + radius, hi);
+
+  // Past a table's worth of cells, scanning every point is cheaper
+  const double n_cells = double(hi[0] - lo[0] + 1) * double(hi[1] - lo[1] + 1) *
+                         double(hi[2] - lo[2] + 1);
+  if (n_cells > static_cast<double>(m_bucket_start.size())) {
+    for (uint32_t k = 0; k < m_points.size(); k++)
+      fn(k);
+    return;
+  }
+
+  // Axes spread once per loop level rather than per cell
+  constexpr int64_t bias = int64_t(1) << 20;
+  for (int64_t x = lo[0]; x <= hi[0]; x++) {
+    const uint64_t code_x = CPU::expand_bits_21(uint64_t(x + bias)) << 2;
+    for (int64_t y = lo[1]; y <= hi[1]; y++) {
+      const uint64_t code_xy =
+          code_x | CPU::expand_bits_21(uint64_t(y + bias)) << 1;
+      for (int64_t z = lo[2]; z <= hi[2]; z++) {
+        const uint64_t code = code_xy | CPU::expand_bits_21(uint64_t(z + bias));
+        const uint32_t bucket = get_bucket(code);
+
+        // Other cells may share the bucket, skip their points
+        for (uint32_t k = m_bucket_start[bucket];
+             k < m_bucket_start[bucket + 1]; k++)
+          if (m_cells[k] == code)
+            fn(k);
+      }
+    }
+  }
+}
+
+} // namespace CTNM::Sim
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../math_utils.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "spatial_hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CTNM::Sim {
+
+/* Both have compact support at 2h */
+enum class SPH_Kernel : uint32_t { Cubic_Spline, Wendland_C2 };
+
+struct SPH_Config {
+  SPH_Kernel kernel = SPH_Kernel::Cubic_Spline;
+  uint32_t n_neighbours = 48;     // Target count inside 2h
+  double gamma = 5.0 / 3.0;       // Adiabatic index
+  double alpha = 1.0, beta = 2.0; // Monaghan artificial viscosity
+};
+
+struct SPH_Stats {
+  size_t n_particles = 0;
+  uint64_t n_pairs = 0; // Neighbour list entries
+  double ms_grid = 0.0, ms_density = 0.0, ms_neighbours = 0.0;
+  double ms_force = 0.0;
+  double mean_neighbours = 0.0, particles_per_s = 0.0;
+
+  double get_ms() const {
+    return ms_grid + ms_density + ms_neighbours + ms_force;
+  }
+};
+
+/* Smoothed particle hydrodynamics for an ideal gas. Smoothing lengths adapt
+ * so 2h holds about n_neighbours particles, found through a spatial hash
+ * with particles kept in its sorted order. The pressure force and energy
+ * equation use the kernel gradient averaged over both smoothing lengths, so
+ * pairs act symmetrically */
+class SPH_Solver {
+public:
+  SPH_Solver(Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
+  ~SPH_Solver() = default;
+
+  void set_config(const SPH_Config &config);
+  const SPH_Config &get_config() const;
+  const SPH_Stats &get_stats() const;
+
+  /* h is read as a first guess, a value <= 0 lets the solver pick one, and
+   * written back adapted. Writes rho and du_dt, a[i] += pressure and
+   * viscous acceleration. u is specific internal energy. A massless particle
+   * with nothing massive within 2h gets rho = 0 and no pressure */
+  void compute(std::span<const Math::vec_d3> p,
+               std::span<const Math::vec_d3> v, std::span<const double> m,
+               std::span<const double> u, std::span<double> h,
+               std::span<double> rho, std::span<Math::vec_d3> a,
+               std::span<double> du_dt);
+
+private:
+  Parallel::Thread_Pool &m_pool;
+  SPH_Config m_config;
+  SPH_Stats m_stats;
+
+  // Particles in hash order, one array per component
+  Spatial_Hash m_hash;
+  std::vector<double> m_x, m_y, m_z, m_vx, m_vy, m_vz, m_m;
+  std::vector<double> m_u, m_h, m_rho, m_p_rho2, m_c;
+  std::vector<double> m_ax, m_ay, m_az, m_du;
+
+  std::vector<uint32_t> m_ngb_start, m_ngb;
+
+  void build_grid(std::span<const Math::vec_d3> p,
+                  std::span<const Math::vec_d3> v, std::span<const double> m,
+                  std::span<const double> u, std::span<const double> h);
+  template <SPH_Kernel K> bool density(const bool first, const bool last);
+  void build_neighbours();
+  template <SPH_Kernel K> void force();
+};
+
+} // namespace CTNM::Sim
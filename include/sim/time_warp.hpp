@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../simulator.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#include <entt/entt.hpp>
+
+namespace CTNM::Sim {
+
+constexpr double MAX_WARP = 1e6;
+
+struct Time_Warp_Config {
+  double budget_ms = 4.0;    // Simulator CPU time per frame
+  double max_substep = 60.0; // Longest leapfrog substep, simulated seconds
+  uint32_t max_substeps = 1024;
+};
+
+/* Offline renders have no frame deadline, only accuracy matters */
+inline Time_Warp_Config make_unbounded_time_warp_config() {
+  Time_Warp_Config config;
+  config.budget_ms = std::numeric_limits<double>::infinity();
+  config.max_substeps = std::numeric_limits<uint32_t>::max();
+  return config;
+}
+
+struct Time_Warp_Stats {
+  double warp = 1.0;
+  double sim_dt = 0.0, substep = 0.0; // Simulated seconds
+  double ms_frame = 0.0, ms_per_eval = 0.0;
+  double sim_per_wall = 0.0; // Simulated seconds per second spent stepping
+  uint32_t n_substeps = 0;
+  Integrator integrator = Integrator::Leapfrog;
+  bool degraded = false; // Over budget, substeps are longer than asked for
+};
+
+/* Advances the simulation by warp x wall time each frame. Picks the
+ * cheapest integrator and substep count that keeps substeps within the
+ * accuracy target, and past the CPU budget stretches substeps and freezes
+ * perturbed orbits onto analytic conics instead of dropping frames. While
+ * frozen, the orbits are handed back for a frame now and then to measure
+ * whether the full simulation fits again */
+class Time_Warp {
+public:
+  Time_Warp(const Time_Warp_Config &config = {});
+  ~Time_Warp() = default;
+
+  void set_warp(const double warp); // Clamped to [1, MAX_WARP]
+  double get_warp() const;
+  const Time_Warp_Stats &get_stats() const;
+
+  void update(entt::registry &reg, Simulator &sim); // Wall clock
+  void advance(entt::registry &reg, Simulator &sim, const double wall_dt);
+
+private:
+  Time_Warp_Config m_config;
+  Time_Warp_Stats m_stats;
+  double m_warp = 1.0;
+  double m_ms_per_eval_full = 0.0; // With perturbed orbits integrated
+  uint32_t m_n_degraded = 0;       // Frames since it was last measured
+
+  bool first_update = true;
+  std::chrono::time_point<std::chrono::steady_clock> m_tp_last;
+};
+
+} // namespace CTNM::Sim
@@ -1,21 +1,189 @@
 #pragma once
 
+#include "components.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/collision.hpp"
+#include "sim/fmm_solver.hpp"
+#include "sim/kepler.hpp"
+#include "sim/pm_solver.hpp"
+#include "sim/spatial_hash.hpp"
+#include "sim/sph.hpp"
+
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 #include <entt/entt.hpp>
 
 namespace CTNM {
 
+constexpr double GRAVITATIONAL_CONSTANT = 6.6743e-11; // m^3 kg^-1 s^-2
+
+/* Value is the order of the integrator */
+enum class Integrator : uint32_t { Euler = 1, Leapfrog = 2, Yoshida = 4 };
+
+/* Force evaluations per substep, leapfrog reuses the last one */
+constexpr uint32_t get_force_evals(const Integrator integrator) {
+  return integrator == Integrator::Yoshida ? 3 : 1;
+}
+
+/* Direct sums every pair, PM solves for the field on a mesh and FMM
+ * expands cells in multipoles, see PM_Solver and FMM_Solver */
+enum class Force_Backend : uint32_t { Direct, PM, FMM };
+
+struct Simulator_Stats {
+  size_t n_analytic = 0, n_numeric = 0, n_gas = 0, n_colliders = 0;
+  uint64_t n_handoffs = 0; // Analytic orbits moved to numeric integration
+  uint64_t n_mergers = 0;
+  uint64_t checksum = 0; // Of the state after the step, deterministic only
+  uint32_t n_force_evals = 0;
+  double ms_step = 0.0;
+};
+
 class Simulator {
 public:
-  Simulator() = default;
+  Simulator(Parallel::Thread_Pool &pool = Parallel::Thread_Pool::get_global());
   ~Simulator() = default;
 
   void update(entt::registry &reg);
+  void step(entt::registry &reg, const double dt,
+            const uint32_t n_substeps = 1);
+
+  double get_time() const;
+  void set_time(const double time); // When resuming from a snapshot
+  const Simulator_Stats &get_stats() const;
+
+  void set_integrator(const Integrator integrator);
+  Integrator get_integrator() const;
+
+  void set_force_backend(const Force_Backend backend);
+  Force_Backend get_force_backend() const;
+  Sim::PM_Solver &get_pm_solver();
+  Sim::FMM_Solver &get_fmm_solver();
+  Sim::SPH_Solver &get_sph_solver();
+  Sim::Collision_Detector &get_collision_detector();
+
+  /* Largest perturbing acceleration, as a fraction of the parent's pull, an
+   * orbit tolerates before it is integrated numerically */
+  void set_perturbation_threshold(const double ratio);
+
+  /* While disabled perturbed orbits stay analytic */
+  void set_handoff(const bool enabled);
+
+  /* Bodies are gathered in entity order rather than storage order, direct
+   * sums are compensated, and every step records a checksum of the state.
+   * The same entities then step to the same bits whatever the thread count
+   * or the order their components were added in */
+  void set_deterministic(const bool enabled);
+  bool is_deterministic() const;
+
+  /* Numeric bodies with a Collider, other than gas, are tested after every
+   * substep. Touching bodies merge, conserving mass and momentum, and the
+   * lighter entity is destroyed once the step ends */
+  void set_collisions(const bool enabled);
+
+  /* Fits osculating elements to every orbit being integrated numerically
+   * and returns it to analytic propagation. Returns the number restored */
+  size_t restore_orbits(entt::registry &reg);
+
+  /* First entity with a Transform whose sphere of the given radius the ray
+   * from origin along dir hits, entt::null if none */
+  entt::entity pick(const entt::registry &reg, const Math::vec_d3 &origin,
+                    const Math::vec_d3 &dir, const double radius);
 
 private:
+  struct Mass_Point {
+    entt::entity e;
+    Math::vec_d3 p;
+    double gm;
+  };
+
+  struct Body {
+    entt::entity e, parent;
+    double gm, mu; // Own and parent's gravitational parameter
+    Math::vec_d3 a_ext;
+  };
+
+  Parallel::Thread_Pool &m_pool;
+
   bool first_update = true;
   std::chrono::time_point<std::chrono::steady_clock> m_tp_last;
+  double m_time = 0.0;
+  double m_perturbation_threshold = 2e-2;
+  bool m_handoff = true;
+  bool m_collisions = true;
+  bool m_deterministic = false;
+  Integrator m_integrator = Integrator::Leapfrog;
+  Force_Backend m_force_backend = Force_Backend::Direct;
+  Sim::PM_Solver m_pm;
+  Sim::FMM_Solver m_fmm;
+  Sim::SPH_Solver m_sph;
+  Sim::Collision_Detector m_collision;
+  Sim::Spatial_Hash m_hash;
+  Simulator_Stats m_stats;
+
+  std::vector<Mass_Point> m_masses;
+  std::vector<Math::vec_d3> m_src_p;
+  std::vector<double> m_src_gm;
+
+  std::vector<entt::entity> m_entities; // Being gathered
+
+  // Numerically integrated bodies
+  std::vector<Body> m_bodies;
+  std::vector<Math::vec_d3> m_p, m_v, m_a;
+  std::unordered_map<entt::entity, size_t> m_body_index;
+
+  // Numeric bodies with Gas, by body index
+  std::vector<size_t> m_gas;
+  std::vector<Math::vec_d3> m_gas_p, m_gas_v, m_gas_a;
+  std::vector<double> m_gas_m, m_gas_u, m_gas_h, m_gas_rho, m_gas_du;
+
+  // Numeric bodies with a Collider, by body index
+  std::vector<size_t> m_colliders;
+  std::vector<Math::vec_d3> m_col_p0, m_col_p1;
+  std::vector<double> m_col_r, m_col_r0; // Now and at gather
+  std::vector<const Components::Mesh *> m_col_meshes;
+  std::vector<CPU::Affine> m_col_frames;
+  std::vector<Sim::Contact> m_contacts;
+  std::vector<uint8_t> m_alive;
+  std::vector<entt::entity> m_absorbed; // Destroyed after scatter
+
+  // Entities indexed by m_hash
+  std::vector<entt::entity> m_hash_entities;
+  std::vector<Math::vec_d3> m_hash_p;
+
+  // Analytic orbits
+  std::vector<entt::entity> m_orbit_entities;
+  std::vector<Components::Orbit> m_orbits;
+  std::vector<double> m_orbit_gm;
+  std::vector<Sim::Orbit_State> m_local, m_world;
+  std::vector<uint8_t> m_resolved;
+  std::unordered_map<entt::entity, size_t> m_orbit_index;
+  bool m_orbits_midstep = false; // Numeric bodies feel an analytic one
+
+  template <typename View> void collect(const View &view);
+  void gather(entt::registry &reg);
+  void scatter(entt::registry &reg);
+  uint64_t get_checksum() const;
+  void gather_masses();
+
+  void evaluate_orbits(entt::registry &reg, const double t);
+  Sim::Orbit_State get_parent_state(entt::registry &reg,
+                                    const entt::entity parent);
+  const Sim::Orbit_State &resolve_orbit(entt::registry &reg, const size_t i);
+
+  Math::vec_d3 get_gravity(const Math::vec_d3 &p, const entt::entity skip_a,
+                           const entt::entity skip_b) const;
+  double get_gm(const entt::entity e) const;
+  void get_accelerations(entt::registry &reg, const double t);
+
+  void drift(const double h);
+  void kick(const double h);
+  void collide();
+  void merge(const size_t a, const size_t b);
 };
 
 }; // namespace CTNM
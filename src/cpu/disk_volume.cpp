@@ -0,0 +1,256 @@
+#include "cpu/disk_volume.hpp"
+#include "components.hpp"
+#include "cpu/geodesic.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+Math::vec_f3 get_blackbody_col(const float kelvin) {
+  // Fit to the CIE 1964 black body locus, Helland
+  const float t = std::clamp(kelvin, 1000.0f, 40000.0f) / 100.0f;
+  const float r = t <= 66.0f ? 255.0f
+                             : 329.698727446f *
+                                   std::pow(t - 60.0f, -0.1332047592f),
+              g = t <= 66.0f
+                      ? 99.4708025861f * std::log(t) - 161.1195681661f
+                      : 288.1221695283f * std::pow(t - 60.0f, -0.0755148492f),
+              b = t >= 66.0f   ? 255.0f
+                  : t <= 19.0f ? 0.0f
+                               : 138.5177312231f * std::log(t - 10.0f) -
+                                     305.0447927307f;
+
+  return simd_clamp(Math::vec_f3{r, g, b} / 255.0f, 0.0f, 1.0f);
+}
+
+Disk_Volume::Disk_Volume(const Geodesic_Params &lens,
+                         const Components::Accretion_Disk &disk,
+                         const bool thick)
+    : m_center(lens.center), m_n(Math::normalize(lens.disk_n)),
+      m_r_s(lens.r_s), m_r_in(lens.disk_r_in), m_r_out(lens.disk_r_out),
+      m_h_r(disk.h_r), m_kappa(disk.opacity / lens.r_s), m_t_max(disk.t_max),
+      m_brightness(disk.brightness), m_thick(thick && disk.h_r > 0.0f) {
+  const Math::vec_f3 helper = std::fabs(m_n.x) < 0.9f
+                                  ? Math::vec_f3{1.0f, 0.0f, 0.0f}
+                                  : Math::vec_f3{0.0f, 1.0f, 0.0f};
+  m_t1 = Math::normalize(simd_cross(helper, m_n));
+  m_t2 = simd_cross(m_n, m_t1);
+
+  if (m_thick)
+    build_grid();
+}
+
+bool Disk_Volume::is_thick() const { return m_thick; }
+
+Math::vec_f3 Disk_Volume::shade_crossing(const Math::vec_f3 &p,
+                                         const Math::vec_f3 &d) const {
+  const Math::vec_f3 p_local = {simd_dot(p, m_t1), simd_dot(p, m_t2),
+                                simd_dot(p, m_n)},
+                     d_local = {simd_dot(d, m_t1), simd_dot(d, m_t2),
+                                simd_dot(d, m_n)};
+  return get_emission(p_local, Math::normalize(d_local));
+}
+
+uint32_t Disk_Volume::march(const Math::vec_f3 &a, const Math::vec_f3 &b,
+                            const Disk_March_Config &config,
+                            Disk_Radiance &rad) const {
+  if (rad.T < config.min_transmittance)
+    return 0;
+
+  const Math::vec_f3 oa = a - m_center, ab = b - a;
+  if (!m_thick) {
+    // Single opaque crossing of the midplane
+    const float d0 = simd_dot(oa, m_n), d1 = simd_dot(oa + ab, m_n);
+    if (d0 * d1 > 0.0f || d0 == d1)
+      return 0;
+
+    const Math::vec_f3 p = oa + ab * (d0 / (d0 - d1));
+    const float r = Math::magnitude(p);
+    if (r < m_r_in || r > m_r_out)
+      return 0;
+
+    rad.L += shade_crossing(p, Math::normalize(ab)) * rad.T;
+    rad.T = 0.0f;
+    return 0;
+  }
+
+  const Math::vec_f3 o = {simd_dot(oa, m_t1), simd_dot(oa, m_t2),
+                          simd_dot(oa, m_n)},
+                     dir = {simd_dot(ab, m_t1), simd_dot(ab, m_t2),
+                            simd_dot(ab, m_n)};
+  const float len = Math::magnitude(dir);
+  if (len <= 0.0f)
+    return 0;
+
+  const Math::vec_f3 dir_n = dir / len;
+  const int32_t dims[3] = {GRID_XY, GRID_XY, GRID_Z};
+
+  // Clip to the grid bounds
+  float t0 = 0.0f, t1 = 1.0f;
+  for (int i = 0; i < 3; i++) {
+    const float lo = m_grid_min[i],
+                hi = m_grid_min[i] + m_cell_size[i] * dims[i];
+    if (std::fabs(dir[i]) < 1e-20f) {
+      if (o[i] < lo || o[i] > hi)
+        return 0;
+      continue;
+    }
+
+    float ta = (lo - o[i]) / dir[i], tb = (hi - o[i]) / dir[i];
+    if (ta > tb)
+      std::swap(ta, tb);
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+  }
+  if (t0 >= t1)
+    return 0;
+
+  /* Amanatides-Woo walk over the occupancy grid */
+  int32_t idx[3], step[3];
+  float t_next[3], t_delta[3];
+  const Math::vec_f3 p0 = o + dir * t0;
+  for (int i = 0; i < 3; i++) {
+    const float cell = (p0[i] - m_grid_min[i]) / m_cell_size[i];
+    idx[i] = std::clamp(static_cast<int32_t>(std::floor(cell)), 0, dims[i] - 1);
+    step[i] = dir[i] >= 0.0f ? 1 : -1;
+    if (std::fabs(dir[i]) < 1e-20f) {
+      t_next[i] = t_delta[i] = std::numeric_limits<float>::infinity();
+      continue;
+    }
+
+    const float edge = m_grid_min[i] + m_cell_size[i] *
+                                           static_cast<float>(idx[i] +
+                                                              (step[i] > 0));
+    t_next[i] = (edge - o[i]) / dir[i];
+    t_delta[i] = m_cell_size[i] / std::fabs(dir[i]);
+  }
+
+  const float min_dt = 1e-3f * m_r_s / len;
+  uint32_t n_steps = 0;
+  float t = t0;
+  while (t < t1) {
+    const int axis = t_next[0] < t_next[1]
+                         ? (t_next[0] < t_next[2] ? 0 : 2)
+                         : (t_next[1] < t_next[2] ? 1 : 2);
+    const float t_exit = std::min(t_next[axis], t1);
+    const float rho_max =
+        m_cell_rho[(static_cast<size_t>(idx[2]) * GRID_XY + idx[1]) * GRID_XY +
+                   idx[0]];
+
+    /* Step length is bounded by the scale height and by the optical depth
+     * the cell could reach at its densest */
+    while (rho_max > 0.0f && t < t_exit) {
+      const Math::vec_f3 p = o + dir * t;
+      const float r = std::max(std::sqrt(p.x * p.x + p.y * p.y), m_r_in);
+      const float ds = std::min(config.step_scale * m_h_r * r,
+                                config.max_dtau / (m_kappa * rho_max));
+      const float dt = std::min(std::max(ds / len, min_dt), t_exit - t);
+
+      const Math::vec_f3 p_mid = o + dir * (t + 0.5f * dt);
+      const float rho = get_density(p_mid);
+      if (rho > 0.0f) {
+        const float trans = std::exp(-m_kappa * rho * dt * len);
+        rad.L += get_emission(p_mid, dir_n) * (rad.T * (1.0f - trans));
+        rad.T *= trans;
+      }
+
+      t += dt;
+      if (++n_steps >= config.max_steps ||
+          rad.T < config.min_transmittance)
+        return n_steps;
+    }
+
+    t = t_exit;
+    idx[axis] += step[axis];
+    if (idx[axis] < 0 || idx[axis] >= dims[axis])
+      break;
+    t_next[axis] += t_delta[axis];
+  }
+
+  return n_steps;
+}
+
+float Disk_Volume::get_density(const Math::vec_f3 &p_local) const {
+  const float r = std::sqrt(p_local.x * p_local.x + p_local.y * p_local.y);
+  if (r < m_r_in || r > m_r_out)
+    return 0.0f;
+
+  const float h = m_h_r * r;
+  return std::pow(m_r_in / r, 1.5f) *
+         std::exp(-p_local.z * p_local.z / (2.0f * h * h));
+}
+
+Math::vec_f3 Disk_Volume::get_emission(const Math::vec_f3 &p_local,
+                                       const Math::vec_f3 &d_local) const {
+  const float r_cyl = std::sqrt(p_local.x * p_local.x + p_local.y * p_local.y),
+              r = Math::magnitude(p_local);
+  if (r_cyl <= 0.0f || r <= m_r_s)
+    return Math::vec_f3{0.0f, 0.0f, 0.0f};
+
+  /* Thin disk temperature, normalised so the peak at 49/36 r_in is t_max */
+  const auto profile = [&](const float x) {
+    const float k = m_r_in / x;
+    return std::pow(k, 0.75f) * std::pow(std::max(1.0f - std::sqrt(k), 0.0f),
+                                         0.25f);
+  };
+  const float temp = m_t_max * profile(r_cyl) / profile(49.0f / 36.0f * m_r_in);
+
+  // Circular orbit speed seen by a static observer, in units of c
+  const float v = std::min(std::sqrt(m_r_s / (2.0f * (r - m_r_s))), 0.99f);
+  const Math::vec_f3 beta =
+      Math::vec_f3{-p_local.y, p_local.x, 0.0f} * (v / r_cyl);
+  const float gamma = 1.0f / std::sqrt(1.0f - v * v);
+  const float doppler = 1.0f / (gamma * (1.0f + simd_dot(beta, d_local)));
+  const float g = doppler * std::sqrt(std::max(1.0f - m_r_s / r, 0.0f));
+
+  const float t_obs = g * temp;
+  const float intensity = m_brightness * std::pow(t_obs / m_t_max, 4.0f);
+  return get_blackbody_col(t_obs) * intensity;
+}
+
+void Disk_Volume::build_grid() {
+  const float z_max = 3.0f * m_h_r * m_r_out;
+  m_grid_min = Math::vec_f3{-m_r_out, -m_r_out, -z_max};
+  m_cell_size = Math::vec_f3{2.0f * m_r_out / GRID_XY,
+                             2.0f * m_r_out / GRID_XY, 2.0f * z_max / GRID_Z};
+  m_cell_rho.assign(static_cast<size_t>(GRID_XY) * GRID_XY * GRID_Z, 0.0f);
+
+  /* Density falls off with r and |z|, so the nearest point of each cell
+   * bounds it from above. The scale height grows with r, use the far edge */
+  for (uint32_t z = 0; z < GRID_Z; z++)
+    for (uint32_t y = 0; y < GRID_XY; y++)
+      for (uint32_t x = 0; x < GRID_XY; x++) {
+        const Math::vec_f3 lo = m_grid_min + m_cell_size * Math::vec_f3{
+                                                 static_cast<float>(x),
+                                                 static_cast<float>(y),
+                                                 static_cast<float>(z)},
+                           hi = lo + m_cell_size;
+        const float dx = std::max({lo.x, -hi.x, 0.0f}),
+                    dy = std::max({lo.y, -hi.y, 0.0f});
+        const float fx = std::max(std::fabs(lo.x), std::fabs(hi.x)),
+                    fy = std::max(std::fabs(lo.y), std::fabs(hi.y));
+        const float r_near = std::sqrt(dx * dx + dy * dy),
+                    r_far = std::sqrt(fx * fx + fy * fy);
+        if (r_near > m_r_out || r_far < m_r_in)
+          continue;
+
+        const float z_near =
+            lo.z <= 0.0f && hi.z >= 0.0f
+                ? 0.0f
+                : std::min(std::fabs(lo.z), std::fabs(hi.z));
+        const float h = m_h_r * std::min(r_far, m_r_out);
+        const float rho = std::pow(m_r_in / std::max(r_near, m_r_in), 1.5f) *
+                          std::exp(-z_near * z_near / (2.0f * h * h));
+        if (rho > 1e-4f)
+          m_cell_rho[(static_cast<size_t>(z) * GRID_XY + y) * GRID_XY + x] =
+              rho;
+      }
+}
+
+} // namespace CTNM::CPU
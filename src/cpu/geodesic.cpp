@@ -0,0 +1,201 @@
+#include "cpu/geodesic.hpp"
+#include "components.hpp"
+#include "cpu/ray.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+Geodesic_Params make_geodesic_params(const Components::Black_Hole &hole,
+                                     const Components::Transform &transform) {
+  Geodesic_Params params;
+  params.center = transform.p;
+  params.disk_n = Math::normalize(hole.disk_n);
+  params.r_s = hole.r_s;
+  params.disk_r_in = hole.disk_r_in * hole.r_s;
+  params.disk_r_out = hole.disk_r_out * hole.r_s;
+  params.r_escape = std::max(100.0f * hole.r_s, 2.0f * params.disk_r_out);
+  return params;
+}
+
+template <typename V>
+static inline void get_accel(const V x[3], const V &h2, const float r_s,
+                             V a[3]) {
+  const V r2 = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+  const V inv_r = simd_rsqrt(r2);
+  const V inv_r2 = inv_r * inv_r;
+  const V k = h2 * (-1.5f * r_s) * inv_r2 * inv_r2 * inv_r;
+  for (int i = 0; i < 3; i++)
+    a[i] = x[i] * k;
+}
+
+template <uint32_t W>
+void init_geodesics(const Geodesic_Params &params, Geodesic_Packet<W> &rays,
+                    const Math::vec_f3 *o, const Math::vec_f3 *d,
+                    const typename Packet_Traits<W>::vint &active) {
+  using vint = typename Packet_Traits<W>::vint;
+
+  for (uint32_t lane = 0; lane < W; lane++) {
+    const Math::vec_f3 x = o[lane] - params.center,
+                       v = Math::normalize(d[lane]);
+    const Math::vec_f3 l = simd_cross(x, v);
+    for (int i = 0; i < 3; i++) {
+      rays.x[i][lane] = x[i];
+      rays.v[i][lane] = v[i];
+    }
+    rays.h2[lane] = simd_dot(l, l);
+    rays.step[lane] = 0.1f * Math::magnitude(x);
+  }
+
+  rays.active = active;
+  rays.end = splat<vint>(static_cast<int32_t>(Geodesic_End::None));
+  rays.n_steps = vint{};
+  rays.n_rejects = vint{};
+  for (int i = 0; i < 3; i++)
+    rays.disk_p[i] = typename Packet_Traits<W>::vfloat{};
+}
+
+template <uint32_t W>
+typename Packet_Traits<W>::vint
+step_geodesics(const Geodesic_Params &params, Geodesic_Packet<W> &rays,
+               typename Packet_Traits<W>::vfloat seg_start[3]) {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  const vfloat r = simd_sqrt(rays.x[0] * rays.x[0] + rays.x[1] * rays.x[1] +
+                             rays.x[2] * rays.x[2]);
+  const vfloat h = simd_min(rays.step, r * 0.5f);
+
+  /* Bogacki–Shampine stages over (x, v) */
+  vfloat k1_v[3], k2_x[3], k2_v[3], k3_x[3], k3_v[3], k4_v[3], tmp[3];
+  get_accel(rays.x, rays.h2, params.r_s, k1_v);
+
+  for (int i = 0; i < 3; i++)
+    tmp[i] = rays.x[i] + rays.v[i] * (h * 0.5f);
+  for (int i = 0; i < 3; i++)
+    k2_x[i] = rays.v[i] + k1_v[i] * (h * 0.5f);
+  get_accel(tmp, rays.h2, params.r_s, k2_v);
+
+  for (int i = 0; i < 3; i++)
+    tmp[i] = rays.x[i] + k2_x[i] * (h * 0.75f);
+  for (int i = 0; i < 3; i++)
+    k3_x[i] = rays.v[i] + k2_v[i] * (h * 0.75f);
+  get_accel(tmp, rays.h2, params.r_s, k3_v);
+
+  vfloat x1[3], v1[3];
+  for (int i = 0; i < 3; i++) {
+    x1[i] = rays.x[i] + h * (rays.v[i] * (2.0f / 9.0f) +
+                             k2_x[i] * (1.0f / 3.0f) + k3_x[i] * (4.0f / 9.0f));
+    v1[i] = rays.v[i] + h * (k1_v[i] * (2.0f / 9.0f) + k2_v[i] * (1.0f / 3.0f) +
+                             k3_v[i] * (4.0f / 9.0f));
+  }
+  get_accel(x1, rays.h2, params.r_s, k4_v);
+
+  // Difference to the embedded second order solution
+  vfloat err_x = vfloat{}, err_v = vfloat{};
+  for (int i = 0; i < 3; i++) {
+    const vfloat ex = h * (rays.v[i] * (2.0f / 9.0f - 7.0f / 24.0f) +
+                           k2_x[i] * (1.0f / 3.0f - 1.0f / 4.0f) +
+                           k3_x[i] * (4.0f / 9.0f - 1.0f / 3.0f) -
+                           v1[i] * (1.0f / 8.0f)),
+                 ev = h * (k1_v[i] * (2.0f / 9.0f - 7.0f / 24.0f) +
+                           k2_v[i] * (1.0f / 3.0f - 1.0f / 4.0f) +
+                           k3_v[i] * (4.0f / 9.0f - 1.0f / 3.0f) -
+                           k4_v[i] * (1.0f / 8.0f));
+    err_x += ex * ex;
+    err_v += ev * ev;
+  }
+
+  const vfloat err = simd_max(simd_sqrt(err_x) /
+                                  (simd_max(r, splat<vfloat>(params.r_s)) *
+                                   params.tol),
+                              simd_sqrt(err_v) / params.tol);
+  const vint accept = rays.active & (err <= 1.0f);
+  const auto end_code = [](const Geodesic_End end) {
+    return splat<vint>(static_cast<int32_t>(end));
+  };
+
+  /* Standard controller, 0.9 (1 / err)^(1 / 3) clamped to [0.2, 4]. A
+   * non-finite error is a rejection like any other and shrinks the step */
+  vfloat factor;
+  for (uint32_t lane = 0; lane < W; lane++)
+    factor[lane] = !std::isfinite(err[lane]) ? 0.2f
+                   : err[lane] > 0.0f ? 0.9f * std::cbrt(1.0f / err[lane])
+                                      : 4.0f;
+  rays.step = h * simd_clamp(factor, 0.2f, 4.0f);
+
+  // Lanes that cannot find an acceptable step end rather than spin
+  rays.n_rejects = select(accept, rays.n_rejects + 1, vint{});
+  const vint stuck =
+      rays.active & ~accept &
+      (rays.n_rejects >= static_cast<int32_t>(params.max_rejects));
+  rays.end = select(stuck, rays.end, end_code(Geodesic_End::Max_Steps));
+  rays.active = rays.active & ~stuck;
+
+  if (!simd_any(accept))
+    return accept;
+
+  for (int i = 0; i < 3; i++) {
+    seg_start[i] = rays.x[i];
+    rays.x[i] = simd_select(rays.x[i], x1[i], accept);
+    rays.v[i] = simd_select(rays.v[i], v1[i], accept);
+  }
+  rays.n_steps = rays.n_steps - accept; // Accepted lanes hold -1
+
+  /* Termination, first matching condition wins */
+  const vfloat r1 = simd_sqrt(rays.x[0] * rays.x[0] + rays.x[1] * rays.x[1] +
+                              rays.x[2] * rays.x[2]);
+  const vfloat d0 = seg_start[0] * params.disk_n.x +
+                    seg_start[1] * params.disk_n.y +
+                    seg_start[2] * params.disk_n.z,
+               d1 = rays.x[0] * params.disk_n.x + rays.x[1] * params.disk_n.y +
+                    rays.x[2] * params.disk_n.z;
+  const vfloat s = d0 / (d0 - d1);
+  vfloat p[3], p_r2 = vfloat{};
+  for (int i = 0; i < 3; i++) {
+    p[i] = seg_start[i] + (rays.x[i] - seg_start[i]) * s;
+    p_r2 += p[i] * p[i];
+  }
+  const vfloat p_r = simd_sqrt(p_r2);
+  const vfloat radial = rays.x[0] * rays.v[0] + rays.x[1] * rays.v[1] +
+                        rays.x[2] * rays.v[2];
+
+  const vint horizon = accept & (r1 <= params.r_s);
+  const vint disk = accept & ~horizon & (d0 * d1 <= 0.0f) & (d0 != d1) &
+                    (p_r >= params.disk_r_in) & (p_r <= params.disk_r_out);
+  const vint escape = accept & ~horizon & ~disk & (r1 >= params.r_escape) &
+                      (radial > 0.0f);
+  const vint max_steps =
+      accept & ~horizon & ~disk & ~escape &
+      (rays.n_steps >= static_cast<int32_t>(params.max_steps));
+
+  rays.end = select(horizon, rays.end, end_code(Geodesic_End::Horizon));
+  rays.end = select(disk, rays.end, end_code(Geodesic_End::Disk));
+  rays.end = select(escape, rays.end, end_code(Geodesic_End::Escape));
+  rays.end = select(max_steps, rays.end, end_code(Geodesic_End::Max_Steps));
+  for (int i = 0; i < 3; i++)
+    rays.disk_p[i] = simd_select(rays.disk_p[i], p[i], disk);
+  rays.active = rays.active & ~(horizon | disk | escape | max_steps);
+
+  return accept;
+}
+
+template void init_geodesics<4>(const Geodesic_Params &, Geodesic_Packet<4> &,
+                                const Math::vec_f3 *, const Math::vec_f3 *,
+                                const Packet_Traits<4>::vint &);
+template void init_geodesics<8>(const Geodesic_Params &, Geodesic_Packet<8> &,
+                                const Math::vec_f3 *, const Math::vec_f3 *,
+                                const Packet_Traits<8>::vint &);
+template Packet_Traits<4>::vint
+step_geodesics<4>(const Geodesic_Params &, Geodesic_Packet<4> &,
+                  Packet_Traits<4>::vfloat[3]);
+template Packet_Traits<8>::vint
+step_geodesics<8>(const Geodesic_Params &, Geodesic_Packet<8> &,
+                  Packet_Traits<8>::vfloat[3]);
+
+} // namespace CTNM::CPU
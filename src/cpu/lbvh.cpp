@@ -0,0 +1,221 @@
+#include "cpu/lbvh.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace CTNM::CPU {
+
+constexpr size_t LBVH_GRAIN = 1 << 12;
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+uint64_t get_morton_code(const Math::vec_f3 &p_normalized) {
+  constexpr float scale = static_cast<float>((1u << 21) - 1);
+  const Math::vec_f3 p = simd_clamp(p_normalized, 0.0f, 1.0f) * scale;
+  return expand_bits_21(static_cast<uint64_t>(p.x)) << 2 |
+         expand_bits_21(static_cast<uint64_t>(p.y)) << 1 |
+         expand_bits_21(static_cast<uint64_t>(p.z));
+}
+
+void LBVH::build(Parallel::Thread_Pool &pool,
+                 std::span<const Math::AABB> prim_bounds) {
+  const auto tp_start = std::chrono::steady_clock::now();
+  const size_t n = prim_bounds.size();
+  m_stats = LBVH_Stats{n};
+  m_nodes.clear();
+  m_codes.clear();
+  m_prims.clear();
+  if (n == 0)
+    return;
+
+  /* Morton codes over centroids */
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, LBVH_GRAIN);
+  std::vector<Math::AABB> chunk_bounds(n_chunks);
+  pool.parallel_for(0, n, LBVH_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t chunk) {
+                      Math::AABB bounds;
+                      for (size_t i = b; i < e; i++)
+                        Math::grow(bounds, Math::centroid(prim_bounds[i]));
+                      chunk_bounds[chunk] = bounds;
+                    });
+
+  Math::AABB centroid_bounds;
+  for (const auto &bounds : chunk_bounds)
+    centroid_bounds = Math::merge(centroid_bounds, bounds);
+
+  const Math::vec_f3 extent =
+      simd_max(centroid_bounds.max - centroid_bounds.min,
+               Math::vec_f3{1e-12f, 1e-12f, 1e-12f});
+  m_codes.resize(n);
+  m_prims.resize(n);
+  pool.parallel_for(0, n, LBVH_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t) {
+                      for (size_t i = b; i < e; i++) {
+                        m_codes[i] = get_morton_code(
+                            (Math::centroid(prim_bounds[i]) -
+                             centroid_bounds.min) /
+                            extent);
+                        m_prims[i] = static_cast<uint32_t>(i);
+                      }
+                    });
+
+  const auto tp_morton = std::chrono::steady_clock::now();
+  m_stats.ms_morton = ms_t(tp_morton - tp_start).count();
+
+  Parallel::radix_sort(pool, m_codes, m_prims);
+
+  const auto tp_sort = std::chrono::steady_clock::now();
+  m_stats.ms_sort = ms_t(tp_sort - tp_morton).count();
+
+  m_nodes.assign(2 * n - 1, BVH_Node{});
+  emit_hierarchy(pool);
+
+  const auto tp_hierarchy = std::chrono::steady_clock::now();
+  m_stats.ms_hierarchy = ms_t(tp_hierarchy - tp_sort).count();
+
+  propagate_bounds(pool, prim_bounds);
+
+  const auto tp_end = std::chrono::steady_clock::now();
+  m_stats.ms_bounds = ms_t(tp_end - tp_hierarchy).count();
+  m_stats.ms_total = ms_t(tp_end - tp_start).count();
+}
+
+void LBVH::refit(Parallel::Thread_Pool &pool,
+                 std::span<const Math::AABB> prim_bounds) {
+  if (prim_bounds.size() != m_prims.size()) {
+    build(pool, prim_bounds);
+    return;
+  }
+  if (m_prims.empty())
+    return;
+
+  const auto tp_start = std::chrono::steady_clock::now();
+  propagate_bounds(pool, prim_bounds);
+  m_stats.ms_bounds = m_stats.ms_total =
+      ms_t(std::chrono::steady_clock::now() - tp_start).count();
+  m_stats.ms_morton = m_stats.ms_sort = m_stats.ms_hierarchy = 0.0;
+}
+
+void LBVH::emit_hierarchy(Parallel::Thread_Pool &pool) {
+  const int64_t n = static_cast<int64_t>(m_codes.size());
+  const uint32_t leaf_offset = static_cast<uint32_t>(n - 1);
+  if (n == 1) {
+    m_nodes[0].prim = m_prims[0];
+    return;
+  }
+
+  // Length of the common prefix of sorted keys i and j, duplicate codes are
+  // disambiguated by their sorted position
+  const auto delta = [&](const int64_t i, const int64_t j) -> int {
+    if (j < 0 || j >= n)
+      return -1;
+
+    const uint64_t a = m_codes[i], b = m_codes[j];
+    if (a == b)
+      return 64 + std::countl_zero(static_cast<uint64_t>(i ^ j));
+
+    return std::countl_zero(a ^ b);
+  };
+
+  pool.parallel_for(
+      0, static_cast<size_t>(n - 1), LBVH_GRAIN,
+      [&](const size_t b, const size_t e, const size_t) {
+        for (int64_t i = static_cast<int64_t>(b); i < static_cast<int64_t>(e);
+             i++) {
+          const int64_t d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+          const int delta_min = delta(i, i - d);
+
+          int64_t l_max = 2;
+          while (delta(i, i + l_max * d) > delta_min)
+            l_max *= 2;
+
+          int64_t l = 0;
+          for (int64_t t = l_max / 2; t >= 1; t /= 2)
+            if (delta(i, i + (l + t) * d) > delta_min)
+              l += t;
+
+          const int64_t j = i + l * d;
+          const int delta_node = delta(i, j);
+
+          int64_t s = 0, t = l;
+          do {
+            t = (t + 1) >> 1;
+            if (delta(i, i + (s + t) * d) > delta_node)
+              s += t;
+          } while (t > 1);
+
+          const int64_t split = i + s * d + std::min<int64_t>(d, 0);
+          const uint32_t split_u32 = static_cast<uint32_t>(split);
+          const uint32_t left = std::min(i, j) == split
+                                    ? leaf_offset + split_u32
+                                    : split_u32;
+          const uint32_t right = std::max(i, j) == split + 1
+                                     ? leaf_offset + split_u32 + 1
+                                     : split_u32 + 1;
+
+          BVH_Node &node = m_nodes[i];
+          node.children[0] = left;
+          node.children[1] = right;
+          m_nodes[left].parent = m_nodes[right].parent =
+              static_cast<uint32_t>(i);
+        }
+      });
+
+  pool.parallel_for(0, static_cast<size_t>(n), LBVH_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t) {
+                      for (size_t i = b; i < e; i++)
+                        m_nodes[leaf_offset + i].prim = m_prims[i];
+                    });
+}
+
+void LBVH::propagate_bounds(Parallel::Thread_Pool &pool,
+                            std::span<const Math::AABB> prim_bounds) {
+  const size_t n = m_prims.size();
+  const size_t leaf_offset = n - 1;
+  if (n == 1) {
+    m_nodes[0].bounds = prim_bounds[m_prims[0]];
+    return;
+  }
+
+  // Second child to arrive at a parent merges both bounds and continues up
+  std::vector<std::atomic<uint32_t>> arrivals(n - 1);
+  pool.parallel_for(
+      0, n, LBVH_GRAIN, [&](const size_t b, const size_t e, const size_t) {
+        for (size_t i = b; i < e; i++) {
+          BVH_Node &leaf = m_nodes[leaf_offset + i];
+          leaf.bounds = prim_bounds[leaf.prim];
+
+          uint32_t parent = leaf.parent;
+          while (parent != BVH_INVALID) {
+            if (arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 0)
+              break;
+
+            BVH_Node &node = m_nodes[parent];
+            node.bounds = Math::merge(m_nodes[node.children[0]].bounds,
+                                      m_nodes[node.children[1]].bounds);
+            parent = node.parent;
+          }
+        }
+      });
+}
+
+const std::vector<BVH_Node> &LBVH::get_nodes() const { return m_nodes; }
+
+uint32_t LBVH::get_root() const { return 0; }
+
+const Math::AABB &LBVH::get_bounds() const {
+  static const Math::AABB empty;
+  return m_nodes.empty() ? empty : m_nodes[0].bounds;
+}
+
+const LBVH_Stats &LBVH::get_stats() const { return m_stats; }
+
+} // namespace CTNM::CPU
@@ -0,0 +1,484 @@
+#include "cpu/lens_table.hpp"
+#include "cpu/geodesic.hpp"
+#include "cpu/ray.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <simd/simd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CTNM::CPU {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+constexpr float PI = 3.14159265f;
+constexpr float B_CRIT = 2.59807621f; // 3 sqrt(3) / 2, in r_s
+constexpr uint32_t LENS_GRAIN = 64;
+
+struct Lens_Ray {
+  float r_o, alpha, phi0;
+};
+
+struct Lens_Result {
+  float beta = 0.0f, phi_end = 0.0f;
+  bool captured = false;
+};
+
+uint64_t align_up(const uint64_t x, const uint64_t a) {
+  return (x + a - 1) / a * a;
+}
+
+/* Integrates rays with r_s = 1 in the z = 0 plane, starting at (r_o, 0, 0)
+ * and sampling u = 1 / r at phi0 + k dphi for k < n_phi */
+uint64_t integrate(const Lens_Ray *rays, const size_t n, const float dphi,
+                   const uint32_t n_phi, const float r_far, const float tol,
+                   Lens_Result *results, float *u) {
+  constexpr uint32_t W = 8;
+  using vfloat = Packet_Traits<W>::vfloat;
+  using vint = Packet_Traits<W>::vint;
+
+  Geodesic_Params params;
+  params.disk_r_in = params.disk_r_out = -1.0f; // No disk
+  params.r_escape = r_far;
+  params.tol = tol;
+  params.max_steps = 1 << 14;
+
+  uint64_t n_steps = 0;
+  Geodesic_Packet<W> packet;
+  Math::vec_f3 o[W], d[W];
+  vfloat seg_start[3];
+  for (size_t first = 0; first < n; first += W) {
+    vint active;
+    float phi[W];
+    uint32_t k[W];
+    for (uint32_t lane = 0; lane < W; lane++) {
+      const Lens_Ray &ray = rays[std::min(first + lane, n - 1)];
+      o[lane] = Math::vec_f3{ray.r_o, 0.0f, 0.0f};
+      d[lane] = Math::vec_f3{-std::cos(ray.alpha), std::sin(ray.alpha), 0.0f};
+      active[lane] = first + lane < n ? -1 : 0;
+      phi[lane] = 0.0f;
+      k[lane] = 0;
+    }
+    init_geodesics<W>(params, packet, o, d, active);
+
+    for (uint32_t lane = 0; lane < W && first + lane < n; lane++)
+      for (; k[lane] < n_phi && rays[first + lane].phi0 + k[lane] * dphi <= 0;
+           k[lane]++)
+        u[(first + lane) * n_phi + k[lane]] = 1.0f / rays[first + lane].r_o;
+
+    while (simd_any(packet.active)) {
+      const vint accepted = step_geodesics<W>(params, packet, seg_start);
+      for (uint32_t lane = 0; lane < W; lane++) {
+        if (!accepted[lane])
+          continue;
+
+        const Math::vec_f3 s = {seg_start[0][lane], seg_start[1][lane],
+                                seg_start[2][lane]},
+                           x = {packet.x[0][lane], packet.x[1][lane],
+                                packet.x[2][lane]};
+        const float d_phi = std::atan2(s.x * x.y - s.y * x.x, simd_dot(s, x)),
+                    phi_new = phi[lane] + d_phi,
+                    u0 = 1.0f / Math::magnitude(s),
+                    u1 = 1.0f / Math::magnitude(x);
+
+        const float phi0 = rays[first + lane].phi0;
+        float *row = u + (first + lane) * n_phi;
+        for (; k[lane] < n_phi; k[lane]++) {
+          const float target = phi0 + k[lane] * dphi;
+          if (target > phi_new)
+            break;
+
+          const float t = d_phi > 0.0f ? (target - phi[lane]) / d_phi : 1.0f;
+          row[k[lane]] = u0 + (u1 - u0) * t;
+        }
+        phi[lane] = phi_new;
+      }
+    }
+
+    for (uint32_t lane = 0; lane < W && first + lane < n; lane++) {
+      Lens_Result &result = results[first + lane];
+      result.captured = packet.end[lane] !=
+                        static_cast<int32_t>(Geodesic_End::Escape);
+      result.phi_end = phi[lane];
+      for (float *row = u + (first + lane) * n_phi; k[lane] < n_phi; k[lane]++)
+        row[k[lane]] = result.captured ? 1.0f : 0.0f;
+
+      // Unwrapped direction, swept angle plus the local angle off radial
+      if (!result.captured) {
+        const Math::vec_f3 x = Math::normalize(Math::vec_f3{
+            packet.x[0][lane], packet.x[1][lane], packet.x[2][lane]});
+        const Math::vec_f3 v = {packet.v[0][lane], packet.v[1][lane],
+                                packet.v[2][lane]};
+        result.beta = phi[lane] + std::atan2(x.x * v.y - x.y * v.x,
+                                             simd_dot(x, v));
+      }
+      n_steps += static_cast<uint64_t>(packet.n_steps[lane]);
+    }
+  }
+
+  return n_steps;
+}
+
+} // namespace
+
+Lens_Table::~Lens_Table() { unmap(); }
+
+void Lens_Table::build(Parallel::Thread_Pool &pool,
+                       const Lens_Table_Config &config) {
+  if (config.n_r < 2 || config.n_alpha < 2 || config.n_phi < 2)
+    throw std::runtime_error("Failed: Lens_Table, need 2+ samples per axis");
+  if (config.r_min <= 1.5f || config.r_max <= config.r_min)
+    throw std::runtime_error("Failed: Lens_Table, bad observer range");
+
+  const auto tp_start = std::chrono::steady_clock::now();
+
+  Lens_Table_Header header;
+  header.n_r = config.n_r;
+  header.n_alpha = config.n_alpha;
+  header.n_phi = config.n_phi;
+  header.r_min = config.r_min;
+  header.r_max = config.r_max;
+  header.r_far = 2.0f * config.r_max;
+  header.phi_max = config.phi_max;
+
+  const uint64_t n_entries = static_cast<uint64_t>(config.n_r) * config.n_alpha;
+  header.beta_offset = align_up(sizeof(Lens_Table_Header), 64);
+  header.phi_end_offset =
+      align_up(header.beta_offset + n_entries * sizeof(float), 64);
+  header.u_offset =
+      align_up(header.phi_end_offset + n_entries * sizeof(float), 64);
+  header.fate_offset = align_up(
+      header.u_offset + n_entries * config.n_phi * sizeof(uint16_t), 64);
+  header.bytes = align_up(header.fate_offset + n_entries, 64);
+
+  unmap();
+  m_storage.assign(header.bytes, std::byte{0});
+  std::memcpy(m_storage.data(), &header, sizeof(header));
+
+  float *beta =
+      reinterpret_cast<float *>(m_storage.data() + header.beta_offset);
+  float *phi_end =
+      reinterpret_cast<float *>(m_storage.data() + header.phi_end_offset);
+  uint16_t *u_q =
+      reinterpret_cast<uint16_t *>(m_storage.data() + header.u_offset);
+  uint8_t *fate =
+      reinterpret_cast<uint8_t *>(m_storage.data() + header.fate_offset);
+
+  const float log_r = std::log(config.r_max / config.r_min),
+              dphi = config.phi_max / static_cast<float>(config.n_phi - 1);
+  std::atomic<uint64_t> n_steps = 0;
+  pool.parallel_for(
+      0, n_entries, LENS_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        std::vector<Lens_Ray> rays(e - b);
+        for (size_t i = b; i < e; i++) {
+          const uint32_t ri = static_cast<uint32_t>(i / config.n_alpha),
+                         ai = static_cast<uint32_t>(i % config.n_alpha);
+          rays[i - b] = Lens_Ray{
+              config.r_min *
+                  std::exp(log_r * static_cast<float>(ri) / (config.n_r - 1)),
+              PI * static_cast<float>(ai) / (config.n_alpha - 1), 0.0f};
+        }
+
+        std::vector<Lens_Result> results(e - b);
+        std::vector<float> u((e - b) * config.n_phi);
+        n_steps.fetch_add(integrate(rays.data(), rays.size(), dphi,
+                                    config.n_phi, header.r_far, config.tol,
+                                    results.data(), u.data()),
+                          std::memory_order_relaxed);
+
+        for (size_t i = b; i < e; i++) {
+          beta[i] = results[i - b].beta;
+          phi_end[i] = results[i - b].phi_end;
+          fate[i] = results[i - b].captured ? 1 : 0;
+        }
+        for (size_t i = 0; i < u.size(); i++)
+          u_q[b * config.n_phi + i] = static_cast<uint16_t>(
+              std::lround(std::clamp(u[i], 0.0f, 1.0f) * 65535.0f));
+      });
+
+  bind(m_storage.data(), m_storage.size());
+  m_stats.n_steps = n_steps.load();
+  m_stats.ms_build =
+      ms_t(std::chrono::steady_clock::now() - tp_start).count();
+}
+
+void Lens_Table::save(const std::filesystem::path &path) const {
+  if (empty())
+    throw std::runtime_error("Failed: Lens_Table, nothing to save");
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(m_header),
+             static_cast<std::streamsize>(m_header->bytes));
+  if (!file)
+    throw std::runtime_error("Failed: could not write " + path.string());
+}
+
+void Lens_Table::load(const std::filesystem::path &path) {
+  const auto tp_start = std::chrono::steady_clock::now();
+  unmap();
+  m_storage.clear();
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed: could not open " + path.string());
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Lens_Table_Header)) {
+    close(fd);
+    throw std::runtime_error("Failed: truncated lens table " + path.string());
+  }
+
+  void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                   MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("Failed: could not map " + path.string());
+
+  m_map = map;
+  m_map_bytes = static_cast<size_t>(st.st_size);
+  bind(static_cast<const std::byte *>(map), m_map_bytes);
+  m_stats.ms_load = ms_t(std::chrono::steady_clock::now() - tp_start).count();
+}
+
+bool Lens_Table::empty() const { return m_header == nullptr; }
+
+const Lens_Table_Header &Lens_Table::get_header() const { return *m_header; }
+
+const Lens_Table_Stats &Lens_Table::get_stats() const { return m_stats; }
+
+Lens_Sample Lens_Table::lookup(const float r_o, const float alpha) const {
+  const Lens_Table_Header &h = *m_header;
+  const float fr = std::clamp(std::log(r_o / h.r_min) /
+                                  std::log(h.r_max / h.r_min),
+                              0.0f, 1.0f) *
+                   static_cast<float>(h.n_r - 1),
+              fa = std::clamp(alpha / PI, 0.0f, 1.0f) *
+                   static_cast<float>(h.n_alpha - 1);
+  const uint32_t r0 = std::min(static_cast<uint32_t>(fr), h.n_r - 2),
+                 a0 = std::min(static_cast<uint32_t>(fa), h.n_alpha - 2);
+  const float tr = fr - static_cast<float>(r0),
+              ta = fa - static_cast<float>(a0);
+
+  /* h = |x × v| is conserved but |v| is not, so the impact parameter at
+   * infinity follows from |v_inf|^2 = 1 - h^2 / r_o^3 */
+  Lens_Sample sample;
+  const float h2 = r_o * r_o * std::sin(alpha) * std::sin(alpha),
+              v_inf2 = 1.0f - h2 / (r_o * r_o * r_o);
+  sample.b = v_inf2 > 0.0f ? std::sqrt(h2 / v_inf2)
+                           : std::numeric_limits<float>::infinity();
+  sample.captured = alpha < 0.5f * PI && sample.b < B_CRIT;
+  sample.entry[0] = r0 * h.n_alpha + a0;
+  sample.entry[1] = sample.entry[0] + 1;
+  sample.entry[2] = sample.entry[0] + h.n_alpha;
+  sample.entry[3] = sample.entry[2] + 1;
+  sample.w[0] = (1.0f - tr) * (1.0f - ta);
+  sample.w[1] = (1.0f - tr) * ta;
+  sample.w[2] = tr * (1.0f - ta);
+  sample.w[3] = tr * ta;
+
+  /* Blending across the capture boundary is meaningless, so only corners
+   * sharing the analytic fate contribute */
+  float w_sum = 0.0f;
+  for (int i = 0; i < 4; i++)
+    w_sum += (m_fate[sample.entry[i]] != 0) == sample.captured ? sample.w[i]
+                                                                : 0.0f;
+  if (w_sum > 0.0f)
+    for (int i = 0; i < 4; i++)
+      sample.w[i] = (m_fate[sample.entry[i]] != 0) == sample.captured
+                        ? sample.w[i] / w_sum
+                        : 0.0f;
+
+  for (int i = 0; i < 4; i++) {
+    sample.beta += sample.w[i] * m_beta[sample.entry[i]];
+    sample.phi_end += sample.w[i] * m_phi_end[sample.entry[i]];
+  }
+
+  return sample;
+}
+
+float Lens_Table::get_radius(const Lens_Sample &sample,
+                             const float phi) const {
+  const Lens_Table_Header &h = *m_header;
+  if (phi < 0.0f || phi >= sample.phi_end || phi >= h.phi_max)
+    return sample.captured ? 1.0f : std::numeric_limits<float>::infinity();
+
+  const float fk = phi / h.phi_max * static_cast<float>(h.n_phi - 1);
+  const uint32_t k0 = std::min(static_cast<uint32_t>(fk), h.n_phi - 2);
+  const float t = fk - static_cast<float>(k0);
+
+  float u = 0.0f;
+  for (int i = 0; i < 4; i++) {
+    const uint16_t *row = m_u + static_cast<size_t>(sample.entry[i]) * h.n_phi;
+    u += sample.w[i] * (row[k0] + (row[k0 + 1] - row[k0]) * t);
+  }
+
+  u /= 65535.0f;
+  return u > 0.0f ? 1.0f / u : std::numeric_limits<float>::infinity();
+}
+
+Lens_Table_Error Lens_Table::measure_error(Parallel::Thread_Pool &pool,
+                                           const size_t n_samples,
+                                           const uint32_t seed) const {
+  if (empty() || n_samples == 0)
+    return Lens_Table_Error{};
+
+  const Lens_Table_Header &h = *m_header;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<Lens_Ray> rays(n_samples);
+  for (Lens_Ray &ray : rays)
+    ray = Lens_Ray{h.r_min * std::pow(h.r_max / h.r_min, unit(rng)),
+                   PI * unit(rng), h.phi_max * unit(rng)};
+
+  /* Reference solution, integrated more tightly than the table */
+  std::vector<Lens_Result> direct(n_samples);
+  std::vector<float> direct_u(n_samples);
+  const auto tp_direct = std::chrono::steady_clock::now();
+  pool.parallel_for(0, n_samples, LENS_GRAIN,
+                    [&](const size_t b, const size_t e, size_t) {
+                      integrate(rays.data() + b, e - b, 0.0f, 1, h.r_far,
+                                1e-6f, direct.data() + b, direct_u.data() + b);
+                    });
+  const double ms_direct =
+      ms_t(std::chrono::steady_clock::now() - tp_direct).count();
+
+  std::vector<Lens_Sample> samples(n_samples);
+  std::vector<float> radii(n_samples);
+  const auto tp_lookup = std::chrono::steady_clock::now();
+  pool.parallel_for(0, n_samples, LENS_GRAIN,
+                    [&](const size_t b, const size_t e, size_t) {
+                      for (size_t i = b; i < e; i++) {
+                        samples[i] = lookup(rays[i].r_o, rays[i].alpha);
+                        radii[i] = get_radius(samples[i], rays[i].phi0);
+                      }
+                    });
+  const double ms_lookup =
+      ms_t(std::chrono::steady_clock::now() - tp_lookup).count();
+
+  Lens_Table_Error error;
+  error.n_samples = n_samples;
+  error.ns_lookup = ms_lookup * 1e6 / static_cast<double>(n_samples);
+  error.ns_integrate = ms_direct * 1e6 / static_cast<double>(n_samples);
+
+  std::vector<double> beta_err, radius_err;
+  for (size_t i = 0; i < n_samples; i++) {
+    if (samples[i].captured != direct[i].captured) {
+      error.n_fate_mismatch++;
+      continue;
+    }
+
+    if (!direct[i].captured)
+      beta_err.push_back(std::fabs(samples[i].beta - direct[i].beta));
+
+    // Radii only where both solutions are still in flight
+    if (rays[i].phi0 < std::min(samples[i].phi_end, direct[i].phi_end) &&
+        direct_u[i] > 0.0f && std::isfinite(radii[i])) {
+      const double r = 1.0 / direct_u[i];
+      radius_err.push_back(std::fabs(radii[i] - r) / r);
+    }
+  }
+
+  const auto summarise = [](std::vector<double> &err, double &mean,
+                            double &p99, double &max) {
+    if (err.empty())
+      return;
+
+    double sum = 0.0;
+    for (const double e : err)
+      sum += e;
+    mean = sum / static_cast<double>(err.size());
+
+    const size_t i99 = err.size() * 99 / 100;
+    std::nth_element(err.begin(), err.begin() + i99, err.end());
+    p99 = err[i99];
+    max = *std::max_element(err.begin(), err.end());
+  };
+  summarise(beta_err, error.beta_mean, error.beta_p99, error.beta_max);
+  summarise(radius_err, error.radius_mean, error.radius_p99, error.radius_max);
+
+  return error;
+}
+
+/* Offsets come from the file, so every array is checked to lie inside it,
+ * aligned and after the one before */
+void Lens_Table::bind(const std::byte *data, const size_t bytes) {
+  if constexpr (std::endian::native != std::endian::little)
+    throw std::runtime_error("Failed: lens tables need a little endian host");
+  if (bytes < sizeof(Lens_Table_Header))
+    throw std::runtime_error("Failed: truncated lens table");
+
+  const Lens_Table_Header *header =
+      reinterpret_cast<const Lens_Table_Header *>(data);
+  const Lens_Table_Header expected;
+  if (std::memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0)
+    throw std::runtime_error("Failed: not a lens table");
+  if (header->endian == std::byteswap(LENS_TABLE_ENDIAN))
+    throw std::runtime_error("Failed: lens table has foreign byte order");
+  if (header->endian != LENS_TABLE_ENDIAN)
+    throw std::runtime_error("Failed: corrupt lens table");
+  if (header->version != LENS_TABLE_VERSION)
+    throw std::runtime_error("Failed: unsupported lens table version");
+
+  const uint64_t n_entries =
+      static_cast<uint64_t>(header->n_r) * header->n_alpha;
+  bool ok = header->n_r >= 2 && header->n_alpha >= 2 && header->n_phi >= 2 &&
+            header->r_min > 0.0f && header->r_max > header->r_min &&
+            std::isfinite(header->r_max) && header->phi_max > 0.0f &&
+            std::isfinite(header->phi_max) && header->bytes <= bytes;
+
+  // Bytes per entry and alignment of each array
+  const struct {
+    uint64_t offset, entry_bytes, align;
+  } arrays[] = {
+      {header->beta_offset, sizeof(float), alignof(float)},
+      {header->phi_end_offset, sizeof(float), alignof(float)},
+      {header->u_offset, header->n_phi * sizeof(uint16_t), alignof(uint16_t)},
+      {header->fate_offset, sizeof(uint8_t), alignof(uint8_t)}};
+  uint64_t end = sizeof(Lens_Table_Header);
+  for (const auto &array : arrays) {
+    ok = ok && array.offset >= end && array.offset <= header->bytes &&
+         array.offset % array.align == 0 &&
+         n_entries <= (header->bytes - array.offset) / array.entry_bytes;
+    if (ok)
+      end = array.offset + n_entries * array.entry_bytes;
+  }
+  if (!ok)
+    throw std::runtime_error("Failed: corrupt lens table");
+
+  m_header = header;
+  m_beta = reinterpret_cast<const float *>(data + header->beta_offset);
+  m_phi_end = reinterpret_cast<const float *>(data + header->phi_end_offset);
+  m_u = reinterpret_cast<const uint16_t *>(data + header->u_offset);
+  m_fate = reinterpret_cast<const uint8_t *>(data + header->fate_offset);
+  m_stats.bytes = header->bytes;
+}
+
+void Lens_Table::unmap() {
+  if (m_map)
+    munmap(m_map, m_map_bytes);
+
+  m_map = nullptr;
+  m_map_bytes = 0;
+  m_header = nullptr;
+}
+
+} // namespace CTNM::CPU
@@ -0,0 +1,583 @@
+#include "cpu/renderer.hpp"
+#include "components.hpp"
+#include "cpu/disk_volume.hpp"
+#include "cpu/geodesic.hpp"
+#include "cpu/lens_table.hpp"
+#include "cpu/ray.hpp"
+#include "cpu/scene.hpp"
+#include "cpu/star_octree.hpp"
+#include "cpu/star_splat.hpp"
+#include "cpu/traversal.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+/* Pixel footprint of one packet, kept square-ish for coherence */
+template <uint32_t W> struct Packet_Shape;
+template <> struct Packet_Shape<1> {
+  static constexpr uint32_t w = 1, h = 1;
+};
+template <> struct Packet_Shape<4> {
+  static constexpr uint32_t w = 2, h = 2;
+};
+template <> struct Packet_Shape<8> {
+  static constexpr uint32_t w = 4, h = 2;
+};
+template <> struct Packet_Shape<16> {
+  static constexpr uint32_t w = 4, h = 4;
+};
+
+Camera_Basis::Camera_Basis(const Components::Camera &cam, const uint32_t _w,
+                           const uint32_t _h)
+    : p(cam.p), forward(Math::normalize(cam.fp - cam.p)),
+      fl(1.0f / (2.0f * tanf((cam.fov * M_PI / 180.0f) / 2.0f))),
+      aspect(static_cast<float>(_w) / static_cast<float>(_h)),
+      w(static_cast<float>(_w)), h(static_cast<float>(_h)) {
+  const Math::vec_f3 world_up = std::fabs(forward.y) > 0.999f
+                                    ? Math::vec_f3{0.0f, 0.0f, 1.0f}
+                                    : Math::vec_f3{0.0f, 1.0f, 0.0f};
+  right = Math::normalize(simd_cross(world_up, forward));
+  up = simd_cross(forward, right);
+}
+
+Math::vec_f3 Camera_Basis::get_dir(const float x, const float y) const {
+  const float ndc_x = (x + 0.5f) / w * 2.0f - 1.0f,
+              ndc_y = (y + 0.5f) / h * 2.0f - 1.0f;
+  return Math::normalize(forward * fl + right * (ndc_x * aspect * 0.5f) +
+                         up * (-ndc_y * 0.5f));
+}
+
+Math::vec_f4 shade(const Scene &scene, const Hit &hit) {
+  if (!hit.exists())
+    return Math::vec_f4{0.0f, 0.0f, 0.0f, 1.0f};
+
+  const Math::vec_f3 col =
+      simd_clamp(scene.get_instances()[hit.inst].col / 255.0f, 0.0f, 1.0f);
+  return Math::vec_f4{col.x, col.y, col.z, 1.0f};
+}
+
+static float get_depth(const Hit &hit) {
+  return hit.exists() ? hit.t : INFINITY;
+}
+
+/* Calls fn(x, y) for each sample a pass at stride traces in [x0, x1) x
+ * [y0, y1), walking the sample grid in packet shaped blocks. A refining
+ * pass skips samples at even grid positions, the pass before it traced
+ * those at twice the stride, so all passes together trace each pixel once */
+template <uint32_t W, typename Fn>
+static void for_each_sample(const uint32_t x0, const uint32_t y0,
+                            const uint32_t x1, const uint32_t y1,
+                            const uint32_t stride, const bool refine,
+                            Fn &&fn) {
+  constexpr uint32_t pw = Packet_Shape<W>::w, ph = Packet_Shape<W>::h;
+  const uint32_t nx = (x1 - x0 + stride - 1) / stride,
+                 ny = (y1 - y0 + stride - 1) / stride;
+  for (uint32_t sy = 0; sy < ny; sy += ph)
+    for (uint32_t sx = 0; sx < nx; sx += pw)
+      for (uint32_t lane = 0; lane < pw * ph; lane++) {
+        const uint32_t gx = sx + lane % pw, gy = sy + lane / pw;
+        if (gx < nx && gy < ny && !(refine && gx % 2 == 0 && gy % 2 == 0))
+          fn(x0 + gx * stride, y0 + gy * stride);
+      }
+}
+
+/* Fills a stride x stride block clipped to [.., x1) x [.., y1) */
+static void fill_block(Framebuffer &fb, const uint32_t x, const uint32_t y,
+                       const uint32_t x1, const uint32_t y1,
+                       const uint32_t stride, const Math::vec_f4 &col,
+                       const uint32_t n_steps, const float depth) {
+  for (uint32_t by = y; by < std::min(y1, y + stride); by++) {
+    const size_t i = static_cast<size_t>(by) * fb.w + x;
+    std::fill_n(fb.px.begin() + i, std::min(x1, x + stride) - x, col);
+    if (!fb.steps.empty())
+      std::fill_n(fb.steps.begin() + i, std::min(x1, x + stride) - x,
+                  n_steps);
+    if (!fb.depth.empty())
+      std::fill_n(fb.depth.begin() + i, std::min(x1, x + stride) - x, depth);
+  }
+}
+
+Renderer::Renderer(Parallel::Thread_Pool &pool, const uint32_t packet_w)
+    : m_scheduler(pool), m_splatter(pool) {
+  set_packet_width(packet_w);
+}
+
+void Renderer::set_packet_width(const uint32_t packet_w) {
+  if (packet_w != 1 && packet_w != 4 && packet_w != 8 && packet_w != 16)
+    throw std::runtime_error("Failed: Renderer, packet width must be 1/4/8/16");
+
+  m_packet_w = packet_w;
+}
+
+uint32_t Renderer::get_packet_width() const { return m_packet_w; }
+
+void Renderer::set_progressive_levels(const uint32_t levels) {
+  m_levels = std::clamp<uint32_t>(levels, 1, 4);
+}
+
+void Renderer::set_ray_mode(const Ray_Mode mode) { m_mode = mode; }
+
+Ray_Mode Renderer::get_ray_mode() const { return m_mode; }
+
+void Renderer::set_lens_table(const Lens_Table *table) { m_lens_table = table; }
+
+void Renderer::set_step_budget(const float steps_per_ray) {
+  m_step_budget = std::max(steps_per_ray, 1.0f);
+}
+
+const std::vector<float> &Renderer::get_tile_tolerances() const {
+  return m_tile_tol;
+}
+
+void Renderer::set_march_config(const Disk_March_Config &config) {
+  m_march_config = config;
+}
+
+const Disk_March_Config &Renderer::get_march_config() const {
+  return m_march_config;
+}
+
+void Renderer::set_splat_config(const Splat_Config &config) {
+  m_splatter.set_config(config);
+}
+
+const Splat_Stats &Renderer::get_splat_stats() const {
+  return m_splatter.get_stats();
+}
+
+void Renderer::set_star_octree(Star_Octree *octree) {
+  m_star_octree = octree;
+}
+
+Tile_Scheduler &Renderer::get_scheduler() { return m_scheduler; }
+
+const Render_Stats &Renderer::get_stats() const { return m_stats; }
+
+void Renderer::render(const Scene &scene, const Components::Camera &cam,
+                      Framebuffer &fb) {
+  if (fb.w == 0 || fb.h == 0)
+    return;
+
+  const Camera_Basis basis(cam, fb.w, fb.h);
+  const bool star_lod = m_star_octree && !m_star_octree->empty();
+  const Star_Points &stars = scene.get_stars();
+  fb.depth.assign(stars.empty() && !star_lod ? 0 : fb.px.size(), INFINITY);
+  uint64_t n_steps = 0;
+  m_march_steps = 0;
+  if (m_mode == Ray_Mode::Geodesic && !scene.get_lenses().empty())
+    n_steps = render_geodesic(scene, basis, fb);
+  else if (m_mode == Ray_Mode::Table && !scene.get_lenses().empty() &&
+           m_lens_table && !m_lens_table->empty())
+    m_scheduler.run(fb.w, fb.h, m_levels,
+                    [&](const Tile &tile, const uint32_t pass) {
+                      return render_lensed_region(
+                          scene, scene.get_lenses().front(),
+                          scene.get_disks().front(), basis, fb, tile,
+                          1u << (m_levels - 1 - pass), pass > 0);
+                    });
+  else
+    m_scheduler.run(fb.w, fb.h, m_levels,
+                    [&](const Tile &tile, const uint32_t pass) {
+                      return render_region(scene, basis, fb, tile.x0, tile.y0,
+                                           tile.x1, tile.y1,
+                                           1u << (m_levels - 1 - pass),
+                                           pass > 0);
+                    });
+
+  const Tile_Frame_Stats &tile_stats = m_scheduler.get_stats();
+  m_stats = Render_Stats{tile_stats.n_rays,
+                         n_steps,
+                         m_march_steps.load(),
+                         static_cast<uint64_t>(fb.w) * fb.h,
+                         tile_stats.n_passes,
+                         tile_stats.cut_off,
+                         tile_stats.ms};
+
+  // Unresolved stars go on last, only where the sky shows through
+  if (star_lod) {
+    m_star_cut.clear();
+    m_star_cut.append(stars);
+    m_star_octree->select(basis, m_star_cut);
+    m_splatter.splat(m_star_cut, basis, fb);
+  } else if (!stars.empty())
+    m_splatter.splat(stars, basis, fb);
+}
+
+Math::vec_f4 Renderer::composite_disks(const Scene &scene,
+                                       const Math::vec_f3 &o,
+                                       const Math::vec_f3 &d, const Hit &hit,
+                                       uint32_t &n_steps) const {
+  const Math::vec_f4 behind = shade(scene, hit);
+  if (scene.get_disks().empty())
+    return behind;
+
+  const Math::vec_f3 a = o + d * RAY_T_MIN,
+                     b = o + d * (hit.exists() ? hit.t : RAY_T_MAX);
+  Disk_Radiance rad;
+  for (const Disk_Volume &disk : scene.get_disks())
+    n_steps += disk.march(a, b, m_march_config, rad);
+
+  m_march_steps.fetch_add(n_steps, std::memory_order_relaxed);
+  return rad.composite(behind);
+}
+
+uint64_t Renderer::render_region(const Scene &scene,
+                                 const Camera_Basis &basis, Framebuffer &fb,
+                                 const uint32_t x0, const uint32_t y0,
+                                 const uint32_t x1, const uint32_t y1,
+                                 const uint32_t stride,
+                                 const bool refine) const {
+  switch (m_packet_w) {
+  case 4:
+    return render_region<4>(scene, basis, fb, x0, y0, x1, y1, stride, refine);
+  case 8:
+    return render_region<8>(scene, basis, fb, x0, y0, x1, y1, stride, refine);
+  case 16:
+    return render_region<16>(scene, basis, fb, x0, y0, x1, y1, stride,
+                             refine);
+  default:
+    break;
+  }
+
+  uint64_t n_rays = 0;
+  for_each_sample<1>(x0, y0, x1, y1, stride, refine,
+                     [&](const uint32_t x, const uint32_t y) {
+                       const Math::vec_f3 d = basis.get_dir(x, y);
+                       const Hit hit = trace(scene, make_ray(basis.p, d));
+                       uint32_t n_steps = 0;
+                       const Math::vec_f4 col =
+                           composite_disks(scene, basis.p, d, hit, n_steps);
+                       fill_block(fb, x, y, x1, y1, stride, col, n_steps,
+                                  get_depth(hit));
+                       n_rays++;
+                     });
+
+  return n_rays;
+}
+
+uint64_t Renderer::render_geodesic(const Scene &scene,
+                                   const Camera_Basis &basis,
+                                   Framebuffer &fb) {
+  // Thick disks are marched, so rays must pass through the midplane
+  Geodesic_Params lens = scene.get_lenses().front();
+  if (scene.get_disks().front().is_thick())
+    lens.disk_r_in = lens.disk_r_out = -1.0f;
+
+  const uint32_t tile_size = m_scheduler.get_tile_size(),
+                 tiles_x = (fb.w + tile_size - 1) / tile_size,
+                 tiles_y = (fb.h + tile_size - 1) / tile_size;
+  if (m_tile_tol.size() != static_cast<size_t>(tiles_x) * tiles_y)
+    m_tile_tol.assign(static_cast<size_t>(tiles_x) * tiles_y, lens.tol);
+
+  std::atomic<uint64_t> n_steps = 0;
+  m_scheduler.run(
+      fb.w, fb.h, m_levels, [&](const Tile &tile, const uint32_t pass) {
+        const size_t i = static_cast<size_t>(tile.y0 / tile_size) * tiles_x +
+                         tile.x0 / tile_size;
+        Geodesic_Params params = lens;
+        params.tol = m_tile_tol[i];
+
+        const uint32_t stride = 1u << (m_levels - 1 - pass);
+        const Geodesic_Tally tally =
+            m_packet_w >= 8
+                ? render_geodesic_region<8>(scene, params, basis, fb, tile,
+                                            stride, pass > 0)
+                : render_geodesic_region<4>(scene, params, basis, fb, tile,
+                                            stride, pass > 0);
+        n_steps.fetch_add(tally.n_steps, std::memory_order_relaxed);
+
+        /* Steps scale as tol^(-1/3) for a third order method, so steer the
+         * tolerance for the next frame by the cube of the overshoot */
+        if (pass == m_levels - 1 && tally.n_rays > 0) {
+          const float avg = static_cast<float>(tally.n_steps) /
+                            static_cast<float>(tally.n_rays);
+          const float k = std::pow(avg / m_step_budget, 3.0f);
+          m_tile_tol[i] = std::clamp(m_tile_tol[i] * std::clamp(k, 0.5f, 2.0f),
+                                     1e-5f, 1e-1f);
+        }
+
+        return tally.n_rays;
+      });
+
+  return n_steps.load();
+}
+
+/* Table lookup path. The orbit stays in the plane spanned by e1 (hole to
+ * camera) and e2; scene geometry is traced along the incoming ray up to
+ * closest approach and along the outgoing asymptote, both straight. depth
+ * is infinite only when the ray escapes to the sky */
+static Math::vec_f4 trace_lensed(const Scene &scene,
+                                 const Geodesic_Params &lens,
+                                 const Disk_Volume &disk,
+                                 const Lens_Table &table,
+                                 const Math::vec_f3 &o, const Math::vec_f3 &d,
+                                 float &depth) {
+  depth = 0.0f;
+  const Math::vec_f3 x = o - lens.center;
+  const float r = Math::magnitude(x);
+  const Math::vec_f3 e1 = x / r;
+  const float cos_a = std::clamp(-simd_dot(d, e1), -1.0f, 1.0f);
+
+  Math::vec_f3 perp = d + e1 * cos_a;
+  if (simd_dot(perp, perp) < 1e-12f)
+    perp = simd_cross(e1, std::fabs(e1.x) < 0.9f
+                              ? Math::vec_f3{1.0f, 0.0f, 0.0f}
+                              : Math::vec_f3{0.0f, 1.0f, 0.0f});
+  const Math::vec_f3 e2 = Math::normalize(perp);
+
+  const Lens_Sample sample = table.lookup(r / lens.r_s, std::acos(cos_a));
+
+  const float t_in = r * cos_a;
+  if (t_in > RAY_T_MIN) {
+    const Hit hit = trace(scene, make_ray(o, d, RAY_T_MIN, t_in));
+    if (hit.exists()) {
+      depth = hit.t;
+      return shade(scene, hit);
+    }
+  }
+
+  // The disk plane cuts the orbit plane along a line, crossed every pi
+  const float phi_c =
+      std::atan2(-simd_dot(e1, lens.disk_n), simd_dot(e2, lens.disk_n));
+  for (float phi = phi_c < 0.0f ? phi_c + M_PI : phi_c; phi < sample.phi_end;
+       phi += M_PI) {
+    const float r_c = table.get_radius(sample, phi) * lens.r_s;
+    if (!std::isfinite(r_c) || r_c <= lens.r_s)
+      break;
+    if (r_c < lens.disk_r_in || r_c > lens.disk_r_out)
+      continue;
+
+    // Orbit tangent from the neighbouring radii, (dr / dphi) e_r + r e_phi
+    const float eps = 1e-2f;
+    const float dr = (table.get_radius(sample, phi + eps) -
+                      table.get_radius(sample, std::max(phi - eps, 0.0f))) *
+                     lens.r_s / (phi + eps - std::max(phi - eps, 0.0f));
+    const Math::vec_f3 e_r = e1 * std::cos(phi) + e2 * std::sin(phi),
+                       e_phi = e2 * std::cos(phi) - e1 * std::sin(phi);
+    const Math::vec_f3 tangent = std::isfinite(dr)
+                                     ? Math::normalize(e_r * dr + e_phi * r_c)
+                                     : e_phi;
+    const Math::vec_f3 col = disk.shade_crossing(e_r * r_c, tangent);
+    return Math::vec_f4{col.x, col.y, col.z, 1.0f};
+  }
+
+  if (sample.captured)
+    return Math::vec_f4{0.0f, 0.0f, 0.0f, 1.0f};
+
+  const float cos_b = std::cos(sample.beta), sin_b = std::sin(sample.beta);
+  const Math::vec_f3 d_out = e1 * cos_b + e2 * sin_b,
+                     p_out = lens.center +
+                             (e1 * sin_b - e2 * cos_b) * (sample.b * lens.r_s);
+  const Hit hit = trace(scene, make_ray(p_out, d_out, 0.0f));
+  depth = get_depth(hit);
+  return shade(scene, hit);
+}
+
+uint64_t Renderer::render_lensed_region(const Scene &scene,
+                                        const Geodesic_Params &lens,
+                                        const Disk_Volume &disk,
+                                        const Camera_Basis &basis,
+                                        Framebuffer &fb, const Tile &tile,
+                                        const uint32_t stride,
+                                        const bool refine) const {
+  uint64_t n_rays = 0;
+  for_each_sample<1>(tile.x0, tile.y0, tile.x1, tile.y1, stride, refine,
+                     [&](const uint32_t x, const uint32_t y) {
+                       float depth;
+                       const Math::vec_f4 col =
+                           trace_lensed(scene, lens, disk, *m_lens_table,
+                                        basis.p, basis.get_dir(x, y), depth);
+                       fill_block(fb, x, y, tile.x1, tile.y1, stride, col, 0,
+                                  depth);
+                       n_rays++;
+                     });
+
+  return n_rays;
+}
+
+template <uint32_t W>
+Renderer::Geodesic_Tally Renderer::render_geodesic_region(
+    const Scene &scene, const Geodesic_Params &lens, const Camera_Basis &basis,
+    Framebuffer &fb, const Tile &tile, const uint32_t stride,
+    const bool refine) const {
+  using vfloat = typename Packet_Traits<W>::vfloat;
+  using vint = typename Packet_Traits<W>::vint;
+
+  // Samples sit on a stride grid, each filling a stride x stride block
+  Geodesic_Packet<W> rays;
+  uint32_t xs[W], ys[W], n = 0;
+  Math::vec_f3 o[W], d[W];
+  Math::vec_f4 col[W];
+  float depth[W];
+  Disk_Radiance rad[W];
+  uint32_t n_march[W];
+  vfloat seg_start[3];
+  Geodesic_Tally tally;
+  const auto flush = [&]() {
+    // Lanes past n repeat the last sample and stay inactive
+    vint active;
+    for (uint32_t lane = 0; lane < W; lane++) {
+      const uint32_t k = std::min(lane, n - 1);
+      o[lane] = basis.p;
+      d[lane] = basis.get_dir(static_cast<float>(xs[k]),
+                              static_cast<float>(ys[k]));
+      col[lane] = Math::vec_f4{0.0f, 0.0f, 0.0f, 1.0f};
+      depth[lane] = 0.0f;
+      rad[lane] = Disk_Radiance{};
+      n_march[lane] = 0;
+      active[lane] = lane < n ? -1 : 0;
+    }
+    init_geodesics<W>(lens, rays, o, d, active);
+
+    /* Every accepted segment is a short straight ray against the scene,
+     * disks are integrated along it up to any hit */
+    while (simd_any(rays.active)) {
+      const vint accepted = step_geodesics<W>(lens, rays, seg_start);
+      for (uint32_t lane = 0; lane < W; lane++) {
+        if (!accepted[lane])
+          continue;
+
+        const Math::vec_f3 a = lens.center + Math::vec_f3{seg_start[0][lane],
+                                                          seg_start[1][lane],
+                                                          seg_start[2][lane]},
+                           b = lens.center + Math::vec_f3{rays.x[0][lane],
+                                                          rays.x[1][lane],
+                                                          rays.x[2][lane]};
+        const float len = Math::magnitude(b - a);
+        const float t_min = rays.n_steps[lane] == 1 ? RAY_T_MIN / len : 0.0f;
+        const Hit hit = trace(scene, make_ray(a, b - a, t_min, 1.0f));
+        for (const Disk_Volume &disk : scene.get_disks())
+          n_march[lane] += disk.march(
+              a, hit.exists() ? a + (b - a) * hit.t : b, m_march_config,
+              rad[lane]);
+
+        if (hit.exists() || rad[lane].T < m_march_config.min_transmittance) {
+          col[lane] = shade(scene, hit);
+          rays.active[lane] = 0;
+          rays.end[lane] = static_cast<int32_t>(Geodesic_End::None);
+        }
+      }
+    }
+
+    for (uint32_t lane = 0; lane < W; lane++) {
+      if (!active[lane])
+        continue;
+
+      // Disk crossings were already composited by the march
+      switch (static_cast<Geodesic_End>(rays.end[lane])) {
+      case Geodesic_End::Escape: {
+        // Far from the hole the remaining path is effectively straight
+        const Math::vec_f3 x = lens.center + Math::vec_f3{rays.x[0][lane],
+                                                          rays.x[1][lane],
+                                                          rays.x[2][lane]},
+                           v = {rays.v[0][lane], rays.v[1][lane],
+                                rays.v[2][lane]};
+        const Hit hit = trace(scene, make_ray(x, v, 0.0f));
+        col[lane] = shade(scene, hit);
+        depth[lane] = get_depth(hit);
+        break;
+      }
+      default:
+        break;
+      }
+
+      tally.n_rays++;
+      tally.n_steps += static_cast<uint64_t>(rays.n_steps[lane]);
+      m_march_steps.fetch_add(n_march[lane], std::memory_order_relaxed);
+
+      fill_block(fb, xs[lane], ys[lane], tile.x1, tile.y1, stride,
+                 rad[lane].composite(col[lane]),
+                 static_cast<uint32_t>(rays.n_steps[lane]) + n_march[lane],
+                 depth[lane]);
+    }
+    n = 0;
+  };
+
+  for_each_sample<W>(tile.x0, tile.y0, tile.x1, tile.y1, stride, refine,
+                     [&](const uint32_t x, const uint32_t y) {
+                       xs[n] = x;
+                       ys[n] = y;
+                       if (++n == W)
+                         flush();
+                     });
+  if (n > 0)
+    flush();
+
+  return tally;
+}
+
+template <uint32_t W>
+uint64_t Renderer::render_region(const Scene &scene, const Camera_Basis &basis,
+                                 Framebuffer &fb, const uint32_t x0,
+                                 const uint32_t y0, const uint32_t x1,
+                                 const uint32_t y1, const uint32_t stride,
+                                 const bool refine) const {
+  using vfloat = typename Ray_Packet<W>::vfloat;
+  using vint = typename Ray_Packet<W>::vint;
+
+  Ray_Packet<W> rays;
+  Hit_Packet<W> hits;
+  uint32_t xs[W], ys[W], n = 0;
+  uint64_t n_rays = 0;
+  const auto flush = [&]() {
+    // Lanes past n repeat the last sample and stay inactive
+    for (uint32_t lane = 0; lane < W; lane++) {
+      const uint32_t k = std::min(lane, n - 1);
+      const Math::vec_f3 d = basis.get_dir(static_cast<float>(xs[k]),
+                                           static_cast<float>(ys[k]));
+      const Math::vec_f3 inv_d = get_inv_dir(d);
+      for (int i = 0; i < 3; i++) {
+        rays.o[i][lane] = basis.p[i];
+        rays.d[i][lane] = d[i];
+        rays.inv_d[i][lane] = inv_d[i];
+      }
+      rays.active[lane] = lane < n ? -1 : 0;
+    }
+    rays.t_min = splat<vfloat>(RAY_T_MIN);
+    rays.t_max = splat<vfloat>(RAY_T_MAX);
+
+    trace<W>(scene, rays, hits);
+
+    const vint active = rays.active;
+    for (uint32_t lane = 0; lane < W; lane++) {
+      if (!active[lane])
+        continue;
+
+      Hit hit;
+      hit.inst = static_cast<uint32_t>(hits.inst[lane]);
+      hit.prim = static_cast<uint32_t>(hits.prim[lane]);
+      hit.t = hits.t[lane];
+      uint32_t n_steps = 0;
+      const Math::vec_f3 d = {rays.d[0][lane], rays.d[1][lane],
+                              rays.d[2][lane]};
+      const Math::vec_f4 col = composite_disks(scene, basis.p, d, hit, n_steps);
+      fill_block(fb, xs[lane], ys[lane], x1, y1, stride, col, n_steps,
+                 get_depth(hit));
+    }
+    n_rays += n;
+    n = 0;
+  };
+
+  for_each_sample<W>(x0, y0, x1, y1, stride, refine,
+                     [&](const uint32_t x, const uint32_t y) {
+                       xs[n] = x;
+                       ys[n] = y;
+                       if (++n == W)
+                         flush();
+                     });
+  if (n > 0)
+    flush();
+
+  return n_rays;
+}
+
+} // namespace CTNM::CPU
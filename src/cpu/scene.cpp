@@ -0,0 +1,288 @@
+#include "cpu/scene.hpp"
+#include "components.hpp"
+#include "cpu/disk_volume.hpp"
+#include "cpu/geodesic.hpp"
+#include "cpu/lbvh.hpp"
+#include "cpu/star_splat.hpp"
+#include "cpu/wide_bvh.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+Affine make_affine(const Components::Transform &transform) {
+  // Same convention as get_mtl_transform, r = (axis, angle)
+  Math::vec_f3 axis = Math::vec_f3{transform.r.x, transform.r.y, transform.r.z};
+  const bool degenerate_axis =
+      Math::approx_eq(Math::magnitude(axis), 0.0f);
+  if (!degenerate_axis)
+    axis = Math::normalize(axis);
+
+  const float angle = degenerate_axis ? 0.0f : transform.r.w;
+  const Math::vec_f3 safe_axis =
+      degenerate_axis ? Math::vec_f3{1.0f, 0.0f, 0.0f} : axis;
+
+  const matrix_float3x3 rotation =
+      simd_matrix3x3(simd_quaternion(angle, safe_axis));
+
+  Affine a;
+  a.c[0] = rotation.columns[0] * transform.s.x;
+  a.c[1] = rotation.columns[1] * transform.s.y;
+  a.c[2] = rotation.columns[2] * transform.s.z;
+  a.t = transform.p;
+  return a;
+}
+
+Affine invert(const Affine &a) {
+  const Math::vec_f3 r0 = simd_cross(a.c[1], a.c[2]),
+                     r1 = simd_cross(a.c[2], a.c[0]),
+                     r2 = simd_cross(a.c[0], a.c[1]);
+  const float det = simd_dot(a.c[0], r0);
+  // Exact test, a uniform scale s has det s^3 and small scales stay valid
+  const float inv_det = det == 0.0f ? 0.0f : 1.0f / det;
+
+  // Rows of the inverse are the scaled cross products
+  Affine inv;
+  inv.c[0] = Math::vec_f3{r0.x, r1.x, r2.x} * inv_det;
+  inv.c[1] = Math::vec_f3{r0.y, r1.y, r2.y} * inv_det;
+  inv.c[2] = Math::vec_f3{r0.z, r1.z, r2.z} * inv_det;
+  inv.t = -transform_vector(inv, a.t);
+  return inv;
+}
+
+Math::AABB transform_bounds(const Affine &a, const Math::AABB &box) {
+  // Arvo's method, extents of the transformed box per axis
+  const Math::vec_f3 center = Math::centroid(box),
+                     half = (box.max - box.min) * 0.5f;
+  const Math::vec_f3 c = transform_point(a, center);
+  const Math::vec_f3 e = simd_abs(a.c[0]) * half.x +
+                         simd_abs(a.c[1]) * half.y +
+                         simd_abs(a.c[2]) * half.z;
+  return Math::AABB{c - e, c + e};
+}
+
+void Mesh_BVH::build(Parallel::Thread_Pool &pool,
+                     const Components::Mesh &mesh, const uint32_t wide_w) {
+  const size_t n_tris = mesh.indicies.size() / 3;
+  std::vector<Math::AABB> tri_bounds(n_tris);
+  std::vector<Triangle> tris(n_tris);
+  for (size_t i = 0; i < n_tris; i++) {
+    const Math::vec_f3 &v0 = mesh.verticies[mesh.indicies[i * 3]].p,
+                       &v1 = mesh.verticies[mesh.indicies[i * 3 + 1]].p,
+                       &v2 = mesh.verticies[mesh.indicies[i * 3 + 2]].p;
+    tris[i] = Triangle{v0, v1 - v0, v2 - v0};
+    Math::grow(tri_bounds[i], v0);
+    Math::grow(tri_bounds[i], v1);
+    Math::grow(tri_bounds[i], v2);
+  }
+
+  m_bvh.build(pool, tri_bounds);
+
+  // Store triangles in leaf order so leaves index them contiguously
+  const std::vector<BVH_Node> &nodes = m_bvh.get_nodes();
+  const size_t leaf_offset = n_tris == 0 ? 0 : n_tris - 1;
+  m_triangles.resize(n_tris);
+  for (size_t i = 0; i < n_tris; i++)
+    m_triangles[i] = tris[nodes[leaf_offset + i].prim];
+
+  collapse(wide_w);
+  m_bounds = m_bvh.get_bounds();
+  m_revision = mesh.revision;
+  m_built = true;
+}
+
+void Mesh_BVH::collapse(const uint32_t wide_w) {
+  if (wide_w != 4 && wide_w != 8)
+    throw std::runtime_error("Failed: Mesh_BVH, wide width must be 4/8");
+
+  m_wide_w = wide_w;
+  if (wide_w == 4) {
+    m_wide_bvh4.collapse(m_bvh);
+    m_wide_bvh8 = Wide_BVH<8>();
+  } else {
+    m_wide_bvh8.collapse(m_bvh);
+    m_wide_bvh4 = Wide_BVH<4>();
+  }
+}
+
+const LBVH &Mesh_BVH::get_bvh() const { return m_bvh; }
+
+const Wide_BVH_Stats &Mesh_BVH::get_wide_stats() const {
+  return m_wide_w == 8 ? m_wide_bvh8.get_stats() : m_wide_bvh4.get_stats();
+}
+
+uint32_t Mesh_BVH::get_wide_width() const { return m_wide_w; }
+
+const std::vector<Triangle> &Mesh_BVH::get_triangles() const {
+  return m_triangles;
+}
+
+const Math::AABB &Mesh_BVH::get_bounds() const { return m_bounds; }
+
+uint64_t Mesh_BVH::get_revision() const { return m_revision; }
+
+bool Mesh_BVH::is_built() const { return m_built; }
+
+void Scene::sync(Parallel::Thread_Pool &pool, const entt::registry &reg) {
+  const auto &renderable_entities =
+      reg.view<Components::Mesh, Components::Transform, Components::Surface>();
+
+  /* Rebuild bottom level structures whose mesh revision changed */
+  std::unordered_set<entt::entity> live;
+  std::vector<std::pair<Mesh_BVH *, const Components::Mesh *>> rebuilds;
+  for (const auto e : renderable_entities) {
+    const Components::Mesh &mesh = reg.get<Components::Mesh>(e);
+    live.insert(e);
+
+    Mesh_BVH &blas = m_blases[e];
+    if (!blas.is_built() || blas.get_revision() != mesh.revision)
+      rebuilds.emplace_back(&blas, &mesh);
+    else if (blas.get_wide_width() != m_wide_w)
+      rebuilds.emplace_back(&blas, nullptr); // Only the width changed
+  }
+
+  for (auto it = m_blases.begin(); it != m_blases.end();) {
+    if (!live.contains(it->first))
+      it = m_blases.erase(it);
+    else
+      it++;
+  }
+
+  pool.dispatch(rebuilds.size(), [&](const size_t i) {
+    if (rebuilds[i].second)
+      rebuilds[i].first->build(pool, *rebuilds[i].second, m_wide_w);
+    else
+      rebuilds[i].first->collapse(m_wide_w);
+  });
+
+  /* Instances are gathered afresh every sync */
+  m_instances.clear();
+  m_instances.reserve(live.size());
+  for (const auto e : renderable_entities) {
+    const auto &[transform, surface] =
+        reg.get<Components::Transform, Components::Surface>(e);
+    const Mesh_BVH &blas = m_blases.at(e);
+    if (blas.get_triangles().empty())
+      continue;
+
+    const Affine obj_to_world = make_affine(transform);
+    m_instances.push_back(Instance{&blas, invert(obj_to_world),
+                                   transform_bounds(obj_to_world,
+                                                    blas.get_bounds()),
+                                   surface.col, e});
+  }
+
+  m_instance_bounds.resize(m_instances.size());
+  for (size_t i = 0; i < m_instances.size(); i++)
+    m_instance_bounds[i] = m_instances[i].bounds;
+
+  /* The same instances in the same order only refit the top level. Motion
+   * degrades a refit tree, so it is rebuilt every TLAS_MAX_REFITS syncs */
+  bool same_instances = m_instances.size() == m_tlas_entities.size();
+  for (size_t i = 0; same_instances && i < m_instances.size(); i++)
+    same_instances = m_instances[i].e == m_tlas_entities[i];
+
+  if (same_instances && m_n_tlas_refits < TLAS_MAX_REFITS) {
+    m_tlas.refit(pool, m_instance_bounds);
+    m_n_tlas_refits++;
+  } else {
+    m_tlas.build(pool, m_instance_bounds);
+    m_n_tlas_refits = 0;
+    m_tlas_entities.resize(m_instances.size());
+    for (size_t i = 0; i < m_instances.size(); i++)
+      m_tlas_entities[i] = m_instances[i].e;
+  }
+  if (m_wide_w == 4) {
+    m_wide_tlas4.collapse(m_tlas, 1);
+    m_wide_tlas8 = Wide_BVH<8>();
+  } else {
+    m_wide_tlas8.collapse(m_tlas, 1);
+    m_wide_tlas4 = Wide_BVH<4>();
+  }
+
+  m_lenses.clear();
+  m_disks.clear();
+  const auto &lens_entities =
+      reg.view<Components::Black_Hole, Components::Transform>();
+  for (const auto e : lens_entities) {
+    const auto &[hole, transform] =
+        reg.get<Components::Black_Hole, Components::Transform>(e);
+    m_lenses.push_back(make_geodesic_params(hole, transform));
+
+    const Components::Accretion_Disk *disk =
+        reg.try_get<Components::Accretion_Disk>(e);
+    m_disks.emplace_back(m_lenses.back(),
+                         disk ? *disk : Components::Accretion_Disk{},
+                         disk != nullptr);
+  }
+
+  // Stars skip the BVHs entirely and are splatted after tracing
+  const auto &star_entities =
+      reg.view<Components::Star, Components::Transform, Components::Surface>();
+  m_stars.resize(star_entities.size_hint());
+  size_t n_stars = 0;
+  for (const auto e : star_entities) {
+    const auto &[star, transform, surface] =
+        reg.get<Components::Star, Components::Transform, Components::Surface>(
+            e);
+    m_stars.x[n_stars] = transform.p.x;
+    m_stars.y[n_stars] = transform.p.y;
+    m_stars.z[n_stars] = transform.p.z;
+    const Math::vec_f3 col = surface.col * (star.l / 255.0f);
+    m_stars.r[n_stars] = col.x;
+    m_stars.g[n_stars] = col.y;
+    m_stars.b[n_stars] = col.z;
+    n_stars++;
+  }
+  m_stars.resize(n_stars);
+}
+
+const std::vector<Instance> &Scene::get_instances() const {
+  return m_instances;
+}
+
+const LBVH &Scene::get_tlas() const { return m_tlas; }
+
+void Scene::set_wide_width(const uint32_t wide_w) {
+  if (wide_w != 4 && wide_w != 8)
+    throw std::runtime_error("Failed: Scene, wide width must be 4/8");
+  m_wide_w = wide_w;
+}
+
+uint32_t Scene::get_wide_width() const { return m_wide_w; }
+
+const std::vector<Geodesic_Params> &Scene::get_lenses() const {
+  return m_lenses;
+}
+
+const std::vector<Disk_Volume> &Scene::get_disks() const { return m_disks; }
+
+const Star_Points &Scene::get_stars() const { return m_stars; }
+
+Scene_Stats Scene::get_stats() const {
+  Scene_Stats stats{m_instances.size(), m_blases.size(), m_stars.size()};
+  const Wide_BVH_Stats &tlas =
+      m_wide_w == 8 ? m_wide_tlas8.get_stats() : m_wide_tlas4.get_stats();
+  stats.binary_bytes = tlas.binary_bytes;
+  stats.wide_bytes = tlas.bytes;
+  stats.wide_w = m_wide_w;
+  for (const auto &[_, blas] : m_blases) {
+    stats.binary_bytes += blas.get_wide_stats().binary_bytes;
+    stats.wide_bytes += blas.get_wide_stats().bytes;
+  }
+
+  return stats;
+}
+
+bool Scene::empty() const { return m_instances.empty(); }
+
+} // namespace CTNM::CPU
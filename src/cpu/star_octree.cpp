@@ -0,0 +1,631 @@
+#include "cpu/star_octree.hpp"
+#include "cpu/lbvh.hpp"
+#include "cpu/renderer.hpp"
+#include "cpu/star_splat.hpp"
+#include "io/read_scheduler.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+constexpr size_t POINT_GRAIN = 1 << 14;
+constexpr size_t NODE_GRAIN = 256;
+constexpr uint32_t MAX_DEPTH = 21; // Bits per axis of a Morton code
+constexpr size_t WRITE_BATCH = size_t(1) << 26;
+constexpr float PREFETCH_PRIORITY = 1e6f; // Root radii, after any miss
+
+// Per node decision of one select() level
+enum Action : uint8_t { CULL, AGGREGATE, LEAF, REFINE };
+
+static_assert(sizeof(Star_Octree_Node) == 56);
+static_assert(sizeof(Star_Octree_Point) == 24);
+
+uint64_t align_up(const uint64_t x) {
+  return (x + STAR_OCTREE_ALIGN - 1) / STAR_OCTREE_ALIGN * STAR_OCTREE_ALIGN;
+}
+
+Math::vec_f3 get_centroid(const Star_Octree_Node &node) {
+  return Math::vec_f3{node.p[0], node.p[1], node.p[2]};
+}
+
+} // namespace
+
+Star_Octree::Star_Octree(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+Star_Octree::~Star_Octree() { close(); }
+
+void Star_Octree::set_config(const Star_LOD_Config &config) {
+  if (!(config.max_error > 0.0f) || config.budget == 0 ||
+      config.leaf_size == 0 || config.io_depth == 0)
+    throw std::runtime_error("Failed: Star_Octree, error, budget, leaf size "
+                             "and io depth must be positive");
+  if (!(config.prefetch_frames >= 0.0f))
+    throw std::runtime_error(
+        "Failed: Star_Octree, prefetch frames must not be negative");
+
+  m_config = config;
+}
+
+const Star_LOD_Config &Star_Octree::get_config() const { return m_config; }
+
+const Star_LOD_Stats &Star_Octree::get_stats() const { return m_stats; }
+
+void Star_Octree::build(const Star_Points &points,
+                        const std::filesystem::path &path) {
+  const auto t0 = std::chrono::steady_clock::now();
+  const size_t n = points.size();
+  if (n == 0 || n > std::numeric_limits<uint32_t>::max())
+    throw std::runtime_error("Failed: Star_Octree, point count out of range");
+
+  // Bounding cube, a hair larger so every code stays below the top cell
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, POINT_GRAIN);
+  std::vector<Math::vec_f3> chunk_lo(n_chunks), chunk_hi(n_chunks);
+  m_pool.parallel_for(0, n, POINT_GRAIN, [&](const size_t b, const size_t e,
+                                             const size_t chunk) {
+    Math::vec_f3 lo = {points.x[b], points.y[b], points.z[b]}, hi = lo;
+    for (size_t i = b; i < e; i++) {
+      const Math::vec_f3 p = {points.x[i], points.y[i], points.z[i]};
+      lo = simd_min(lo, p);
+      hi = simd_max(hi, p);
+    }
+    chunk_lo[chunk] = lo;
+    chunk_hi[chunk] = hi;
+  });
+  Math::vec_f3 lo = chunk_lo[0], hi = chunk_hi[0];
+  for (size_t chunk = 1; chunk < n_chunks; chunk++) {
+    lo = simd_min(lo, chunk_lo[chunk]);
+    hi = simd_max(hi, chunk_hi[chunk]);
+  }
+  const Math::vec_f3 extent = hi - lo;
+  const float side =
+      std::max({extent.x, extent.y, extent.z, 1e-30f}) * (1.0f + 1e-5f);
+
+  std::vector<uint64_t> codes(n);
+  std::vector<uint32_t> order(n);
+  m_pool.parallel_for(0, n, POINT_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          const Math::vec_f3 p = {points.x[i], points.y[i],
+                                                  points.z[i]};
+                          codes[i] = get_morton_code((p - lo) / side);
+                          order[i] = static_cast<uint32_t>(i);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, codes, order);
+
+  /* Breadth first, so each depth is a contiguous run of nodes. Codes are
+   * sorted, so a child's range ends where the next digit begins */
+  std::vector<Star_Octree_Node> nodes(1);
+  std::vector<uint64_t> begin = {0}, end = {n};
+  std::vector<uint32_t> levels;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const uint32_t depth = nodes[i].depth;
+    if (levels.size() <= depth)
+      levels.push_back(static_cast<uint32_t>(i));
+
+    if (end[i] - begin[i] <= m_config.leaf_size || depth == MAX_DEPTH)
+      continue;
+
+    if (nodes.size() + 8 > std::numeric_limits<uint32_t>::max())
+      throw std::runtime_error("Failed: Star_Octree, too many nodes");
+
+    const uint32_t shift = 3 * (MAX_DEPTH - 1 - depth);
+    nodes[i].first_child = static_cast<uint32_t>(nodes.size());
+    for (uint64_t b = begin[i]; b < end[i];) {
+      const uint64_t digit = (codes[b] >> shift) & 7;
+      const uint64_t e =
+          std::partition_point(codes.begin() + b, codes.begin() + end[i],
+                               [&](const uint64_t code) {
+                                 return ((code >> shift) & 7) == digit;
+                               }) -
+          codes.begin();
+
+      Star_Octree_Node &child = nodes.emplace_back();
+      child.depth = depth + 1;
+      begin.push_back(b);
+      end.push_back(e);
+      nodes[i].n_children++;
+      b = e;
+    }
+  }
+  levels.push_back(static_cast<uint32_t>(nodes.size()));
+
+  Star_Octree_Header header;
+  header.leaf_size = m_config.leaf_size;
+  header.n_nodes = nodes.size();
+  header.n_points = n;
+  header.nodes_offset = sizeof(Star_Octree_Header);
+  uint64_t cursor =
+      align_up(header.nodes_offset + nodes.size() * sizeof(Star_Octree_Node));
+  std::vector<uint32_t> leaves;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    nodes[i].n_points = end[i] - begin[i];
+    if (nodes[i].n_children > 0)
+      continue;
+
+    nodes[i].offset = cursor;
+    cursor = align_up(cursor + nodes[i].n_points * sizeof(Star_Octree_Point));
+    leaves.push_back(static_cast<uint32_t>(i));
+  }
+  header.bytes = cursor;
+
+  // Aggregates, deepest level first
+  for (size_t level = levels.size() - 1; level-- > 0;)
+    m_pool.parallel_for(
+        levels[level], levels[level + 1], NODE_GRAIN,
+        [&](const size_t b, const size_t e, size_t) {
+          for (size_t i = b; i < e; i++) {
+            Star_Octree_Node &node = nodes[i];
+            Math::vec_d3 flux = {0.0, 0.0, 0.0}, sum_lp = {0.0, 0.0, 0.0},
+                         sum_p = {0.0, 0.0, 0.0};
+            if (node.n_children == 0) {
+              for (uint64_t k = begin[i]; k < end[i]; k++) {
+                const uint32_t j = order[k];
+                const Math::vec_d3 p = {points.x[j], points.y[j], points.z[j]};
+                const double l = static_cast<double>(points.r[j]) +
+                                 points.g[j] + points.b[j];
+                flux += Math::vec_d3{points.r[j], points.g[j], points.b[j]};
+                sum_lp += p * l;
+                sum_p += p;
+              }
+            } else {
+              for (uint32_t c = node.first_child;
+                   c < node.first_child + node.n_children; c++) {
+                const Star_Octree_Node &child = nodes[c];
+                const Math::vec_d3 p = {child.p[0], child.p[1], child.p[2]},
+                                   child_flux = {child.flux[0], child.flux[1],
+                                                 child.flux[2]};
+                flux += child_flux;
+                sum_lp += p * (child_flux.x + child_flux.y + child_flux.z);
+                sum_p += p * static_cast<double>(child.n_points);
+              }
+            }
+
+            // Dark cells fall back to the plain centroid
+            const double l = flux.x + flux.y + flux.z;
+            const Math::vec_d3 p =
+                l > 0.0 ? sum_lp / l
+                        : sum_p / static_cast<double>(node.n_points);
+            for (int axis = 0; axis < 3; axis++) {
+              node.p[axis] = static_cast<float>(p[axis]);
+              node.flux[axis] = static_cast<float>(flux[axis]);
+            }
+
+            // Bounds about the centroid rather than the cell, usually tighter
+            double radius = 0.0;
+            if (node.n_children == 0)
+              for (uint64_t k = begin[i]; k < end[i]; k++) {
+                const uint32_t j = order[k];
+                radius = std::max(
+                    radius, Math::magnitude(Math::vec_d3{points.x[j],
+                                                         points.y[j],
+                                                         points.z[j]} -
+                                            p));
+              }
+            else
+              for (uint32_t c = node.first_child;
+                   c < node.first_child + node.n_children; c++) {
+                const Star_Octree_Node &child = nodes[c];
+                radius = std::max(
+                    radius, Math::magnitude(Math::vec_d3{child.p[0],
+                                                         child.p[1],
+                                                         child.p[2]} -
+                                            p) +
+                                child.radius);
+              }
+            node.radius = static_cast<float>(radius) * (1.0f + 1e-6f);
+          }
+        });
+
+  const auto t1 = std::chrono::steady_clock::now();
+
+  std::filesystem::path tmp = path;
+  tmp += ".tmp";
+  std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+  std::vector<char> head(
+      align_up(header.nodes_offset + nodes.size() * sizeof(nodes[0])), 0);
+  std::memcpy(head.data(), &header, sizeof(header));
+  std::memcpy(head.data() + header.nodes_offset, nodes.data(),
+              nodes.size() * sizeof(nodes[0]));
+  file.write(head.data(), static_cast<std::streamsize>(head.size()));
+
+  // Leaf blocks in file order, gathered a batch at a time over the pool
+  std::vector<char> block;
+  for (size_t first = 0; first < leaves.size() && file;) {
+    const uint64_t base = nodes[leaves[first]].offset;
+    size_t last = first + 1;
+    while (last < leaves.size() &&
+           nodes[leaves[last]].offset - base < WRITE_BATCH)
+      last++;
+    const uint64_t limit =
+        last < leaves.size() ? nodes[leaves[last]].offset : header.bytes;
+
+    block.assign(limit - base, 0);
+    m_pool.parallel_for(
+        first, last, 1, [&](const size_t b, const size_t e, size_t) {
+          for (size_t l = b; l < e; l++) {
+            const uint32_t i = leaves[l];
+            auto *out = reinterpret_cast<Star_Octree_Point *>(
+                block.data() + (nodes[i].offset - base));
+            for (uint64_t k = begin[i]; k < end[i]; k++) {
+              const uint32_t j = order[k];
+              out[k - begin[i]] =
+                  Star_Octree_Point{points.x[j], points.y[j], points.z[j],
+                                    points.r[j], points.g[j], points.b[j]};
+            }
+          }
+        });
+    file.write(block.data(), static_cast<std::streamsize>(block.size()));
+    first = last;
+  }
+
+  file.close();
+  if (!file)
+    throw std::runtime_error("Failed: could not write " + tmp.string());
+  std::filesystem::rename(tmp, path);
+
+  m_stats = Star_LOD_Stats{};
+  m_stats.n_nodes = nodes.size();
+  m_stats.n_points = n;
+  m_stats.ms_build = ms_t(t1 - t0).count();
+  m_stats.ms_write = ms_t(std::chrono::steady_clock::now() - t1).count();
+}
+
+void Star_Octree::open(const std::filesystem::path &path) {
+  close();
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Failed: could not open " + path.string());
+
+  std::error_code ec;
+  const uint64_t bytes = std::filesystem::file_size(path, ec);
+  Star_Octree_Header header;
+  const Star_Octree_Header expected;
+  const char *error = nullptr;
+  if (ec || bytes < sizeof(header) ||
+      !file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    error = "Failed: truncated octree ";
+  else if (std::memcmp(header.magic, expected.magic, sizeof(expected.magic)) !=
+           0)
+    error = "Failed: not a star octree ";
+  else if (header.version != STAR_OCTREE_VERSION)
+    error = "Failed: unsupported star octree version ";
+  else if (header.bytes != bytes || header.n_nodes == 0 ||
+           header.nodes_offset < sizeof(header) ||
+           header.n_nodes > (header.bytes - header.nodes_offset) /
+                                sizeof(Star_Octree_Node))
+    error = "Failed: corrupt star octree ";
+
+  // Only the nodes are read now, leaves as views need them
+  std::vector<Star_Octree_Node> nodes;
+  if (!error) {
+    nodes.resize(header.n_nodes);
+    file.seekg(static_cast<std::streamoff>(header.nodes_offset));
+    if (!file.read(reinterpret_cast<char *>(nodes.data()),
+                   static_cast<std::streamsize>(nodes.size() *
+                                                sizeof(nodes[0]))))
+      error = "Failed: truncated octree ";
+  }
+  for (uint64_t i = 0; !error && i < header.n_nodes; i++) {
+    const Star_Octree_Node &node = nodes[i];
+    if (node.n_children > 8 ||
+        node.first_child + uint64_t(node.n_children) > header.n_nodes ||
+        (node.n_children > 0 && node.first_child <= i) ||
+        (node.n_children == 0 &&
+         (node.offset % STAR_OCTREE_ALIGN != 0 ||
+          node.n_points > (header.bytes - std::min(node.offset,
+                                                   header.bytes)) /
+                              sizeof(Star_Octree_Point))))
+      error = "Failed: corrupt star octree ";
+  }
+  if (error)
+    throw std::runtime_error(error + path.string());
+
+  m_reader = std::make_unique<IO::Read_Scheduler>(
+      path, IO::Read_Scheduler_Config{m_config.io_depth});
+  m_header = header;
+  m_nodes = std::move(nodes);
+  m_stats = Star_LOD_Stats{};
+  m_stats.n_nodes = header.n_nodes;
+  m_stats.n_points = header.n_points;
+}
+
+void Star_Octree::close() {
+  m_reader.reset(); // Waits for reads in flight
+  m_nodes = {};
+  m_cache.clear();
+  m_lru.clear();
+  m_cache_bytes = 0;
+  m_has_last_eye = false;
+}
+
+bool Star_Octree::empty() const { return m_nodes.empty(); }
+
+void Star_Octree::select(const Camera_Basis &basis, Star_Points &out) {
+  if (empty())
+    throw std::runtime_error("Failed: Star_Octree, nothing open");
+
+  const auto t0 = std::chrono::steady_clock::now();
+  m_stats = Star_LOD_Stats{};
+  m_stats.n_nodes = m_header.n_nodes;
+  m_stats.n_points = m_header.n_points;
+  m_frame++;
+  absorb(false);
+  m_reader->clear_queued();
+
+  /* Leaves the camera is heading for are queued first, behind anything
+   * this frame misses, which re-requests them sooner if both want one */
+  const Math::vec_f3 step = basis.p - m_last_eye;
+  if (!m_config.wait && m_has_last_eye && m_config.prefetch_frames > 0.0f &&
+      (step.x != 0.0f || step.y != 0.0f || step.z != 0.0f)) {
+    cut(basis, basis.p + step * m_config.prefetch_frames);
+    for (size_t l = 0; l < m_leaves.size(); l++)
+      if (!m_cache.contains(m_leaves[l])) {
+        request(m_leaves[l], PREFETCH_PRIORITY + m_leaf_distance[l]);
+        m_stats.n_prefetches++;
+      }
+  }
+
+  const Cut_Tally tally = cut(basis, basis.p);
+  m_stats.n_visited = tally.n_visited;
+  m_stats.n_culled = tally.n_culled;
+
+  /* Missing leaves are read nearest first and drawn as their aggregate
+   * until they arrive, unless waiting for them */
+  m_leaf_points.clear();
+  size_t kept = 0;
+  for (size_t l = 0; l < m_leaves.size(); l++) {
+    const uint32_t leaf = m_leaves[l];
+    const Star_Octree_Point *points = find(leaf);
+    if (points)
+      m_stats.n_hits++;
+    else {
+      m_stats.n_misses++;
+      request(leaf, m_leaf_distance[l]);
+    }
+
+    if (points || m_config.wait) {
+      m_leaves[kept++] = leaf;
+      m_leaf_points.push_back(points);
+    } else
+      m_aggregates.push_back(leaf);
+  }
+  m_leaves.resize(kept);
+  for (size_t l = 0; l < m_leaves.size(); l++)
+    while (!m_leaf_points[l]) {
+      const bool idle = m_reader->get_stats().n_outstanding == 0;
+      absorb(true);
+      m_leaf_points[l] = find(m_leaves[l]);
+      if (!m_leaf_points[l] && idle)
+        throw std::runtime_error("Failed: could not read star octree leaf");
+    }
+
+  m_leaf_start.resize(m_leaves.size() + 1);
+  m_leaf_start[0] = out.size() + m_aggregates.size();
+  for (size_t l = 0; l < m_leaves.size(); l++)
+    m_leaf_start[l + 1] = m_leaf_start[l] + m_nodes[m_leaves[l]].n_points;
+
+  const size_t base = out.size();
+  out.resize(m_leaf_start.back());
+  m_pool.parallel_for(0, m_aggregates.size(), NODE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t a = b; a < e; a++) {
+                          const Star_Octree_Node &node =
+                              m_nodes[m_aggregates[a]];
+                          out.x[base + a] = node.p[0];
+                          out.y[base + a] = node.p[1];
+                          out.z[base + a] = node.p[2];
+                          out.r[base + a] = node.flux[0];
+                          out.g[base + a] = node.flux[1];
+                          out.b[base + a] = node.flux[2];
+                        }
+                      });
+  m_pool.parallel_for(
+      0, m_leaves.size(), 1, [&](const size_t b, const size_t e, size_t) {
+        for (size_t l = b; l < e; l++) {
+          const uint64_t n = m_nodes[m_leaves[l]].n_points;
+          const Star_Octree_Point *points = m_leaf_points[l];
+          for (uint64_t k = 0; k < n; k++) {
+            const size_t i = m_leaf_start[l] + k;
+            out.x[i] = points[k].x;
+            out.y[i] = points[k].y;
+            out.z[i] = points[k].z;
+            out.r[i] = points[k].r;
+            out.g[i] = points[k].g;
+            out.b[i] = points[k].b;
+          }
+        }
+      });
+
+  // Least recently used first, never what this frame drew
+  while (m_cache_bytes > m_config.cache_bytes && !m_lru.empty()) {
+    const auto it = m_cache.find(m_lru.back());
+    if (it->second.frame == m_frame)
+      break;
+
+    m_cache_bytes -= it->second.data.size();
+    m_cache.erase(it);
+    m_lru.pop_back();
+  }
+  m_last_eye = basis.p;
+  m_has_last_eye = true;
+
+  m_stats.n_aggregates = m_aggregates.size();
+  m_stats.n_leaves = m_leaves.size();
+  m_stats.n_leaf_points = m_leaf_start.back() - m_leaf_start[0];
+  m_stats.bytes_leaves = m_stats.n_leaf_points * sizeof(Star_Octree_Point);
+  m_stats.bytes_cached = m_cache_bytes;
+  m_stats.io = m_reader->get_stats();
+  m_stats.ms_select = ms_t(std::chrono::steady_clock::now() - t0).count();
+}
+
+Star_Octree::Cut_Tally Star_Octree::cut(const Camera_Basis &basis,
+                                        const Math::vec_f3 &eye) {
+  // Outward side plane normals, a sphere past any of them is off screen
+  const float tan_x = 0.5f * basis.aspect, tan_y = 0.5f;
+  const Math::vec_f3 sides[4] = {
+      Math::normalize(basis.right * basis.fl - basis.forward * tan_x),
+      Math::normalize(-basis.right * basis.fl - basis.forward * tan_x),
+      Math::normalize(basis.up * basis.fl - basis.forward * tan_y),
+      Math::normalize(-basis.up * basis.fl - basis.forward * tan_y)};
+  const float k = basis.fl * basis.h;
+
+  // Distances in units of the root, squares stay in float range
+  const float s = 1.0f / std::max(m_nodes[0].radius, 1e-30f);
+
+  Cut_Tally tally;
+  m_frontier.assign(1, 0);
+  m_aggregates.clear();
+  m_leaves.clear();
+  m_leaf_distance.clear();
+  uint64_t used = 0; // Points committed to the cut
+  while (!m_frontier.empty()) {
+    const size_t n = m_frontier.size();
+    m_action.resize(n);
+    m_error.resize(n);
+    m_distance.resize(n);
+    m_pool.parallel_for(0, n, NODE_GRAIN, [&](const size_t b, const size_t e,
+                                               size_t) {
+      for (size_t f = b; f < e; f++) {
+        const Star_Octree_Node &node = m_nodes[m_frontier[f]];
+        const Math::vec_f3 v = (get_centroid(node) - eye) * s;
+        const float r = node.radius * s;
+        bool culled = simd_dot(v, basis.forward) < -r;
+        for (const Math::vec_f3 &side : sides)
+          culled = culled || simd_dot(v, side) > r;
+
+        // Pixels any star may move by when drawn at the cell's aggregate
+        const float d = Math::magnitude(v);
+        m_distance[f] = d;
+        m_error[f] = d > r ? r / (d - r) * k
+                           : std::numeric_limits<float>::infinity();
+        m_action[f] = culled                            ? CULL
+                      : m_error[f] < m_config.max_error ? AGGREGATE
+                      : node.n_children == 0            ? LEAF
+                                                        : REFINE;
+      }
+    });
+
+    /* Every visible cell costs at least its aggregate. Refinements are
+     * granted largest error first while the budget lasts */
+    uint64_t committed = used, extra = 0;
+    m_refine.clear();
+    for (size_t f = 0; f < n; f++) {
+      if (m_action[f] == CULL)
+        continue;
+
+      committed++;
+      if (m_action[f] == AGGREGATE)
+        continue;
+
+      const Star_Octree_Node &node = m_nodes[m_frontier[f]];
+      extra += (m_action[f] == LEAF ? node.n_points : node.n_children) - 1;
+      m_refine.push_back(static_cast<uint32_t>(f));
+    }
+    if (committed + extra > m_config.budget) {
+      std::sort(m_refine.begin(), m_refine.end(),
+                [&](const uint32_t a, const uint32_t b) {
+                  return m_error[a] != m_error[b] ? m_error[a] > m_error[b]
+                                                  : a < b;
+                });
+      for (const uint32_t f : m_refine) {
+        const Star_Octree_Node &node = m_nodes[m_frontier[f]];
+        const uint64_t cost =
+            (m_action[f] == LEAF ? node.n_points : node.n_children) - 1;
+        if (committed + cost <= m_config.budget)
+          committed += cost;
+        else
+          m_action[f] = AGGREGATE;
+      }
+    }
+
+    m_next.clear();
+    for (size_t f = 0; f < n; f++) {
+      const uint32_t i = m_frontier[f];
+      const Star_Octree_Node &node = m_nodes[i];
+      switch (m_action[f]) {
+      case CULL:
+        tally.n_culled++;
+        break;
+      case AGGREGATE:
+        m_aggregates.push_back(i);
+        used++;
+        break;
+      case LEAF:
+        m_leaves.push_back(i);
+        m_leaf_distance.push_back(m_distance[f]);
+        used += node.n_points;
+        break;
+      case REFINE:
+        for (uint32_t c = 0; c < node.n_children; c++)
+          m_next.push_back(node.first_child + c);
+        break;
+      }
+    }
+
+    tally.n_visited += n;
+    std::swap(m_frontier, m_next);
+  }
+
+  return tally;
+}
+
+void Star_Octree::request(const uint32_t leaf, const float priority) {
+  const Star_Octree_Node &node = m_nodes[leaf];
+  m_reader->request(leaf, node.offset,
+                    node.n_points * sizeof(Star_Octree_Point), priority);
+}
+
+void Star_Octree::absorb(const bool wait) {
+  m_reads.clear();
+  m_reader->poll(m_reads, wait);
+  for (IO::Read_Result &read : m_reads) {
+    const auto leaf = static_cast<uint32_t>(read.key);
+    if (!read.ok || m_cache.contains(leaf))
+      continue;
+
+    // Kept through this frame, so a wait is never undone by eviction
+    m_lru.push_front(leaf);
+    Leaf &entry = m_cache[leaf];
+    entry.data = std::move(read.data);
+    entry.frame = m_frame;
+    entry.lru = m_lru.begin();
+    m_cache_bytes += entry.data.size();
+  }
+}
+
+const Star_Octree_Point *Star_Octree::find(const uint32_t leaf) {
+  const auto it = m_cache.find(leaf);
+  if (it == m_cache.end())
+    return nullptr;
+
+  it->second.frame = m_frame;
+  m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+  return reinterpret_cast<const Star_Octree_Point *>(it->second.data.data());
+}
+
+} // namespace CTNM::CPU
@@ -0,0 +1,246 @@
+#include "cpu/star_splat.hpp"
+#include "cpu/renderer.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+constexpr size_t SPLAT_GRAIN = 1 << 14;
+
+} // namespace
+
+void Star_Points::clear() {
+  for (std::vector<float> *column : {&x, &y, &z, &r, &g, &b})
+    column->clear();
+}
+
+void Star_Points::resize(const size_t n) {
+  for (std::vector<float> *column : {&x, &y, &z, &r, &g, &b})
+    column->resize(n);
+}
+
+void Star_Points::append(const Star_Points &other) {
+  x.insert(x.end(), other.x.begin(), other.x.end());
+  y.insert(y.end(), other.y.begin(), other.y.end());
+  z.insert(z.end(), other.z.begin(), other.z.end());
+  r.insert(r.end(), other.r.begin(), other.r.end());
+  g.insert(g.end(), other.g.begin(), other.g.end());
+  b.insert(b.end(), other.b.begin(), other.b.end());
+}
+
+Star_Splatter::Star_Splatter(Parallel::Thread_Pool &pool) : m_pool(pool) {
+  set_config(Splat_Config{});
+}
+
+void Star_Splatter::set_config(const Splat_Config &config) {
+  if (!(config.psf_sigma > 0.0f) || !(config.reference_distance > 0.0))
+    throw std::runtime_error("Failed: splat PSF and distance must be positive");
+
+  m_config = config;
+  m_radius = std::clamp(
+      static_cast<uint32_t>(std::ceil(2.0f * config.psf_sigma)), 1u,
+      SPLAT_MAX_RADIUS);
+
+  // Separable Gaussian sampled at pixel centres around each phase
+  const uint32_t n_taps = 2 * m_radius + 1;
+  m_psf.resize(SPLAT_PHASES * n_taps);
+  for (uint32_t phase = 0; phase < SPLAT_PHASES; phase++) {
+    const float offset =
+        (static_cast<float>(phase) + 0.5f) / SPLAT_PHASES - 0.5f;
+    float *w = m_psf.data() + phase * n_taps;
+    float sum = 0.0f;
+    for (uint32_t tap = 0; tap < n_taps; tap++) {
+      const float d = static_cast<float>(tap) -
+                      static_cast<float>(m_radius) - offset;
+      w[tap] = std::exp(-d * d / (2.0f * config.psf_sigma * config.psf_sigma));
+      sum += w[tap];
+    }
+
+    for (uint32_t tap = 0; tap < n_taps; tap++)
+      w[tap] /= sum;
+  }
+}
+
+const Splat_Config &Star_Splatter::get_config() const { return m_config; }
+
+const Splat_Stats &Star_Splatter::get_stats() const { return m_stats; }
+
+void Star_Splatter::splat(const Star_Points &points, const Camera_Basis &basis,
+                          Framebuffer &fb) {
+  m_stats = Splat_Stats{};
+  m_stats.n_points = points.size();
+  if (fb.w == 0 || fb.h == 0)
+    return;
+
+  for (size_t begin = 0; begin < points.size(); begin += SPLAT_BATCH)
+    splat_batch(points, begin, std::min(points.size(), begin + SPLAT_BATCH),
+                basis, fb);
+}
+
+void Star_Splatter::splat_batch(const Star_Points &points, const size_t begin,
+                                const size_t end, const Camera_Basis &basis,
+                                Framebuffer &fb) {
+  const auto t0 = std::chrono::steady_clock::now();
+  const size_t n = end - begin;
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, SPLAT_GRAIN);
+  const uint32_t n_bands = (fb.h + SPLAT_BAND - 1) / SPLAT_BAND,
+                 n_bins = n_bands + 1; // The last collects culled points
+  m_sx.resize(n);
+  m_sy.resize(n);
+  m_flux.resize(n);
+  m_band.resize(n);
+  m_offsets.assign(n_chunks * n_bins, 0);
+
+  /* Camera space in units of the reference distance, so squared distances
+   * stay in float range, and pixel centres at integers */
+  const float s = static_cast<float>(1.0 / m_config.reference_distance);
+  const Math::vec_f3 o = basis.p, f = basis.forward, rt = basis.right,
+                     up = basis.up;
+  const float k = basis.fl * basis.h, x0 = 0.5f * basis.w - 0.5f,
+              y0 = 0.5f * basis.h - 0.5f, near = m_config.near * s,
+              exposure = m_config.exposure;
+  const float lo = -(static_cast<float>(m_radius) + 0.5f),
+              hi_x = basis.w + static_cast<float>(m_radius) - 0.5f,
+              hi_y = basis.h + static_cast<float>(m_radius) - 0.5f,
+              last_row = basis.h - 1.0f;
+
+  m_pool.parallel_for(0, n, SPLAT_GRAIN, [&](const size_t b, const size_t e,
+                                             const size_t chunk) {
+    const float *px = points.x.data() + begin, *py = points.y.data() + begin,
+                *pz = points.z.data() + begin;
+    float *sx = m_sx.data(), *sy = m_sy.data(), *flux = m_flux.data();
+    for (size_t i = b; i < e; i++) {
+      const float rx = (px[i] - o.x) * s, ry = (py[i] - o.y) * s,
+                  rz = (pz[i] - o.z) * s;
+      const float cz = rx * f.x + ry * f.y + rz * f.z,
+                  cx = rx * rt.x + ry * rt.y + rz * rt.z,
+                  cy = rx * up.x + ry * up.y + rz * up.z;
+      const float inv_z = 1.0f / cz,
+                  inv_d2 = exposure / (rx * rx + ry * ry + rz * rz);
+      sx[i] = cx * inv_z * k + x0;
+      sy[i] = -cy * inv_z * k + y0;
+      flux[i] = cz > near ? inv_d2 : 0.0f; // Selected, so the loop vectorises
+    }
+
+    /* Band of the nearest row, footprints may spill into the next ones.
+     * Selects rather than branches, most points miss the frame at random */
+    uint64_t *counts = m_offsets.data() + chunk * n_bins;
+    for (size_t i = b; i < e; i++) {
+      const bool in = (flux[i] > 0.0f) & (sx[i] > lo) & (sx[i] < hi_x) &
+                      (sy[i] > lo) & (sy[i] < hi_y);
+      const float row = std::clamp(in ? sy[i] + 0.5f : 0.0f, 0.0f, last_row);
+      m_band[i] = in ? static_cast<uint32_t>(row) / SPLAT_BAND : n_bands;
+      counts[m_band[i]]++;
+    }
+  });
+  const auto t1 = std::chrono::steady_clock::now();
+
+  // Counting sort, bands in order and chunks in order within each
+  m_band_start.resize(n_bands + 1);
+  uint64_t sum = 0;
+  for (uint32_t band = 0; band < n_bands; band++) {
+    m_band_start[band] = sum;
+    for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+      const uint64_t ct = m_offsets[chunk * n_bins + band];
+      m_offsets[chunk * n_bins + band] = sum;
+      sum += ct;
+    }
+  }
+  m_band_start[n_bands] = sum;
+
+  m_splats.resize(sum);
+  m_pool.parallel_for(0, n, SPLAT_GRAIN, [&](const size_t b, const size_t e,
+                                             const size_t chunk) {
+    uint64_t *offsets = m_offsets.data() + chunk * n_bins;
+    for (size_t i = b; i < e; i++) {
+      if (m_band[i] == n_bands)
+        continue;
+
+      const size_t p = begin + i;
+      const float flux = m_flux[i];
+      m_splats[offsets[m_band[i]]++] =
+          Splat{m_sx[i], m_sy[i], flux * points.r[p], flux * points.g[p],
+                flux * points.b[p]};
+    }
+  });
+  const auto t2 = std::chrono::steady_clock::now();
+
+  // Footprints reach half a band at most, so same parity bands never meet
+  std::atomic<uint64_t> n_faint = 0;
+  for (uint32_t parity = 0; parity < 2; parity++)
+    m_pool.dispatch((n_bands + 1 - parity) / 2, [&](const size_t i) {
+      const uint32_t band = static_cast<uint32_t>(i) * 2 + parity;
+      n_faint.fetch_add(splat_band(band, fb), std::memory_order_relaxed);
+    });
+  const auto t3 = std::chrono::steady_clock::now();
+
+  m_stats.n_visible += sum;
+  m_stats.n_faint += n_faint.load();
+  m_stats.ms_project += ms_t(t1 - t0).count();
+  m_stats.ms_bin += ms_t(t2 - t1).count();
+  m_stats.ms_splat += ms_t(t3 - t2).count();
+}
+
+uint64_t Star_Splatter::splat_band(const uint32_t band, Framebuffer &fb) {
+  const int32_t radius = static_cast<int32_t>(m_radius),
+                n_taps = 2 * radius + 1, w = static_cast<int32_t>(fb.w),
+                h = static_cast<int32_t>(fb.h);
+  const bool sky_only = !fb.depth.empty();
+  const auto is_sky = [&](const size_t i) {
+    return !sky_only || std::isinf(fb.depth[i]);
+  };
+
+  uint64_t n_faint = 0;
+  for (uint64_t k = m_band_start[band]; k < m_band_start[band + 1]; k++) {
+    const Splat &s = m_splats[k];
+    const int32_t ix = static_cast<int32_t>(std::floor(s.x + 0.5f)),
+                  iy = static_cast<int32_t>(std::floor(s.y + 0.5f));
+    const Math::vec_f4 col = {s.r, s.g, s.b, 0.0f};
+
+    if (std::max({s.r, s.g, s.b}) < m_config.faint) {
+      const size_t i = static_cast<size_t>(iy) * fb.w + ix;
+      if (ix >= 0 && ix < w && iy >= 0 && iy < h && is_sky(i))
+        fb.px[i] += col;
+      n_faint++;
+      continue;
+    }
+
+    const auto get_phase = [](const float frac) {
+      return std::min(SPLAT_PHASES - 1,
+                      static_cast<uint32_t>((frac + 0.5f) * SPLAT_PHASES));
+    };
+    const float *wx = m_psf.data() + get_phase(s.x - ix) * n_taps,
+                *wy = m_psf.data() + get_phase(s.y - iy) * n_taps;
+    for (int32_t dy = -radius; dy <= radius; dy++) {
+      const int32_t y = iy + dy;
+      if (y < 0 || y >= h)
+        continue;
+
+      const Math::vec_f4 row_col = col * wy[dy + radius];
+      const size_t row = static_cast<size_t>(y) * fb.w;
+      for (int32_t dx = std::max(-radius, -ix);
+           dx <= std::min(radius, w - 1 - ix); dx++)
+        if (is_sky(row + ix + dx))
+          fb.px[row + ix + dx] += row_col * wx[dx + radius];
+    }
+  }
+
+  return n_faint;
+}
+
+} // namespace CTNM::CPU
@@ -0,0 +1,171 @@
+#include "cpu/tile_scheduler.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace CTNM::CPU {
+
+static inline uint32_t expand_bits_16(uint32_t v) {
+  v &= 0xffff;
+  v = (v | v << 8) & 0x00ff00ff;
+  v = (v | v << 4) & 0x0f0f0f0f;
+  v = (v | v << 2) & 0x33333333;
+  v = (v | v << 1) & 0x55555555;
+  return v;
+}
+
+Tile_Scheduler::Tile_Scheduler(Parallel::Thread_Pool &pool,
+                               const uint32_t tile_size)
+    : m_pool(pool), m_tile_size(std::max<uint32_t>(tile_size, 1)) {}
+
+void Tile_Scheduler::set_tile_size(const uint32_t tile_size) {
+  m_tile_size = std::max<uint32_t>(tile_size, 1);
+  m_w = m_h = 0; // Force a new layout
+}
+
+uint32_t Tile_Scheduler::get_tile_size() const { return m_tile_size; }
+
+void Tile_Scheduler::set_deadline(const std::chrono::microseconds budget) {
+  m_budget = budget;
+}
+
+void Tile_Scheduler::layout(const uint32_t w, const uint32_t h) {
+  if (w == m_w && h == m_h)
+    return;
+
+  m_w = w;
+  m_h = h;
+  const uint32_t n_x = (w + m_tile_size - 1) / m_tile_size,
+                 n_y = (h + m_tile_size - 1) / m_tile_size;
+
+  std::vector<uint32_t> codes, order;
+  codes.reserve(n_x * n_y);
+  order.reserve(n_x * n_y);
+  for (uint32_t ty = 0; ty < n_y; ty++)
+    for (uint32_t tx = 0; tx < n_x; tx++) {
+      codes.push_back(expand_bits_16(tx) | expand_bits_16(ty) << 1);
+      order.push_back(ty * n_x + tx);
+    }
+
+  Parallel::radix_sort(m_pool, codes, order);
+
+  m_tiles.clear();
+  m_tiles.reserve(order.size());
+  for (const uint32_t i : order) {
+    const uint32_t x0 = (i % n_x) * m_tile_size, y0 = (i / n_x) * m_tile_size;
+    m_tiles.push_back(Tile{x0, y0, std::min(w, x0 + m_tile_size),
+                           std::min(h, y0 + m_tile_size)});
+  }
+}
+
+bool Tile_Scheduler::pop(const uint32_t worker, uint32_t &tile,
+                         bool &stolen) {
+  {
+    Tile_Queue &own = *m_queues[worker];
+    const std::lock_guard<std::mutex> lock(own.mtx);
+    if (!own.tiles.empty()) {
+      tile = own.tiles.front();
+      own.tiles.pop_front();
+      stolen = false;
+      return true;
+    }
+  }
+
+  // Steal from the back so the victim keeps its Morton-local tiles
+  const uint32_t n_queues = static_cast<uint32_t>(m_queues.size());
+  for (uint32_t k = 1; k < n_queues; k++) {
+    Tile_Queue &victim = *m_queues[(worker + k) % n_queues];
+    const std::lock_guard<std::mutex> lock(victim.mtx);
+    if (victim.tiles.empty())
+      continue;
+
+    tile = victim.tiles.back();
+    victim.tiles.pop_back();
+    stolen = true;
+    return true;
+  }
+
+  return false;
+}
+
+void Tile_Scheduler::run(const uint32_t w, const uint32_t h,
+                         const uint32_t n_passes, const Tile_Fn &fn) {
+  const auto tp_start = std::chrono::steady_clock::now();
+  const auto tp_deadline = tp_start + m_budget;
+  layout(w, h);
+
+  const uint32_t n_tiles = static_cast<uint32_t>(m_tiles.size());
+  m_stats = Tile_Frame_Stats{};
+  m_stats.n_tiles = n_tiles;
+  m_stats.tile_ms.assign(n_tiles, 0.0);
+  m_stats.tile_passes.assign(n_tiles, 0);
+
+  const uint32_t n_workers = m_pool.get_thread_ct();
+  if (m_queues.size() != n_workers) {
+    m_queues.clear();
+    for (uint32_t i = 0; i < n_workers; i++)
+      m_queues.push_back(std::make_unique<Tile_Queue>());
+  }
+
+  std::atomic<uint64_t> n_tiles_done = 0, n_steals = 0, n_rays = 0;
+  std::atomic<bool> cut_off = false;
+  for (uint32_t pass = 0; pass < n_passes && !cut_off.load(); pass++) {
+    // Contiguous Morton runs per worker keep neighbouring tiles together
+    for (uint32_t q = 0; q < n_workers; q++) {
+      Tile_Queue &queue = *m_queues[q];
+      queue.tiles.clear();
+      const uint32_t b = static_cast<uint32_t>(uint64_t(n_tiles) * q /
+                                               n_workers),
+                     e = static_cast<uint32_t>(uint64_t(n_tiles) * (q + 1) /
+                                               n_workers);
+      for (uint32_t i = b; i < e; i++)
+        queue.tiles.push_back(i);
+    }
+
+    const bool can_cut = pass > 0 && m_budget.count() > 0;
+    m_pool.dispatch(n_workers, [&](const size_t worker) {
+      uint32_t tile;
+      bool stolen;
+      while (pop(static_cast<uint32_t>(worker), tile, stolen)) {
+        if (can_cut && std::chrono::steady_clock::now() >= tp_deadline) {
+          cut_off.store(true);
+          return;
+        }
+
+        const auto tp_tile = std::chrono::steady_clock::now();
+        n_rays.fetch_add(fn(m_tiles[tile], pass));
+        m_stats.tile_ms[tile] += std::chrono::duration<double, std::milli>(
+                                     std::chrono::steady_clock::now() - tp_tile)
+                                     .count();
+        m_stats.tile_passes[tile] = pass + 1;
+        n_tiles_done.fetch_add(1);
+        if (stolen)
+          n_steals.fetch_add(1);
+      }
+    });
+
+    if (!cut_off.load())
+      m_stats.n_passes = pass + 1;
+  }
+
+  m_stats.n_tiles_done = n_tiles_done.load();
+  m_stats.n_steals = n_steals.load();
+  m_stats.n_rays = n_rays.load();
+  m_stats.cut_off = cut_off.load();
+  m_stats.ms = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - tp_start)
+                   .count();
+}
+
+const std::vector<Tile> &Tile_Scheduler::get_tiles() const { return m_tiles; }
+
+const Tile_Frame_Stats &Tile_Scheduler::get_stats() const { return m_stats; }
+
+} // namespace CTNM::CPU
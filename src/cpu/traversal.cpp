@@ -0,0 +1,274 @@
+#include "cpu/traversal.hpp"
+#include "cpu/lbvh.hpp"
+#include "cpu/ray.hpp"
+#include "cpu/scene.hpp"
+#include "cpu/wide_bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::CPU {
+
+namespace {
+
+/* LBVH depth is not bounded, clustered or duplicate Morton codes can make
+ * it as deep as the primitive count. Pushes past the fixed part spill to
+ * the heap */
+class Traversal_Stack {
+public:
+  void push(const uint32_t node) {
+    if (m_ct < TRAVERSAL_STACK_SIZE)
+      m_fixed[m_ct] = node;
+    else
+      m_spill.push_back(node);
+    m_ct++;
+  }
+
+  uint32_t pop() {
+    if (--m_ct < TRAVERSAL_STACK_SIZE)
+      return m_fixed[m_ct];
+
+    const uint32_t node = m_spill.back();
+    m_spill.pop_back();
+    return node;
+  }
+
+  bool empty() const { return m_ct == 0; }
+
+private:
+  uint32_t m_fixed[TRAVERSAL_STACK_SIZE];
+  std::vector<uint32_t> m_spill;
+  uint32_t m_ct = 0;
+};
+
+} // namespace
+
+/* One ray against every child box of a wide node in a single SIMD test */
+template <uint32_t N>
+static inline typename Packet_Traits<N>::vint
+intersect_children(const Ray &ray, const Wide_Node<N> &node,
+                   typename Packet_Traits<N>::vfloat &t_entry) {
+  using vfloat = typename Packet_Traits<N>::vfloat;
+  using vint = typename Packet_Traits<N>::vint;
+
+  vfloat t_near = splat<vfloat>(ray.t_min), t_far = splat<vfloat>(ray.t_max);
+  for (int axis = 0; axis < 3; axis++) {
+    vfloat q_min, q_max;
+    for (uint32_t c = 0; c < N; c++) {
+      q_min[c] = node.q_min[axis][c];
+      q_max[c] = node.q_max[axis][c];
+    }
+
+    const float scale = std::ldexp(1.0f, node.exp[axis]);
+    const float o = (node.origin[axis] - ray.o[axis]) * ray.inv_d[axis],
+                s = scale * ray.inv_d[axis];
+    const vfloat t0 = q_min * s + o, t1 = q_max * s + o;
+    t_near = simd_max(t_near, simd_min(t0, t1));
+    t_far = simd_min(t_far, simd_max(t0, t1));
+  }
+
+  // Slots past n_children hold no box and must not report a hit
+  vint filled;
+  for (uint32_t c = 0; c < N; c++)
+    filled[c] = c < node.n_children ? -1 : 0;
+
+  t_entry = t_near;
+  return (t_near <= t_far) & filled;
+}
+
+/* on_leaf(first, ct) handles a range of sorted primitive positions and may
+ * shorten ray.t_max */
+template <uint32_t N, typename Leaf_Fn>
+static void traverse(const Wide_BVH<N> &bvh, Ray &ray, Leaf_Fn &&on_leaf) {
+  using vfloat = typename Packet_Traits<N>::vfloat;
+
+  const std::vector<Wide_Node<N>> &nodes = bvh.get_nodes();
+  Traversal_Stack stack;
+  stack.push(0);
+  while (!stack.empty()) {
+    const Wide_Node<N> &node = nodes[stack.pop()];
+    vfloat t_entry;
+    const auto mask = intersect_children(ray, node, t_entry);
+    if (!simd_any(mask))
+      continue;
+
+    // Order hit children far to near so the nearest is popped first
+    uint32_t order[N];
+    uint32_t n_hit = 0;
+    for (uint32_t c = 0; c < node.n_children; c++) {
+      if (!mask[c])
+        continue;
+
+      uint32_t k = n_hit++;
+      for (; k > 0 && t_entry[order[k - 1]] < t_entry[c]; k--)
+        order[k] = order[k - 1];
+      order[k] = c;
+    }
+
+    // Leaves are intersected near to far right away to shorten t_max early
+    for (uint32_t k = n_hit; k > 0; k--) {
+      const uint32_t child = node.children[order[k - 1]];
+      if (Wide_Node<N>::is_leaf(child))
+        on_leaf(Wide_Node<N>::get_leaf_first(child),
+                Wide_Node<N>::get_leaf_ct(child));
+    }
+
+    for (uint32_t k = 0; k < n_hit; k++) {
+      const uint32_t child = node.children[order[k]];
+      if (!Wide_Node<N>::is_leaf(child))
+        stack.push(child);
+    }
+  }
+}
+
+template <uint32_t N>
+static void trace_blas(const Mesh_BVH &blas, Ray &ray, Hit &hit,
+                       const uint32_t inst) {
+  const std::vector<Triangle> &tris = blas.get_triangles();
+  const std::vector<BVH_Node> &nodes = blas.get_bvh().get_nodes();
+  const uint32_t leaf_offset = static_cast<uint32_t>(tris.size()) - 1;
+
+  traverse(blas.get_wide_bvh<N>(), ray,
+           [&](const uint32_t first, const uint32_t ct) {
+             for (uint32_t b = 0; b < ct; b += N) {
+               const int lane = intersect_triangles<N>(
+                   ray, hit, &tris[first + b], std::min(ct - b, N));
+               if (lane < 0)
+                 continue;
+
+               hit.inst = inst;
+               hit.prim = nodes[leaf_offset + first + b + lane].prim;
+             }
+           });
+}
+
+template <uint32_t N> static Hit trace_wide(const Scene &scene, Ray ray) {
+  Hit hit;
+  const std::vector<Instance> &instances = scene.get_instances();
+  const std::vector<BVH_Node> &nodes = scene.get_tlas().get_nodes();
+  const uint32_t leaf_offset = static_cast<uint32_t>(instances.size()) - 1;
+
+  traverse(scene.get_wide_tlas<N>(), ray,
+           [&](const uint32_t first, const uint32_t ct) {
+             for (uint32_t i = first; i < first + ct; i++) {
+               const uint32_t inst = nodes[leaf_offset + i].prim;
+               const Instance &instance = instances[inst];
+               Ray ray_obj = make_ray(
+                   transform_point(instance.world_to_obj, ray.o),
+                   transform_vector(instance.world_to_obj, ray.d), ray.t_min,
+                   ray.t_max);
+               trace_blas<N>(*instance.blas, ray_obj, hit, inst);
+               ray.t_max = ray_obj.t_max; // Affine maps keep t consistent
+             }
+           });
+
+  return hit;
+}
+
+Hit trace(const Scene &scene, Ray ray) {
+  if (scene.empty())
+    return Hit{};
+
+  return scene.get_wide_width() == 8 ? trace_wide<8>(scene, ray)
+                                     : trace_wide<4>(scene, ray);
+}
+
+template <uint32_t W>
+static void trace_blas(const Mesh_BVH &blas, Ray_Packet<W> &rays,
+                       Hit_Packet<W> &hits, const uint32_t inst) {
+  using vfloat = typename Ray_Packet<W>::vfloat;
+
+  const std::vector<BVH_Node> &nodes = blas.get_bvh().get_nodes();
+  const std::vector<Triangle> &tris = blas.get_triangles();
+  const uint32_t leaf_offset = static_cast<uint32_t>(tris.size()) - 1;
+
+  Traversal_Stack stack;
+  stack.push(blas.get_bvh().get_root());
+  while (!stack.empty()) {
+    const uint32_t i = stack.pop();
+    const BVH_Node &node = nodes[i];
+    vfloat t_entry;
+    if (!simd_any(intersect_box(rays, node.bounds, t_entry)))
+      continue;
+
+    if (node.is_leaf()) {
+      intersect_triangle(rays, hits, tris[i - leaf_offset], inst, node.prim);
+      continue;
+    }
+
+    // Visit the child the packet reaches first on average
+    vfloat t_l, t_r;
+    const auto mask_l =
+                   intersect_box(rays, nodes[node.children[0]].bounds, t_l),
+               mask_r =
+                   intersect_box(rays, nodes[node.children[1]].bounds, t_r);
+    const bool hit_l = simd_any(mask_l), hit_r = simd_any(mask_r);
+    if (hit_l && hit_r) {
+      const bool l_near = simd_reduce_add(simd_select(vfloat{}, t_l, mask_l)) <=
+                          simd_reduce_add(simd_select(vfloat{}, t_r, mask_r));
+      stack.push(node.children[l_near ? 1 : 0]);
+      stack.push(node.children[l_near ? 0 : 1]);
+    } else if (hit_l)
+      stack.push(node.children[0]);
+    else if (hit_r)
+      stack.push(node.children[1]);
+  }
+}
+
+template <uint32_t W>
+void trace(const Scene &scene, Ray_Packet<W> &rays, Hit_Packet<W> &hits) {
+  using vfloat = typename Ray_Packet<W>::vfloat;
+  using vint = typename Ray_Packet<W>::vint;
+
+  hits.t = splat<vfloat>(std::numeric_limits<float>::infinity());
+  hits.u = hits.v = vfloat{};
+  hits.inst = hits.prim = splat<vint>(-1);
+  if (scene.empty())
+    return;
+
+  const std::vector<Instance> &instances = scene.get_instances();
+  const std::vector<BVH_Node> &nodes = scene.get_tlas().get_nodes();
+
+  Traversal_Stack stack;
+  stack.push(scene.get_tlas().get_root());
+  while (!stack.empty()) {
+    const BVH_Node &node = nodes[stack.pop()];
+    vfloat t_entry;
+    const vint mask = intersect_box(rays, node.bounds, t_entry);
+    if (!simd_any(mask))
+      continue;
+
+    if (!node.is_leaf()) {
+      stack.push(node.children[1]);
+      stack.push(node.children[0]);
+      continue;
+    }
+
+    /* Move the packet into object space, the matrix is shared by all lanes */
+    const Affine &m = instances[node.prim].world_to_obj;
+    Ray_Packet<W> rays_obj;
+    for (int r = 0; r < 3; r++) {
+      rays_obj.o[r] = rays.o[0] * m.c[0][r] + rays.o[1] * m.c[1][r] +
+                      rays.o[2] * m.c[2][r] + m.t[r];
+      rays_obj.d[r] = rays.d[0] * m.c[0][r] + rays.d[1] * m.c[1][r] +
+                      rays.d[2] * m.c[2][r];
+      rays_obj.inv_d[r] = get_inv_dir(rays_obj.d[r]);
+    }
+    rays_obj.t_min = rays.t_min;
+    rays_obj.t_max = rays.t_max;
+    rays_obj.active = mask;
+
+    trace_blas(*instances[node.prim].blas, rays_obj, hits, node.prim);
+    rays.t_max = simd_select(rays.t_max, rays_obj.t_max, mask);
+  }
+}
+
+template void trace<4>(const Scene &, Ray_Packet<4> &, Hit_Packet<4> &);
+template void trace<8>(const Scene &, Ray_Packet<8> &, Hit_Packet<8> &);
+template void trace<16>(const Scene &, Ray_Packet<16> &, Hit_Packet<16> &);
+
+} // namespace CTNM::CPU
@@ -0,0 +1,187 @@
+#include "cpu/wide_bvh.hpp"
+#include "cpu/lbvh.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace CTNM::CPU {
+
+struct Prim_Range {
+  uint32_t first = 0, ct = 0;
+};
+
+/* Binary subtrees cover contiguous sorted positions */
+static std::vector<Prim_Range> get_ranges(const std::vector<BVH_Node> &nodes,
+                                          const uint32_t leaf_offset) {
+  std::vector<Prim_Range> ranges(nodes.size());
+  std::vector<std::pair<uint32_t, bool>> stack{{0, false}};
+  while (!stack.empty()) {
+    const auto [i, expanded] = stack.back();
+    stack.pop_back();
+    const BVH_Node &node = nodes[i];
+    if (node.is_leaf()) {
+      ranges[i] = Prim_Range{i - leaf_offset, 1};
+      continue;
+    }
+
+    if (!expanded) {
+      stack.emplace_back(i, true);
+      stack.emplace_back(node.children[0], false);
+      stack.emplace_back(node.children[1], false);
+      continue;
+    }
+
+    const Prim_Range &l = ranges[node.children[0]],
+                     &r = ranges[node.children[1]];
+    ranges[i] = Prim_Range{std::min(l.first, r.first), l.ct + r.ct};
+  }
+
+  return ranges;
+}
+
+template <uint32_t N>
+static void quantize(Wide_Node<N> &node, const Math::AABB &parent,
+                     const Math::AABB *child_bounds) {
+  for (int axis = 0; axis < 3; axis++) {
+    const float extent = parent.max[axis] - parent.min[axis];
+    const int exp =
+        extent > 0.0f ? static_cast<int>(std::ceil(std::log2(extent / 255.0f)))
+                      : -126;
+    const int8_t exp_clamped = static_cast<int8_t>(std::clamp(exp, -126, 127));
+    const float inv_scale = std::ldexp(1.0f, -exp_clamped);
+
+    node.origin[axis] = parent.min[axis];
+    node.exp[axis] = exp_clamped;
+    for (uint32_t c = 0; c < N; c++) {
+      if (c >= node.n_children) {
+        /* Empty slots are masked by the traversal; the slab test orders
+         * each axis's bounds, so this box alone would not miss */
+        node.q_min[axis][c] = 255;
+        node.q_max[axis][c] = 0;
+        continue;
+      }
+
+      // Nudge outwards where float rounding left the decoded box too small
+      const float scale = std::ldexp(1.0f, exp_clamped);
+      float lo = std::floor((child_bounds[c].min[axis] - node.origin[axis]) *
+                            inv_scale),
+            hi = std::ceil((child_bounds[c].max[axis] - node.origin[axis]) *
+                           inv_scale);
+      if (node.origin[axis] + lo * scale > child_bounds[c].min[axis])
+        lo -= 1.0f;
+      if (node.origin[axis] + hi * scale < child_bounds[c].max[axis])
+        hi += 1.0f;
+
+      node.q_min[axis][c] = static_cast<uint8_t>(std::clamp(lo, 0.0f, 255.0f));
+      node.q_max[axis][c] = static_cast<uint8_t>(std::clamp(hi, 0.0f, 255.0f));
+    }
+  }
+}
+
+template <uint32_t N>
+void Wide_BVH<N>::collapse(const LBVH &bvh, const uint32_t max_leaf_prims) {
+  const auto tp_start = std::chrono::steady_clock::now();
+  const std::vector<BVH_Node> &nodes = bvh.get_nodes();
+  m_nodes.clear();
+  m_stats = Wide_BVH_Stats{};
+  if (nodes.empty())
+    return;
+
+  const uint32_t n_prims = static_cast<uint32_t>(nodes.size() + 1) / 2;
+  const uint32_t leaf_offset = n_prims - 1;
+  const uint32_t max_leaf = std::clamp<uint32_t>(max_leaf_prims, 1,
+                                                 WIDE_LEAF_MAX_PRIMS);
+  const std::vector<Prim_Range> ranges = get_ranges(nodes, leaf_offset);
+  const auto is_leaf = [&](const uint32_t i) {
+    return nodes[i].is_leaf() || ranges[i].ct <= max_leaf;
+  };
+
+  m_nodes.reserve(n_prims / (N - 1) + 1);
+  m_nodes.emplace_back();
+
+  // Pairs of (binary node, wide node) still to be collapsed
+  std::vector<std::pair<uint32_t, uint32_t>> stack{{bvh.get_root(), 0}};
+  while (!stack.empty()) {
+    const auto [b, w] = stack.back();
+    stack.pop_back();
+
+    /* Greedily open the largest internal child until N children are found */
+    uint32_t cands[N];
+    uint32_t n_cands = 0;
+    if (nodes[b].is_leaf())
+      cands[n_cands++] = b;
+    else {
+      cands[n_cands++] = nodes[b].children[0];
+      cands[n_cands++] = nodes[b].children[1];
+    }
+
+    while (n_cands < N) {
+      int best = -1;
+      float best_area = -1.0f;
+      for (uint32_t c = 0; c < n_cands; c++) {
+        const float area = Math::surface_area(nodes[cands[c]].bounds);
+        if (!is_leaf(cands[c]) && area > best_area) {
+          best = static_cast<int>(c);
+          best_area = area;
+        }
+      }
+
+      if (best < 0)
+        break;
+
+      const BVH_Node &opened = nodes[cands[best]];
+      cands[best] = opened.children[0];
+      cands[n_cands++] = opened.children[1];
+    }
+
+    Math::AABB child_bounds[N];
+    Wide_Node<N> node{};
+    node.n_children = static_cast<uint8_t>(n_cands);
+    for (uint32_t c = 0; c < n_cands; c++) {
+      child_bounds[c] = nodes[cands[c]].bounds;
+      if (is_leaf(cands[c])) {
+        node.children[c] = Wide_Node<N>::encode_leaf(ranges[cands[c]].first,
+                                                     ranges[cands[c]].ct);
+        m_stats.n_leaves++;
+        continue;
+      }
+
+      node.children[c] = static_cast<uint32_t>(m_nodes.size());
+      stack.emplace_back(cands[c], node.children[c]);
+      m_nodes.emplace_back();
+    }
+
+    quantize(node, nodes[b].bounds, child_bounds);
+    m_nodes[w] = node;
+  }
+
+  m_stats.n_nodes = m_nodes.size();
+  m_stats.bytes = m_nodes.size() * sizeof(Wide_Node<N>);
+  m_stats.binary_bytes = nodes.size() * sizeof(BVH_Node);
+  m_stats.ms_collapse = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - tp_start)
+                            .count();
+}
+
+template <uint32_t N>
+const std::vector<Wide_Node<N>> &Wide_BVH<N>::get_nodes() const {
+  return m_nodes;
+}
+
+template <uint32_t N> const Wide_BVH_Stats &Wide_BVH<N>::get_stats() const {
+  return m_stats;
+}
+
+template <uint32_t N> bool Wide_BVH<N>::empty() const {
+  return m_nodes.empty();
+}
+
+template class Wide_BVH<4>;
+template class Wide_BVH<8>;
+
+} // namespace CTNM::CPU
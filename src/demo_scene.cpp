@@ -0,0 +1,51 @@
+#include "demo_scene.hpp"
+#include "components.hpp"
+#include "math_utils.hpp"
+
+#include <utility>
+
+#include <entt/entt.hpp>
+
+namespace CTNM {
+
+Components::Mesh generate_cube_mesh(const float h) {
+  Components::Mesh mesh{.verticies =
+                            {
+                                {{-h, -h, +h}}, {{+h, -h, +h}},
+                                {{+h, +h, +h}}, {{-h, +h, +h}}, // front
+                                {{+h, -h, -h}}, {{-h, -h, -h}},
+                                {{-h, +h, -h}}, {{+h, +h, -h}}, // back
+                                {{-h, -h, -h}}, {{-h, -h, +h}},
+                                {{-h, +h, +h}}, {{-h, +h, -h}}, // left
+                                {{+h, -h, +h}}, {{+h, -h, -h}},
+                                {{+h, +h, -h}}, {{+h, +h, +h}}, // right
+                                {{-h, +h, +h}}, {{+h, +h, +h}},
+                                {{+h, +h, -h}}, {{-h, +h, -h}}, // top
+                                {{-h, -h, -h}}, {{+h, -h, -h}},
+                                {{+h, -h, +h}}, {{-h, -h, +h}}, // bottom
+                            },
+                        .indicies = {
+                            0,  1,  2,  0,  2,  3,  // front
+                            4,  5,  6,  4,  6,  7,  // back
+                            8,  9,  10, 8,  10, 11, // left
+                            12, 13, 14, 12, 14, 15, // right
+                            16, 17, 18, 16, 18, 19, // top
+                            20, 21, 22, 20, 22, 23  // bottom
+                        }};
+  return mesh;
+}
+
+void populate_scene(entt::registry &reg, Components::Mesh mesh) {
+  entt::entity en1 = reg.create();
+  reg.emplace<Components::Transform>(en1, Math::vec_f3{0.0f, 0.0f, 0.0f},
+                                     Math::vec_f3{1.0f, 1.0f, 1.0f},
+                                     Math::vec_f4{25.0f, 25.0f, 25.0f, 1.0f});
+  reg.emplace<Components::Physics>(en1, Math::vec_f3{0.0f, -1.5f, 0.0f});
+  reg.emplace<Components::Mesh>(en1, std::move(mesh));
+  reg.emplace<Components::Surface>(en1, Math::vec_f3{0.0f, 255.0f, 0.0f});
+
+  entt::entity cam = reg.create();
+  reg.emplace<Components::Camera>(cam);
+}
+
+} // namespace CTNM
@@ -0,0 +1,234 @@
+#include "io/frame_writer.hpp"
+#include "cpu/renderer.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace CTNM::IO {
+
+Image_Format parse_image_format(const std::string &name) {
+  if (name == "png")
+    return Image_Format::PNG;
+  if (name == "exr")
+    return Image_Format::EXR;
+  if (name == "raw")
+    return Image_Format::RAW;
+
+  throw std::runtime_error("Failed: unknown image format, " + name);
+}
+
+const char *get_extension(const Image_Format format) {
+  switch (format) {
+  case Image_Format::PNG:
+    return ".png";
+  case Image_Format::EXR:
+    return ".exr";
+  case Image_Format::RAW:
+    return ".raw";
+  }
+
+  return "";
+}
+
+void write_png(const std::filesystem::path &path, const CPU::Framebuffer &fb) {
+  std::vector<uint8_t> rgba(fb.px.size() * 4);
+  for (size_t i = 0; i < fb.px.size(); i++)
+    for (int c = 0; c < 4; c++)
+      rgba[i * 4 + c] = static_cast<uint8_t>(
+          std::lround(std::clamp(fb.px[i][c], 0.0f, 1.0f) * 255.0f));
+
+  if (!stbi_write_png(path.c_str(), static_cast<int>(fb.w),
+                      static_cast<int>(fb.h), 4, rgba.data(),
+                      static_cast<int>(fb.w * 4)))
+    throw std::runtime_error("Failed: stbi_write_png, " + path.string());
+}
+
+template <typename T> static void put(std::vector<char> &buff, const T v) {
+  const size_t o = buff.size();
+  buff.resize(o + sizeof(T));
+  std::memcpy(buff.data() + o, &v, sizeof(T));
+}
+
+static void put_str(std::vector<char> &buff, const char *str) {
+  buff.insert(buff.end(), str, str + std::strlen(str) + 1);
+}
+
+static void put_attr(std::vector<char> &buff, const char *name,
+                     const char *type, const int32_t size) {
+  put_str(buff, name);
+  put_str(buff, type);
+  put(buff, size);
+}
+
+void write_exr(const std::filesystem::path &path, const CPU::Framebuffer &fb) {
+  // Channels must be listed alphabetically, scanline data follows that order
+  constexpr const char *channels[] = {"A", "B", "G", "R"};
+  constexpr int channel_src[] = {3, 2, 1, 0};
+  const int32_t w = static_cast<int32_t>(fb.w), h = static_cast<int32_t>(fb.h);
+
+  std::vector<char> header;
+  put<uint32_t>(header, 20000630); // Magic
+  put<uint32_t>(header, 2);        // Version 2, single part scanline
+
+  put_attr(header, "channels", "chlist", 4 * 18 + 1);
+  for (const char *channel : channels) {
+    put_str(header, channel);
+    put<int32_t>(header, 2); // FLOAT
+    put<uint32_t>(header, 0);
+    put<int32_t>(header, 1);
+    put<int32_t>(header, 1);
+  }
+  header.push_back('\0');
+
+  put_attr(header, "compression", "compression", 1);
+  header.push_back('\0'); // NO_COMPRESSION
+  for (const char *window : {"dataWindow", "displayWindow"}) {
+    put_attr(header, window, "box2i", 16);
+    put<int32_t>(header, 0);
+    put<int32_t>(header, 0);
+    put<int32_t>(header, w - 1);
+    put<int32_t>(header, h - 1);
+  }
+  put_attr(header, "lineOrder", "lineOrder", 1);
+  header.push_back('\0'); // INCREASING_Y
+  put_attr(header, "pixelAspectRatio", "float", 4);
+  put<float>(header, 1.0f);
+  put_attr(header, "screenWindowCenter", "v2f", 8);
+  put<float>(header, 0.0f);
+  put<float>(header, 0.0f);
+  put_attr(header, "screenWindowWidth", "float", 4);
+  put<float>(header, 1.0f);
+  header.push_back('\0');
+
+  const int32_t line_bytes = w * 4 * static_cast<int32_t>(sizeof(float));
+  const uint64_t lines_start =
+      header.size() + static_cast<uint64_t>(h) * sizeof(uint64_t);
+  for (int32_t y = 0; y < h; y++)
+    put<uint64_t>(header,
+                  lines_start + static_cast<uint64_t>(y) * (8 + line_bytes));
+
+  std::vector<char> lines;
+  lines.reserve(static_cast<size_t>(h) * (8 + line_bytes));
+  for (int32_t y = 0; y < h; y++) {
+    put<int32_t>(lines, y);
+    put<int32_t>(lines, line_bytes);
+    for (const int c : channel_src)
+      for (int32_t x = 0; x < w; x++)
+        put<float>(lines, fb.px[static_cast<size_t>(y) * w + x][c]);
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  file.write(lines.data(), static_cast<std::streamsize>(lines.size()));
+  if (!file)
+    throw std::runtime_error("Failed: write_exr, " + path.string());
+}
+
+void write_raw(const std::filesystem::path &path, const CPU::Framebuffer &fb) {
+  std::vector<float> rgba(fb.px.size() * 4);
+  for (size_t i = 0; i < fb.px.size(); i++)
+    for (int c = 0; c < 4; c++)
+      rgba[i * 4 + c] = fb.px[i][c];
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(rgba.data()),
+             static_cast<std::streamsize>(rgba.size() * sizeof(float)));
+  if (!file)
+    throw std::runtime_error("Failed: write_raw, " + path.string());
+}
+
+Frame_Writer::Frame_Writer(const std::filesystem::path &dir,
+                           const Image_Format format, const uint32_t n_threads,
+                           const uint32_t max_inflight)
+    : m_dir(dir), m_format(format),
+      m_max_inflight(std::max<uint32_t>(max_inflight, 1)),
+      m_pool(std::max<uint32_t>(n_threads, 1) + 1) {
+  std::error_code err;
+  std::filesystem::create_directories(m_dir, err);
+  if (err)
+    throw std::runtime_error("Failed: Frame_Writer, create_directories " +
+                             m_dir.string());
+}
+
+Frame_Writer::~Frame_Writer() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_cv.wait(lock, [this]() { return m_inflight == 0; });
+}
+
+void Frame_Writer::write(const uint64_t frame_id, const CPU::Framebuffer &fb) {
+  {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cv.wait(lock, [this]() { return m_inflight < m_max_inflight; });
+    m_inflight++;
+  }
+
+  char name[32];
+  std::snprintf(name, sizeof(name), "frame_%06llu%s",
+                static_cast<unsigned long long>(frame_id),
+                get_extension(m_format));
+
+  // Copy so the caller can render the next frame into fb immediately
+  m_pool.submit([this, path = m_dir / name,
+                 frame = std::make_shared<CPU::Framebuffer>(fb)]() {
+    std::string err;
+    try {
+      switch (m_format) {
+      case Image_Format::PNG:
+        write_png(path, *frame);
+        break;
+      case Image_Format::EXR:
+        write_exr(path, *frame);
+        break;
+      case Image_Format::RAW:
+        write_raw(path, *frame);
+        break;
+      }
+
+      m_frames_written.fetch_add(1);
+      std::error_code size_err;
+      const uintmax_t size = std::filesystem::file_size(path, size_err);
+      if (!size_err)
+        m_bytes_written.fetch_add(size);
+    } catch (const std::exception &e) {
+      err = e.what();
+    }
+
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_error.empty())
+      m_error = err;
+    m_inflight--;
+    m_cv.notify_all();
+  });
+}
+
+void Frame_Writer::flush() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_cv.wait(lock, [this]() { return m_inflight == 0; });
+  if (!m_error.empty())
+    throw std::runtime_error(m_error);
+}
+
+uint64_t Frame_Writer::get_frames_written() const {
+  return m_frames_written.load();
+}
+
+uint64_t Frame_Writer::get_bytes_written() const {
+  return m_bytes_written.load();
+}
+
+} // namespace CTNM::IO
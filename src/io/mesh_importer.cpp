@@ -0,0 +1,1358 @@
+#include "io/mesh_importer.hpp"
+#include "components.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <simd/simd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CTNM::IO {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+constexpr size_t TEXT_GRAIN = 1 << 20; // Bytes of OBJ per chunk
+constexpr size_t RECORD_GRAIN = 1 << 15;
+constexpr uint32_t MAX_JSON_DEPTH = 64;
+
+/* Read-only mapping of a whole file, empty files map to nothing */
+class Mapped_File {
+public:
+  explicit Mapped_File(const std::filesystem::path &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Failed: could not open " + path.string());
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Failed: could not stat " + path.string());
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+    void *map = m_size == 0 ? nullptr
+                            : mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      throw std::runtime_error("Failed: could not map " + path.string());
+
+    m_data = static_cast<const char *>(map);
+    if (m_data)
+      madvise(map, m_size, MADV_WILLNEED);
+  }
+
+  ~Mapped_File() {
+    if (m_data)
+      munmap(const_cast<char *>(m_data), m_size);
+  }
+
+  Mapped_File(const Mapped_File &) = delete;
+  Mapped_File &operator=(const Mapped_File &) = delete;
+
+  const char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+bool is_blank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char *skip_blank(const char *p, const char *end) {
+  while (p < end && is_blank(*p))
+    p++;
+  return p;
+}
+
+const char *skip_token(const char *p, const char *end) {
+  while (p < end && !is_blank(*p))
+    p++;
+  return p;
+}
+
+/* First byte of the line holding pos, or past it if pos starts one */
+size_t get_line_start(const char *data, const size_t size, const size_t pos) {
+  if (pos == 0 || pos >= size)
+    return std::min(pos, size);
+
+  const void *nl = std::memchr(data + pos - 1, '\n', size - pos + 1);
+  return nl ? static_cast<size_t>(static_cast<const char *>(nl) - data) + 1
+            : size;
+}
+
+template <typename Fn> void for_each_line(const char *p, const char *end,
+                                          Fn &&fn) {
+  while (p < end) {
+    const void *nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    const char *line_end = nl ? static_cast<const char *>(nl) : end;
+    fn(skip_blank(p, line_end), line_end);
+    p = line_end + 1;
+  }
+}
+
+bool parse_float(const char *&p, const char *end, float &out) {
+  p = skip_blank(p, end);
+  if (p < end && *p == '+')
+    p++;
+  const auto [next, err] = std::from_chars(p, end, out);
+  p = next;
+  return err == std::errc();
+}
+
+// -0 and +0 compare equal, so they key equal too
+uint32_t get_position_key(const Math::vec_f3 &p, const int d) {
+  return std::bit_cast<uint32_t>(p[d] + 0.0f);
+}
+
+bool same_position(const Math::vec_f3 &a, const Math::vec_f3 &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// PLY
+
+enum class Ply_Type : uint8_t { None, I8, U8, I16, U16, I32, U32, F32, F64 };
+
+Ply_Type parse_ply_type(const std::string_view name) {
+  if (name == "char" || name == "int8")
+    return Ply_Type::I8;
+  if (name == "uchar" || name == "uint8")
+    return Ply_Type::U8;
+  if (name == "short" || name == "int16")
+    return Ply_Type::I16;
+  if (name == "ushort" || name == "uint16")
+    return Ply_Type::U16;
+  if (name == "int" || name == "int32")
+    return Ply_Type::I32;
+  if (name == "uint" || name == "uint32")
+    return Ply_Type::U32;
+  if (name == "float" || name == "float32")
+    return Ply_Type::F32;
+  if (name == "double" || name == "float64")
+    return Ply_Type::F64;
+
+  throw std::runtime_error("Failed: unknown PLY type " + std::string(name));
+}
+
+size_t get_size(const Ply_Type type) {
+  switch (type) {
+  case Ply_Type::I8:
+  case Ply_Type::U8:
+    return 1;
+  case Ply_Type::I16:
+  case Ply_Type::U16:
+    return 2;
+  case Ply_Type::I32:
+  case Ply_Type::U32:
+  case Ply_Type::F32:
+    return 4;
+  case Ply_Type::F64:
+    return 8;
+  case Ply_Type::None:
+    break;
+  }
+
+  return 0;
+}
+
+template <size_t N>
+using Bits = std::conditional_t<
+    N == 1, uint8_t,
+    std::conditional_t<N == 2, uint16_t,
+                       std::conditional_t<N == 4, uint32_t, uint64_t>>>;
+
+template <typename T> T load_scalar(const char *p, const bool swap) {
+  using U = Bits<sizeof(T)>;
+  U bits;
+  std::memcpy(&bits, p, sizeof(U));
+  if (swap)
+    bits = std::byteswap(bits);
+  return std::bit_cast<T>(bits);
+}
+
+double load_number(const char *p, const Ply_Type type, const bool swap) {
+  switch (type) {
+  case Ply_Type::I8:
+    return load_scalar<int8_t>(p, swap);
+  case Ply_Type::U8:
+    return load_scalar<uint8_t>(p, swap);
+  case Ply_Type::I16:
+    return load_scalar<int16_t>(p, swap);
+  case Ply_Type::U16:
+    return load_scalar<uint16_t>(p, swap);
+  case Ply_Type::I32:
+    return load_scalar<int32_t>(p, swap);
+  case Ply_Type::U32:
+    return load_scalar<uint32_t>(p, swap);
+  case Ply_Type::F32:
+    return load_scalar<float>(p, swap);
+  case Ply_Type::F64:
+    return load_scalar<double>(p, swap);
+  case Ply_Type::None:
+    break;
+  }
+
+  return 0.0;
+}
+
+struct Ply_Property {
+  std::string name;
+  Ply_Type type = Ply_Type::None, count_type = Ply_Type::None; // List if set
+};
+
+struct Ply_Element {
+  std::string name;
+  uint64_t count = 0;
+  std::vector<Ply_Property> properties;
+  size_t stride = 0; // Zero if any property is a list
+};
+
+// The face's vertex index list, other face properties are skipped past
+size_t find_face_indices(const Ply_Element &element) {
+  for (size_t k = 0; k < element.properties.size(); k++) {
+    const Ply_Property &property = element.properties[k];
+    if (property.count_type != Ply_Type::None &&
+        (property.name == "vertex_indices" || property.name == "vertex_index"))
+      return k;
+  }
+
+  throw std::runtime_error("Failed: unsupported PLY face layout");
+}
+
+/* ASCII records are whitespace separated numbers */
+class Ply_Text {
+public:
+  Ply_Text(const char *p, const char *end) : m_p(p), m_end(end) {}
+
+  double next() {
+    while (m_p < m_end && std::isspace(static_cast<unsigned char>(*m_p)))
+      m_p++;
+    if (m_p < m_end && *m_p == '+')
+      m_p++;
+    if (m_p == m_end)
+      throw std::runtime_error("Failed: truncated PLY");
+
+    double value = 0.0;
+    const auto [next, err] = std::from_chars(m_p, m_end, value);
+    if (err != std::errc())
+      throw std::runtime_error("Failed: bad PLY number");
+    m_p = next;
+    return value;
+  }
+
+  // Values in a list, or 1 for a scalar
+  uint64_t get_count(const Ply_Property &property) {
+    if (property.count_type == Ply_Type::None)
+      return 1;
+
+    const double n = next();
+    if (!(n >= 0.0 && n <= static_cast<double>(UINT32_MAX)))
+      throw std::runtime_error("Failed: bad PLY list count");
+    return static_cast<uint64_t>(n);
+  }
+
+  void skip(const uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      next();
+  }
+
+private:
+  const char *m_p, *m_end;
+};
+
+/* Text is walked serially, vertices take x y z and faces are fanned into
+ * triangles */
+void load_ply_ascii(const char *data, const char *end,
+                    const std::vector<Ply_Element> &elements,
+                    Components::Mesh &mesh) {
+  Ply_Text text(data, end);
+  std::vector<uint32_t> polygon;
+  for (const Ply_Element &element : elements) {
+    const std::vector<Ply_Property> &properties = element.properties;
+    if (element.name == "vertex") {
+      size_t xyz[3] = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+      for (size_t k = 0; k < properties.size(); k++)
+        for (int d = 0; d < 3; d++)
+          if (properties[k].count_type == Ply_Type::None &&
+              properties[k].name == std::string(1, static_cast<char>('x' + d)))
+            xyz[d] = k;
+      if (xyz[0] == SIZE_MAX || xyz[1] == SIZE_MAX || xyz[2] == SIZE_MAX)
+        throw std::runtime_error("Failed: unsupported PLY vertex layout");
+
+      for (uint64_t i = 0; i < element.count; i++) {
+        Math::vec_f3 v = {0.0f, 0.0f, 0.0f};
+        for (size_t k = 0; k < properties.size(); k++) {
+          const uint64_t n = text.get_count(properties[k]);
+          if (properties[k].count_type != Ply_Type::None) {
+            text.skip(n);
+            continue;
+          }
+
+          const float value = static_cast<float>(text.next());
+          for (int d = 0; d < 3; d++)
+            if (k == xyz[d])
+              v[d] = value;
+        }
+        mesh.verticies.push_back(Components::Vertex{v});
+      }
+      continue;
+    }
+
+    const size_t indices =
+        element.name == "face" ? find_face_indices(element) : SIZE_MAX;
+    for (uint64_t i = 0; i < element.count && !properties.empty(); i++)
+      for (size_t k = 0; k < properties.size(); k++) {
+        const uint64_t n = text.get_count(properties[k]);
+        if (k != indices) {
+          text.skip(n);
+          continue;
+        }
+
+        polygon.clear();
+        for (uint64_t j = 0; j < n; j++) {
+          const double index = text.next();
+          if (!(index >= 0.0 &&
+                index < static_cast<double>(mesh.verticies.size())))
+            throw std::runtime_error("Failed: PLY face index out of range");
+          polygon.push_back(static_cast<uint32_t>(index));
+        }
+        for (size_t j = 2; j < polygon.size(); j++) {
+          mesh.indicies.push_back(polygon[0]);
+          mesh.indicies.push_back(polygon[j - 1]);
+          mesh.indicies.push_back(polygon[j]);
+        }
+      }
+  }
+}
+
+// glTF
+
+struct Json {
+  enum class Type { Null, Bool, Number, String, Array, Object };
+
+  Type type = Type::Null;
+  double number = 0.0;
+  std::string string;
+  std::vector<Json> items;                           // Array
+  std::vector<std::pair<std::string, Json>> members; // Object
+
+  const Json *find(const std::string_view key) const {
+    for (const auto &[name, value] : members)
+      if (name == key)
+        return &value;
+    return nullptr;
+  }
+
+  const Json &at(const uint64_t i) const {
+    if (type != Type::Array || i >= items.size())
+      throw std::runtime_error("Failed: glTF index out of range");
+    return items[i];
+  }
+
+  uint64_t get_uint(const std::string_view key, const uint64_t fallback) const {
+    const Json *value = find(key);
+    if (!value)
+      return fallback;
+    if (value->type != Type::Number || value->number < 0.0)
+      throw std::runtime_error("Failed: glTF " + std::string(key) +
+                               " is not a count");
+    return static_cast<uint64_t>(value->number);
+  }
+};
+
+/* Enough JSON for glTF, numbers are read as doubles */
+class Json_Parser {
+public:
+  Json_Parser(const char *data, const size_t size)
+      : m_p(data), m_end(data + size) {}
+
+  Json parse() {
+    Json value = parse_value(0);
+    skip_space();
+    if (m_p != m_end)
+      fail();
+    return value;
+  }
+
+private:
+  const char *m_p, *m_end;
+
+  [[noreturn]] void fail() {
+    throw std::runtime_error("Failed: malformed glTF JSON");
+  }
+
+  void skip_space() {
+    while (m_p < m_end &&
+           (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+      m_p++;
+  }
+
+  void expect(const char c) {
+    skip_space();
+    if (m_p >= m_end || *m_p != c)
+      fail();
+    m_p++;
+  }
+
+  bool consume(const std::string_view word) {
+    if (static_cast<size_t>(m_end - m_p) < word.size() ||
+        std::string_view(m_p, word.size()) != word)
+      return false;
+    m_p += word.size();
+    return true;
+  }
+
+  uint32_t parse_hex4() {
+    if (m_end - m_p < 4)
+      fail();
+    uint32_t code = 0;
+    const auto [next, err] = std::from_chars(m_p, m_p + 4, code, 16);
+    if (err != std::errc() || next != m_p + 4)
+      fail();
+    m_p += 4;
+    return code;
+  }
+
+  std::string parse_string() {
+    expect('"');
+    std::string out;
+    while (m_p < m_end && *m_p != '"') {
+      if (*m_p != '\\') {
+        out.push_back(*m_p++);
+        continue;
+      }
+
+      if (++m_p >= m_end)
+        fail();
+      const char c = *m_p++;
+      switch (c) {
+      case 'b':
+        out.push_back('\b');
+        break;
+      case 'f':
+        out.push_back('\f');
+        break;
+      case 'n':
+        out.push_back('\n');
+        break;
+      case 'r':
+        out.push_back('\r');
+        break;
+      case 't':
+        out.push_back('\t');
+        break;
+      case 'u': {
+        uint32_t code = parse_hex4();
+        if (code >= 0xd800 && code < 0xdc00 && consume("\\u"))
+          code = 0x10000 + ((code - 0xd800) << 10) + (parse_hex4() - 0xdc00);
+
+        // UTF-8
+        if (code < 0x80) {
+          out.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+          out.push_back(static_cast<char>(0xc0 | code >> 6));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        } else if (code < 0x10000) {
+          out.push_back(static_cast<char>(0xe0 | code >> 12));
+          out.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        } else {
+          out.push_back(static_cast<char>(0xf0 | code >> 18));
+          out.push_back(static_cast<char>(0x80 | (code >> 12 & 0x3f)));
+          out.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        break;
+      }
+      default:
+        out.push_back(c); // Quote, backslash and slash
+      }
+    }
+
+    expect('"');
+    return out;
+  }
+
+  Json parse_value(const uint32_t depth) {
+    if (depth > MAX_JSON_DEPTH)
+      fail();
+
+    skip_space();
+    if (m_p >= m_end)
+      fail();
+
+    Json value;
+    if (*m_p == '{') {
+      value.type = Json::Type::Object;
+      m_p++;
+      skip_space();
+      if (m_p < m_end && *m_p == '}') {
+        m_p++;
+        return value;
+      }
+
+      do {
+        std::string key = parse_string();
+        expect(':');
+        value.members.emplace_back(std::move(key), parse_value(depth + 1));
+        skip_space();
+      } while (m_p < m_end && *m_p == ',' && ++m_p);
+      expect('}');
+    } else if (*m_p == '[') {
+      value.type = Json::Type::Array;
+      m_p++;
+      skip_space();
+      if (m_p < m_end && *m_p == ']') {
+        m_p++;
+        return value;
+      }
+
+      do {
+        value.items.push_back(parse_value(depth + 1));
+        skip_space();
+      } while (m_p < m_end && *m_p == ',' && ++m_p);
+      expect(']');
+    } else if (*m_p == '"') {
+      value.type = Json::Type::String;
+      value.string = parse_string();
+    } else if (consume("true") || consume("false")) {
+      value.type = Json::Type::Bool;
+      value.number = m_p[-1] == 'e' && m_p[-2] == 'u' ? 1.0 : 0.0;
+    } else if (consume("null")) {
+      value.type = Json::Type::Null;
+    } else {
+      value.type = Json::Type::Number;
+      const auto [next, err] = std::from_chars(m_p, m_end, value.number);
+      if (err != std::errc())
+        fail();
+      m_p = next;
+    }
+
+    return value;
+  }
+};
+
+std::vector<char> decode_base64(const std::string_view text) {
+  std::vector<char> out;
+  out.reserve(text.size() / 4 * 3);
+  uint32_t bits = 0, n_bits = 0;
+  for (const char c : text) {
+    uint32_t v;
+    if (c >= 'A' && c <= 'Z')
+      v = static_cast<uint32_t>(c - 'A');
+    else if (c >= 'a' && c <= 'z')
+      v = static_cast<uint32_t>(c - 'a') + 26;
+    else if (c >= '0' && c <= '9')
+      v = static_cast<uint32_t>(c - '0') + 52;
+    else if (c == '+' || c == '-')
+      v = 62;
+    else if (c == '/' || c == '_')
+      v = 63;
+    else if (c == '=')
+      break;
+    else
+      throw std::runtime_error("Failed: bad base64 in glTF data URI");
+
+    bits = bits << 6 | v;
+    n_bits += 6;
+    if (n_bits >= 8) {
+      n_bits -= 8;
+      out.push_back(static_cast<char>(bits >> n_bits & 0xff));
+    }
+  }
+
+  return out;
+}
+
+std::string decode_uri(const std::string_view uri) {
+  std::string out;
+  for (size_t i = 0; i < uri.size(); i++) {
+    uint32_t byte = 0;
+    if (uri[i] == '%' && i + 2 < uri.size() &&
+        std::from_chars(uri.data() + i + 1, uri.data() + i + 3, byte, 16).ec ==
+            std::errc()) {
+      out.push_back(static_cast<char>(byte));
+      i += 2;
+    } else {
+      out.push_back(uri[i]);
+    }
+  }
+
+  return out;
+}
+
+using Mat4 = std::array<double, 16>; // Column major, as glTF stores them
+
+constexpr Mat4 IDENTITY = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+Mat4 multiply(const Mat4 &a, const Mat4 &b) {
+  Mat4 m = {};
+  for (int c = 0; c < 4; c++)
+    for (int r = 0; r < 4; r++)
+      for (int k = 0; k < 4; k++)
+        m[c * 4 + r] += a[k * 4 + r] * b[c * 4 + k];
+  return m;
+}
+
+std::vector<double> get_numbers(const Json &node, const std::string_view key,
+                                const size_t n) {
+  const Json *value = node.find(key);
+  if (!value)
+    return {};
+  if (value->type != Json::Type::Array || value->items.size() != n)
+    throw std::runtime_error("Failed: glTF node " + std::string(key) +
+                             " has the wrong size");
+
+  std::vector<double> out(n);
+  for (size_t i = 0; i < n; i++)
+    out[i] = value->items[i].number;
+  return out;
+}
+
+/* matrix, or translation * rotation * scale */
+Mat4 get_local_transform(const Json &node) {
+  if (const std::vector<double> m = get_numbers(node, "matrix", 16); !m.empty())
+    return Mat4{m[0], m[1], m[2],  m[3],  m[4],  m[5],  m[6],  m[7],
+                m[8], m[9], m[10], m[11], m[12], m[13], m[14], m[15]};
+
+  std::vector<double> t = get_numbers(node, "translation", 3);
+  std::vector<double> q = get_numbers(node, "rotation", 4);
+  std::vector<double> s = get_numbers(node, "scale", 3);
+  if (t.empty())
+    t = {0.0, 0.0, 0.0};
+  if (q.empty())
+    q = {0.0, 0.0, 0.0, 1.0};
+  if (s.empty())
+    s = {1.0, 1.0, 1.0};
+
+  const double x = q[0], y = q[1], z = q[2], w = q[3];
+  return Mat4{(1 - 2 * (y * y + z * z)) * s[0],
+              (2 * (x * y + z * w)) * s[0],
+              (2 * (x * z - y * w)) * s[0],
+              0.0,
+              (2 * (x * y - z * w)) * s[1],
+              (1 - 2 * (x * x + z * z)) * s[1],
+              (2 * (y * z + x * w)) * s[1],
+              0.0,
+              (2 * (x * z + y * w)) * s[2],
+              (2 * (y * z - x * w)) * s[2],
+              (1 - 2 * (x * x + y * y)) * s[2],
+              0.0,
+              t[0],
+              t[1],
+              t[2],
+              1.0};
+}
+
+/* Bytes of one accessor, stride zero means tightly packed */
+struct Gltf_View {
+  const char *data = nullptr;
+  uint64_t count = 0, stride = 0;
+  uint32_t component = 0;
+};
+
+struct Gltf_Draw {
+  Gltf_View p, idx; // idx.data is null for unindexed primitives
+  Mat4 transform = IDENTITY;
+  uint64_t first_vertex = 0, first_index = 0;
+};
+
+constexpr uint32_t GLTF_U8 = 5121, GLTF_U16 = 5123, GLTF_U32 = 5125,
+                   GLTF_F32 = 5126, GLTF_TRIANGLES = 4;
+
+} // namespace
+
+Mesh_Format get_mesh_format(const std::filesystem::path &path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](const unsigned char c) { return std::tolower(c); });
+  if (ext == ".obj")
+    return Mesh_Format::OBJ;
+  if (ext == ".ply")
+    return Mesh_Format::PLY;
+  if (ext == ".gltf" || ext == ".glb")
+    return Mesh_Format::GLTF;
+
+  throw std::runtime_error("Failed: unknown mesh format " + path.string());
+}
+
+Mesh_Importer::Mesh_Importer(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+void Mesh_Importer::set_config(const Mesh_Import_Config &config) {
+  m_config = config;
+}
+
+const Mesh_Import_Config &Mesh_Importer::get_config() const {
+  return m_config;
+}
+
+const Mesh_Import_Stats &Mesh_Importer::get_stats() const { return m_stats; }
+
+void Mesh_Importer::load(const std::filesystem::path &path,
+                         Components::Mesh &mesh) {
+  m_stats = Mesh_Import_Stats{};
+  const Mesh_Format format = get_mesh_format(path);
+
+  const auto t0 = std::chrono::steady_clock::now();
+  const Mapped_File file(path);
+  m_stats.bytes = file.size();
+  const auto t1 = std::chrono::steady_clock::now();
+
+  // Built aside so a file that fails to load leaves the mesh untouched
+  Components::Mesh loaded;
+  switch (format) {
+  case Mesh_Format::OBJ:
+    load_obj(file.data(), file.size(), loaded);
+    break;
+  case Mesh_Format::PLY:
+    load_ply(file.data(), file.size(), loaded);
+    break;
+  case Mesh_Format::GLTF:
+    load_gltf(path, file.data(), file.size(), loaded);
+    break;
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+
+  m_stats.n_verticies = loaded.verticies.size();
+  if (m_config.weld)
+    weld(loaded);
+  m_stats.n_triangles = loaded.indicies.size() / 3;
+  mesh.verticies = std::move(loaded.verticies);
+  mesh.indicies = std::move(loaded.indicies);
+  mesh.revision++;
+  const auto t3 = std::chrono::steady_clock::now();
+
+  m_stats.ms_map = ms_t(t1 - t0).count();
+  m_stats.ms_parse = ms_t(t2 - t1).count();
+  m_stats.ms_weld = ms_t(t3 - t2).count();
+}
+
+/* Chunks start at line breaks. The first pass counts what each chunk
+ * emits so the second writes straight into the mesh at fixed offsets and
+ * resolves relative indices against the vertices before it */
+void Mesh_Importer::load_obj(const char *data, const size_t size,
+                             Components::Mesh &mesh) {
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(size, TEXT_GRAIN);
+  std::vector<uint64_t> v_start(n_chunks + 1, 0), i_start(n_chunks + 1, 0);
+  const auto get_range = [&](const size_t chunk) {
+    return std::pair{
+        data + get_line_start(data, size, chunk * TEXT_GRAIN),
+        data + get_line_start(data, size, (chunk + 1) * TEXT_GRAIN)};
+  };
+
+  m_pool.parallel_for(0, n_chunks, 1, [&](const size_t b, const size_t e,
+                                          size_t) {
+    for (size_t chunk = b; chunk < e; chunk++) {
+      uint64_t n_v = 0, n_i = 0;
+      const auto [begin, end] = get_range(chunk);
+      for_each_line(begin, end, [&](const char *p, const char *line_end) {
+        if (line_end - p < 2 || !is_blank(p[1]))
+          return;
+        if (p[0] == 'v') {
+          n_v++;
+        } else if (p[0] == 'f') {
+          uint64_t n_refs = 0;
+          for (p = skip_blank(p + 1, line_end); p < line_end;
+               p = skip_blank(skip_token(p, line_end), line_end))
+            n_refs++;
+          n_i += n_refs >= 3 ? 3 * (n_refs - 2) : 0;
+        }
+      });
+      v_start[chunk + 1] = n_v;
+      i_start[chunk + 1] = n_i;
+    }
+  });
+
+  for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+    v_start[chunk + 1] += v_start[chunk];
+    i_start[chunk + 1] += i_start[chunk];
+  }
+  const uint64_t n_verticies = v_start[n_chunks];
+  if (n_verticies > UINT32_MAX)
+    throw std::runtime_error("Failed: OBJ has too many vertices");
+
+  mesh.verticies.resize(n_verticies);
+  mesh.indicies.resize(i_start[n_chunks]);
+  std::atomic<bool> ok = true;
+  m_pool.parallel_for(0, n_chunks, 1, [&](const size_t b, const size_t e,
+                                          size_t) {
+    std::vector<uint32_t> refs;
+    for (size_t chunk = b; chunk < e; chunk++) {
+      uint64_t v = v_start[chunk], i = i_start[chunk];
+      const auto [begin, end] = get_range(chunk);
+      for_each_line(begin, end, [&](const char *p, const char *line_end) {
+        if (line_end - p < 2 || !is_blank(p[1]))
+          return;
+
+        if (p[0] == 'v') {
+          // Vector lanes cannot be bound to references
+          float x = 0.0f, y = 0.0f, z = 0.0f;
+          p++;
+          if (!parse_float(p, line_end, x) || !parse_float(p, line_end, y) ||
+              !parse_float(p, line_end, z))
+            ok = false;
+          mesh.verticies[v++].p = Math::vec_f3{x, y, z};
+          return;
+        }
+        if (p[0] != 'f')
+          return;
+
+        // v, v/vt, v//vn or v/vt/vn, one based or negative from the end
+        refs.clear();
+        for (p = skip_blank(p + 1, line_end); p < line_end;
+             p = skip_blank(skip_token(p, line_end), line_end)) {
+          int64_t ref = 0;
+          const auto [next, err] = std::from_chars(p, line_end, ref);
+          const int64_t k = ref > 0 ? ref - 1 : static_cast<int64_t>(v) + ref;
+          if (err != std::errc() || ref == 0 || k < 0 ||
+              k >= static_cast<int64_t>(n_verticies)) {
+            ok = false;
+            return;
+          }
+          refs.push_back(static_cast<uint32_t>(k));
+        }
+
+        for (size_t k = 2; k < refs.size(); k++) {
+          mesh.indicies[i++] = refs[0];
+          mesh.indicies[i++] = refs[k - 1];
+          mesh.indicies[i++] = refs[k];
+        }
+      });
+    }
+  });
+
+  if (!ok)
+    throw std::runtime_error("Failed: malformed OBJ");
+}
+
+/* Binary vertices are fixed size records decoded in parallel. Faces are
+ * assumed to be all triangles with only scalars beside the index list,
+ * which a parallel check of every count confirms, and walked serially
+ * otherwise. ASCII files are read serially */
+void Mesh_Importer::load_ply(const char *data, const size_t size,
+                             Components::Mesh &mesh) {
+  const char *end = data + size;
+  const char *p = data;
+  bool swap = false, ascii = false;
+  std::vector<Ply_Element> elements;
+  const auto next_line = [&]() {
+    const void *nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    if (!nl)
+      throw std::runtime_error("Failed: truncated PLY header");
+    const std::string_view line(p, static_cast<const char *>(nl) - p);
+    p = static_cast<const char *>(nl) + 1;
+    return line.ends_with('\r') ? line.substr(0, line.size() - 1) : line;
+  };
+  const auto split = [](const std::string_view line) {
+    std::vector<std::string_view> words;
+    for (size_t i = 0; i < line.size();) {
+      const size_t j = std::min(line.find(' ', i), line.size());
+      if (j > i)
+        words.push_back(line.substr(i, j - i));
+      i = j + 1;
+    }
+    return words;
+  };
+
+  if (next_line() != "ply")
+    throw std::runtime_error("Failed: not a PLY file");
+  for (std::string_view line = next_line(); line != "end_header";
+       line = next_line()) {
+    const std::vector<std::string_view> words = split(line);
+    if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+      continue;
+
+    if (words[0] == "format" && words.size() >= 2) {
+      ascii = words[1] == "ascii";
+      swap = (words[1] == "binary_big_endian") ==
+             (std::endian::native == std::endian::little);
+    } else if (words[0] == "element" && words.size() == 3) {
+      Ply_Element &element = elements.emplace_back();
+      element.name = words[1];
+      if (std::from_chars(words[2].data(), words[2].data() + words[2].size(),
+                          element.count)
+              .ec != std::errc())
+        throw std::runtime_error("Failed: bad PLY element count");
+    } else if (words[0] == "property" && !elements.empty()) {
+      Ply_Property &property = elements.back().properties.emplace_back();
+      if (words.size() == 5 && words[1] == "list") {
+        property.count_type = parse_ply_type(words[2]);
+        property.type = parse_ply_type(words[3]);
+        property.name = words[4];
+      } else if (words.size() == 3) {
+        property.type = parse_ply_type(words[1]);
+        property.name = words[2];
+      } else {
+        throw std::runtime_error("Failed: bad PLY property");
+      }
+    }
+  }
+
+  if (ascii) {
+    load_ply_ascii(p, end, elements, mesh);
+    return;
+  }
+
+  // Advances past a list count and checks its values follow, 1 for scalars
+  const auto get_count = [&](const Ply_Property &property) {
+    uint64_t n = 1;
+    if (property.count_type != Ply_Type::None) {
+      const size_t count_size = get_size(property.count_type);
+      if (static_cast<size_t>(end - p) < count_size)
+        throw std::runtime_error("Failed: truncated PLY");
+      const double count = load_number(p, property.count_type, swap);
+      if (!(count >= 0.0))
+        throw std::runtime_error("Failed: bad PLY list count");
+      n = static_cast<uint64_t>(count);
+      p += count_size;
+    }
+    if (static_cast<uint64_t>(end - p) / get_size(property.type) < n)
+      throw std::runtime_error("Failed: truncated PLY");
+    return n;
+  };
+
+  for (Ply_Element &element : elements) {
+    for (const Ply_Property &property : element.properties)
+      element.stride = property.count_type == Ply_Type::None &&
+                               (element.stride > 0 ||
+                                &property == &element.properties.front())
+                           ? element.stride + get_size(property.type)
+                           : 0;
+    if (element.properties.empty())
+      element.stride = 0;
+  }
+
+  for (const Ply_Element &element : elements) {
+    const size_t remaining = static_cast<size_t>(end - p);
+    if (element.name == "vertex") {
+      size_t offset = 0, xyz[3] = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+      Ply_Type types[3] = {};
+      for (const Ply_Property &property : element.properties) {
+        for (int d = 0; d < 3; d++)
+          if (property.name == std::string(1, static_cast<char>('x' + d))) {
+            xyz[d] = offset;
+            types[d] = property.type;
+          }
+        offset += get_size(property.type);
+      }
+      if (element.stride == 0 || xyz[0] == SIZE_MAX || xyz[1] == SIZE_MAX ||
+          xyz[2] == SIZE_MAX || element.count > remaining / element.stride)
+        throw std::runtime_error("Failed: unsupported PLY vertex layout");
+
+      const char *records = p;
+      const size_t stride = element.stride;
+      mesh.verticies.resize(element.count);
+      m_pool.parallel_for(
+          0, element.count, RECORD_GRAIN,
+          [&](const size_t b, const size_t e, size_t) {
+            for (size_t i = b; i < e; i++) {
+              const char *record = records + i * stride;
+              Math::vec_f3 &out = mesh.verticies[i].p;
+              for (int d = 0; d < 3; d++)
+                out[d] = types[d] == Ply_Type::F32
+                             ? load_scalar<float>(record + xyz[d], swap)
+                             : static_cast<float>(load_number(
+                                   record + xyz[d], types[d], swap));
+            }
+          });
+      p += element.count * stride;
+      continue;
+    }
+
+    if (element.name != "face") {
+      if (element.stride > 0) {
+        if (element.count > remaining / element.stride)
+          throw std::runtime_error("Failed: truncated PLY");
+        p += element.count * element.stride;
+        continue;
+      }
+
+      // Lists elsewhere are skipped one record at a time
+      for (uint64_t i = 0; i < element.count && !element.properties.empty();
+           i++)
+        for (const Ply_Property &property : element.properties)
+          p += get_count(property) * get_size(property.type);
+      continue;
+    }
+
+    const size_t indices = find_face_indices(element);
+    const Ply_Type count_type = element.properties[indices].count_type;
+    const Ply_Type index_type = element.properties[indices].type;
+    const size_t count_size = get_size(count_type);
+    const size_t index_size = get_size(index_type);
+
+    // Scalars around the index list keep triangle records a fixed size
+    size_t before = 0, after = 0;
+    bool scalars = true;
+    for (size_t k = 0; k < element.properties.size(); k++)
+      if (k != indices) {
+        scalars &= element.properties[k].count_type == Ply_Type::None;
+        (k < indices ? before : after) += get_size(element.properties[k].type);
+      }
+
+    const size_t stride = before + count_size + 3 * index_size + after;
+    const uint64_t n_verticies = mesh.verticies.size();
+    const char *records = p;
+    std::atomic<bool> triangles =
+        scalars && element.count <= remaining / stride;
+    if (triangles)
+      m_pool.parallel_for(0, element.count, RECORD_GRAIN,
+                          [&](const size_t b, const size_t e, size_t) {
+                            for (size_t i = b; i < e && triangles; i++)
+                              if (load_number(records + i * stride + before,
+                                              count_type, swap) != 3.0)
+                                triangles = false;
+                          });
+
+    std::atomic<bool> ok = true;
+    const auto get_index = [&](const char *q) {
+      const double k = load_number(q, index_type, swap);
+      if (!(k >= 0.0 && k < static_cast<double>(n_verticies))) {
+        ok = false;
+        return uint32_t(0);
+      }
+      return static_cast<uint32_t>(k);
+    };
+
+    if (triangles) {
+      const size_t first = before + count_size;
+      mesh.indicies.resize(element.count * 3);
+      m_pool.parallel_for(
+          0, element.count, RECORD_GRAIN,
+          [&](const size_t b, const size_t e, size_t) {
+            for (size_t i = b; i < e; i++)
+              for (size_t k = 0; k < 3; k++)
+                mesh.indicies[i * 3 + k] =
+                    get_index(records + i * stride + first + k * index_size);
+          });
+      p += element.count * stride;
+    } else {
+      mesh.indicies.clear();
+      for (uint64_t i = 0; i < element.count; i++)
+        for (size_t k = 0; k < element.properties.size(); k++) {
+          const Ply_Property &property = element.properties[k];
+          const uint64_t n = get_count(property);
+          for (uint64_t j = 2; k == indices && j < n; j++) {
+            mesh.indicies.push_back(get_index(p));
+            mesh.indicies.push_back(get_index(p + (j - 1) * index_size));
+            mesh.indicies.push_back(get_index(p + j * index_size));
+          }
+          p += n * get_size(property.type);
+        }
+    }
+
+    if (!ok)
+      throw std::runtime_error("Failed: PLY face index out of range");
+  }
+}
+
+/* The JSON is small and parsed serially; positions and indices are copied
+ * out of the buffers per primitive in parallel */
+void Mesh_Importer::load_gltf(const std::filesystem::path &path,
+                              const char *data, const size_t size,
+                              Components::Mesh &mesh) {
+  // A .glb is a JSON chunk and an optional binary chunk
+  std::string_view json(data, size), bin;
+  if (size >= 12 && std::memcmp(data, "glTF", 4) == 0) {
+    uint32_t header[3];
+    std::memcpy(header, data, sizeof(header));
+    if (header[1] != 2 || header[2] > size)
+      throw std::runtime_error("Failed: unsupported glb " + path.string());
+
+    json = {};
+    for (size_t o = 12; o + 8 <= header[2];) {
+      uint32_t chunk[2];
+      std::memcpy(chunk, data + o, sizeof(chunk));
+      if (chunk[0] > header[2] - o - 8)
+        throw std::runtime_error("Failed: truncated glb " + path.string());
+      if (chunk[1] == 0x4e4f534a) // JSON
+        json = std::string_view(data + o + 8, chunk[0]);
+      else if (chunk[1] == 0x004e4942) // BIN
+        bin = std::string_view(data + o + 8, chunk[0]);
+      o += 8 + (chunk[0] + 3) / 4 * 4;
+    }
+  }
+
+  const Json root = Json_Parser(json.data(), json.size()).parse();
+  const auto get_array = [&](const char *key) -> const Json & {
+    static const Json empty = [] {
+      Json value;
+      value.type = Json::Type::Array;
+      return value;
+    }();
+    const Json *value = root.find(key);
+    return value && value->type == Json::Type::Array ? *value : empty;
+  };
+  const Json &buffers = get_array("buffers");
+  const Json &views = get_array("bufferViews");
+  const Json &accessors = get_array("accessors");
+  const Json &meshes = get_array("meshes");
+  const Json &nodes = get_array("nodes");
+  const Json &scenes = get_array("scenes");
+
+  // Buffers are the glb chunk, a base64 data URI or a file beside this one
+  std::vector<std::string_view> buffer_data(buffers.items.size());
+  std::vector<std::vector<char>> decoded;
+  std::vector<std::unique_ptr<Mapped_File>> files;
+  for (size_t b = 0; b < buffers.items.size(); b++) {
+    const Json *uri = buffers.items[b].find("uri");
+    if (!uri) {
+      buffer_data[b] = bin;
+    } else if (uri->string.starts_with("data:")) {
+      const size_t comma = uri->string.find(',');
+      if (comma == std::string::npos ||
+          uri->string.substr(0, comma).find(";base64") == std::string::npos)
+        throw std::runtime_error("Failed: glTF data URI is not base64");
+      const std::vector<char> &bytes = decoded.emplace_back(
+          decode_base64(std::string_view(uri->string).substr(comma + 1)));
+      buffer_data[b] = std::string_view(bytes.data(), bytes.size());
+    } else {
+      const Mapped_File &file = *files.emplace_back(
+          std::make_unique<Mapped_File>(path.parent_path() /
+                                        decode_uri(uri->string)));
+      buffer_data[b] = std::string_view(file.data(), file.size());
+      m_stats.bytes += file.size();
+    }
+
+    if (buffer_data[b].size() < buffers.items[b].get_uint("byteLength", 0))
+      throw std::runtime_error("Failed: glTF buffer shorter than declared");
+  }
+
+  const auto get_view = [&](const uint64_t accessor_id, const char *type,
+                            const uint64_t n_components) {
+    const Json &accessor = accessors.at(accessor_id);
+    const Json *accessor_type = accessor.find("type");
+    if (!accessor_type || accessor_type->string != type)
+      throw std::runtime_error(std::string("Failed: glTF accessor is not ") +
+                               type);
+    if (accessor.find("sparse") || !accessor.find("bufferView"))
+      throw std::runtime_error("Failed: sparse glTF accessors unsupported");
+
+    const Json &view = views.at(accessor.get_uint("bufferView", 0));
+    const std::string_view buffer =
+        buffer_data.at(view.get_uint("buffer", 0));
+    Gltf_View out;
+    out.component =
+        static_cast<uint32_t>(accessor.get_uint("componentType", 0));
+    out.count = accessor.get_uint("count", 0);
+    const uint64_t component_size = out.component == GLTF_U8    ? 1
+                                    : out.component == GLTF_U16 ? 2
+                                                                : 4;
+    const uint64_t elem_size = component_size * n_components;
+    out.stride = view.get_uint("byteStride", elem_size);
+    const uint64_t begin =
+        view.get_uint("byteOffset", 0) + accessor.get_uint("byteOffset", 0);
+    const uint64_t view_end =
+        view.get_uint("byteOffset", 0) + view.get_uint("byteLength", 0);
+    if (view_end > buffer.size() ||
+        (out.count > 0 &&
+         begin + (out.count - 1) * out.stride + elem_size > view_end))
+      throw std::runtime_error("Failed: glTF accessor overruns its buffer");
+
+    out.data = buffer.data() + begin;
+    return out;
+  };
+
+  // Every triangle primitive of every node in the default scene
+  std::vector<Gltf_Draw> draws;
+  uint64_t n_verticies = 0, n_indicies = 0;
+  const auto add_mesh = [&](const Json &gltf_mesh, const Mat4 &transform) {
+    const Json *primitives = gltf_mesh.find("primitives");
+    if (!primitives)
+      return;
+    for (const Json &primitive : primitives->items) {
+      const Json *attributes = primitive.find("attributes");
+      if (primitive.get_uint("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES ||
+          !attributes || !attributes->find("POSITION"))
+        continue;
+
+      Gltf_Draw &draw = draws.emplace_back();
+      draw.p = get_view(attributes->get_uint("POSITION", 0), "VEC3", 3);
+      if (draw.p.component != GLTF_F32)
+        throw std::runtime_error("Failed: glTF positions must be float");
+      if (primitive.find("indices")) {
+        draw.idx = get_view(primitive.get_uint("indices", 0), "SCALAR", 1);
+        if (draw.idx.component != GLTF_U8 && draw.idx.component != GLTF_U16 &&
+            draw.idx.component != GLTF_U32)
+          throw std::runtime_error("Failed: bad glTF index type");
+      }
+
+      draw.transform = transform;
+      draw.first_vertex = n_verticies;
+      draw.first_index = n_indicies;
+      n_verticies += draw.p.count;
+      n_indicies += (draw.idx.data ? draw.idx.count : draw.p.count) / 3 * 3;
+    }
+  };
+
+  const auto add_node = [&](const auto &self, const uint64_t node_id,
+                            const Mat4 &parent, const uint32_t depth) -> void {
+    if (depth > MAX_JSON_DEPTH)
+      throw std::runtime_error("Failed: glTF node hierarchy too deep");
+
+    const Json &node = nodes.at(node_id);
+    const Mat4 transform = multiply(parent, get_local_transform(node));
+    if (node.find("mesh"))
+      add_mesh(meshes.at(node.get_uint("mesh", 0)), transform);
+    if (const Json *children = node.find("children"))
+      for (const Json &child : children->items)
+        self(self, static_cast<uint64_t>(child.number), transform, depth + 1);
+  };
+
+  if (!scenes.items.empty()) {
+    const Json &scene = scenes.at(root.get_uint("scene", 0));
+    if (const Json *roots = scene.find("nodes"))
+      for (const Json &node : roots->items)
+        add_node(add_node, static_cast<uint64_t>(node.number), IDENTITY, 0);
+  } else {
+    for (const Json &gltf_mesh : meshes.items)
+      add_mesh(gltf_mesh, IDENTITY);
+  }
+
+  if (n_verticies > UINT32_MAX)
+    throw std::runtime_error("Failed: glTF has too many vertices");
+  mesh.verticies.resize(n_verticies);
+  mesh.indicies.resize(n_indicies);
+  std::atomic<bool> ok = true;
+  for (const Gltf_Draw &draw : draws) {
+    const Mat4 &m = draw.transform;
+    m_pool.parallel_for(
+        0, draw.p.count, RECORD_GRAIN,
+        [&](const size_t b, const size_t e, size_t) {
+          for (size_t i = b; i < e; i++) {
+            float v[3];
+            std::memcpy(v, draw.p.data + i * draw.p.stride, sizeof(v));
+            Math::vec_f3 &out = mesh.verticies[draw.first_vertex + i].p;
+            for (int r = 0; r < 3; r++)
+              out[r] = static_cast<float>(m[r] * v[0] + m[4 + r] * v[1] +
+                                          m[8 + r] * v[2] + m[12 + r]);
+          }
+        });
+
+    const uint64_t n = (draw.idx.data ? draw.idx.count : draw.p.count) / 3 * 3;
+    m_pool.parallel_for(
+        0, n, RECORD_GRAIN, [&](const size_t b, const size_t e, size_t) {
+          for (size_t i = b; i < e; i++) {
+            uint32_t k = static_cast<uint32_t>(i); // Unindexed
+            if (draw.idx.data) {
+              const char *src = draw.idx.data + i * draw.idx.stride;
+              k = draw.idx.component == GLTF_U8
+                      ? static_cast<uint8_t>(*src)
+                  : draw.idx.component == GLTF_U16
+                      ? load_scalar<uint16_t>(src, false)
+                      : load_scalar<uint32_t>(src, false);
+            }
+
+            if (k >= draw.p.count)
+              ok = false;
+            mesh.indicies[draw.first_index + i] =
+                static_cast<uint32_t>(draw.first_vertex) + k;
+          }
+        });
+  }
+
+  if (!ok)
+    throw std::runtime_error("Failed: glTF index out of range");
+}
+
+/* Vertices sort by position, z first and then x and y, with a stable
+ * radix sort, so equal positions form one run in file order. Each takes
+ * the first vertex of its run and the survivors keep their original order */
+void Mesh_Importer::weld(Components::Mesh &mesh) {
+  const size_t n = mesh.verticies.size();
+  if (n < 2)
+    return;
+
+  m_keys.resize(n);
+  m_order.resize(n);
+  m_pool.parallel_for(0, n, Parallel::PRIMITIVE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          m_keys[i] = get_position_key(mesh.verticies[i].p, 2);
+                          m_order[i] = static_cast<uint32_t>(i);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, m_keys, m_order);
+
+  m_xy_keys.resize(n);
+  m_pool.parallel_for(0, n, Parallel::PRIMITIVE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t k = b; k < e; k++) {
+                          const Math::vec_f3 &p = mesh.verticies[m_order[k]].p;
+                          m_xy_keys[k] =
+                              uint64_t(get_position_key(p, 0)) << 32 |
+                              get_position_key(p, 1);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, m_xy_keys, m_order);
+
+  // Each chunk looks back once for the start of its first run
+  m_first.resize(n);
+  m_pool.parallel_for(
+      0, n, Parallel::PRIMITIVE_GRAIN,
+      [&](const size_t b, const size_t e, size_t) {
+        const auto starts_run = [&](const size_t k) {
+          return k == 0 || !same_position(mesh.verticies[m_order[k - 1]].p,
+                                          mesh.verticies[m_order[k]].p);
+        };
+
+        size_t run = b;
+        while (!starts_run(run))
+          run--;
+        for (size_t k = b; k < e; k++) {
+          if (starts_run(k))
+            run = k;
+          m_first[m_order[k]] = m_order[run];
+        }
+      });
+
+  // Survivors' new slots, then every vertex's through its first
+  Parallel::compact_indices(
+      m_pool, n, [&](const size_t i) { return m_first[i] == i; }, m_kept);
+  m_stats.n_welded = n - m_kept.size();
+  if (m_stats.n_welded == 0)
+    return;
+
+  std::vector<Components::Vertex> verticies(m_kept.size());
+  m_pool.parallel_for(0, m_kept.size(), Parallel::PRIMITIVE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t j = b; j < e; j++) {
+                          verticies[j] = mesh.verticies[m_kept[j]];
+                          m_keys[m_kept[j]] = static_cast<uint32_t>(j);
+                        }
+                      });
+  m_pool.parallel_for(0, mesh.indicies.size(), Parallel::PRIMITIVE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++)
+                          mesh.indicies[i] = m_keys[m_first[mesh.indicies[i]]];
+                      });
+  mesh.verticies = std::move(verticies);
+}
+
+} // namespace CTNM::IO
@@ -0,0 +1,469 @@
+#include "io/read_scheduler.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#if __has_include(<linux/io_uring.h>)
+#define CTNM_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace CTNM::IO {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+int open_uncached(const std::filesystem::path &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed: could not open " + path.string());
+
+#ifdef F_NOCACHE
+  fcntl(fd, F_NOCACHE, 1);
+#endif
+  return fd;
+}
+
+// Our caller keeps what it reads, so the kernel need not
+void drop_cached(const int fd, const uint64_t offset, const uint64_t size) {
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(size),
+                POSIX_FADV_DONTNEED);
+#else
+  (void)fd;
+  (void)offset;
+  (void)size;
+#endif
+}
+
+bool read_fully(const int fd, std::byte *data, const uint64_t size,
+                uint64_t offset) {
+  for (uint64_t done = 0; done < size;) {
+    const ssize_t n = pread(fd, data + done, size - done,
+                            static_cast<off_t>(offset + done));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+
+    done += static_cast<uint64_t>(n);
+  }
+
+  return true;
+}
+
+} // namespace
+
+/* The kernel's submission and completion rings, shared through mmap. Only
+ * the thread in drive_ring() touches them once they are set up */
+struct Read_Scheduler::Ring {
+#ifdef CTNM_IO_URING
+  struct Slot {
+    uint64_t key = 0, offset = 0, size = 0;
+    uint64_t done = 0; // Bytes read so far, short reads are resubmitted
+    std::vector<std::byte> data;
+  };
+
+  int fd = -1;
+  void *sq_map = nullptr, *cq_map = nullptr;
+  size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+  io_uring_sqe *sqes = nullptr;
+  unsigned *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+  unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  std::vector<Slot> slots;
+  std::vector<uint32_t> free_slots;
+  std::vector<uint32_t> retry; // Held slots with a remainder to read
+
+  ~Ring() {
+    if (sqes)
+      munmap(sqes, sqe_bytes);
+    if (cq_map && cq_map != sq_map)
+      munmap(cq_map, cq_bytes);
+    if (sq_map)
+      munmap(sq_map, sq_bytes);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  static std::unique_ptr<Ring> create(const uint32_t depth) {
+    io_uring_params params = {};
+    const long fd = syscall(__NR_io_uring_setup, depth, &params);
+    if (fd < 0)
+      return nullptr;
+
+    auto ring = std::make_unique<Ring>();
+    ring->fd = static_cast<int>(fd);
+
+    // IORING_OP_READ came with the probe in 5.6, older kernels fail both
+    std::vector<uint64_t> probe_words(
+        (sizeof(io_uring_probe) +
+         IORING_OP_LAST * sizeof(io_uring_probe_op)) /
+            sizeof(uint64_t) +
+        1);
+    auto *probe = reinterpret_cast<io_uring_probe *>(probe_words.data());
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe,
+                IORING_OP_LAST) < 0 ||
+        probe->last_op < IORING_OP_READ ||
+        !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED))
+      return nullptr;
+
+    ring->sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_bytes =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      ring->sq_bytes = ring->cq_bytes =
+          std::max(ring->sq_bytes, ring->cq_bytes);
+
+    void *sq_map =
+        mmap(nullptr, ring->sq_bytes, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED)
+      return nullptr;
+    ring->sq_map = sq_map;
+
+    void *cq_map = sq_map;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      cq_map = mmap(nullptr, ring->cq_bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+      if (cq_map == MAP_FAILED)
+        return nullptr;
+    }
+    ring->cq_map = cq_map;
+
+    ring->sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, ring->sqe_bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      return nullptr;
+    ring->sqes = static_cast<io_uring_sqe *>(sqes);
+
+    auto *sq = static_cast<char *>(sq_map);
+    auto *cq = static_cast<char *>(cq_map);
+    ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    ring->slots.resize(std::min(depth, params.sq_entries));
+    for (uint32_t i = static_cast<uint32_t>(ring->slots.size()); i-- > 0;)
+      ring->free_slots.push_back(i);
+    return ring;
+  }
+
+  // Slots not free are owned by the kernel or waiting in retry
+  uint32_t get_in_flight() const {
+    return static_cast<uint32_t>(slots.size() - free_slots.size());
+  }
+
+  uint32_t acquire(const uint64_t key, const uint64_t offset,
+                   const uint64_t size) {
+    const uint32_t s = free_slots.back();
+    free_slots.pop_back();
+    slots[s] = Slot{key, offset, size, 0, std::vector<std::byte>(size)};
+    return s;
+  }
+
+  void release(const uint32_t s) {
+    slots[s].data = {};
+    free_slots.push_back(s);
+  }
+
+  // Queues a read of what slot s still lacks, the kernel sees it on enter()
+  void queue(const uint32_t s, const int file) {
+    const Slot &slot = slots[s];
+    const unsigned tail = *sq_tail, i = tail & *sq_mask;
+    io_uring_sqe &sqe = sqes[i];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<uint64_t>(slot.data.data() + slot.done);
+    sqe.len = static_cast<uint32_t>(
+        std::min<uint64_t>(slot.size - slot.done, uint64_t(1) << 30));
+    sqe.off = slot.offset + slot.done;
+    sqe.user_data = s;
+    sq_array[i] = i;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  /* Takes back the last n queued entries. Without SQPOLL the kernel only
+   * reads the submission ring inside enter(), so this is safe after it */
+  void unqueue(const uint32_t n) {
+    __atomic_store_n(sq_tail, *sq_tail - n, __ATOMIC_RELEASE);
+  }
+
+  // Entries the kernel took, or -1
+  int enter(const uint32_t to_submit, const uint32_t min_complete) {
+    long ret;
+    do
+      ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                    min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr,
+                    0);
+    while (ret < 0 && errno == EINTR);
+    return static_cast<int>(ret);
+  }
+#else
+  static std::unique_ptr<Ring> create(const uint32_t) { return nullptr; }
+#endif
+};
+
+Read_Scheduler::Read_Scheduler(const std::filesystem::path &path,
+                               const Read_Scheduler_Config &config)
+    : m_config(config), m_fd(open_uncached(path)),
+      m_ring(config.use_uring
+                 ? Ring::create(std::max<uint32_t>(config.queue_depth, 1))
+                 : nullptr),
+      m_pool(m_ring ? 2 : std::max<uint32_t>(config.queue_depth, 1) + 1) {
+  m_stats.uring = m_ring != nullptr;
+  if (m_ring) {
+    m_driving = true;
+    m_pool.submit([this]() { drive_ring(); });
+  }
+}
+
+Read_Scheduler::~Read_Scheduler() {
+  {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_stopping = true;
+    m_queue.clear();
+    m_seq.clear();
+    m_cv.notify_all();
+
+    // Buffers and the descriptor must outlive every read in flight
+    m_done_cv.wait(lock, [this]() {
+      return m_stats.n_in_flight == 0 && !m_driving;
+    });
+  }
+
+  ::close(m_fd);
+}
+
+void Read_Scheduler::request(const uint64_t key, const uint64_t offset,
+                             const uint64_t size, const float priority) {
+  {
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_stopping)
+      return;
+
+    auto it = m_seq.find(key);
+    if (it != m_seq.end() && it->second == 0)
+      return;
+    if (it == m_seq.end()) {
+      it = m_seq.emplace(key, 0).first;
+      m_stats.n_requested++;
+      m_stats.n_outstanding++;
+    }
+
+    it->second = m_next_seq++;
+    m_queue.push_back(Pending{priority, it->second, key, offset, size});
+    std::push_heap(m_queue.begin(), m_queue.end(), is_later);
+  }
+
+  // Each task takes whatever is most urgent when it runs
+  if (m_ring)
+    m_cv.notify_one();
+  else
+    m_pool.submit([this]() { read_one(); });
+}
+
+void Read_Scheduler::clear_queued() {
+  const std::lock_guard<std::mutex> lock(m_mtx);
+  for (auto it = m_seq.begin(); it != m_seq.end();) {
+    if (it->second != 0) {
+      it = m_seq.erase(it);
+      m_stats.n_outstanding--;
+    } else
+      it++;
+  }
+
+  m_queue.clear();
+  m_done_cv.notify_all();
+}
+
+size_t Read_Scheduler::poll(std::vector<Read_Result> &out, const bool wait) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  if (wait)
+    m_done_cv.wait(lock, [this]() {
+      return !m_done.empty() || m_stats.n_outstanding == 0;
+    });
+
+  const size_t n = m_done.size();
+  for (Read_Result &result : m_done)
+    out.push_back(std::move(result));
+  m_done.clear();
+  return n;
+}
+
+Read_Stats Read_Scheduler::get_stats() const {
+  const std::lock_guard<std::mutex> lock(m_mtx);
+  Read_Stats stats = m_stats;
+  if (stats.n_in_flight > 0)
+    stats.ms_busy +=
+        ms_t(std::chrono::steady_clock::now() - m_busy_start).count();
+  return stats;
+}
+
+bool Read_Scheduler::is_later(const Pending &a, const Pending &b) {
+  return a.priority != b.priority ? a.priority > b.priority : a.seq > b.seq;
+}
+
+bool Read_Scheduler::pop(Pending &pending) {
+  while (!m_queue.empty()) {
+    std::pop_heap(m_queue.begin(), m_queue.end(), is_later);
+    const Pending top = m_queue.back();
+    m_queue.pop_back();
+
+    // Superseded by a later request for the same key
+    const auto it = m_seq.find(top.key);
+    if (it == m_seq.end() || it->second != top.seq)
+      continue;
+
+    it->second = 0;
+    pending = top;
+    if (m_stats.n_in_flight++ == 0)
+      m_busy_start = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  return false;
+}
+
+void Read_Scheduler::finish_read(const uint64_t key, const uint64_t size,
+                                 std::vector<std::byte> &&data,
+                                 const bool ok) {
+  m_seq.erase(key);
+  m_stats.n_outstanding--;
+  m_stats.n_completed += ok ? 1 : 0;
+  m_stats.n_failed += ok ? 0 : 1;
+  m_stats.bytes_read += ok ? size : 0;
+  if (--m_stats.n_in_flight == 0)
+    m_stats.ms_busy +=
+        ms_t(std::chrono::steady_clock::now() - m_busy_start).count();
+
+  m_done.push_back(Read_Result{key, ok, ok ? std::move(data)
+                                           : std::vector<std::byte>()});
+  m_done_cv.notify_all();
+}
+
+void Read_Scheduler::read_one() {
+  Pending pending;
+  {
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_stopping || !pop(pending))
+      return;
+  }
+
+  std::vector<std::byte> data(pending.size);
+  const bool ok = read_fully(m_fd, data.data(), pending.size, pending.offset);
+  drop_cached(m_fd, pending.offset, pending.size);
+
+  const std::lock_guard<std::mutex> lock(m_mtx);
+  finish_read(pending.key, pending.size, std::move(data), ok);
+}
+
+/* Keeps the ring full from the queue and blocks in the kernel for the next
+ * completion, so requests made meanwhile wait at most one read */
+void Read_Scheduler::drive_ring() {
+#ifdef CTNM_IO_URING
+  Ring &ring = *m_ring;
+  struct Completion {
+    uint64_t key, size;
+    std::vector<std::byte> data;
+    bool ok;
+  };
+  std::vector<Completion> completions;
+  std::vector<uint32_t> queued;
+
+  std::unique_lock<std::mutex> lock(m_mtx);
+  while (true) {
+    m_cv.wait(lock, [&]() {
+      return m_stopping || ring.get_in_flight() > 0 || !m_queue.empty();
+    });
+    if (m_stopping && ring.get_in_flight() == 0)
+      break;
+
+    // Remainders of short reads go first, they already hold their slots
+    queued.clear();
+    for (const uint32_t s : ring.retry) {
+      ring.queue(s, m_fd);
+      queued.push_back(s);
+    }
+    ring.retry.clear();
+
+    Pending pending;
+    while (!m_stopping && !ring.free_slots.empty() && pop(pending)) {
+      const uint32_t s =
+          ring.acquire(pending.key, pending.offset, pending.size);
+      ring.queue(s, m_fd);
+      queued.push_back(s);
+    }
+    lock.unlock();
+
+    /* Entries the kernel did not take are taken back off the ring and
+     * failed. Slots it did take stay held until their completion */
+    const int entered = ring.enter(static_cast<uint32_t>(queued.size()),
+                                   ring.get_in_flight() > 0 ? 1 : 0);
+    const size_t taken =
+        entered < 0 ? 0 : std::min(static_cast<size_t>(entered), queued.size());
+    ring.unqueue(static_cast<uint32_t>(queued.size() - taken));
+    completions.clear();
+    for (size_t q = taken; q < queued.size(); q++) {
+      const Ring::Slot &slot = ring.slots[queued[q]];
+      completions.push_back(Completion{slot.key, slot.size, {}, false});
+      ring.release(queued[q]);
+    }
+
+    unsigned head = *ring.cq_head;
+    const unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const io_uring_cqe &cqe = ring.cqes[head & *ring.cq_mask];
+      const auto s = static_cast<uint32_t>(cqe.user_data);
+      Ring::Slot &slot = ring.slots[s];
+      if (cqe.res == -EAGAIN || cqe.res == -EINTR ||
+          (cqe.res > 0 && slot.done + cqe.res < slot.size)) {
+        slot.done += cqe.res > 0 ? static_cast<uint64_t>(cqe.res) : 0;
+        ring.retry.push_back(s);
+        continue;
+      }
+
+      // A read of nothing short of the end is the end of the file
+      const bool ok = cqe.res >= 0 && slot.done + cqe.res == slot.size;
+      drop_cached(m_fd, slot.offset, slot.size);
+      completions.push_back(
+          Completion{slot.key, slot.size, std::move(slot.data), ok});
+      ring.release(s);
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+    lock.lock();
+    for (Completion &completion : completions)
+      finish_read(completion.key, completion.size,
+                  std::move(completion.data), completion.ok);
+  }
+
+  m_driving = false;
+  m_done_cv.notify_all();
+#endif
+}
+
+} // namespace CTNM::IO
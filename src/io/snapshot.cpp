@@ -0,0 +1,585 @@
+#include "io/snapshot.hpp"
+#include "components.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef CTNM_ZSTD
+#include <zstd.h>
+#endif
+
+namespace CTNM::IO {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static constexpr size_t COPY_GRAIN = 1 << 14;
+static constexpr size_t MESH_GRAIN = 64;
+
+struct IO_Task {
+  std::byte *data = nullptr;
+  uint64_t bytes = 0, offset = 0;
+};
+
+static uint64_t align_up(const uint64_t x) {
+  return (x + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+static uint64_t get_chunk_ct(const uint64_t bytes) {
+  return (bytes + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+}
+
+static bool write_all(const int fd, const std::byte *data, uint64_t bytes,
+                      uint64_t offset) {
+  while (bytes > 0) {
+    const ssize_t n = pwrite(fd, data, bytes, static_cast<off_t>(offset));
+    if (n <= 0)
+      return false;
+
+    data += n;
+    bytes -= static_cast<uint64_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+
+  return true;
+}
+
+/* Every task runs even if one fails, the pool cannot carry exceptions */
+static bool write_tasks(Parallel::Thread_Pool &pool,
+                        const std::vector<IO_Task> &tasks, const int fd) {
+  std::atomic<bool> ok = true;
+  pool.parallel_for(0, tasks.size(), 1,
+                    [&](const size_t b, const size_t e, size_t) {
+                      for (size_t i = b; i < e; i++)
+                        if (!write_all(fd, tasks[i].data, tasks[i].bytes,
+                                       tasks[i].offset))
+                          ok = false;
+                    });
+
+  return ok;
+}
+
+Snapshot_Writer::Snapshot_Writer(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+void Snapshot_Writer::set_config(const Snapshot_Config &config) {
+#ifndef CTNM_ZSTD
+  if (config.codec == Snapshot_Codec::Zstd)
+    throw std::runtime_error("Failed: Snapshot_Writer, built without zstd");
+#endif
+  if (config.codec != Snapshot_Codec::None &&
+      config.codec != Snapshot_Codec::Zstd)
+    throw std::runtime_error("Failed: Snapshot_Writer, unknown codec");
+
+  m_config = config;
+}
+
+const Snapshot_Config &Snapshot_Writer::get_config() const { return m_config; }
+
+const Snapshot_Stats &Snapshot_Writer::get_stats() const { return m_stats; }
+
+const Snapshot_Stats &Snapshot_Writer::write(const std::filesystem::path &path,
+                                             const entt::registry &reg,
+                                             const double time) {
+  m_stats = Snapshot_Stats{};
+  m_n_columns = 0;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  add_component<Components::Camera>(reg, "Camera");
+  add_component<Components::Transform>(reg, "Transform");
+  add_component<Components::Physics>(reg, "Physics");
+  add_component<Components::Gas>(reg, "Gas");
+  add_component<Components::Collider>(reg, "Collider");
+  add_component<Components::Surface>(reg, "Surface");
+  add_component<Components::Black_Hole>(reg, "Black_Hole");
+  add_component<Components::Accretion_Disk>(reg, "Accretion_Disk");
+  add_component<Components::Orbit>(reg, "Orbit");
+  add_component<Components::Star>(reg, "Star");
+  add_meshes(reg);
+  m_stats.n_columns = m_n_columns;
+  const auto t1 = std::chrono::steady_clock::now();
+
+  // Chunks compress independently, so they spread over the pool
+  if (m_config.codec == Snapshot_Codec::Zstd) {
+    std::vector<std::pair<uint32_t, uint32_t>> chunks;
+    for (uint32_t c = 0; c < m_n_columns; c++) {
+      Column &column = m_columns[c];
+      const uint64_t n_chunks =
+          get_chunk_ct(column.desc.count * column.desc.elem_size);
+      column.chunks.resize(n_chunks);
+      column.chunk_bytes.resize(n_chunks);
+      for (uint32_t k = 0; k < n_chunks; k++)
+        chunks.emplace_back(c, k);
+    }
+
+    std::atomic<bool> ok = true;
+    m_pool.parallel_for(0, chunks.size(), 1, [&](const size_t b,
+                                                 const size_t e, size_t) {
+      for (size_t i = b; i < e; i++) {
+#ifdef CTNM_ZSTD
+        Column &column = m_columns[chunks[i].first];
+        const uint64_t k = chunks[i].second;
+        const uint64_t raw_bytes = column.desc.count * column.desc.elem_size;
+        const uint64_t begin = k * SNAPSHOT_CHUNK;
+        const uint64_t bytes = std::min(SNAPSHOT_CHUNK, raw_bytes - begin);
+        std::vector<std::byte> &out = column.chunks[k];
+        out.resize(ZSTD_compressBound(bytes));
+        const size_t n = ZSTD_compress(out.data(), out.size(),
+                                       column.raw.get() + begin, bytes,
+                                       m_config.level);
+        if (ZSTD_isError(n))
+          ok = false;
+        else
+          out.resize(n);
+        column.chunk_bytes[k] = out.size();
+#endif
+      }
+    });
+    if (!ok)
+      throw std::runtime_error("Failed: Snapshot_Writer, compression");
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+
+  // Header and table, then each column on its own page
+  Snapshot_Header header;
+  header.n_columns = m_n_columns;
+  header.time = time;
+  std::vector<std::byte> head(sizeof(Snapshot_Header) +
+                              m_n_columns * sizeof(Snapshot_Column));
+  uint64_t offset = align_up(head.size());
+  std::vector<IO_Task> tasks;
+  for (size_t c = 0; c < m_n_columns; c++) {
+    Column &column = m_columns[c];
+    Snapshot_Column &desc = column.desc;
+    const uint64_t raw_bytes = desc.count * desc.elem_size;
+    desc.offset = offset;
+    if (desc.codec == static_cast<uint32_t>(Snapshot_Codec::None)) {
+      desc.stored = raw_bytes;
+      for (uint64_t begin = 0; begin < raw_bytes; begin += SNAPSHOT_CHUNK)
+        tasks.push_back({column.raw.get() + begin,
+                         std::min(SNAPSHOT_CHUNK, raw_bytes - begin),
+                         offset + begin});
+    } else {
+      desc.stored = column.chunk_bytes.size() * sizeof(uint64_t);
+      tasks.push_back({reinterpret_cast<std::byte *>(column.chunk_bytes.data()),
+                       desc.stored, offset});
+      for (auto &chunk : column.chunks) {
+        tasks.push_back({chunk.data(), chunk.size(), offset + desc.stored});
+        desc.stored += chunk.size();
+      }
+    }
+
+    std::memcpy(head.data() + sizeof(Snapshot_Header) +
+                    c * sizeof(Snapshot_Column),
+                &desc, sizeof(Snapshot_Column));
+    offset = align_up(offset + desc.stored);
+  }
+  header.bytes = offset;
+  std::memcpy(head.data(), &header, sizeof(Snapshot_Header));
+  tasks.push_back({head.data(), head.size(), 0});
+
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Failed: could not open " + tmp_path.string());
+
+  bool ok = ftruncate(fd, static_cast<off_t>(header.bytes)) == 0 &&
+            write_tasks(m_pool, tasks, fd) &&
+            (!m_config.sync || fsync(fd) == 0);
+  ok = close(fd) == 0 && ok;
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::filesystem::remove(tmp_path);
+    throw std::runtime_error("Failed: could not write " + path.string());
+  }
+  const auto t3 = std::chrono::steady_clock::now();
+
+  m_stats.bytes_file = header.bytes;
+  m_stats.ms_registry = ms_t(t1 - t0).count();
+  m_stats.ms_codec = ms_t(t2 - t1).count();
+  m_stats.ms_io = ms_t(t3 - t2).count();
+  return m_stats;
+}
+
+std::byte *Snapshot_Writer::add_column(const char *name,
+                                       const uint32_t elem_size,
+                                       const uint64_t count) {
+  if (std::strlen(name) >= sizeof(Snapshot_Column::name))
+    throw std::runtime_error("Failed: snapshot column name too long");
+
+  if (m_n_columns == m_columns.size())
+    m_columns.emplace_back();
+  Column &column = m_columns[m_n_columns++];
+  column.desc = Snapshot_Column{};
+  std::memcpy(column.desc.name, name, std::strlen(name));
+  column.desc.codec = static_cast<uint32_t>(m_config.codec);
+  column.desc.elem_size = elem_size;
+  column.desc.count = count;
+
+  const size_t bytes = count * elem_size;
+  if (bytes > column.capacity) {
+    column.raw = std::make_unique_for_overwrite<std::byte[]>(bytes);
+    column.capacity = bytes;
+  }
+  m_stats.bytes_raw += bytes;
+  return column.raw.get();
+}
+
+/* Entities are listed serially, the copy out of the registry is parallel */
+template <typename T>
+void Snapshot_Writer::add_component(const entt::registry &reg,
+                                    const char *name) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  m_entities.clear();
+  m_sources.clear();
+  for (const auto e : reg.view<T>()) {
+    m_entities.push_back(e);
+    m_sources.push_back(&reg.get<T>(e));
+  }
+
+  const size_t n = m_entities.size();
+  const std::string entity_name = std::string(name) + ".entity";
+  std::memcpy(add_column(entity_name.c_str(), sizeof(entt::entity), n),
+              m_entities.data(), n * sizeof(entt::entity));
+
+  std::byte *data = add_column(name, sizeof(T), n);
+  m_pool.parallel_for(0, n, COPY_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++)
+                          std::memcpy(data + i * sizeof(T), m_sources[i],
+                                      sizeof(T));
+                      });
+  m_stats.n_components += n;
+}
+
+void Snapshot_Writer::add_meshes(const entt::registry &reg) {
+  m_entities.clear();
+  m_sources.clear();
+  for (const auto e : reg.view<Components::Mesh>()) {
+    m_entities.push_back(e);
+    m_sources.push_back(&reg.get<Components::Mesh>(e));
+  }
+
+  const size_t n = m_entities.size();
+  std::memcpy(add_column("Mesh.entity", sizeof(entt::entity), n),
+              m_entities.data(), n * sizeof(entt::entity));
+
+  // Each mesh's first vertex and index, then the total
+  std::vector<uint64_t> v_start(n + 1, 0), i_start(n + 1, 0);
+  auto *sizes = reinterpret_cast<Snapshot_Mesh *>(
+      add_column("Mesh", sizeof(Snapshot_Mesh), n));
+  for (size_t i = 0; i < n; i++) {
+    const auto *mesh = static_cast<const Components::Mesh *>(m_sources[i]);
+    sizes[i] = Snapshot_Mesh{mesh->verticies.size(), mesh->indicies.size(),
+                             mesh->revision};
+    v_start[i + 1] = v_start[i] + sizes[i].n_verticies;
+    i_start[i + 1] = i_start[i] + sizes[i].n_indicies;
+  }
+
+  auto *verticies = reinterpret_cast<Components::Vertex *>(add_column(
+      "Mesh.verticies", sizeof(Components::Vertex), v_start[n]));
+  auto *indicies = reinterpret_cast<uint32_t *>(
+      add_column("Mesh.indicies", sizeof(uint32_t), i_start[n]));
+  m_pool.parallel_for(
+      0, n, MESH_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t i = b; i < e; i++) {
+          const auto *mesh =
+              static_cast<const Components::Mesh *>(m_sources[i]);
+          std::copy(mesh->verticies.begin(), mesh->verticies.end(),
+                    verticies + v_start[i]);
+          std::copy(mesh->indicies.begin(), mesh->indicies.end(),
+                    indicies + i_start[i]);
+        }
+      });
+  m_stats.n_components += n;
+}
+
+Snapshot_Reader::Snapshot_Reader(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+Snapshot_Reader::~Snapshot_Reader() { close(); }
+
+void Snapshot_Reader::open(const std::filesystem::path &path) {
+  close();
+  m_stats = Snapshot_Stats{};
+  const auto tp_start = std::chrono::steady_clock::now();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed: could not open " + path.string());
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Snapshot_Header)) {
+    ::close(fd);
+    throw std::runtime_error("Failed: truncated snapshot " + path.string());
+  }
+
+  void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                   MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("Failed: could not map " + path.string());
+
+  m_map = map;
+  m_map_bytes = static_cast<size_t>(st.st_size);
+  const auto *header = static_cast<const Snapshot_Header *>(map);
+  const auto *table = reinterpret_cast<const Snapshot_Column *>(header + 1);
+  const Snapshot_Header expected;
+  const char *error = nullptr;
+  if (std::memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0)
+    error = "Failed: not a snapshot ";
+  else if (header->endian == std::byteswap(SNAPSHOT_ENDIAN))
+    error = "Failed: snapshot has foreign byte order ";
+  else if (header->endian != SNAPSHOT_ENDIAN)
+    error = "Failed: corrupt snapshot ";
+  else if (header->version != SNAPSHOT_VERSION)
+    error = "Failed: unsupported snapshot version ";
+  else if (header->bytes > m_map_bytes ||
+           header->bytes < sizeof(Snapshot_Header) ||
+           header->n_columns > (header->bytes - sizeof(Snapshot_Header)) /
+                                   sizeof(Snapshot_Column))
+    error = "Failed: corrupt snapshot ";
+
+  for (uint64_t c = 0; !error && c < header->n_columns; c++) {
+    const Snapshot_Column &desc = table[c];
+    // count * elem_size sizes the column, compressed ones included
+    if (desc.name[sizeof(desc.name) - 1] != '\0' || desc.elem_size == 0 ||
+        desc.count > header->bytes ||
+        desc.count > UINT64_MAX / desc.elem_size ||
+        desc.offset % SNAPSHOT_ALIGN != 0 ||
+        desc.offset > header->bytes ||
+        desc.stored > header->bytes - desc.offset ||
+        (desc.codec == static_cast<uint32_t>(Snapshot_Codec::None) &&
+         desc.stored != desc.count * desc.elem_size))
+      error = "Failed: corrupt snapshot ";
+#ifndef CTNM_ZSTD
+    if (desc.codec == static_cast<uint32_t>(Snapshot_Codec::Zstd))
+      error = "Failed: snapshot needs zstd ";
+#endif
+  }
+  if (error) {
+    close();
+    throw std::runtime_error(error + path.string());
+  }
+
+  m_header = header;
+  m_table = table;
+  m_decoded.assign(header->n_columns, {});
+  m_stats.n_columns = header->n_columns;
+  m_stats.bytes_file = header->bytes;
+  m_stats.ms_io = ms_t(std::chrono::steady_clock::now() - tp_start).count();
+}
+
+void Snapshot_Reader::close() {
+  if (m_map)
+    munmap(m_map, m_map_bytes);
+
+  m_map = nullptr;
+  m_map_bytes = 0;
+  m_header = nullptr;
+  m_table = nullptr;
+  m_decoded.clear();
+}
+
+bool Snapshot_Reader::empty() const { return m_header == nullptr; }
+
+const Snapshot_Header &Snapshot_Reader::get_header() const {
+  return *m_header;
+}
+
+std::span<const Snapshot_Column> Snapshot_Reader::get_columns() const {
+  return m_header ? std::span<const Snapshot_Column>(m_table,
+                                                     m_header->n_columns)
+                  : std::span<const Snapshot_Column>();
+}
+
+const Snapshot_Stats &Snapshot_Reader::get_stats() const { return m_stats; }
+
+/* The kernel reads ahead while the registry fills, so the copy mostly
+ * waits on the disk rather than on faults one page at a time */
+void Snapshot_Reader::restore(entt::registry &reg) {
+  if (empty())
+    throw std::runtime_error("Failed: Snapshot_Reader, nothing open");
+
+  const auto tp_start = std::chrono::steady_clock::now();
+  const double ms_codec = m_stats.ms_codec;
+  madvise(m_map, m_map_bytes, MADV_WILLNEED);
+  restore_component<Components::Camera>(reg, "Camera");
+  restore_component<Components::Transform>(reg, "Transform");
+  restore_component<Components::Physics>(reg, "Physics");
+  restore_component<Components::Gas>(reg, "Gas");
+  restore_component<Components::Collider>(reg, "Collider");
+  restore_component<Components::Surface>(reg, "Surface");
+  restore_component<Components::Black_Hole>(reg, "Black_Hole");
+  restore_component<Components::Accretion_Disk>(reg, "Accretion_Disk");
+  restore_component<Components::Orbit>(reg, "Orbit");
+  restore_component<Components::Star>(reg, "Star");
+  restore_meshes(reg);
+
+  m_stats.ms_registry +=
+      ms_t(std::chrono::steady_clock::now() - tp_start).count() -
+      (m_stats.ms_codec - ms_codec);
+}
+
+double Snapshot_Reader::read(const std::filesystem::path &path,
+                             entt::registry &reg) {
+  open(path);
+  const double time = m_header->time;
+  restore(reg);
+  close();
+  return time;
+}
+
+const std::byte *Snapshot_Reader::find(const char *name,
+                                       const uint32_t elem_size,
+                                       uint64_t *count) {
+  for (size_t c = 0; c < get_columns().size(); c++) {
+    const Snapshot_Column &desc = m_table[c];
+    if (std::strncmp(desc.name, name, sizeof(desc.name)) != 0)
+      continue;
+    if (desc.elem_size != elem_size)
+      throw std::runtime_error(std::string("Failed: snapshot column ") + name +
+                               " has a different layout");
+
+    *count = desc.count;
+    if (desc.count == 0)
+      return nullptr;
+    if (desc.codec == static_cast<uint32_t>(Snapshot_Codec::None))
+      return static_cast<const std::byte *>(m_map) + desc.offset;
+    return decode(c);
+  }
+
+  return nullptr;
+}
+
+const std::byte *Snapshot_Reader::decode(const size_t c) {
+  std::vector<std::byte> &out = m_decoded[c];
+  if (!out.empty())
+    return out.data();
+
+#ifdef CTNM_ZSTD
+  const auto tp_start = std::chrono::steady_clock::now();
+  const Snapshot_Column &desc = m_table[c];
+  const std::byte *packed = static_cast<const std::byte *>(m_map) + desc.offset;
+  const uint64_t raw_bytes = desc.count * desc.elem_size;
+  const uint64_t n_chunks = get_chunk_ct(raw_bytes);
+  if (desc.stored < n_chunks * sizeof(uint64_t))
+    throw std::runtime_error("Failed: corrupt snapshot column");
+
+  std::vector<uint64_t> start(n_chunks + 1);
+  start[0] = n_chunks * sizeof(uint64_t);
+  for (uint64_t k = 0; k < n_chunks; k++) {
+    uint64_t bytes;
+    std::memcpy(&bytes, packed + k * sizeof(uint64_t), sizeof(bytes));
+    start[k + 1] = start[k] + bytes;
+    if (bytes > desc.stored || start[k + 1] > desc.stored)
+      throw std::runtime_error("Failed: corrupt snapshot column");
+  }
+
+  out.resize(raw_bytes);
+  std::atomic<bool> ok = true;
+  m_pool.parallel_for(
+      0, n_chunks, 1, [&](const size_t b, const size_t e, size_t) {
+        for (size_t k = b; k < e; k++) {
+          const uint64_t begin = k * SNAPSHOT_CHUNK;
+          const uint64_t bytes = std::min(SNAPSHOT_CHUNK, raw_bytes - begin);
+          const size_t n =
+              ZSTD_decompress(out.data() + begin, bytes, packed + start[k],
+                              start[k + 1] - start[k]);
+          if (ZSTD_isError(n) || n != bytes)
+            ok = false;
+        }
+      });
+  if (!ok) {
+    out.clear();
+    throw std::runtime_error("Failed: corrupt snapshot column");
+  }
+
+  m_stats.ms_codec +=
+      ms_t(std::chrono::steady_clock::now() - tp_start).count();
+#endif
+  return out.data();
+}
+
+/* Ids are recreated as they were, entities already present are reused */
+static const entt::entity *
+restore_entities(entt::registry &reg, const std::byte *data, const uint64_t n) {
+  const auto *entities = reinterpret_cast<const entt::entity *>(data);
+  for (uint64_t i = 0; i < n; i++)
+    if (!reg.valid(entities[i]) && reg.create(entities[i]) != entities[i])
+      throw std::runtime_error("Failed: snapshot entity id already in use");
+
+  return entities;
+}
+
+template <typename T>
+void Snapshot_Reader::restore_component(entt::registry &reg,
+                                        const char *name) {
+  const std::string entity_name = std::string(name) + ".entity";
+  uint64_t n_entities = 0, n = 0;
+  const std::byte *ids =
+      find(entity_name.c_str(), sizeof(entt::entity), &n_entities);
+  const std::byte *data = find(name, sizeof(T), &n);
+  if (!ids || !data)
+    return;
+  if (n != n_entities)
+    throw std::runtime_error(std::string("Failed: snapshot column ") + name +
+                             " does not match its entities");
+
+  const entt::entity *entities = restore_entities(reg, ids, n);
+  const auto *components = reinterpret_cast<const T *>(data);
+  reg.insert<T>(entities, entities + n, components);
+  m_stats.n_components += n;
+}
+
+void Snapshot_Reader::restore_meshes(entt::registry &reg) {
+  uint64_t n_entities = 0, n = 0, n_verticies = 0, n_indicies = 0;
+  const std::byte *ids = find("Mesh.entity", sizeof(entt::entity), &n_entities);
+  const auto *sizes = reinterpret_cast<const Snapshot_Mesh *>(
+      find("Mesh", sizeof(Snapshot_Mesh), &n));
+  const auto *verticies = reinterpret_cast<const Components::Vertex *>(
+      find("Mesh.verticies", sizeof(Components::Vertex), &n_verticies));
+  const auto *indicies = reinterpret_cast<const uint32_t *>(
+      find("Mesh.indicies", sizeof(uint32_t), &n_indicies));
+  if (!ids || !sizes)
+    return;
+
+  uint64_t v_total = 0, i_total = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    v_total += sizes[i].n_verticies;
+    i_total += sizes[i].n_indicies;
+  }
+  if (n != n_entities || v_total != n_verticies || i_total != n_indicies)
+    throw std::runtime_error("Failed: snapshot meshes do not match");
+
+  const entt::entity *entities = restore_entities(reg, ids, n);
+  for (uint64_t i = 0; i < n; i++) {
+    Components::Mesh mesh;
+    mesh.verticies.assign(verticies, verticies + sizes[i].n_verticies);
+    mesh.indicies.assign(indicies, indicies + sizes[i].n_indicies);
+    mesh.revision = sizes[i].revision;
+    reg.emplace<Components::Mesh>(entities[i], std::move(mesh));
+    verticies += sizes[i].n_verticies;
+    indicies += sizes[i].n_indicies;
+  }
+  m_stats.n_components += n;
+}
+
+} // namespace CTNM::IO
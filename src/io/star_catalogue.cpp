@@ -0,0 +1,666 @@
+#include "io/star_catalogue.hpp"
+#include "components.hpp"
+#include "cpu/disk_volume.hpp"
+#include "cpu/star_splat.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <fcntl.h>
+#include <simd/simd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CTNM::IO {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static_assert(sizeof(Star_Record) == STAR_FIELD_CT * sizeof(double),
+              "Star_Record is packed as is");
+
+namespace {
+
+constexpr size_t TEXT_GRAIN = 1 << 20; // Bytes of CSV per chunk
+constexpr size_t RECORD_GRAIN = 1 << 14;
+constexpr uint64_t DATA_ALIGN = 64;
+constexpr size_t N_REQUIRED = 3; // ra, dec and parallax lead the fields
+
+// Tangential km s^-1 of 1 mas yr^-1 at 1 pc
+constexpr double KM_S_PER_MAS_PC = 4.740470463533348e-3;
+constexpr double SOLAR_TEFF = 5772.0; // Kelvin, when there is no colour
+constexpr double MASS_LUMINOSITY_EXP = 1.0 / 3.5;
+
+/* Read-only mapping of a whole file, empty files map to nothing */
+class Catalogue_Map {
+public:
+  explicit Catalogue_Map(const std::filesystem::path &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Failed: could not open " + path.string());
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Failed: could not stat " + path.string());
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+    void *map = m_size == 0 ? nullptr
+                            : mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      throw std::runtime_error("Failed: could not map " + path.string());
+
+    m_data = static_cast<const char *>(map);
+    if (m_data)
+      madvise(map, m_size, MADV_SEQUENTIAL);
+  }
+
+  ~Catalogue_Map() {
+    if (m_data)
+      munmap(const_cast<char *>(m_data), m_size);
+  }
+
+  Catalogue_Map(const Catalogue_Map &) = delete;
+  Catalogue_Map &operator=(const Catalogue_Map &) = delete;
+
+  const char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+size_t get_page() {
+  static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return page;
+}
+
+/* VmHWM on Linux, which clear_refs can reset between measurements;
+ * ru_maxrss is in kilobytes there and in bytes on macOS */
+uint64_t get_peak_rss() {
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.starts_with("VmHWM:"))
+      return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+#endif
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// Starts reading the next window while this one is parsed
+void prefetch(const char *data, const size_t size, const size_t begin,
+              const size_t end) {
+  const size_t b = begin / get_page() * get_page(), e = std::min(end, size);
+  if (e > b)
+    madvise(const_cast<char *>(data) + b, e - b, MADV_WILLNEED);
+}
+
+/* Drops the pages between released and end, bar the one end shares with
+ * the next window, so the mapping never holds more than a window or two */
+void release(const char *data, size_t &released, const size_t end) {
+  const size_t e = end / get_page() * get_page();
+  if (e > released)
+    madvise(const_cast<char *>(data) + released, e - released, MADV_DONTNEED);
+  released = std::max(released, e);
+}
+
+/* First byte of the line holding pos, or past it if pos starts one */
+size_t get_line_start(const char *data, const size_t size, const size_t pos) {
+  if (pos == 0 || pos >= size)
+    return std::min(pos, size);
+
+  const void *nl = std::memchr(data + pos - 1, '\n', size - pos + 1);
+  return nl ? static_cast<size_t>(static_cast<const char *>(nl) - data) + 1
+            : size;
+}
+
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    text.remove_prefix(1);
+  while (!text.empty() && (text.back() == ' ' || text.back() == '\t' ||
+                           text.back() == '\r'))
+    text.remove_suffix(1);
+  return text;
+}
+
+/* Past the field starting at p, quoted fields may hold commas and "" */
+const char *get_field_end(const char *p, const char *end) {
+  if (p < end && *p == '"') {
+    for (p++; p < end; p++)
+      if (*p == '"' && (++p == end || *p != '"'))
+        break;
+  }
+
+  const void *comma = std::memchr(p, ',', static_cast<size_t>(end - p));
+  return comma ? static_cast<const char *>(comma) : end;
+}
+
+// Blank, null and anything else that is not wholly a number is missing
+double parse_number(const char *p, const char *end) {
+  const std::string_view text = trim(std::string_view(p, end - p));
+  const char *b = text.data(), *e = text.data() + text.size();
+  if (b < e && *b == '+')
+    b++;
+
+  double value = Star_Record::NONE;
+  const auto [next, err] = std::from_chars(b, e, value);
+  return err == std::errc() && next == e && b < e ? value : Star_Record::NONE;
+}
+
+template <typename Fn>
+void for_each_row(const char *p, const char *end, Fn &&fn) {
+  while (p < end) {
+    const void *nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    const char *line_end = nl ? static_cast<const char *>(nl) : end;
+    const std::string_view line = trim(std::string_view(p, line_end - p));
+    if (!line.empty() && line.front() != '#')
+      fn(line.data(), line.data() + line.size());
+    p = line_end + 1;
+  }
+}
+
+double get_temperature(const Star_Record &record) {
+  if (record.teff > 0.0)
+    return record.teff;
+  if (std::isfinite(record.bp_rp)) {
+    // Ballesteros, from the colour index of a black body
+    const double c = 0.92 * record.bp_rp;
+    return 4600.0 * (1.0 / (c + 1.7) + 1.0 / (c + 0.62));
+  }
+
+  return SOLAR_TEFF;
+}
+
+} // namespace
+
+Star_Catalogue_Reader::Star_Catalogue_Reader(Parallel::Thread_Pool &pool)
+    : m_pool(pool) {}
+
+void Star_Catalogue_Reader::set_config(const Star_Catalogue_Config &config) {
+  for (size_t f = 0; f < N_REQUIRED; f++)
+    if (config.columns[f].empty())
+      throw std::runtime_error("Failed: ra, dec and parallax need columns");
+  if (!(config.scale > 0.0))
+    throw std::runtime_error("Failed: catalogue scale must be positive");
+  if (config.window == 0)
+    throw std::runtime_error("Failed: catalogue window must be non-zero");
+
+  m_config = config;
+}
+
+const Star_Catalogue_Config &Star_Catalogue_Reader::get_config() const {
+  return m_config;
+}
+
+const Star_Catalogue_Stats &Star_Catalogue_Reader::get_stats() const {
+  return m_stats;
+}
+
+const Star_Catalogue_Stats &
+Star_Catalogue_Reader::stream(const std::filesystem::path &path,
+                              const Sink &sink) {
+  m_stats = Star_Catalogue_Stats{};
+  const Catalogue_Map map(path);
+  m_stats.bytes = map.size();
+
+  if (map.size() >= sizeof(Star_Catalogue_Header) &&
+      std::memcmp(map.data(), Star_Catalogue_Header{}.magic, 8) == 0)
+    stream_binary(map.data(), map.size(), sink);
+  else
+    stream_csv(map.data(), map.size(), sink);
+
+  m_stats.peak_rss_bytes = get_peak_rss();
+  return m_stats;
+}
+
+/* Windows end at line breaks and split into chunks that do too. Rows are
+ * counted first so each chunk parses straight into its slot of the batch,
+ * then comment and blank lines are squeezed out. Fields past the last
+ * configured column are never looked at */
+void Star_Catalogue_Reader::stream_csv(const char *data, const size_t size,
+                                       const Sink &sink) {
+  // Header, after any ECSV metadata
+  size_t pos = 0;
+  std::string_view header;
+  while (pos < size && header.empty()) {
+    const size_t line_end = get_line_start(data, size, pos + 1);
+    for_each_row(data + pos, data + line_end,
+                 [&](const char *b, const char *e) { header = {b, e}; });
+    pos = line_end;
+  }
+
+  std::vector<int32_t> slots; // Field of each column, -1 if unused
+  std::array<bool, STAR_FIELD_CT> found = {};
+  for (const char *p = header.data(), *end = p + header.size(); p <= end;) {
+    const char *field_end = get_field_end(p, end);
+    std::string_view name = trim(std::string_view(p, field_end - p));
+    if (name.size() >= 2 && name.front() == '"' && name.back() == '"')
+      name = name.substr(1, name.size() - 2);
+
+    int32_t slot = -1;
+    for (size_t f = 0; f < STAR_FIELD_CT; f++)
+      if (!found[f] && !m_config.columns[f].empty() &&
+          m_config.columns[f] == name) {
+        slot = static_cast<int32_t>(f);
+        found[f] = true;
+        break;
+      }
+    slots.push_back(slot);
+    p = field_end + 1;
+  }
+
+  for (size_t f = 0; f < N_REQUIRED; f++)
+    if (!found[f])
+      throw std::runtime_error("Failed: catalogue lacks column " +
+                               m_config.columns[f]);
+  while (slots.back() < 0)
+    slots.pop_back();
+
+  std::vector<uint64_t> n_parsed;
+  size_t released = 0;
+  for (size_t wb = pos; wb < size;) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const size_t we =
+        get_line_start(data, size, std::min(size, wb + m_config.window));
+    prefetch(data, size, we, we + m_config.window);
+
+    const size_t n_chunks =
+        Parallel::Thread_Pool::get_chunk_ct(we - wb, TEXT_GRAIN);
+    const auto get_range = [&](const size_t chunk) {
+      return std::pair{
+          data + std::min(we, get_line_start(data, size,
+                                             wb + chunk * TEXT_GRAIN)),
+          data + std::min(we, get_line_start(data, size,
+                                             wb + (chunk + 1) * TEXT_GRAIN))};
+    };
+
+    m_chunk_rows.assign(n_chunks + 1, 0);
+    n_parsed.assign(n_chunks, 0);
+    m_pool.parallel_for(0, n_chunks, 1, [&](const size_t b, const size_t e,
+                                            size_t) {
+      for (size_t chunk = b; chunk < e; chunk++) {
+        const auto [begin, end] = get_range(chunk);
+        uint64_t n = begin < end && end[-1] != '\n' ? 1 : 0;
+        for (const char *p = begin;
+             (p = static_cast<const char *>(
+                  std::memchr(p, '\n', static_cast<size_t>(end - p))));
+             p++)
+          n++;
+        m_chunk_rows[chunk + 1] = n;
+      }
+    });
+    for (size_t chunk = 0; chunk < n_chunks; chunk++)
+      m_chunk_rows[chunk + 1] += m_chunk_rows[chunk];
+
+    m_records.resize(m_chunk_rows[n_chunks]);
+    m_pool.parallel_for(0, n_chunks, 1, [&](const size_t b, const size_t e,
+                                            size_t) {
+      for (size_t chunk = b; chunk < e; chunk++) {
+        uint64_t i = m_chunk_rows[chunk];
+        const auto [begin, end] = get_range(chunk);
+        for_each_row(begin, end, [&](const char *p, const char *line_end) {
+          Star_Record record;
+          for (size_t column = 0; column < slots.size() && p <= line_end;
+               column++) {
+            const char *field_end = get_field_end(p, line_end);
+            if (slots[column] >= 0)
+              record.*STAR_FIELDS[slots[column]] =
+                  parse_number(p, field_end);
+            p = field_end + 1;
+          }
+          m_records[i++] = record;
+        });
+        n_parsed[chunk] = i - m_chunk_rows[chunk];
+      }
+    });
+
+    size_t n = 0;
+    for (size_t chunk = 0; chunk < n_chunks; chunk++) {
+      if (n != m_chunk_rows[chunk])
+        std::memmove(m_records.data() + n,
+                     m_records.data() + m_chunk_rows[chunk],
+                     n_parsed[chunk] * sizeof(Star_Record));
+      n += n_parsed[chunk];
+    }
+    m_records.resize(n);
+
+    m_stats.n_rows += n;
+    m_stats.n_batches++;
+    m_stats.ms_parse += ms_t(std::chrono::steady_clock::now() - t0).count();
+    const bool more = sink(m_records);
+    m_stats.peak_batch_bytes =
+        std::max(m_stats.peak_batch_bytes, get_batch_bytes());
+    release(data, released, we);
+    if (!more)
+      return;
+    wb = we;
+  }
+}
+
+void Star_Catalogue_Reader::stream_binary(const char *data, const size_t size,
+                                          const Sink &sink) {
+  Star_Catalogue_Header header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.version != STAR_CATALOGUE_VERSION)
+    throw std::runtime_error("Failed: unsupported star catalogue version");
+  if (header.stride == 0 || header.n_columns > size / sizeof(header) ||
+      sizeof(header) + header.n_columns * sizeof(Star_Catalogue_Column) >
+          header.data_offset ||
+      header.data_offset > size ||
+      header.n_rows > (size - header.data_offset) / header.stride)
+    throw std::runtime_error("Failed: truncated star catalogue");
+
+  // Offset and size of each field within a row, size 0 if absent
+  std::array<uint64_t, STAR_FIELD_CT> offsets = {}, sizes = {};
+  for (uint32_t c = 0; c < header.n_columns; c++) {
+    Star_Catalogue_Column column;
+    std::memcpy(&column,
+                data + sizeof(header) + c * sizeof(Star_Catalogue_Column),
+                sizeof(column));
+    if ((column.elem_size != 4 && column.elem_size != 8) ||
+        column.offset + column.elem_size > header.stride)
+      throw std::runtime_error("Failed: bad star catalogue column");
+
+    const std::string_view name(column.name,
+                                strnlen(column.name, sizeof(column.name)));
+    for (size_t f = 0; f < STAR_FIELD_CT; f++)
+      if (sizes[f] == 0 && !m_config.columns[f].empty() &&
+          m_config.columns[f] == name) {
+        offsets[f] = column.offset;
+        sizes[f] = column.elem_size;
+      }
+  }
+
+  for (size_t f = 0; f < N_REQUIRED; f++)
+    if (sizes[f] == 0)
+      throw std::runtime_error("Failed: catalogue lacks column " +
+                               m_config.columns[f]);
+
+  const uint64_t window =
+      std::max<uint64_t>(1, m_config.window / header.stride);
+  size_t released = 0;
+  for (uint64_t begin = 0; begin < header.n_rows; begin += window) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint64_t n = std::min(window, header.n_rows - begin);
+    const char *rows = data + header.data_offset + begin * header.stride;
+    prefetch(data, size, header.data_offset + (begin + n) * header.stride,
+             header.data_offset + (begin + n + window) * header.stride);
+
+    m_records.resize(n);
+    m_pool.parallel_for(0, n, RECORD_GRAIN, [&](const size_t b,
+                                                const size_t e, size_t) {
+      for (size_t i = b; i < e; i++) {
+        const char *row = rows + i * header.stride;
+        Star_Record &record = m_records[i];
+        for (size_t f = 0; f < STAR_FIELD_CT; f++) {
+          double &value = record.*STAR_FIELDS[f];
+          if (sizes[f] == 8) {
+            std::memcpy(&value, row + offsets[f], sizeof(double));
+          } else if (sizes[f] == 4) {
+            float v;
+            std::memcpy(&v, row + offsets[f], sizeof(float));
+            value = v;
+          } else {
+            value = Star_Record::NONE;
+          }
+        }
+      }
+    });
+
+    m_stats.n_rows += n;
+    m_stats.n_batches++;
+    m_stats.ms_parse += ms_t(std::chrono::steady_clock::now() - t0).count();
+    const bool more = sink(m_records);
+    m_stats.peak_batch_bytes =
+        std::max(m_stats.peak_batch_bytes, get_batch_bytes());
+    release(data, released, header.data_offset + (begin + n) * header.stride);
+    if (!more)
+      return;
+  }
+}
+
+/* Keeps the rows that pass the filters, up to max_rows in all, and turns
+ * them into components in m_transforms, m_physics, m_surfaces and
+ * m_stars */
+void Star_Catalogue_Reader::convert(std::span<const Star_Record> records) {
+  const Star_Catalogue_Config &cfg = m_config;
+  Parallel::compact_indices(
+      m_pool, records.size(),
+      [&](const size_t i) {
+        const Star_Record &r = records[i];
+        return std::isfinite(r.ra) && std::isfinite(r.dec) &&
+               std::isfinite(r.parallax) && r.parallax > 0.0 &&
+               r.parallax > cfg.min_parallax && !(r.mag > cfg.mag_limit);
+      },
+      m_kept);
+  m_kept.resize(std::min<uint64_t>(m_kept.size(),
+                                   cfg.max_rows - std::min(cfg.max_rows,
+                                                           m_stats.n_kept)));
+
+  const size_t n = m_kept.size();
+  m_transforms.resize(n);
+  m_physics.resize(n);
+  m_surfaces.resize(n);
+  m_stars.resize(n);
+  m_pool.parallel_for(0, n, RECORD_GRAIN, [&](const size_t b, const size_t e,
+                                              size_t) {
+    for (size_t k = b; k < e; k++) {
+      const Star_Record &r = records[m_kept[k]];
+      const double ra = r.ra * std::numbers::pi / 180.0,
+                   dec = r.dec * std::numbers::pi / 180.0;
+      const double d_pc = 1e3 / r.parallax;
+      const double d = d_pc * PARSEC * cfg.scale;
+
+      // Line of sight and the east and north directions on the sky
+      const double x[3] = {std::cos(dec) * std::cos(ra),
+                           std::cos(dec) * std::sin(ra), std::sin(dec)};
+      const double east[3] = {-std::sin(ra), std::cos(ra), 0.0};
+      const double north[3] = {-std::sin(dec) * std::cos(ra),
+                               -std::sin(dec) * std::sin(ra), std::cos(dec)};
+      const double v_ra = std::isfinite(r.pmra)
+                              ? r.pmra * KM_S_PER_MAS_PC * d_pc
+                              : 0.0,
+                   v_dec = std::isfinite(r.pmdec)
+                               ? r.pmdec * KM_S_PER_MAS_PC * d_pc
+                               : 0.0,
+                   v_r = std::isfinite(r.radial_velocity)
+                             ? r.radial_velocity
+                             : 0.0;
+
+      double v[3];
+      for (int i = 0; i < 3; i++)
+        v[i] = (v_r * x[i] + v_ra * east[i] + v_dec * north[i]) * 1e3 *
+               cfg.scale;
+
+      // ICRS z is the celestial pole, the scene keeps +y up
+      m_transforms[k] = Components::Transform{};
+      m_transforms[k].p =
+          Math::vec_f3{static_cast<float>(d * x[0]),
+                       static_cast<float>(d * x[2]),
+                       static_cast<float>(-d * x[1])};
+
+      const double abs_mag = std::isfinite(r.mag)
+                                 ? r.mag + 5.0 * std::log10(r.parallax) - 10.0
+                                 : SOLAR_ABS_MAG;
+      const double luminosity =
+          std::pow(10.0, -0.4 * (abs_mag - SOLAR_ABS_MAG));
+
+      m_physics[k] = Components::Physics{};
+      m_physics[k].v = Math::vec_f3{static_cast<float>(v[0]),
+                                    static_cast<float>(v[2]),
+                                    static_cast<float>(-v[1])};
+      m_physics[k].m =
+          cfg.mass_from_luminosity
+              ? static_cast<float>(SOLAR_MASS *
+                                   std::pow(luminosity, MASS_LUMINOSITY_EXP))
+              : cfg.mass;
+
+      m_surfaces[k].col =
+          CPU::get_blackbody_col(static_cast<float>(get_temperature(r))) *
+          255.0f;
+      m_stars[k].l = static_cast<float>(luminosity);
+    }
+  });
+}
+
+uint64_t Star_Catalogue_Reader::get_batch_bytes() const {
+  return m_records.capacity() * sizeof(Star_Record) +
+         m_kept.capacity() * sizeof(uint32_t) +
+         m_entities.capacity() * sizeof(entt::entity) +
+         m_transforms.capacity() * sizeof(Components::Transform) +
+         m_physics.capacity() * sizeof(Components::Physics) +
+         m_surfaces.capacity() * sizeof(Components::Surface) +
+         m_stars.capacity() * sizeof(Components::Star);
+}
+
+const Star_Catalogue_Stats &
+Star_Catalogue_Reader::load(const std::filesystem::path &path,
+                            entt::registry &reg) {
+  return stream(path, [&](std::span<const Star_Record> records) {
+    const auto t0 = std::chrono::steady_clock::now();
+    convert(records);
+    const auto t1 = std::chrono::steady_clock::now();
+
+    m_entities.resize(m_kept.size());
+    reg.create(m_entities.begin(), m_entities.end());
+    reg.insert<Components::Transform>(m_entities.begin(), m_entities.end(),
+                                      m_transforms.begin());
+    reg.insert<Components::Physics>(m_entities.begin(), m_entities.end(),
+                                    m_physics.begin());
+    reg.insert<Components::Surface>(m_entities.begin(), m_entities.end(),
+                                    m_surfaces.begin());
+    reg.insert<Components::Star>(m_entities.begin(), m_entities.end(),
+                                 m_stars.begin());
+    const auto t2 = std::chrono::steady_clock::now();
+
+    m_stats.n_kept += m_kept.size();
+    m_stats.ms_convert += ms_t(t1 - t0).count();
+    m_stats.ms_registry += ms_t(t2 - t1).count();
+    return m_stats.n_kept < m_config.max_rows;
+  });
+}
+
+const Star_Catalogue_Stats &
+Star_Catalogue_Reader::load(const std::filesystem::path &path,
+                            CPU::Star_Points &out) {
+  return stream(path, [&](std::span<const Star_Record> records) {
+    const auto t0 = std::chrono::steady_clock::now();
+    convert(records);
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const size_t base = out.size();
+    out.resize(base + m_kept.size());
+    m_pool.parallel_for(0, m_kept.size(), RECORD_GRAIN,
+                        [&](const size_t b, const size_t e, size_t) {
+                          for (size_t k = b; k < e; k++) {
+                            const Math::vec_f3 &p = m_transforms[k].p,
+                                               &col = m_surfaces[k].col;
+                            const float l = m_stars[k].l / 255.0f;
+                            out.x[base + k] = p.x;
+                            out.y[base + k] = p.y;
+                            out.z[base + k] = p.z;
+                            out.r[base + k] = col.x * l;
+                            out.g[base + k] = col.y * l;
+                            out.b[base + k] = col.z * l;
+                          }
+                        });
+    const auto t2 = std::chrono::steady_clock::now();
+
+    m_stats.n_kept += m_kept.size();
+    m_stats.ms_convert += ms_t(t1 - t0).count();
+    m_stats.ms_registry += ms_t(t2 - t1).count();
+    return m_stats.n_kept < m_config.max_rows;
+  });
+}
+
+/* Rows go out as Star_Records, so the file is written beside the target
+ * and the header, which counts them, goes in last */
+const Star_Catalogue_Stats &
+Star_Catalogue_Reader::pack(const std::filesystem::path &path,
+                            const std::filesystem::path &out) {
+  Star_Catalogue_Header header;
+  header.n_columns = STAR_FIELD_CT;
+  header.stride = sizeof(Star_Record);
+  header.data_offset =
+      (sizeof(header) + STAR_FIELD_CT * sizeof(Star_Catalogue_Column) +
+       DATA_ALIGN - 1) /
+      DATA_ALIGN * DATA_ALIGN;
+
+  std::vector<char> head(header.data_offset, 0);
+  for (size_t f = 0; f < STAR_FIELD_CT; f++) {
+    Star_Catalogue_Column column;
+    if (m_config.columns[f].size() >= sizeof(column.name))
+      throw std::runtime_error("Failed: column name too long, " +
+                               m_config.columns[f]);
+    std::memcpy(column.name, m_config.columns[f].data(),
+                m_config.columns[f].size());
+    column.elem_size = sizeof(double);
+    column.offset = static_cast<uint32_t>(f * sizeof(double));
+    std::memcpy(head.data() + sizeof(header) + f * sizeof(column), &column,
+                sizeof(column));
+  }
+
+  std::filesystem::path tmp = out;
+  tmp += ".tmp";
+  std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+  file.write(head.data(), static_cast<std::streamsize>(head.size()));
+
+  double ms_write = 0.0;
+  stream(path, [&](std::span<const Star_Record> records) {
+    const auto t0 = std::chrono::steady_clock::now();
+    file.write(reinterpret_cast<const char *>(records.data()),
+               static_cast<std::streamsize>(records.size_bytes()));
+    header.n_rows += records.size();
+    ms_write += ms_t(std::chrono::steady_clock::now() - t0).count();
+    return static_cast<bool>(file);
+  });
+
+  const auto t0 = std::chrono::steady_clock::now();
+  std::memcpy(head.data(), &header, sizeof(header));
+  file.seekp(0);
+  file.write(head.data(), sizeof(header));
+  file.close();
+  if (!file)
+    throw std::runtime_error("Failed: could not write " + tmp.string());
+  std::filesystem::rename(tmp, out);
+
+  m_stats.n_kept = header.n_rows;
+  m_stats.ms_registry =
+      ms_write + ms_t(std::chrono::steady_clock::now() - t0).count();
+  return m_stats;
+}
+
+} // namespace CTNM::IO
@@ -1,71 +1,34 @@
-#ifndef __APPLE__
-
-#include <exception>
-
-int main(int argc, char *argv[]) {
-  throw std::runtime_error("Application requires Apple system to run.");
-}
-
-#else
+#include "demo_scene.hpp"
+#include "offline.hpp"
 
+#ifdef __APPLE__
 #include "rhi/gpu_context.hpp"
 #include "rhi/gpu_interface.hpp"
+#include "sim/time_warp.hpp"
 #include "simulator.hpp"
 #include "stager.hpp"
 #include "window.hpp"
 
 #include <chrono>
 #include <memory>
-
-inline CTNM::Components::Mesh generate_cube_mesh(const float h = 0.5f) {
-  CTNM::Components::Mesh mesh{.verticies =
-                                  {
-                                      {{-h, -h, +h}}, {{+h, -h, +h}},
-                                      {{+h, +h, +h}}, {{-h, +h, +h}}, // front
-                                      {{+h, -h, -h}}, {{-h, -h, -h}},
-                                      {{-h, +h, -h}}, {{+h, +h, -h}}, // back
-                                      {{-h, -h, -h}}, {{-h, -h, +h}},
-                                      {{-h, +h, +h}}, {{-h, +h, -h}}, // left
-                                      {{+h, -h, +h}}, {{+h, -h, -h}},
-                                      {{+h, +h, -h}}, {{+h, +h, +h}}, // right
-                                      {{-h, +h, +h}}, {{+h, +h, +h}},
-                                      {{+h, +h, -h}}, {{-h, +h, -h}}, // top
-                                      {{-h, -h, -h}}, {{+h, -h, -h}},
-                                      {{+h, -h, +h}}, {{-h, -h, +h}}, // bottom
-                                  },
-                              .indicies = {
-                                  0,  1,  2,  0,  2,  3,  // front
-                                  4,  5,  6,  4,  6,  7,  // back
-                                  8,  9,  10, 8,  10, 11, // left
-                                  12, 13, 14, 12, 14, 15, // right
-                                  16, 17, 18, 16, 18, 19, // top
-                                  20, 21, 22, 20, 22, 23  // bottom
-                              }};
-  return mesh;
-}
+#endif
 
 int main(int argc, char *argv[]) {
+#ifndef __APPLE__
+  // The windowed renderer needs Metal, elsewhere every run is headless
+  return CTNM::run_headless(argc, argv);
+#else
+  if (CTNM::is_headless(argc, argv))
+    return CTNM::run_headless(argc, argv);
+
   entt::registry reg;
   std::shared_ptr<CTNM::Window> win(std::make_shared<CTNM::Window>(
       CTNM::FB_Size{800, 600}, std::chrono::milliseconds(16))); // 16ms ~ 60fps
   CTNM::RHI::GPU_Interface interface(win);
   CTNM::Stager stager;
   CTNM::Simulator sim;
-
-  const float h = 0.5f;
-  entt::entity en1 = reg.create();
-  reg.emplace<CTNM::Components::Transform>(
-      en1, CTNM::Math::vec_f3{0.0f, 0.0f, 0.0f},
-      CTNM::Math::vec_f3{1.0f, 1.0f, 1.0f},
-      CTNM::Math::vec_f4{25.0f, 25.0f, 25.0f, 1.0f});
-  reg.emplace<CTNM::Components::Physics>(en1,
-                                         CTNM::Math::vec_f3{0.0f, -1.5f, 0.0f});
-  reg.emplace<CTNM::Components::Mesh>(en1, generate_cube_mesh());
-  reg.emplace<CTNM::Components::Surface>(
-      en1, CTNM::Math::vec_f3{0.0f, 255.0f, 0.0f});
-
-  entt::entity cam = reg.create();
-  reg.emplace<CTNM::Components::Camera>(cam);
+  CTNM::Sim::Time_Warp warp;
+  CTNM::populate_scene(reg);
 
   auto sink_on_mesh_destroy = reg.on_destroy<CTNM::Components::Mesh>();
   auto &ev_on_cpu_completed = interface.on_cpu_completed();
@@ -86,7 +49,7 @@ int main(int argc, char *argv[]) {
       continue;
     }
 
-    sim.update(reg);
+    warp.update(reg, sim);
     stager.stage(gpu_context, reg);
     interface.render(stager.get_render_packets(), stager.get_mutex(),
                      stager.get_revision(), reg);
@@ -101,6 +64,5 @@ int main(int argc, char *argv[]) {
   ev_on_gpu_completed.clear();
 
   return 0;
-}
-
 #endif
+}
@@ -0,0 +1,340 @@
+#include "offline.hpp"
+#include "components.hpp"
+#include "cpu/lens_table.hpp"
+#include "cpu/renderer.hpp"
+#include "cpu/star_octree.hpp"
+#include "cpu/star_splat.hpp"
+#include "demo_scene.hpp"
+#include "io/frame_writer.hpp"
+#include "io/mesh_importer.hpp"
+#include "io/snapshot.hpp"
+#include "io/star_catalogue.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/time_warp.hpp"
+#include "simulator.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <entt/entt.hpp>
+
+namespace CTNM {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static CPU::Ray_Mode parse_ray_mode(const std::string &name) {
+  if (name == "straight")
+    return CPU::Ray_Mode::Straight;
+  if (name == "geodesic")
+    return CPU::Ray_Mode::Geodesic;
+  if (name == "table")
+    return CPU::Ray_Mode::Table;
+
+  throw std::runtime_error("Failed: unknown lens mode " + name);
+}
+
+bool is_headless(const int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++)
+    if (std::string_view(argv[i]) == "--headless")
+      return true;
+
+  return false;
+}
+
+Offline_Config parse_offline_config(const int argc, char *argv[]) {
+  Offline_Config config;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg(argv[i]);
+    if (arg == "--headless")
+      continue;
+
+    if (i + 1 >= argc)
+      throw std::runtime_error("Failed: missing value for " + std::string(arg));
+
+    const std::string value(argv[++i]);
+    if (arg == "--frames")
+      config.n_frames = std::stoull(value);
+    else if (arg == "--dt")
+      config.dt = std::stof(value);
+    else if (arg == "--warp")
+      config.warp = std::stod(value);
+    else if (arg == "--size") {
+      const size_t x = value.find('x');
+      if (x == std::string::npos)
+        throw std::runtime_error("Failed: --size expects WxH, " + value);
+      config.w = static_cast<uint32_t>(std::stoul(value.substr(0, x)));
+      config.h = static_cast<uint32_t>(std::stoul(value.substr(x + 1)));
+    } else if (arg == "--out")
+      config.out_dir = value;
+    else if (arg == "--format")
+      config.format = IO::parse_image_format(value);
+    else if (arg == "--packet")
+      config.packet_w = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--bvh")
+      config.bvh_w = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--encoders")
+      config.n_encoders = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--lens")
+      config.ray_mode = parse_ray_mode(value);
+    else if (arg == "--lens-table")
+      config.lens_table = value;
+    else if (arg == "--resume")
+      config.resume = value;
+    else if (arg == "--checkpoint")
+      config.checkpoint = value;
+    else if (arg == "--mesh")
+      config.mesh = value;
+    else if (arg == "--stars")
+      config.stars = value;
+    else if (arg == "--star-octree")
+      config.star_octree = value;
+    else
+      throw std::runtime_error("Failed: unknown argument " + std::string(arg));
+  }
+
+  if (config.w == 0 || config.h == 0)
+    throw std::runtime_error("Failed: frame size must be non-zero");
+
+  return config;
+}
+
+Offline_Renderer::Offline_Renderer(const Offline_Config &config,
+                                   Parallel::Thread_Pool &pool)
+    : m_config(config), m_pool(pool), m_star_octree(pool),
+      m_renderer(pool, config.packet_w),
+      m_writer(config.out_dir, config.format, config.n_encoders),
+      m_warp(Sim::make_unbounded_time_warp_config()) {
+  m_fb.resize(m_config.w, m_config.h);
+  m_warp.set_warp(m_config.warp);
+  m_renderer.set_ray_mode(m_config.ray_mode);
+  m_scene.set_wide_width(m_config.bvh_w);
+
+  if (m_config.ray_mode == CPU::Ray_Mode::Table) {
+    if (!m_config.lens_table.empty() &&
+        std::filesystem::exists(m_config.lens_table))
+      m_lens_table.load(m_config.lens_table);
+    else {
+      m_lens_table.build(m_pool);
+      if (!m_config.lens_table.empty())
+        m_lens_table.save(m_config.lens_table);
+    }
+
+    m_renderer.set_lens_table(&m_lens_table);
+  }
+
+  // The catalogue goes into the octree rather than the registry
+  if (!m_config.star_octree.empty()) {
+    if (!std::filesystem::exists(m_config.star_octree)) {
+      if (m_config.stars.empty())
+        throw std::runtime_error("Failed: no star octree or catalogue at " +
+                                 m_config.star_octree.string());
+
+      IO::Star_Catalogue_Reader reader(m_pool);
+      CPU::Star_Points points;
+      const IO::Star_Catalogue_Stats &stars =
+          reader.load(m_config.stars, points);
+      std::printf("Stars: %llu of %llu rows kept, %.2f million rows per "
+                  "second, %.1f MB peak resident\n",
+                  static_cast<unsigned long long>(stars.n_kept),
+                  static_cast<unsigned long long>(stars.n_rows),
+                  stars.get_rows_per_s() / 1e6,
+                  static_cast<double>(stars.peak_rss_bytes) / 1e6);
+      m_star_octree.build(points, m_config.star_octree);
+    }
+
+    // Frames are written to disk, so they wait for every leaf they need
+    CPU::Star_LOD_Config lod = m_star_octree.get_config();
+    lod.wait = true;
+    m_star_octree.set_config(lod);
+    m_star_octree.open(m_config.star_octree);
+    m_renderer.set_star_octree(&m_star_octree);
+  }
+}
+
+const Offline_Stats &Offline_Renderer::run(entt::registry &reg,
+                                           Simulator &sim) {
+  m_stats = Offline_Stats{};
+  const auto tp_start = std::chrono::steady_clock::now();
+
+  const auto &cam_view = reg.view<Components::Camera>();
+  if (cam_view.empty())
+    throw std::runtime_error("Failed: Offline_Renderer, no camera");
+
+  for (uint64_t frame = 0; frame < m_config.n_frames; frame++) {
+    const auto tp_frame = std::chrono::steady_clock::now();
+    if (frame > 0)
+      m_warp.advance(reg, sim, m_config.dt);
+
+    const auto tp_sim = std::chrono::steady_clock::now();
+    m_scene.sync(m_pool, reg);
+    m_renderer.render(m_scene, reg.get<Components::Camera>(cam_view.front()),
+                      m_fb);
+    m_writer.write(frame, m_fb); // Encoding overlaps the next frame
+
+    const auto tp_render = std::chrono::steady_clock::now();
+    m_stats.ms_sim += ms_t(tp_sim - tp_frame).count();
+    m_stats.ms_render += ms_t(tp_render - tp_sim).count();
+    m_stats.n_frames++;
+  }
+
+  m_writer.flush();
+  m_stats.ms_total =
+      ms_t(std::chrono::steady_clock::now() - tp_start).count();
+  return m_stats;
+}
+
+uint64_t Offline_Renderer::get_bytes_written() const {
+  return m_writer.get_bytes_written();
+}
+
+const CPU::Lens_Table &Offline_Renderer::get_lens_table() const {
+  return m_lens_table;
+}
+
+const CPU::Render_Stats &Offline_Renderer::get_render_stats() const {
+  return m_renderer.get_stats();
+}
+
+CPU::Scene_Stats Offline_Renderer::get_scene_stats() const {
+  return m_scene.get_stats();
+}
+
+const CPU::Splat_Stats &Offline_Renderer::get_splat_stats() const {
+  return m_renderer.get_splat_stats();
+}
+
+const CPU::Star_LOD_Stats &Offline_Renderer::get_star_lod_stats() const {
+  return m_star_octree.get_stats();
+}
+
+const Sim::Time_Warp_Stats &Offline_Renderer::get_time_warp_stats() const {
+  return m_warp.get_stats();
+}
+
+int run_headless(const int argc, char *argv[]) {
+  const Offline_Config config = parse_offline_config(argc, argv);
+
+  entt::registry reg;
+  Simulator sim;
+  if (!config.resume.empty()) {
+    IO::Snapshot_Reader reader;
+    sim.set_time(reader.read(config.resume, reg));
+  } else if (!config.mesh.empty()) {
+    IO::Mesh_Importer importer;
+    Components::Mesh mesh;
+    importer.load(config.mesh, mesh);
+    const IO::Mesh_Import_Stats &imported = importer.get_stats();
+    std::printf("Mesh: %llu triangles, %llu of %llu vertices welded, %.2f "
+                "GB/s\n",
+                static_cast<unsigned long long>(imported.n_triangles),
+                static_cast<unsigned long long>(imported.n_welded),
+                static_cast<unsigned long long>(imported.n_verticies),
+                imported.get_gb_per_s());
+    populate_scene(reg, std::move(mesh));
+  } else {
+    populate_scene(reg);
+  }
+
+  if (config.resume.empty() && !config.stars.empty() &&
+      config.star_octree.empty()) {
+    IO::Star_Catalogue_Reader reader;
+    const IO::Star_Catalogue_Stats &stars = reader.load(config.stars, reg);
+    std::printf("Stars: %llu of %llu rows kept, %.2f million rows per "
+                "second, %.1f MB batches, %.1f MB peak resident\n",
+                static_cast<unsigned long long>(stars.n_kept),
+                static_cast<unsigned long long>(stars.n_rows),
+                stars.get_rows_per_s() / 1e6,
+                static_cast<double>(stars.peak_batch_bytes) / 1e6,
+                static_cast<double>(stars.peak_rss_bytes) / 1e6);
+  }
+
+  if (config.resume.empty() && config.ray_mode != CPU::Ray_Mode::Straight) {
+    entt::entity hole = reg.create();
+    reg.emplace<Components::Transform>(hole, Math::vec_f3{4.0f, 0.0f, 0.0f});
+    reg.emplace<Components::Black_Hole>(hole, 0.25f);
+    reg.emplace<Components::Accretion_Disk>(hole);
+  }
+
+  Offline_Renderer renderer(config);
+  const Offline_Stats &stats = renderer.run(reg, sim);
+
+  std::printf("Rendered %llu frames to %s (%.1f fps, %.1f MB)\n",
+              static_cast<unsigned long long>(stats.n_frames),
+              config.out_dir.c_str(), stats.get_fps(),
+              static_cast<double>(renderer.get_bytes_written()) / 1e6);
+  std::printf("Last frame: %.0f ns per pixel, %.1f disk samples per pixel\n",
+              renderer.get_render_stats().get_ns_per_pixel(),
+              renderer.get_render_stats().get_march_steps_per_pixel());
+  const CPU::Scene_Stats scene = renderer.get_scene_stats();
+  std::printf("BVH%u: %.3f MB wide nodes, %.3f MB binary\n", scene.wide_w,
+              static_cast<double>(scene.wide_bytes) / 1e6,
+              static_cast<double>(scene.binary_bytes) / 1e6);
+  const CPU::Star_LOD_Stats &lod = renderer.get_star_lod_stats();
+  if (lod.n_nodes > 0) {
+    std::printf("Star LOD: %llu stars drawn as %llu aggregates and %llu "
+                "points from %llu leaves (%.1f MB), %.1f ms select\n",
+                static_cast<unsigned long long>(lod.n_points),
+                static_cast<unsigned long long>(lod.n_aggregates),
+                static_cast<unsigned long long>(lod.n_leaf_points),
+                static_cast<unsigned long long>(lod.n_leaves),
+                static_cast<double>(lod.bytes_leaves) / 1e6, lod.ms_select);
+    std::printf("Star leaves: %.1f%% cache hits, %llu reads outstanding, "
+                "%.1f MB/s (%s)\n",
+                lod.get_hit_rate() * 100.0,
+                static_cast<unsigned long long>(lod.io.n_outstanding),
+                lod.io.get_bytes_per_s() / 1e6,
+                lod.io.uring ? "io_uring" : "threads");
+  }
+  const CPU::Splat_Stats &splat = renderer.get_splat_stats();
+  if (splat.n_points > 0)
+    std::printf("Star splats: %llu of %llu in frame, %llu faint, %.1f "
+                "million points per second\n",
+                static_cast<unsigned long long>(splat.n_visible),
+                static_cast<unsigned long long>(splat.n_points),
+                static_cast<unsigned long long>(splat.n_faint),
+                splat.get_mpoints_per_s());
+
+  const Sim::Time_Warp_Stats &warp = renderer.get_time_warp_stats();
+  std::printf("Simulation: %.0fx warp, %u %s substeps per frame, %.3g "
+              "simulated seconds per second\n",
+              warp.warp, warp.n_substeps,
+              warp.integrator == Integrator::Yoshida ? "Yoshida" : "leapfrog",
+              warp.sim_per_wall);
+  if (sim.get_stats().n_gas > 0) {
+    const Sim::SPH_Stats &sph = sim.get_sph_solver().get_stats();
+    std::printf("Gas: %zu SPH particles, %.1f neighbours each, %.3g "
+                "particles per second\n",
+                sph.n_particles, sph.mean_neighbours, sph.particles_per_s);
+  }
+
+  if (!config.checkpoint.empty()) {
+    IO::Snapshot_Writer writer;
+    const IO::Snapshot_Stats &snap =
+        writer.write(config.checkpoint, reg, sim.get_time());
+    std::printf("Checkpoint: %llu components, %.1f MB in %.0f ms\n",
+                static_cast<unsigned long long>(snap.n_components),
+                static_cast<double>(snap.bytes_file) / 1e6, snap.get_ms());
+  }
+
+  const CPU::Lens_Table &table = renderer.get_lens_table();
+  if (!table.empty()) {
+    const CPU::Lens_Table_Error error =
+        table.measure_error(Parallel::Thread_Pool::get_global());
+    std::printf("Lens table: %.1f MB, deflection error mean %.2e p99 %.2e "
+                "rad, radius error mean %.2e p99 %.2e, %.0f ns lookup vs "
+                "%.0f ns integration\n",
+                static_cast<double>(table.get_stats().bytes) / 1e6,
+                error.beta_mean, error.beta_p99, error.radius_mean,
+                error.radius_p99, error.ns_lookup, error.ns_integrate);
+  }
+
+  return 0;
+}
+
+} // namespace CTNM
@@ -0,0 +1,124 @@
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace CTNM::Parallel {
+
+struct Dispatch_Job {
+  const std::function<void(size_t)> *fn;
+  size_t n_tasks;
+  std::atomic<size_t> next = 0, done = 0;
+  std::mutex mtx;
+  std::condition_variable cv;
+
+  void drain() {
+    size_t task;
+    while ((task = next.fetch_add(1)) < n_tasks) {
+      (*fn)(task);
+      if (done.fetch_add(1) + 1 == n_tasks) {
+        const std::lock_guard<std::mutex> lock(mtx);
+        cv.notify_all();
+      }
+    }
+  }
+};
+
+Thread_Pool::Thread_Pool(const uint32_t n_threads) {
+  // Calling thread always participates in dispatch, so spawn one less
+  const uint32_t n_workers = std::max<uint32_t>(n_threads, 1) - 1;
+  m_workers.reserve(n_workers);
+  for (uint32_t i = 0; i < n_workers; i++)
+    m_workers.emplace_back(&Thread_Pool::work, this);
+}
+
+Thread_Pool::~Thread_Pool() {
+  {
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    m_stopping = true;
+  }
+
+  m_cv.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+}
+
+Thread_Pool &Thread_Pool::get_global() {
+  static Thread_Pool pool;
+  return pool;
+}
+
+uint32_t Thread_Pool::get_thread_ct() const {
+  return static_cast<uint32_t>(m_workers.size()) + 1;
+}
+
+void Thread_Pool::submit(std::function<void()> task) {
+  if (m_workers.empty()) {
+    task();
+    return;
+  }
+
+  {
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    m_tasks.push_back(std::move(task));
+  }
+
+  m_cv.notify_one();
+}
+
+void Thread_Pool::dispatch(const size_t n_tasks,
+                           const std::function<void(size_t)> &fn) {
+  if (n_tasks == 0)
+    return;
+
+  if (m_workers.empty() || n_tasks == 1) {
+    for (size_t task = 0; task < n_tasks; task++)
+      fn(task);
+    return;
+  }
+
+  // Helpers may start after the caller has drained every task (e.g. nested
+  // dispatch while all workers are busy), so the job outlives this call
+  std::shared_ptr<Dispatch_Job> job = std::make_shared<Dispatch_Job>();
+  job->fn = &fn;
+  job->n_tasks = n_tasks;
+
+  const size_t n_helpers = std::min(n_tasks - 1, m_workers.size());
+  {
+    const std::lock_guard<std::mutex> lock(m_mtx);
+    for (size_t i = 0; i < n_helpers; i++)
+      m_tasks.push_back([job]() { job->drain(); });
+  }
+
+  m_cv.notify_all();
+  job->drain();
+
+  std::unique_lock<std::mutex> lock(job->mtx);
+  job->cv.wait(lock, [&job]() { return job->done.load() == job->n_tasks; });
+}
+
+void Thread_Pool::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mtx);
+      m_cv.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+      if (m_stopping && m_tasks.empty())
+        return;
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+
+    task();
+  }
+}
+
+} // namespace CTNM::Parallel
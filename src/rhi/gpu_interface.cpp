@@ -1,5 +1,9 @@
 #include "rhi/gpu_interface.hpp"
+#include "components.hpp"
 #include "event.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
 #include "rhi/bridges.hpp"
 #include "rhi/gpu_context.hpp"
 #include "rhi/gpu_types.hpp"
@@ -7,6 +11,10 @@
 #include "rhi/render_packet.hpp"
 #include "window.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <functional>
@@ -24,16 +32,33 @@
 #include <Metal/Metal.hpp>
 #include <QuartzCore/QuartzCore.hpp>
 #include <entt/entt.hpp>
+#include <simd/simd.h>
 
 namespace CTNM::RHI {
 
+using ms_t = std::chrono::duration<double, std::milli>;
+
+namespace {
+
+constexpr size_t CULL_GRAIN = 1 << 12;
+constexpr size_t INSTANCE_GRAIN = 1 << 10;
+
+/* The TLAS holds a quarter more instances than are visible when built, and
+ * is built again once fewer than half its instances are visible */
+constexpr size_t TLAS_PAD_DIV = 4;
+constexpr size_t TLAS_SHRINK_DIV = 2;
+
+} // namespace
+
 void GPU_Interface::cb_fb_resized(const FB_Size fb_size) {
   if (m_layer.exists())
     m_layer->setDrawableSize(CGSizeMake(fb_size.w, fb_size.h));
 }
 
-GPU_Interface::GPU_Interface(std::shared_ptr<Window> win)
-    : m_win(std::move(win)), m_pool_full(NS::AutoreleasePool::alloc()->init()),
+GPU_Interface::GPU_Interface(std::shared_ptr<Window> win,
+                             Parallel::Thread_Pool &pool)
+    : m_win(std::move(win)), m_pool(pool),
+      m_pool_full(NS::AutoreleasePool::alloc()->init()),
       m_device(MTL::CreateSystemDefaultDevice()),
       m_layer(CA::MetalLayer::layer()->retain()) {
   if (!m_device.exists())
@@ -191,6 +216,22 @@ GPU_Interface::~GPU_Interface() {
   }
 }
 
+void GPU_Interface::set_cull_config(const Cull_Config &config) {
+  if (!(config.min_pixels >= 0.0f) || !(config.far > 0.0f))
+    throw std::runtime_error(
+        "Failed: GPU_Interface, cull size must not be negative, far positive");
+
+  m_cull_config = config;
+}
+
+const Cull_Config &GPU_Interface::get_cull_config() const {
+  return m_cull_config;
+}
+
+const Cull_Stats &GPU_Interface::get_cull_stats() const {
+  return m_cull_stats;
+}
+
 void GPU_Interface::free_current_frame(const bool end_cmd_buff) {
   Frame_Context &frame = m_frame_contexts[m_slot];
   std::lock_guard<std::mutex> lock(frame.mtx);
@@ -271,6 +312,64 @@ GPU_Context GPU_Interface::get_gpu_context() {
   return GPU_Context{m_slot, skip_frame, m_device, m_ce_as, frame.rset};
 }
 
+/* Same basis as k_raytracer. The four side planes are tested at once, one
+ * float4 lane each, against the box's nearest corner */
+void GPU_Interface::cull_packets(const Components::Camera &cam,
+                                 const float width, const float height) {
+  const auto t0 = std::chrono::steady_clock::now();
+
+  const Math::vec_f3 forward = Math::normalize(cam.fp - cam.p),
+                     world_up = std::fabs(forward.y) > 0.999f
+                                    ? Math::vec_f3{0.0f, 0.0f, 1.0f}
+                                    : Math::vec_f3{0.0f, 1.0f, 0.0f},
+                     right = Math::normalize(simd_cross(world_up, forward)),
+                     up = simd_cross(forward, right);
+  const float fl = 1.0f / (2.0f * tanf((cam.fov * M_PI / 180.0f) / 2.0f));
+  const float tan_x = 0.5f * width / std::max(height, 1.0f), tan_y = 0.5f;
+  const Math::vec_f3 sides[4] = {
+      Math::normalize(right * fl - forward * tan_x),
+      Math::normalize(-right * fl - forward * tan_x),
+      Math::normalize(up * fl - forward * tan_y),
+      Math::normalize(-up * fl - forward * tan_y)};
+  const Math::vec_f4 nx = {sides[0].x, sides[1].x, sides[2].x, sides[3].x},
+                     ny = {sides[0].y, sides[1].y, sides[2].y, sides[3].y},
+                     nz = {sides[0].z, sides[1].z, sides[2].z, sides[3].z},
+                     ax = simd_abs(nx), ay = simd_abs(ny), az = simd_abs(nz);
+  const Math::vec_f3 forward_abs = simd_abs(forward);
+  const float k = fl * height; // Pixels per unit of size over distance
+  const float far = m_cull_config.far, min_pixels = m_cull_config.min_pixels;
+
+  const size_t n = m_cull_packets.size();
+  m_cull_flags.resize(n);
+  m_pool.parallel_for(
+      0, n, CULL_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t i = b; i < e; i++) {
+          const Math::AABB &box = m_cull_packets[i]->get_bounds(m_slot);
+          const Math::vec_f3 c = (box.min + box.max) * 0.5f - cam.p,
+                             h = (box.max - box.min) * 0.5f;
+          const Math::vec_f4 outside = nx * c.x + ny * c.y + nz * c.z -
+                                       (ax * h.x + ay * h.y + az * h.z);
+          const bool behind =
+              simd_dot(c, forward) + simd_dot(forward_abs, h) < 0.0f;
+
+          // Bounding sphere, the eye inside it always keeps the packet
+          const float r = Math::magnitude(h), d = Math::magnitude(c);
+          const bool near = d <= r;
+          const bool small = !near && 2.0f * r < min_pixels / k * (d - r);
+          const bool beyond = !near && d - r > far;
+
+          // Empty meshes have NaN bounds and fail every test
+          m_cull_flags[i] = !simd_any(outside > 0.0f) && !behind &&
+                            (near || (!small && !beyond && std::isfinite(d)));
+        }
+      });
+
+  m_cull_stats.n_packets = n;
+  m_cull_stats.n_visible = static_cast<uint64_t>(
+      std::count(m_cull_flags.begin(), m_cull_flags.end(), uint8_t(1)));
+  m_cull_stats.ms_cull = ms_t(std::chrono::steady_clock::now() - t0).count();
+}
+
 void GPU_Interface::render(
     std::unordered_map<entt::entity, Render_Packet> &render_packets,
     std::mutex &packet_mtx, const uint64_t packet_revision,
@@ -289,70 +388,118 @@ void GPU_Interface::render(
   frame.rset->commit();
   frame.cmd_buff->useResidencySet(frame.rset.get());
 
+  const auto &_cam_view = reg.view<Components::Camera>();
+  const Components::Camera *_cam =
+      _cam_view.empty() ? nullptr
+                        : &reg.get<Components::Camera>(_cam_view.front());
+
   // --- Process tlas ---
-  const bool rebuild_tlas =
-      packet_revision != frame.revision || !frame.tlas_built;
-  if (rebuild_tlas)
-    frame.tlas_built = false;
-  frame.revision = packet_revision;
-  size_t n_packets;
+  bool rebuild_tlas;
+  size_t n_packets, n_visible, n_instances;
   std::vector<GPU_Types::Surface> surfaces;
   std::vector<Render_Packet *> rebuilt_packets;
 
   {
     const std::lock_guard<std::mutex> lock(packet_mtx);
     n_packets = render_packets.size();
-    surfaces.reserve(n_packets);
     rebuilt_packets.reserve(n_packets);
 
-    if (rebuild_tlas)
+    m_cull_packets.clear();
+    m_cull_packets.reserve(n_packets);
+    for (auto &[_, packet] : render_packets) {
+      m_cull_packets.push_back(&packet);
+      if (packet.has_pending_build(m_slot))
+        rebuilt_packets.push_back(&packet);
+    }
+
+    // Without a camera nothing is drawn, the TLAS is still kept current
+    MTL::Texture *drawable_tex = frame.drawable->texture();
+    if (_cam)
+      cull_packets(*_cam, static_cast<float>(drawable_tex->width()),
+                   static_cast<float>(drawable_tex->height()));
+    else {
+      m_cull_flags.assign(n_packets, 1);
+      m_cull_stats = Cull_Stats{n_packets, n_packets, 0.0};
+    }
+
+    n_visible = Parallel::compact_indices(
+        m_pool, n_packets,
+        [&](const size_t i) { return m_cull_flags[i] != 0; }, m_visible);
+
+    /* Only visible packets get instances. The TLAS is sized for a padded
+     * count and the tail repeats the last instance masked out, so the
+     * instance count holds between builds and a changed visible set
+     * refits */
+    n_instances = frame.tlas_capacity;
+    rebuild_tlas = packet_revision != frame.revision || !frame.tlas_built ||
+                   n_visible > n_instances ||
+                   n_visible * TLAS_SHRINK_DIV < n_instances;
+    if (rebuild_tlas) {
+      frame.tlas_built = false;
+      n_instances = n_visible + n_visible / TLAS_PAD_DIV;
+      frame.tlas_capacity = n_instances;
+    }
+    frame.revision = packet_revision;
+
+    const size_t buff_as_instances_len =
+        (n_instances == 0 ? 1 : n_instances) *
+        sizeof(MTL::IndirectAccelerationStructureInstanceDescriptor);
+    if (!frame.buff_as_instances.exists() ||
+        frame.buff_as_instances->length() < buff_as_instances_len)
       frame.buff_as_instances = m_device->newBuffer(
-          n_packets *
-              sizeof(MTL::IndirectAccelerationStructureInstanceDescriptor),
-          MTL::ResourceStorageModeShared);
+          buff_as_instances_len, MTL::ResourceStorageModeShared);
 
     MTL::IndirectAccelerationStructureInstanceDescriptor *asi_descs =
         static_cast<MTL::IndirectAccelerationStructureInstanceDescriptor *>(
             frame.buff_as_instances->contents());
 
-    size_t iid = 0;
-    for (auto &[_, packet] : render_packets) {
-      surfaces.push_back(packet.get_surface(m_slot));
-      if (packet.has_pending_build(m_slot))
-        rebuilt_packets.push_back(&packet);
-
-      MTL::IndirectAccelerationStructureInstanceDescriptor &asi_desc =
-          asi_descs[iid];
-      asi_desc.accelerationStructureID = packet.get_as(m_slot)->gpuResourceID();
-      asi_desc.userID = iid++;
-      asi_desc.transformationMatrix = packet.get_transform(m_slot);
-      asi_desc.options = MTL::AccelerationStructureInstanceOptionNone;
-      asi_desc.mask = 0xFF;
-      asi_desc.intersectionFunctionTableOffset = 0;
+    // Instance index into surfaces, the shader reads it as instance_id
+    surfaces.resize(n_visible);
+    m_pool.parallel_for(
+        0, n_visible, INSTANCE_GRAIN,
+        [&](const size_t b, const size_t e, size_t) {
+          for (size_t iid = b; iid < e; iid++) {
+            const Render_Packet &packet = *m_cull_packets[m_visible[iid]];
+            surfaces[iid] = packet.get_surface(m_slot);
+
+            MTL::IndirectAccelerationStructureInstanceDescriptor &asi_desc =
+                asi_descs[iid];
+            asi_desc.accelerationStructureID =
+                packet.get_as(m_slot)->gpuResourceID();
+            asi_desc.userID = static_cast<uint32_t>(iid);
+            asi_desc.transformationMatrix = packet.get_transform(m_slot);
+            asi_desc.options = MTL::AccelerationStructureInstanceOptionNone;
+            asi_desc.mask = 0xFF;
+            asi_desc.intersectionFunctionTableOffset = 0;
+          }
+        });
+
+    // Shrinking rebuilds before the visible count reaches zero
+    for (size_t iid = n_visible; iid < n_instances; iid++) {
+      asi_descs[iid] = asi_descs[n_visible - 1];
+      asi_descs[iid].mask = 0x00;
     }
   }
 
   const size_t buff_surfaces_len =
-      (n_packets == 0 ? 1 : n_packets) * sizeof(GPU_Types::Surface);
+      (n_visible == 0 ? 1 : n_visible) * sizeof(GPU_Types::Surface);
   if (!frame.buff_surfaces.exists() ||
       frame.buff_surfaces->length() < buff_surfaces_len)
-    ;
-  frame.buff_surfaces =
-      m_device->newBuffer(buff_surfaces_len, MTL::ResourceStorageModeShared);
+    frame.buff_surfaces =
+        m_device->newBuffer(buff_surfaces_len, MTL::ResourceStorageModeShared);
 
-  const uint32_t n_packets_u32 = static_cast<uint32_t>(n_packets);
-  std::memcpy(frame.buff_as_instance_ct->contents(), &n_packets_u32,
+  const uint32_t n_instances_u32 = static_cast<uint32_t>(n_instances);
+  std::memcpy(frame.buff_as_instance_ct->contents(), &n_instances_u32,
               sizeof(uint32_t));
-  frame.tlas_desc->setMaxInstanceCount(static_cast<NS::UInteger>(n_packets));
+  frame.tlas_desc->setMaxInstanceCount(static_cast<NS::UInteger>(n_instances));
   frame.tlas_desc->setInstanceCountBuffer(MTL4::BufferRange::Make(
       frame.buff_as_instance_ct->gpuAddress(), sizeof(uint32_t)));
   frame.tlas_desc->setInstanceDescriptorBuffer(MTL4::BufferRange::Make(
       frame.buff_as_instances->gpuAddress(),
-      n_packets *
-          sizeof(MTL::IndirectAccelerationStructureInstanceDescriptor)));
+      frame.buff_as_instances->length()));
 
   frame.tlas_sizes_desc->setMaxInstanceCount(
-      static_cast<NS::UInteger>(n_packets));
+      static_cast<NS::UInteger>(n_instances));
   frame.tlas_sizes_desc->setInstanceCountBuffer(
       frame.buff_as_instance_ct.get());
   frame.tlas_sizes_desc->setInstanceDescriptorBuffer(
@@ -438,19 +585,16 @@ void GPU_Interface::render(
   std::memcpy(frame.buff_rt_params->contents(), &params,
               sizeof(GPU_Types::Raytracing_Params));
 
-  const auto &_cam_view = reg.view<Components::Camera>();
-  if (_cam_view.empty()) {
+  if (!_cam) {
     free_current_frame(true);
     return;
   }
 
-  const Components::Camera &_cam =
-      reg.get<Components::Camera>(_cam_view.front());
   GPU_Types::Camera cam;
-  const CTNM::Math::vec_f3 dir = _cam.fp - _cam.p;
-  cam.p = MTL::PackedFloat3{_cam.p.x, _cam.p.y, _cam.p.z};
+  const CTNM::Math::vec_f3 dir = _cam->fp - _cam->p;
+  cam.p = MTL::PackedFloat3{_cam->p.x, _cam->p.y, _cam->p.z};
   cam.dir = MTL::PackedFloat3{dir.x, dir.y, dir.z};
-  cam.fl = 1.0f / (2.0f * tanf((_cam.fov * M_PI / 180.0f) / 2.0f));
+  cam.fl = 1.0f / (2.0f * tanf((_cam->fov * M_PI / 180.0f) / 2.0f));
   std::memcpy(frame.buff_cam->contents(), &cam, sizeof(GPU_Types::Camera));
 
   std::memcpy(frame.buff_surfaces->contents(), surfaces.data(),
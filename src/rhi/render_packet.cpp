@@ -45,6 +45,26 @@ get_mtl_transform(const CTNM::Components::Transform &transform) {
   return MTL::PackedFloat4x3{p_col_0, p_col_1, p_col_2, p_col_3};
 }
 
+// Arvo's method, extents of the transformed box per axis
+static inline CTNM::Math::AABB
+get_world_bounds(const MTL::PackedFloat4x3 &transform,
+                 const CTNM::Math::AABB &box) {
+  const CTNM::Math::vec_f3 center = (box.min + box.max) * 0.5f,
+                           half = (box.max - box.min) * 0.5f;
+  CTNM::Math::vec_f3 c = {transform.columns[3].x, transform.columns[3].y,
+                          transform.columns[3].z},
+                     e = {0.0f, 0.0f, 0.0f};
+  for (int axis = 0; axis < 3; axis++) {
+    const CTNM::Math::vec_f3 col = {transform.columns[axis].x,
+                                    transform.columns[axis].y,
+                                    transform.columns[axis].z};
+    c += col * center[axis];
+    e += simd_abs(col) * half[axis];
+  }
+
+  return CTNM::Math::AABB{c - e, c + e};
+}
+
 Render_Packet::Render_Packet(GPU_Context &gpu_context,
                              const Components::Transform &transform,
                              const Components::Mesh &mesh,
@@ -76,6 +96,9 @@ void Render_Packet::update(GPU_Context &gpu_context,
     as_context.as_built = false;
     as_context.as_build_pending = false;
     as_context.revision = mesh.revision;
+    as_context.local_bounds = Math::AABB{};
+    for (const Components::Vertex &vertex : mesh.verticies)
+      Math::grow(as_context.local_bounds, vertex.p);
     as_context.buff_verticies = gpu_context.device->newBuffer(
         mesh.verticies.data(),
         mesh.verticies.size() * sizeof(Components::Vertex),
@@ -98,6 +121,9 @@ void Render_Packet::update(GPU_Context &gpu_context,
                                 as_context.buff_indicies->length()));
   }
 
+  as_context.bounds =
+      get_world_bounds(as_context.transform, as_context.local_bounds);
+
   MTL4::AccelerationStructureTriangleGeometryDescriptor *as_geom_descs[] = {
       as_context.as_geom_desc.get()};
   NS::Array *as_geom_desc_array =
@@ -194,4 +220,8 @@ Render_Packet::get_surface(const uint32_t slot) const {
   return m_as_contexts[slot].surface;
 }
 
+const Math::AABB &Render_Packet::get_bounds(const uint32_t slot) const {
+  return m_as_contexts[slot].bounds;
+}
+
 } // namespace CTNM::RHI
@@ -0,0 +1,327 @@
+#include "sim/collision.hpp"
+#include "components.hpp"
+#include "cpu/scene.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static constexpr size_t SWEEP_GRAIN = 1 << 14;
+static constexpr size_t NARROW_GRAIN = 256;
+static constexpr size_t LARGE_GRAIN = 64;
+static constexpr double CELL_REACHES = 4.0; // Hash cell over the mean reach
+
+/* Earliest s in [0, 1] with |d0 + (d1 - d0) s| <= r, negative if none */
+static double get_sphere_toi(const Math::vec_d3 &d0, const Math::vec_d3 &d1,
+                             const double r) {
+  const double c = simd_dot(d0, d0) - r * r;
+  if (c <= 0.0)
+    return 0.0;
+
+  const Math::vec_d3 dd = d1 - d0;
+  const double a = simd_dot(dd, dd), b = simd_dot(d0, dd);
+  if (b >= 0.0 || a <= 0.0) // Separating
+    return -1.0;
+
+  const double disc = b * b - a * c;
+  if (disc < 0.0)
+    return -1.0;
+
+  const double s = (-b - std::sqrt(disc)) / a;
+  return s <= 1.0 ? s : -1.0;
+}
+
+/* Ericson, Real-Time Collision Detection 5.1.5 */
+static Math::vec_d3 get_closest_on_triangle(const Math::vec_d3 &q,
+                                            const Math::vec_d3 &a,
+                                            const Math::vec_d3 &b,
+                                            const Math::vec_d3 &c) {
+  const Math::vec_d3 ab = b - a, ac = c - a, ap = q - a;
+  const double d1 = simd_dot(ab, ap), d2 = simd_dot(ac, ap);
+  if (d1 <= 0.0 && d2 <= 0.0)
+    return a;
+
+  const Math::vec_d3 bp = q - b;
+  const double d3 = simd_dot(ab, bp), d4 = simd_dot(ac, bp);
+  if (d3 >= 0.0 && d4 <= d3)
+    return b;
+
+  const double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    return a + ab * (d1 / (d1 - d3));
+
+  const Math::vec_d3 cp = q - c;
+  const double d5 = simd_dot(ab, cp), d6 = simd_dot(ac, cp);
+  if (d6 >= 0.0 && d5 <= d6)
+    return c;
+
+  const double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    return a + ac * (d2 / (d2 - d6));
+
+  const double va = d3 * d6 - d5 * d4;
+  if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+  const double denom = 1.0 / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+/* Whether a sphere at q touches a triangle of the mesh placed at p. Nodes
+ * are culled in world space by their bounds under frame; LBVH depth is
+ * unbounded, so the caller's stack grows as needed */
+static bool touches_mesh(const CPU::Mesh_BVH &blas, const CPU::Affine &frame,
+                         const Math::vec_d3 &p, const Math::vec_d3 &q,
+                         const double r, std::vector<uint32_t> &stack) {
+  const std::vector<CPU::BVH_Node> &nodes = blas.get_bvh().get_nodes();
+  const std::vector<CPU::Triangle> &tris = blas.get_triangles();
+  if (tris.empty())
+    return false;
+
+  const auto to_world = [&](const Math::vec_f3 &v) {
+    return p + simd_double(CPU::transform_vector(frame, v));
+  };
+  const auto reaches = [&](const Math::AABB &box) {
+    const Math::AABB world = CPU::transform_bounds(frame, box);
+    const Math::vec_d3 d =
+        simd_max(simd_max(p + simd_double(world.min) - q,
+                          Math::vec_d3{0.0, 0.0, 0.0}),
+                 q - p - simd_double(world.max));
+    return simd_dot(d, d) <= r * r;
+  };
+
+  // Leaves sit after the n - 1 internal nodes, triangles in leaf order
+  const size_t leaf_offset = tris.size() - 1;
+  stack.assign(1, blas.get_bvh().get_root());
+  while (!stack.empty()) {
+    const uint32_t k = stack.back();
+    stack.pop_back();
+    const CPU::BVH_Node &node = nodes[k];
+    if (!reaches(node.bounds))
+      continue;
+
+    if (node.is_leaf()) {
+      const CPU::Triangle &tri = tris[k - leaf_offset];
+      const Math::vec_d3 closest = get_closest_on_triangle(
+          q, to_world(tri.v0), to_world(tri.v0 + tri.e1),
+          to_world(tri.v0 + tri.e2));
+      const Math::vec_d3 d = closest - q;
+      if (simd_dot(d, d) <= r * r)
+        return true;
+    } else {
+      stack.push_back(node.children[0]);
+      stack.push_back(node.children[1]);
+    }
+  }
+
+  return false;
+}
+
+Collision_Detector::Collision_Detector(Parallel::Thread_Pool &pool)
+    : m_pool(pool), m_hash(pool) {}
+
+const Collision_Stats &Collision_Detector::get_stats() const {
+  return m_stats;
+}
+
+void Collision_Detector::detect(std::span<const Math::vec_d3> p0,
+                                std::span<const Math::vec_d3> p1,
+                                std::span<const double> r,
+                                std::span<const Components::Mesh *const> meshes,
+                                std::span<const CPU::Affine> frames,
+                                std::vector<Contact> &out) {
+  const size_t n = p0.size();
+  if (p1.size() != n || r.size() != n || meshes.size() != n ||
+      frames.size() != n)
+    throw std::runtime_error("Failed: Collision_Detector, span size mismatch");
+
+  m_stats = Collision_Stats{n};
+  out.clear();
+  if (n < 2)
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  m_centres.resize(n);
+  m_reach.resize(n);
+  m_pool.parallel_for(0, n, SWEEP_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          m_centres[i] = 0.5 * (p0[i] + p1[i]);
+                          m_reach[i] = r[i] + 0.5 * simd_distance(p0[i], p1[i]);
+                        }
+                      });
+
+  const double reach_sum = Parallel::reduce_sum(
+      m_pool, n, [&](const size_t i) { return m_reach[i]; });
+  const double cell = std::max(
+      CELL_REACHES * reach_sum / static_cast<double>(n), 1e-300);
+
+  // Any two small bodies that touch are within one cell of each other
+  m_small.clear();
+  m_large.clear();
+  m_small_centres.clear();
+  double small_reach = 0.0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (m_reach[i] <= 0.5 * cell) {
+      m_small.push_back(i);
+      m_small_centres.push_back(m_centres[i]);
+      small_reach = std::max(small_reach, m_reach[i]);
+    } else {
+      m_large.push_back(i);
+    }
+  }
+  m_stats.n_large = m_large.size();
+
+  m_hash.build(m_small_centres, cell);
+  m_hash.find_pairs(2.0 * small_reach, m_pairs);
+  const std::span<const uint32_t> order = m_hash.get_order();
+  const auto is_near = [&](const uint32_t i, const uint32_t j) {
+    const double reach = m_reach[i] + m_reach[j];
+    const Math::vec_d3 d = m_centres[i] - m_centres[j];
+    return simd_dot(d, d) <= reach * reach;
+  };
+
+  size_t n_kept = 0;
+  for (const auto &[a, b] : m_pairs) {
+    const uint32_t i = m_small[order[a]], j = m_small[order[b]];
+    if (is_near(i, j))
+      m_pairs[n_kept++] = {std::min(i, j), std::max(i, j)};
+  }
+  m_pairs.resize(n_kept);
+
+  /* Large bodies sweep and prune along the axis their centres spread
+   * most, and query the hash for small ones, over the pool */
+  const size_t n_large = m_large.size();
+  Math::vec_d3 lo = n_large == 0 ? Math::vec_d3{0.0, 0.0, 0.0}
+                                 : m_centres[m_large[0]],
+               hi = lo;
+  for (const uint32_t i : m_large) {
+    lo = simd_min(lo, m_centres[i]);
+    hi = simd_max(hi, m_centres[i]);
+  }
+  const Math::vec_d3 spread = hi - lo;
+  const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0
+                   : spread.y >= spread.z                       ? 1
+                                                                : 2;
+  const auto get_lo = [&](const uint32_t i) {
+    return m_centres[i][axis] - m_reach[i];
+  };
+  std::sort(m_large.begin(), m_large.end(),
+            [&](const uint32_t i, const uint32_t j) {
+              return get_lo(i) != get_lo(j) ? get_lo(i) < get_lo(j) : i < j;
+            });
+
+  const size_t n_large_chunks =
+      Parallel::Thread_Pool::get_chunk_ct(n_large, LARGE_GRAIN);
+  m_chunk_pairs.resize(n_large_chunks);
+  m_pool.parallel_for(
+      0, n_large, LARGE_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        std::vector<std::pair<uint32_t, uint32_t>> &pairs =
+            m_chunk_pairs[chunk];
+        pairs.clear();
+        for (size_t a = b; a < e; a++) {
+          const uint32_t i = m_large[a];
+          m_hash.for_each_in_radius(
+              m_centres[i], m_reach[i] + small_reach,
+              [&](const uint32_t k, const double) {
+                const uint32_t j = m_small[order[k]];
+                if (is_near(i, j))
+                  pairs.emplace_back(std::min(i, j), std::max(i, j));
+              });
+
+          const double i_hi = m_centres[i][axis] + m_reach[i];
+          for (size_t c = a + 1; c < n_large && get_lo(m_large[c]) <= i_hi;
+               c++)
+            if (is_near(i, m_large[c]))
+              pairs.emplace_back(std::min(i, m_large[c]),
+                                 std::max(i, m_large[c]));
+        }
+      });
+  for (size_t c = 0; c < n_large_chunks; c++)
+    m_pairs.insert(m_pairs.end(), m_chunk_pairs[c].begin(),
+                   m_chunk_pairs[c].end());
+  m_stats.n_candidates = m_pairs.size();
+  const auto t1 = std::chrono::steady_clock::now();
+
+  /* Mesh BVHs are kept between steps and rebuilt when the mesh changes,
+   * those of meshes no longer passed in are dropped */
+  std::unordered_set<const Components::Mesh *> live;
+  std::vector<std::pair<CPU::Mesh_BVH *, const Components::Mesh *>> rebuilds;
+  for (const Components::Mesh *mesh : meshes) {
+    if (!mesh || !live.insert(mesh).second)
+      continue;
+
+    CPU::Mesh_BVH &blas = m_mesh_bvhs[mesh];
+    if (!blas.is_built() || blas.get_revision() != mesh->revision ||
+        blas.get_triangles().size() != mesh->indicies.size() / 3)
+      rebuilds.emplace_back(&blas, mesh);
+  }
+  std::erase_if(m_mesh_bvhs,
+                [&](const auto &entry) { return !live.contains(entry.first); });
+  m_pool.dispatch(rebuilds.size(), [&](const size_t k) {
+    rebuilds[k].first->build(m_pool, *rebuilds[k].second);
+  });
+
+  const size_t n_chunks =
+      Parallel::Thread_Pool::get_chunk_ct(m_pairs.size(), NARROW_GRAIN);
+  std::vector<std::vector<Contact>> chunk_contacts(n_chunks);
+  m_pool.parallel_for(
+      0, m_pairs.size(), NARROW_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        std::vector<uint32_t> stack;
+        for (size_t k = b; k < e; k++) {
+          const auto [i, j] = m_pairs[k];
+          const Math::vec_d3 d0 = p0[j] - p0[i], d1 = p1[j] - p1[i];
+          double s = get_sphere_toi(d0, d1, r[i] + r[j]);
+          if (s < 0.0)
+            continue;
+
+          if (meshes[i] || meshes[j]) {
+            // Triangles of the larger mesh against the other's sphere
+            const uint32_t m =
+                !meshes[j] || (meshes[i] && r[i] >= r[j]) ? i : j;
+            const uint32_t o = m == i ? j : i;
+            const Math::vec_d3 dd = d1 - d0;
+            const double dd2 = simd_dot(dd, dd);
+            s = std::clamp(dd2 > 0.0 ? -simd_dot(d0, dd) / dd2 : 0.0, s,
+                           1.0);
+            const Math::vec_d3 pm = p0[m] + (p1[m] - p0[m]) * s,
+                               po = p0[o] + (p1[o] - p0[o]) * s;
+            if (!touches_mesh(m_mesh_bvhs.at(meshes[m]), frames[m], pm, po,
+                              r[o], stack))
+              continue;
+          }
+
+          chunk_contacts[chunk].push_back(Contact{i, j, s});
+        }
+      });
+
+  for (const auto &contacts : chunk_contacts)
+    out.insert(out.end(), contacts.begin(), contacts.end());
+  std::sort(out.begin(), out.end(), [](const Contact &a, const Contact &b) {
+    return a.s != b.s ? a.s < b.s : a.i != b.i ? a.i < b.i : a.j < b.j;
+  });
+  const auto t2 = std::chrono::steady_clock::now();
+
+  m_stats.n_contacts = out.size();
+  m_stats.ms_broadphase = ms_t(t1 - t0).count();
+  m_stats.ms_narrowphase = ms_t(t2 - t1).count();
+}
+
+} // namespace CTNM::Sim
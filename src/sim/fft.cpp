@@ -0,0 +1,183 @@
+#include "sim/fft.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <stdexcept>
+#include <utility>
+
+namespace CTNM::Sim {
+
+using cfloat = std::complex<float>;
+
+/* Neighbouring columns transformed together, one cache line of complex
+ * floats per row so the butterflies stream along contiguous memory */
+static constexpr size_t LINE_WIDTH = 8;
+static constexpr size_t LINE_GRAIN = 4;
+
+static inline cfloat mul(const cfloat a, const cfloat b) {
+  return cfloat(a.real() * b.real() - a.imag() * b.imag(),
+                a.real() * b.imag() + a.imag() * b.real());
+}
+
+/* Radix-2 transform of `width` adjacent lines of length n, element j of
+ * line c at data[j * stride + c]. tw holds exp(-2 pi i k / n_tw) */
+static void fft_lines(cfloat *data, const uint32_t n, const size_t stride,
+                      const size_t width, const cfloat *tw,
+                      const uint32_t n_tw, const uint32_t *bitrev,
+                      const bool inverse) {
+  for (uint32_t i = 0; i < n; i++) {
+    const uint32_t j = bitrev[i];
+    if (i < j)
+      std::swap_ranges(data + i * stride, data + i * stride + width,
+                       data + j * stride);
+  }
+
+  for (uint32_t len = 2; len <= n; len <<= 1) {
+    const uint32_t half = len >> 1, tw_step = n_tw / len;
+    for (uint32_t i = 0; i < n; i += len)
+      for (uint32_t k = 0; k < half; k++) {
+        const cfloat w =
+            inverse ? std::conj(tw[k * tw_step]) : tw[k * tw_step];
+        cfloat *a = data + (i + k) * stride, *b = a + half * stride;
+        for (size_t c = 0; c < width; c++) {
+          const cfloat t = mul(w, b[c]);
+          b[c] = a[c] - t;
+          a[c] += t;
+        }
+      }
+  }
+}
+
+static std::vector<uint32_t> make_bitrev(const uint32_t n) {
+  std::vector<uint32_t> bitrev(n);
+  const uint32_t bits = std::countr_zero(n);
+  for (uint32_t i = 0; i < n; i++)
+    for (uint32_t bit = 0; bit < bits; bit++)
+      bitrev[i] |= ((i >> bit) & 1u) << (bits - 1 - bit);
+  return bitrev;
+}
+
+FFT_3D::FFT_3D(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+void FFT_3D::resize(const uint32_t n) {
+  if (n < 4 || !std::has_single_bit(n))
+    throw std::runtime_error("Failed: FFT size must be a power of two >= 4");
+  if (n == m_n)
+    return;
+
+  m_n = n;
+  m_twiddles.resize(n / 2);
+  for (uint32_t k = 0; k < n / 2; k++) {
+    const double angle = -2.0 * std::numbers::pi * k / n;
+    m_twiddles[k] = cfloat(static_cast<float>(std::cos(angle)),
+                           static_cast<float>(std::sin(angle)));
+  }
+
+  m_bitrev_n = make_bitrev(n);
+  m_bitrev_half = make_bitrev(n / 2);
+}
+
+uint32_t FFT_3D::get_size() const { return m_n; }
+
+size_t FFT_3D::get_row() const { return 2 * (m_n / 2 + 1); }
+
+size_t FFT_3D::get_mesh_size() const {
+  return static_cast<size_t>(m_n) * m_n * get_row();
+}
+
+void FFT_3D::forward(std::span<float> mesh) {
+  if (mesh.size() < get_mesh_size())
+    throw std::runtime_error("Failed: FFT mesh is smaller than n^3");
+
+  auto *data = reinterpret_cast<cfloat *>(mesh.data());
+  transform_rows(false, data);
+  transform_lines(false, data);
+}
+
+void FFT_3D::inverse(std::span<float> mesh) {
+  if (mesh.size() < get_mesh_size())
+    throw std::runtime_error("Failed: FFT mesh is smaller than n^3");
+
+  auto *data = reinterpret_cast<cfloat *>(mesh.data());
+  transform_lines(true, data);
+  transform_rows(true, data);
+}
+
+/* The x and y axes of the half spectrum, LINE_WIDTH columns of kz at once */
+void FFT_3D::transform_lines(const bool inverse, cfloat *data) {
+  const uint32_t n = m_n;
+  const size_t h = n / 2 + 1;
+  const size_t n_blocks = (h + LINE_WIDTH - 1) / LINE_WIDTH;
+
+  const auto run_axis = [&](const size_t plane_stride, const size_t stride) {
+    m_pool.parallel_for(
+        0, n * n_blocks, LINE_GRAIN,
+        [&](const size_t b, const size_t e, const size_t) {
+          for (size_t task = b; task < e; task++) {
+            const size_t plane = task / n_blocks,
+                         kz = (task % n_blocks) * LINE_WIDTH;
+            fft_lines(data + plane * plane_stride + kz, n, stride,
+                      std::min(LINE_WIDTH, h - kz), m_twiddles.data(), n,
+                      m_bitrev_n.data(), inverse);
+          }
+        });
+  };
+
+  run_axis(n * h, h); // y, one plane per x
+  run_axis(h, n * h); // x, one plane per y
+}
+
+/* Real rows as n/2 point complex transforms of (even, odd) pairs, split
+ * into the n/2 + 1 bins of the real spectrum */
+void FFT_3D::transform_rows(const bool inverse, cfloat *data) {
+  const uint32_t n = m_n, m = n / 2;
+  const size_t h = m + 1;
+
+  m_pool.parallel_for(
+      0, static_cast<size_t>(n) * n, LINE_GRAIN * LINE_WIDTH,
+      [&](const size_t b, const size_t e, const size_t) {
+        for (size_t row = b; row < e; row++) {
+          cfloat *z = data + row * h;
+          if (!inverse) {
+            fft_lines(z, m, 1, 1, m_twiddles.data(), n, m_bitrev_half.data(),
+                      false);
+
+            const cfloat z0 = z[0];
+            z[0] = cfloat(z0.real() + z0.imag(), 0.0f);
+            z[m] = cfloat(z0.real() - z0.imag(), 0.0f);
+            for (uint32_t k = 1; k <= m / 2; k++) {
+              const cfloat a = z[k], c = z[m - k];
+              const cfloat e0 = 0.5f * (a + std::conj(c)),
+                           o0 = cfloat(0.0f, -0.5f) * (a - std::conj(c));
+              const cfloat e1 = 0.5f * (c + std::conj(a)),
+                           o1 = cfloat(0.0f, -0.5f) * (c - std::conj(a));
+              z[k] = e0 + mul(m_twiddles[k], o0);
+              z[m - k] = e1 + mul(m_twiddles[m - k], o1);
+            }
+          } else {
+            const cfloat x0 = z[0], xm = z[m];
+            z[0] = cfloat(x0.real() + xm.real(), x0.real() - xm.real());
+            for (uint32_t k = 1; k <= m / 2; k++) {
+              const cfloat a = z[k], c = z[m - k];
+              const cfloat e0 = a + std::conj(c), o0 = a - std::conj(c);
+              const cfloat e1 = c + std::conj(a), o1 = c - std::conj(a);
+              z[k] = e0 + cfloat(0.0f, 1.0f) *
+                              mul(std::conj(m_twiddles[k]), o0);
+              z[m - k] = e1 + cfloat(0.0f, 1.0f) *
+                                  mul(std::conj(m_twiddles[m - k]), o1);
+            }
+
+            fft_lines(z, m, 1, 1, m_twiddles.data(), n, m_bitrev_half.data(),
+                      true);
+          }
+        }
+      });
+}
+
+} // namespace CTNM::Sim
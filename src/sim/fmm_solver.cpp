@@ -0,0 +1,508 @@
+#include "sim/fmm_solver.hpp"
+#include "cpu/lbvh.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+using cdouble = std::complex<double>;
+
+static constexpr size_t FMM_GRAIN = 4096;
+static constexpr size_t NODE_GRAIN = 16;
+static constexpr uint32_t MAX_DEPTH = 21; // Bits per axis of a Morton code
+static constexpr uint32_t NO_TARGET = std::numeric_limits<uint32_t>::max();
+
+/* Solid harmonics in Dehnen's normalisation (2014),
+ *   Y_n^m(r) = (-1)^m r^n / (n + m)! P_n^m(cos t) e^(i m phi)
+ *   T_n^m(r) = (-1)^m (n - m)! / r^(n + 1) P_n^m(cos t) e^(i m phi)
+ * so that 1 / |x - y| = sum Y_n^m*(y) T_n^m(x) for |y| < |x|. Only m >= 0
+ * is stored, X_n^-m = (-1)^m X_n^m* */
+static inline size_t get_index(const int n, const int m) {
+  return static_cast<size_t>(n * (n + 1) / 2 + m);
+}
+
+static inline size_t get_coeff_ct(const uint32_t p) {
+  return static_cast<size_t>(p + 1) * (p + 2) / 2;
+}
+
+static inline size_t get_full_ct(const uint32_t p) {
+  return static_cast<size_t>(p + 1) * (p + 1);
+}
+
+static inline cdouble get_coeff(const cdouble *c, const int n, const int m) {
+  if (m >= 0)
+    return c[get_index(n, m)];
+  const cdouble v = std::conj(c[get_index(n, -m)]);
+  return (m & 1) ? -v : v;
+}
+
+// Without the inf / nan recovery of operator*
+static inline cdouble mul(const cdouble a, const cdouble b) {
+  return cdouble(a.real() * b.real() - a.imag() * b.imag(),
+                 a.real() * b.imag() + a.imag() * b.real());
+}
+
+/* Every m of each order, split into real and imaginary arrays with X_n^m at
+ * n^2 + n + m */
+static void expand(const int p, const cdouble *c, double *re, double *im) {
+  for (int n = 0; n <= p; n++)
+    for (int m = -n; m <= n; m++) {
+      const cdouble v = get_coeff(c, n, m);
+      re[n * n + n + m] = v.real();
+      im[n * n + n + m] = v.imag();
+    }
+}
+
+static void get_regular(const int p, const Math::vec_d3 &r, cdouble *out) {
+  const double r2 = simd_dot(r, r);
+  const cdouble xy(r.x, r.y);
+  out[0] = 1.0;
+  for (int n = 1; n <= p; n++)
+    out[get_index(n, n)] = -xy / (2.0 * n) * out[get_index(n - 1, n - 1)];
+  for (int m = 0; m < p; m++)
+    for (int n = m + 1; n <= p; n++) {
+      const cdouble prev = n - 2 >= m ? out[get_index(n - 2, m)] : 0.0;
+      out[get_index(n, m)] =
+          ((2.0 * n - 1.0) * r.z * out[get_index(n - 1, m)] - r2 * prev) /
+          static_cast<double>((n + m) * (n - m));
+    }
+}
+
+static void get_irregular(const int p, const Math::vec_d3 &r, cdouble *out) {
+  const double inv_r2 = 1.0 / simd_dot(r, r);
+  const cdouble xy(r.x, r.y);
+  out[0] = std::sqrt(inv_r2);
+  for (int n = 1; n <= p; n++)
+    out[get_index(n, n)] =
+        -(2.0 * n - 1.0) * inv_r2 * xy * out[get_index(n - 1, n - 1)];
+  for (int m = 0; m < p; m++)
+    for (int n = m + 1; n <= p; n++) {
+      const cdouble prev = n - 2 >= m ? out[get_index(n - 2, m)] : 0.0;
+      out[get_index(n, m)] =
+          ((2.0 * n - 1.0) * r.z * out[get_index(n - 1, m)] -
+           static_cast<double>((n - 1 + m) * (n - 1 - m)) * prev) *
+          inv_r2;
+    }
+}
+
+/* Multipoles of a child about the parent, s = z_child - z_parent */
+static void m2m(const int p, const cdouble *child, const Math::vec_d3 &s,
+                cdouble *parent, cdouble *y) {
+  get_regular(p, s, y);
+  for (int n = 0; n <= p; n++)
+    for (int m = 0; m <= n; m++) {
+      cdouble sum = 0.0;
+      for (int k = 0; k <= n; k++)
+        for (int l = std::max(-k, m - n + k); l <= std::min(k, m + n - k); l++)
+          sum += mul(std::conj(get_coeff(y, k, l)),
+                     get_coeff(child, n - k, m - l));
+      parent[get_index(n, m)] += sum;
+    }
+}
+
+/* Local expansion about a target of a source's expanded multipoles, r =
+ * z_target - z_source. The inner sums run over contiguous m */
+static void m2l(const int p, const double *m_re, const double *m_im,
+                const Math::vec_d3 &r, cdouble *local, cdouble *t,
+                double *t_re, double *t_im) {
+  get_irregular(p, r, t);
+  expand(p, t, t_re, t_im);
+  for (int k = 0; k <= p; k++)
+    for (int l = 0; l <= k; l++) {
+      double sum_re = 0.0, sum_im = 0.0;
+      for (int n = 0; n <= p - k; n++) {
+        const int o = n * n + n, q = (n + k) * (n + k) + (n + k) + l;
+        for (int m = -n; m <= n; m++) {
+          sum_re += m_re[o + m] * t_re[q + m] - m_im[o + m] * t_im[q + m];
+          sum_im += m_re[o + m] * t_im[q + m] + m_im[o + m] * t_re[q + m];
+        }
+      }
+      local[get_index(k, l)] += (k & 1) ? cdouble(-sum_re, -sum_im)
+                                        : cdouble(sum_re, sum_im);
+    }
+}
+
+/* Local expansion of a parent about a child, s = z_child - z_parent. Only
+ * orders up to p_out are produced */
+static void l2l(const int p, const int p_out, const cdouble *parent,
+                const Math::vec_d3 &s, cdouble *child, cdouble *y) {
+  get_regular(p, s, y);
+  for (int j = 0; j <= p_out; j++)
+    for (int i = 0; i <= j; i++) {
+      cdouble sum = 0.0;
+      for (int k = j; k <= p; k++)
+        for (int l = std::max(-k, i - k + j); l <= std::min(k, i + k - j); l++)
+          sum += mul(get_coeff(parent, k, l),
+                     std::conj(get_coeff(y, k - j, l - i)));
+      child[get_index(j, i)] += sum;
+    }
+}
+
+FMM_Solver::FMM_Solver(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+void FMM_Solver::set_config(const FMM_Config &config) {
+  if (config.order < 1 || config.order > FMM_MAX_ORDER)
+    throw std::runtime_error("Failed: FMM order must be in [1, 20]");
+  if (!(config.theta > 0.0 && config.theta < 1.0))
+    throw std::runtime_error("Failed: FMM opening angle must be in (0, 1)");
+  if (config.leaf_size == 0)
+    throw std::runtime_error("Failed: FMM leaf size must be positive");
+
+  m_config = config;
+}
+
+const FMM_Config &FMM_Solver::get_config() const { return m_config; }
+
+const FMM_Stats &FMM_Solver::get_stats() const { return m_stats; }
+
+void FMM_Solver::accumulate(std::span<const Math::vec_d3> src_p,
+                            std::span<const double> src_gm,
+                            std::span<const Math::vec_d3> p,
+                            std::span<Math::vec_d3> a) {
+  if (src_gm.size() != src_p.size() || a.size() != p.size())
+    throw std::runtime_error("Failed: FMM_Solver, span size mismatch");
+
+  m_stats = FMM_Stats{};
+  if (src_p.empty() || p.empty())
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  build(src_p, src_gm, p);
+  const auto t1 = std::chrono::steady_clock::now();
+  upward();
+  const auto t2 = std::chrono::steady_clock::now();
+  traverse();
+  const auto t3 = std::chrono::steady_clock::now();
+  interact();
+  const auto t4 = std::chrono::steady_clock::now();
+  downward(a);
+  const auto t5 = std::chrono::steady_clock::now();
+
+  m_stats.n_nodes = m_nodes.size();
+  m_stats.ms_build = ms_t(t1 - t0).count();
+  m_stats.ms_upward = ms_t(t2 - t1).count();
+  m_stats.ms_traverse = ms_t(t3 - t2).count();
+  m_stats.ms_interact = ms_t(t4 - t3).count();
+  m_stats.ms_downward = ms_t(t5 - t4).count();
+}
+
+/* Sources and targets share one octree. A node splits on the next octal
+ * digit of the Morton code, so its children are contiguous runs */
+void FMM_Solver::build(std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm,
+                       std::span<const Math::vec_d3> p) {
+  const size_t n_src = src_p.size(), n = n_src + p.size();
+  const auto get_point = [&](const size_t i) {
+    return i < n_src ? src_p[i] : p[i - n_src];
+  };
+
+  Math::vec_d3 lo = src_p[0], hi = src_p[0];
+  for (size_t i = 0; i < n; i++) {
+    lo = simd_min(lo, get_point(i));
+    hi = simd_max(hi, get_point(i));
+  }
+  const Math::vec_d3 extent = hi - lo;
+  const double side = std::max({extent.x, extent.y, extent.z, 1e-300});
+
+  m_codes.resize(n);
+  m_order.resize(n);
+  m_pool.parallel_for(0, n, FMM_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          m_codes[i] = CPU::get_morton_code(
+                              simd_float((get_point(i) - lo) / side));
+                          m_order[i] = static_cast<uint32_t>(i);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, m_codes, m_order);
+
+  m_x.resize(n);
+  m_gm.resize(n);
+  m_target.resize(n);
+  m_pool.parallel_for(0, n, FMM_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t k = b; k < e; k++) {
+                          const uint32_t i = m_order[k];
+                          m_x[k] = get_point(i);
+                          m_gm[k] = i < n_src ? src_gm[i] : 0.0;
+                          m_target[k] = i < n_src
+                                            ? NO_TARGET
+                                            : static_cast<uint32_t>(i - n_src);
+                        }
+                      });
+
+  m_nodes.clear();
+  m_levels.clear();
+  m_nodes.push_back(Node{});
+  m_nodes[0].end = static_cast<uint32_t>(n);
+  std::vector<uint32_t> depth = {0};
+  for (size_t i = 0; i < m_nodes.size(); i++) {
+    if (m_levels.size() <= depth[i])
+      m_levels.push_back(static_cast<uint32_t>(i));
+
+    const uint32_t begin = m_nodes[i].begin, end = m_nodes[i].end;
+    if (end - begin <= m_config.leaf_size || depth[i] == MAX_DEPTH)
+      continue;
+
+    const uint32_t shift = 3 * (MAX_DEPTH - 1 - depth[i]);
+    m_nodes[i].first_child = static_cast<uint32_t>(m_nodes.size());
+    for (uint32_t b = begin; b < end;) {
+      const uint64_t digit = (m_codes[b] >> shift) & 7;
+      uint32_t e = b + 1;
+      while (e < end && ((m_codes[e] >> shift) & 7) == digit)
+        e++;
+      Node &child = m_nodes.emplace_back();
+      child.begin = b;
+      child.end = e;
+      child.parent = static_cast<uint32_t>(i);
+      depth.push_back(depth[i] + 1);
+      m_nodes[i].n_children++;
+      b = e;
+    }
+  }
+  m_levels.push_back(static_cast<uint32_t>(m_nodes.size()));
+}
+
+/* Centres, radii and multipoles, deepest level first */
+void FMM_Solver::upward() {
+  const int p = static_cast<int>(m_config.order);
+  const size_t n_coeffs = get_coeff_ct(m_config.order);
+  m_multipoles.assign(m_nodes.size() * n_coeffs, 0.0);
+
+  for (size_t level = m_levels.size() - 1; level-- > 0;)
+    m_pool.parallel_for(
+        m_levels[level], m_levels[level + 1], NODE_GRAIN,
+        [&](const size_t b, const size_t e, size_t) {
+          std::vector<cdouble> y(n_coeffs);
+          for (size_t i = b; i < e; i++) {
+            Node &node = m_nodes[i];
+            cdouble *multipole = m_multipoles.data() + i * n_coeffs;
+            Math::vec_d3 sum_gm = {0.0, 0.0, 0.0}, sum_x = {0.0, 0.0, 0.0};
+            node.gm = 0.0;
+            node.n_targets = 0;
+
+            // Centre of mass, or the centroid of a cell with only targets
+            if (node.n_children == 0) {
+              for (uint32_t k = node.begin; k < node.end; k++) {
+                sum_gm += m_x[k] * m_gm[k];
+                sum_x += m_x[k];
+                node.gm += m_gm[k];
+                node.n_targets += m_target[k] != NO_TARGET ? 1 : 0;
+              }
+            } else {
+              for (uint32_t c = node.first_child;
+                   c < node.first_child + node.n_children; c++) {
+                const Node &child = m_nodes[c];
+                sum_gm += child.z * child.gm;
+                sum_x += child.z * static_cast<double>(child.end - child.begin);
+                node.gm += child.gm;
+                node.n_targets += child.n_targets;
+              }
+            }
+            node.z = node.gm > 0.0 ? sum_gm / node.gm
+                                   : sum_x / static_cast<double>(node.end -
+                                                                 node.begin);
+
+            node.r = 0.0;
+            if (node.n_children == 0) {
+              for (uint32_t k = node.begin; k < node.end; k++) {
+                node.r = std::max(node.r, Math::magnitude(m_x[k] - node.z));
+                if (m_gm[k] <= 0.0)
+                  continue;
+
+                get_regular(p, m_x[k] - node.z, y.data());
+                for (size_t c = 0; c < n_coeffs; c++)
+                  multipole[c] += m_gm[k] * std::conj(y[c]);
+              }
+            } else {
+              for (uint32_t c = node.first_child;
+                   c < node.first_child + node.n_children; c++) {
+                const Node &child = m_nodes[c];
+                node.r = std::max(node.r, Math::magnitude(child.z - node.z) +
+                                              child.r);
+                if (child.gm > 0.0)
+                  m2m(p, m_multipoles.data() + c * n_coeffs, child.z - node.z,
+                      multipole, y.data());
+              }
+            }
+          }
+        });
+
+  const size_t n_full = get_full_ct(m_config.order);
+  m_expanded.resize(m_nodes.size() * 2 * n_full);
+  m_pool.parallel_for(0, m_nodes.size(), NODE_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          double *re = m_expanded.data() + i * 2 * n_full;
+                          expand(p, m_multipoles.data() + i * n_coeffs, re,
+                                 re + n_full);
+                        }
+                      });
+}
+
+/* One-way dual-tree walk from the root's self interaction. A pair of cells
+ * is accepted when (r_a + r_b) < theta d, otherwise the larger one opens */
+void FMM_Solver::traverse() {
+  std::vector<uint64_t> m2l_pairs, p2p_pairs; // target << 32 | source
+  const double theta = m_config.theta;
+
+  const auto walk = [&](const auto &self, const uint32_t ti,
+                        const uint32_t si) -> void {
+    const Node &t = m_nodes[ti], &s = m_nodes[si];
+    if (t.n_targets == 0 || s.gm <= 0.0)
+      return;
+
+    const uint64_t pair = static_cast<uint64_t>(ti) << 32 | si;
+    if (ti == si) {
+      if (t.n_children == 0) {
+        p2p_pairs.push_back(pair);
+        return;
+      }
+      for (uint32_t a = t.first_child; a < t.first_child + t.n_children; a++)
+        for (uint32_t b = t.first_child; b < t.first_child + t.n_children;
+             b++)
+          self(self, a, b);
+      return;
+    }
+
+    if (t.r + s.r < theta * Math::magnitude(t.z - s.z)) {
+      m2l_pairs.push_back(pair);
+    } else if (t.n_children == 0 && s.n_children == 0) {
+      p2p_pairs.push_back(pair);
+    } else if (s.n_children == 0 || (t.n_children != 0 && t.r >= s.r)) {
+      for (uint32_t c = t.first_child; c < t.first_child + t.n_children; c++)
+        self(self, c, si);
+    } else {
+      for (uint32_t c = s.first_child; c < s.first_child + s.n_children; c++)
+        self(self, ti, c);
+    }
+  };
+  walk(walk, 0, 0);
+
+  // Grouped by target, order within a target is kept by the stable sort
+  const auto group = [&](std::vector<uint64_t> &pairs,
+                         std::vector<uint32_t> &start,
+                         std::vector<uint32_t> &sources) {
+    start.assign(m_nodes.size() + 1, 0);
+    for (const uint64_t pair : pairs)
+      start[(pair >> 32) + 1]++;
+    for (size_t i = 0; i < m_nodes.size(); i++)
+      start[i + 1] += start[i];
+
+    Parallel::radix_sort(m_pool, pairs);
+    sources.resize(pairs.size());
+    for (size_t k = 0; k < pairs.size(); k++)
+      sources[k] = static_cast<uint32_t>(pairs[k]);
+  };
+  group(m2l_pairs, m_m2l_start, m_m2l);
+  group(p2p_pairs, m_p2p_start, m_p2p);
+  m_stats.n_m2l = m_m2l.size();
+}
+
+/* Multipole to local conversions, each target cell gathers its own list */
+void FMM_Solver::interact() {
+  const int p = static_cast<int>(m_config.order);
+  const size_t n_coeffs = get_coeff_ct(m_config.order);
+  const size_t n_full = get_full_ct(m_config.order);
+  m_locals.assign(m_nodes.size() * n_coeffs, 0.0);
+
+  m_pool.parallel_for(
+      0, m_nodes.size(), NODE_GRAIN,
+      [&](const size_t b, const size_t e, size_t) {
+        std::vector<cdouble> t(n_coeffs);
+        std::vector<double> t_full(2 * n_full);
+        for (size_t i = b; i < e; i++)
+          for (uint32_t k = m_m2l_start[i]; k < m_m2l_start[i + 1]; k++) {
+            const uint32_t s = m_m2l[k];
+            const double *source = m_expanded.data() + s * 2 * n_full;
+            m2l(p, source, source + n_full, m_nodes[i].z - m_nodes[s].z,
+                m_locals.data() + i * n_coeffs, t.data(), t_full.data(),
+                t_full.data() + n_full);
+          }
+      });
+}
+
+/* Locals pushed down level by level, then every leaf evaluates its local
+ * expansion and sums its near field directly */
+void FMM_Solver::downward(std::span<Math::vec_d3> a) {
+  const int p = static_cast<int>(m_config.order);
+  const size_t n_coeffs = get_coeff_ct(m_config.order);
+
+  for (size_t level = 1; level + 1 < m_levels.size(); level++)
+    m_pool.parallel_for(m_levels[level], m_levels[level + 1], NODE_GRAIN,
+                        [&](const size_t b, const size_t e, size_t) {
+                          std::vector<cdouble> y(n_coeffs);
+                          for (size_t i = b; i < e; i++) {
+                            const Node &node = m_nodes[i];
+                            if (node.n_targets == 0)
+                              continue;
+
+                            const Node &parent = m_nodes[node.parent];
+                            l2l(p, p,
+                                m_locals.data() + node.parent * n_coeffs,
+                                node.z - parent.z,
+                                m_locals.data() + i * n_coeffs, y.data());
+                          }
+                        });
+
+  std::vector<uint64_t> chunk_pairs(
+      Parallel::Thread_Pool::get_chunk_ct(m_nodes.size(), NODE_GRAIN), 0);
+  m_pool.parallel_for(
+      0, m_nodes.size(), NODE_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        std::vector<cdouble> y(n_coeffs);
+        cdouble grad[3];
+        uint64_t n_pairs = 0;
+        for (size_t i = b; i < e; i++) {
+          const Node &node = m_nodes[i];
+          if (node.n_children != 0 || node.n_targets == 0)
+            continue;
+
+          const cdouble *local = m_locals.data() + i * n_coeffs;
+          for (uint32_t j = node.begin; j < node.end; j++) {
+            if (m_target[j] == NO_TARGET)
+              continue;
+
+            // First order terms of the local shifted onto the body
+            std::fill(grad, grad + 3, 0.0);
+            l2l(p, 1, local, m_x[j] - node.z, grad, y.data());
+            Math::vec_d3 acc = {-grad[2].real(), -grad[2].imag(),
+                                grad[1].real()};
+
+            for (uint32_t k = m_p2p_start[i]; k < m_p2p_start[i + 1]; k++) {
+              const Node &source = m_nodes[m_p2p[k]];
+              for (uint32_t s = source.begin; s < source.end; s++) {
+                const Math::vec_d3 d = m_x[s] - m_x[j];
+                const double r2 = simd_dot(d, d);
+                if (r2 > 0.0 && m_gm[s] > 0.0) {
+                  acc += d * (m_gm[s] / (r2 * std::sqrt(r2)));
+                  n_pairs++;
+                }
+              }
+            }
+
+            a[m_target[j]] += acc;
+          }
+        }
+        chunk_pairs[chunk] = n_pairs;
+      });
+
+  for (const uint64_t n_pairs : chunk_pairs)
+    m_stats.n_p2p_pairs += n_pairs;
+}
+
+} // namespace CTNM::Sim
@@ -0,0 +1,61 @@
+#include "sim/gravity.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+static constexpr size_t DIRECT_GRAIN = 64;
+
+template <bool Compensated>
+static void accumulate(Parallel::Thread_Pool &pool,
+                       std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm,
+                       std::span<const Math::vec_d3> p,
+                       std::span<Math::vec_d3> a) {
+  pool.parallel_for(0, p.size(), DIRECT_GRAIN,
+                    [&](const size_t b, const size_t e, const size_t) {
+                      for (size_t i = b; i < e; i++) {
+                        Math::vec_d3 sum = {0.0, 0.0, 0.0};
+                        Math::vec_d3 c = {0.0, 0.0, 0.0};
+                        for (size_t j = 0; j < src_p.size(); j++) {
+                          const Math::vec_d3 d = src_p[j] - p[i];
+                          const double r2 = simd_dot(d, d);
+                          if (r2 <= 0.0)
+                            continue;
+
+                          const Math::vec_d3 x =
+                              d * (src_gm[j] / (r2 * std::sqrt(r2)));
+                          if constexpr (Compensated) {
+                            const Math::vec_d3 y = x - c, t = sum + y;
+                            c = (t - sum) - y;
+                            sum = t;
+                          } else {
+                            sum += x;
+                          }
+                        }
+                        a[i] += sum;
+                      }
+                    });
+}
+
+void accumulate_direct(Parallel::Thread_Pool &pool,
+                       std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm,
+                       std::span<const Math::vec_d3> p,
+                       std::span<Math::vec_d3> a, const bool compensated) {
+  if (src_gm.size() != src_p.size() || a.size() != p.size())
+    throw std::runtime_error("Failed: accumulate_direct, span size mismatch");
+
+  if (compensated)
+    accumulate<true>(pool, src_p, src_gm, p, a);
+  else
+    accumulate<false>(pool, src_p, src_gm, p, a);
+}
+
+} // namespace CTNM::Sim
@@ -0,0 +1,210 @@
+#include "sim/kepler.hpp"
+#include "components.hpp"
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+static constexpr size_t ORBIT_GRAIN = 4096;
+static constexpr double DEGENERATE_EPS = 1e-10;
+
+/* Elements use the usual frame with +Z as the pole, the scene's pole is +y */
+static inline Math::vec_d3 to_world(const Math::vec_d3 &s) {
+  return Math::vec_d3{s.x, s.z, -s.y};
+}
+
+static inline Math::vec_d3 to_reference(const Math::vec_d3 &w) {
+  return Math::vec_d3{w.x, -w.z, w.y};
+}
+
+void solve_kepler(std::span<const double> mean_anomaly,
+                  std::span<const double> e, std::span<double> anomaly) {
+  if (e.size() != mean_anomaly.size() || anomaly.size() != mean_anomaly.size())
+    throw std::runtime_error("Failed: Kepler solver spans differ in size");
+
+  using vdouble = simd::double4;
+  using vlong = simd::long4;
+  const size_t n = mean_anomaly.size();
+  for (size_t b = 0; b < n; b += 4) {
+    const size_t k = std::min<size_t>(4, n - b);
+    vdouble M = {0.0, 0.0, 0.0, 0.0}, ecc = {0.0, 0.0, 0.0, 0.0};
+    for (size_t j = 0; j < k; j++) {
+      M[j] = mean_anomaly[b + j];
+      ecc[j] = e[b + j];
+    }
+
+    const vdouble one = vdouble{} + 1.0;
+    const vlong hyper = ecc > 1.0;
+    const vdouble sgn = simd_select(one, -one, M < 0.0), abs_M = simd::fabs(M);
+
+    /* Near periapsis both equations reduce to (e/6) x^3 + |1-e| x = M, whose
+     * real root stays accurate as e -> 1 where the usual starters stall.
+     * Further out Danby's starter for the ellipse and the asymptotic log
+     * form for the hyperbola */
+    const vdouble e_safe = simd_max(ecc, vdouble{} + 1e-3);
+    const vdouble p = 2.0 * simd::fabs(1.0 - ecc) / e_safe,
+                  q = 3.0 * abs_M / e_safe;
+    const vdouble w = simd::cbrt(q + simd::sqrt(q * q + p * p * p));
+    const vdouble cubic = w - p / w;
+    const vdouble far = simd_select(
+        abs_M + ecc * 0.85,
+        simd::log(2.0 * abs_M / simd_max(ecc, one) + 1.8), hyper);
+    vdouble x = sgn * simd_select(far, cubic, cubic < 1.0);
+    for (uint32_t it = 0; it < KEPLER_ITERATIONS; it++) {
+      const vdouble s = simd::sin(x), c = simd::cos(x);
+      const vdouble sh = simd::sinh(x), ch = simd::cosh(x);
+      const vdouble f = simd_select(x - ecc * s - M, ecc * sh - x - M, hyper),
+                    fp = simd_select(1.0 - ecc * c, ecc * ch - 1.0, hyper),
+                    fpp = simd_select(ecc * s, ecc * sh, hyper);
+      x -= f / (fp - 0.5 * f * fpp / fp);
+    }
+
+    for (size_t j = 0; j < k; j++)
+      anomaly[b + j] = x[j];
+  }
+}
+
+static double get_mean_anomaly(const Components::Orbit &orbit,
+                               const double t) {
+  const double abs_a = std::fabs(orbit.a);
+  const double n = std::sqrt(orbit.mu / (abs_a * abs_a * abs_a));
+  const double M = orbit.m0 + n * (t - orbit.epoch);
+  return orbit.e < 1.0 ? std::remainder(M, 2.0 * std::numbers::pi) : M;
+}
+
+/* Perifocal state rotated by Rz(raan) Rx(i) Rz(argp) */
+static Orbit_State get_state(const Components::Orbit &orbit,
+                             const double anomaly) {
+  const double abs_a = std::fabs(orbit.a), e = orbit.e;
+  double x, y, vx, vy;
+  if (e < 1.0) {
+    const double s = std::sin(anomaly), c = std::cos(anomaly);
+    const double q = std::sqrt(1.0 - e * e);
+    const double r = abs_a * (1.0 - e * c);
+    const double k = std::sqrt(orbit.mu * abs_a) / r;
+    x = abs_a * (c - e);
+    y = abs_a * q * s;
+    vx = -k * s;
+    vy = k * q * c;
+  } else {
+    const double sh = std::sinh(anomaly), ch = std::cosh(anomaly);
+    const double q = std::sqrt(e * e - 1.0);
+    const double r = abs_a * (e * ch - 1.0);
+    const double k = std::sqrt(orbit.mu * abs_a) / r;
+    x = abs_a * (e - ch);
+    y = abs_a * q * sh;
+    vx = -k * sh;
+    vy = k * q * ch;
+  }
+
+  const double so = std::sin(orbit.raan), co = std::cos(orbit.raan);
+  const double sw = std::sin(orbit.argp), cw = std::cos(orbit.argp);
+  const double si = std::sin(orbit.i), ci = std::cos(orbit.i);
+  const Math::vec_d3 P = {co * cw - so * sw * ci, so * cw + co * sw * ci,
+                          sw * si},
+                     Q = {-co * sw - so * cw * ci, -so * sw + co * cw * ci,
+                          cw * si};
+
+  return Orbit_State{to_world(P * x + Q * y), to_world(P * vx + Q * vy)};
+}
+
+Orbit_State get_orbit_state(const Components::Orbit &orbit, const double t) {
+  const double M = get_mean_anomaly(orbit, t), e = orbit.e;
+  double anomaly;
+  solve_kepler(std::span<const double>(&M, 1), std::span<const double>(&e, 1),
+               std::span<double>(&anomaly, 1));
+  return get_state(orbit, anomaly);
+}
+
+void get_orbit_states(Parallel::Thread_Pool &pool,
+                      std::span<const Components::Orbit> orbits,
+                      const double t, std::span<Orbit_State> out) {
+  if (out.size() != orbits.size())
+    throw std::runtime_error("Failed: Orbit state span differs in size");
+
+  pool.parallel_for(
+      0, orbits.size(), ORBIT_GRAIN,
+      [&](const size_t b, const size_t e, const size_t) {
+        const size_t n = e - b;
+        std::vector<double> M(n), ecc(n), anomaly(n);
+        for (size_t i = 0; i < n; i++) {
+          M[i] = get_mean_anomaly(orbits[b + i], t);
+          ecc[i] = orbits[b + i].e;
+        }
+
+        solve_kepler(M, ecc, anomaly);
+        for (size_t i = 0; i < n; i++)
+          out[b + i] = get_state(orbits[b + i], anomaly[i]);
+      });
+}
+
+Components::Orbit make_orbit(const Orbit_State &state, const double mu,
+                             const double epoch, const entt::entity parent) {
+  const Math::vec_d3 r = to_reference(state.p), v = to_reference(state.v);
+  const double r_len = Math::magnitude(r);
+  if (r_len <= 0.0 || mu <= 0.0)
+    throw std::runtime_error("Failed: Orbit needs a separation and mass");
+
+  const Math::vec_d3 h = simd_cross(r, v);
+  const double h_len = Math::magnitude(h);
+  if (h_len <= 0.0)
+    throw std::runtime_error("Failed: Radial trajectories have no orbit");
+
+  const double v2 = simd_dot(v, v);
+  const Math::vec_d3 e_vec = (r * (v2 - mu / r_len) - v * simd_dot(r, v)) / mu;
+  const Math::vec_d3 h_n = h / h_len;
+
+  Components::Orbit orbit;
+  orbit.parent = parent;
+  orbit.mu = mu;
+  orbit.e = Math::magnitude(e_vec);
+  if (std::fabs(orbit.e - 1.0) < DEGENERATE_EPS) // Nearest non-parabolic conic
+    orbit.e = 1.0 - DEGENERATE_EPS;
+  orbit.a = h_len * h_len / (mu * (1.0 - orbit.e * orbit.e));
+  orbit.i = std::acos(std::clamp(h_n.z, -1.0, 1.0));
+  orbit.epoch = epoch;
+
+  // Node line, or +x for equatorial orbits
+  const Math::vec_d3 node = {-h.y, h.x, 0.0};
+  const double node_len = Math::magnitude(node);
+  const bool equatorial = node_len <= DEGENERATE_EPS * h_len;
+  const Math::vec_d3 node_n =
+      equatorial ? Math::vec_d3{1.0, 0.0, 0.0} : node / node_len;
+  orbit.raan = equatorial ? 0.0 : std::atan2(node.y, node.x);
+
+  const auto get_angle = [&](const Math::vec_d3 &from,
+                             const Math::vec_d3 &to) {
+    return std::atan2(simd_dot(simd_cross(from, to), h_n), simd_dot(from, to));
+  };
+
+  // Circular orbits measure the anomaly from the node
+  const bool circular = orbit.e <= DEGENERATE_EPS;
+  orbit.argp = circular ? 0.0 : get_angle(node_n, e_vec);
+  const double nu = circular ? get_angle(node_n, r) : get_angle(e_vec, r);
+  if (circular)
+    orbit.e = 0.0;
+
+  const double e = orbit.e;
+  if (e < 1.0) {
+    const double E =
+        std::atan2(std::sqrt(1.0 - e * e) * std::sin(nu), e + std::cos(nu));
+    orbit.m0 = E - e * std::sin(E);
+  } else {
+    const double H = std::asinh(std::sqrt(e * e - 1.0) * std::sin(nu) /
+                                (1.0 + e * std::cos(nu)));
+    orbit.m0 = e * std::sinh(H) - H;
+  }
+
+  return orbit;
+}
+
+} // namespace CTNM::Sim
@@ -0,0 +1,398 @@
+#include "sim/pm_solver.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/fft.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static constexpr size_t PM_GRAIN = 4096;
+static constexpr uint32_t MAX_CHAIN_CELLS = 128; // Per side
+static constexpr uint32_t SHORT_TABLE = 1024;
+
+static inline double wrap(const double u, const double n) {
+  const double w = u - n * std::floor(u / n);
+  return w < n ? w : 0.0;
+}
+
+PM_Solver::PM_Solver(Parallel::Thread_Pool &pool) : m_pool(pool), m_fft(pool) {}
+
+void PM_Solver::set_config(const PM_Config &config) {
+  if (config.n_mesh < 16 || !std::has_single_bit(config.n_mesh))
+    throw std::runtime_error("Failed: PM mesh must be a power of two >= 16");
+
+  m_config = config;
+}
+
+const PM_Config &PM_Solver::get_config() const { return m_config; }
+
+const PM_Stats &PM_Solver::get_stats() const { return m_stats; }
+
+void PM_Solver::accumulate(std::span<const Math::vec_d3> src_p,
+                           std::span<const double> src_gm,
+                           std::span<const Math::vec_d3> p,
+                           std::span<Math::vec_d3> a) {
+  if (src_gm.size() != src_p.size() || a.size() != p.size())
+    throw std::runtime_error("Failed: PM_Solver, span size mismatch");
+
+  m_stats = PM_Stats{};
+  if (src_p.empty() || p.empty())
+    return;
+
+  fit_box(src_p, p);
+  m_fft.resize(m_config.n_mesh);
+  m_mesh.resize(m_fft.get_mesh_size());
+
+  const auto t0 = std::chrono::steady_clock::now();
+  assign(src_p, src_gm);
+  const auto t1 = std::chrono::steady_clock::now();
+  solve();
+  const auto t2 = std::chrono::steady_clock::now();
+  interpolate(p, a);
+  const auto t3 = std::chrono::steady_clock::now();
+  if (m_config.tree_pm)
+    add_short_range(src_p, src_gm, p, a);
+  const auto t4 = std::chrono::steady_clock::now();
+
+  m_stats.ms_assign = ms_t(t1 - t0).count();
+  m_stats.ms_fft = ms_t(t2 - t1).count();
+  m_stats.ms_interpolate = ms_t(t3 - t2).count();
+  m_stats.ms_short = ms_t(t4 - t3).count();
+}
+
+/* A fitted box is twice the extent of the bodies, which keeps the pull of
+ * the periodic images small for isolated scenes */
+void PM_Solver::fit_box(std::span<const Math::vec_d3> src_p,
+                        std::span<const Math::vec_d3> p) {
+  if (m_config.box_size > 0.0) {
+    m_origin = m_config.box_min;
+    m_box = m_config.box_size;
+  } else {
+    Math::vec_d3 lo = src_p[0], hi = src_p[0];
+    for (const auto &q : src_p) {
+      lo = simd_min(lo, q);
+      hi = simd_max(hi, q);
+    }
+    for (const auto &q : p) {
+      lo = simd_min(lo, q);
+      hi = simd_max(hi, q);
+    }
+
+    const Math::vec_d3 extent = hi - lo;
+    const double side = std::max({extent.x, extent.y, extent.z});
+    m_box = side > 0.0 ? 2.0 * side : 1.0;
+    m_origin = (lo + hi) * 0.5 - m_box * 0.5;
+  }
+
+  m_h = m_box / m_config.n_mesh;
+}
+
+/* Cloud-in-cell deposit. Sources are sorted into x slabs two cells thick;
+ * a deposit reaches at most the next slab, so slabs of one parity never
+ * touch the same cells and can be written concurrently */
+void PM_Solver::assign(std::span<const Math::vec_d3> src_p,
+                       std::span<const double> src_gm) {
+  const uint32_t n = m_config.n_mesh, n_slabs = n / 2, mask = n - 1;
+  const size_t row = m_fft.get_row(), plane = n * row;
+  const double n_d = static_cast<double>(n), inv_h = 1.0 / m_h;
+  const double inv_vol = inv_h * inv_h * inv_h;
+
+  m_pool.parallel_for(0, n, 1, [&](const size_t b, const size_t e, size_t) {
+    std::fill(m_mesh.begin() + b * plane, m_mesh.begin() + e * plane, 0.0f);
+  });
+
+  const size_t n_src = src_p.size();
+  m_keys.resize(n_src);
+  m_order.resize(n_src);
+  m_pool.parallel_for(0, n_src, PM_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          const double u =
+                              wrap((src_p[i].x - m_origin.x) * inv_h, n_d);
+                          m_keys[i] = static_cast<uint32_t>(u) / 2;
+                          m_order[i] = static_cast<uint32_t>(i);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, m_keys, m_order);
+
+  m_start.resize(n_slabs + 1);
+  for (uint32_t s = 0; s <= n_slabs; s++)
+    m_start[s] = static_cast<uint32_t>(
+        std::lower_bound(m_keys.begin(), m_keys.end(), s) - m_keys.begin());
+
+  for (uint32_t parity = 0; parity < 2; parity++)
+    m_pool.parallel_for(
+        0, n_slabs / 2, 1, [&](const size_t b, const size_t e, size_t) {
+          for (size_t s = 2 * b + parity; s < 2 * e; s += 2)
+            for (uint32_t k = m_start[s]; k < m_start[s + 1]; k++) {
+              const uint32_t j = m_order[k];
+              const Math::vec_d3 q = (src_p[j] - m_origin) * inv_h;
+              const double u[3] = {wrap(q.x, n_d), wrap(q.y, n_d),
+                                   wrap(q.z, n_d)};
+              uint32_t i0[3];
+              float w[3][2];
+              for (int d = 0; d < 3; d++) {
+                i0[d] = static_cast<uint32_t>(u[d]);
+                const float f = static_cast<float>(u[d] - i0[d]);
+                w[d][0] = 1.0f - f;
+                w[d][1] = f;
+              }
+
+              const float mass = static_cast<float>(src_gm[j] * inv_vol);
+              for (uint32_t dx = 0; dx < 2; dx++)
+                for (uint32_t dy = 0; dy < 2; dy++) {
+                  float *line = m_mesh.data() +
+                                ((i0[0] + dx) & mask) * plane +
+                                ((i0[1] + dy) & mask) * row;
+                  const float wxy = mass * w[0][dx] * w[1][dy];
+                  line[i0[2]] += wxy * w[2][0];
+                  line[(i0[2] + 1) & mask] += wxy * w[2][1];
+                }
+            }
+        });
+}
+
+/* phi_k = -4 pi rho_k / k^2, deconvolved by the cloud-in-cell window of the
+ * deposit and the interpolation. The TreePM split keeps exp(-k^2 r_s^2) */
+void PM_Solver::solve() {
+  const uint32_t n = m_config.n_mesh, h = n / 2 + 1;
+  const double k_f = 2.0 * std::numbers::pi / m_box;
+  const double r_s = m_config.r_split * m_h;
+  const double norm = 1.0 / (static_cast<double>(n) * n * n);
+
+  std::vector<double> k(n), window(n);
+  for (uint32_t i = 0; i < n; i++) {
+    const double f = i <= n / 2 ? static_cast<double>(i)
+                                : static_cast<double>(i) - n;
+    const double t = std::numbers::pi * f / n;
+    const double sinc = t == 0.0 ? 1.0 : std::sin(t) / t;
+    k[i] = k_f * f;
+    window[i] = 1.0 / (sinc * sinc * sinc * sinc);
+  }
+
+  m_fft.forward(m_mesh);
+
+  auto *spectrum = reinterpret_cast<std::complex<float> *>(m_mesh.data());
+  m_pool.parallel_for(0, n, 1, [&](const size_t b, const size_t e, size_t) {
+    for (size_t x = b; x < e; x++)
+      for (uint32_t y = 0; y < n; y++) {
+        std::complex<float> *line = spectrum + (x * n + y) * h;
+        for (uint32_t z = 0; z < h; z++) {
+          const double k2 = k[x] * k[x] + k[y] * k[y] + k[z] * k[z];
+          if (k2 == 0.0) {
+            line[z] = 0.0f; // Mean density sets no force in a periodic box
+            continue;
+          }
+
+          double green = -4.0 * std::numbers::pi / k2 * window[x] *
+                         window[y] * window[z] * norm;
+          if (m_config.tree_pm)
+            green *= std::exp(-k2 * r_s * r_s);
+          line[z] *= static_cast<float>(green);
+        }
+      }
+  });
+
+  m_fft.inverse(m_mesh);
+}
+
+/* Four point central differences of the potential at the eight corners,
+ * blended with the deposit weights so a body feels no force from itself */
+void PM_Solver::interpolate(std::span<const Math::vec_d3> p,
+                            std::span<Math::vec_d3> a) const {
+  const uint32_t n = m_config.n_mesh, mask = n - 1;
+  const size_t row = m_fft.get_row(), plane = n * row;
+  const double n_d = static_cast<double>(n), inv_h = 1.0 / m_h;
+  const double inv_12h = 1.0 / (12.0 * m_h);
+
+  const auto phi = [&](const uint32_t x, const uint32_t y, const uint32_t z) {
+    return static_cast<double>(
+        m_mesh[(x & mask) * plane + (y & mask) * row + (z & mask)]);
+  };
+
+  m_pool.parallel_for(0, p.size(), PM_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          const Math::vec_d3 q = (p[i] - m_origin) * inv_h;
+                          const double u[3] = {wrap(q.x, n_d), wrap(q.y, n_d),
+                                               wrap(q.z, n_d)};
+                          uint32_t i0[3];
+                          double w[3][2];
+                          for (int d = 0; d < 3; d++) {
+                            i0[d] = static_cast<uint32_t>(u[d]);
+                            w[d][1] = u[d] - i0[d];
+                            w[d][0] = 1.0 - w[d][1];
+                          }
+
+                          Math::vec_d3 grad = {0.0, 0.0, 0.0};
+                          for (uint32_t dx = 0; dx < 2; dx++)
+                            for (uint32_t dy = 0; dy < 2; dy++)
+                              for (uint32_t dz = 0; dz < 2; dz++) {
+                                // Offset by n so the stencil never underflows
+                                const uint32_t x = i0[0] + dx + n,
+                                               y = i0[1] + dy + n,
+                                               z = i0[2] + dz + n;
+                                const Math::vec_d3 g = {
+                                    8.0 * (phi(x + 1, y, z) -
+                                           phi(x - 1, y, z)) -
+                                        (phi(x + 2, y, z) - phi(x - 2, y, z)),
+                                    8.0 * (phi(x, y + 1, z) -
+                                           phi(x, y - 1, z)) -
+                                        (phi(x, y + 2, z) - phi(x, y - 2, z)),
+                                    8.0 * (phi(x, y, z + 1) -
+                                           phi(x, y, z - 1)) -
+                                        (phi(x, y, z + 2) - phi(x, y, z - 2))};
+                                grad += g * (w[0][dx] * w[1][dy] * w[2][dz]);
+                              }
+
+                          a[i] -= grad * inv_12h;
+                        }
+                      });
+}
+
+/* The part of the force the mesh filtered out, erfc(r / 2 r_s) plus its
+ * gradient term, for pairs in neighbouring chaining mesh cells */
+void PM_Solver::add_short_range(std::span<const Math::vec_d3> src_p,
+                                std::span<const double> src_gm,
+                                std::span<const Math::vec_d3> p,
+                                std::span<Math::vec_d3> a) {
+  const double r_s = m_config.r_split * m_h, r_cut = m_config.r_cut * r_s;
+  const double r_cut2 = r_cut * r_cut, inv_r_cut2 = 1.0 / r_cut2;
+  const uint32_t nc = static_cast<uint32_t>(
+      std::clamp(std::floor(m_box / r_cut), 1.0,
+                 static_cast<double>(MAX_CHAIN_CELLS)));
+  const int32_t nc_i = static_cast<int32_t>(nc);
+  const double nc_d = static_cast<double>(nc), inv_cell = nc_d / m_box;
+
+  const auto wrap_into_box = [&](const Math::vec_d3 &q) {
+    const Math::vec_d3 u = q - m_origin;
+    return m_origin + simd_make_double3(wrap(u.x, m_box), wrap(u.y, m_box),
+                                        wrap(u.z, m_box));
+  };
+  const auto get_cell = [&](const Math::vec_d3 &q, uint32_t c[3]) {
+    const Math::vec_d3 u = (q - m_origin) * inv_cell;
+    c[0] = std::min(static_cast<uint32_t>(wrap(u.x, nc_d)), nc - 1);
+    c[1] = std::min(static_cast<uint32_t>(wrap(u.y, nc_d)), nc - 1);
+    c[2] = std::min(static_cast<uint32_t>(wrap(u.z, nc_d)), nc - 1);
+  };
+
+  // Sources sorted by cell, copied out so each cell is contiguous
+  const size_t n_src = src_p.size(), n_cells = size_t(nc) * nc * nc;
+  m_keys.resize(n_src);
+  m_order.resize(n_src);
+  m_pool.parallel_for(0, n_src, PM_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          uint32_t c[3];
+                          get_cell(src_p[i], c);
+                          m_keys[i] = (c[0] * nc + c[1]) * nc + c[2];
+                          m_order[i] = static_cast<uint32_t>(i);
+                        }
+                      });
+  Parallel::radix_sort(m_pool, m_keys, m_order);
+
+  m_start.assign(n_cells + 1, 0);
+  for (const uint32_t key : m_keys)
+    m_start[key + 1]++;
+  for (size_t c = 0; c < n_cells; c++)
+    m_start[c + 1] += m_start[c];
+
+  // Wrapped into the box, so a neighbour across the edge is one box away
+  std::vector<Math::vec_d3> sorted_p(n_src);
+  std::vector<double> sorted_gm(n_src);
+  for (size_t k = 0; k < n_src; k++) {
+    sorted_p[k] = wrap_into_box(src_p[m_order[k]]);
+    sorted_gm[k] = src_gm[m_order[k]];
+  }
+
+  /* erfc(x) + 2x / sqrt(pi) exp(-x^2) with x = r / 2 r_s, tabulated over
+   * r^2 / r_cut^2 */
+  std::vector<double> table(SHORT_TABLE + 2);
+  for (uint32_t t = 0; t < table.size(); t++) {
+    const double x = r_cut * std::sqrt(static_cast<double>(t) / SHORT_TABLE) /
+                     (2.0 * r_s);
+    table[t] = std::erfc(x) +
+               2.0 * x / std::sqrt(std::numbers::pi) * std::exp(-x * x);
+  }
+
+  /* Under three cells per side the 27 neighbours repeat, so each distinct
+   * cell is visited once with the minimum image instead */
+  const bool small = nc < 3;
+  std::vector<int32_t> offsets;
+  for (const int32_t d : {-1, 0, 1})
+    if (!small || std::find_if(offsets.begin(), offsets.end(), [&](int32_t o) {
+                    return (o + nc_i) % nc_i == (d + nc_i) % nc_i;
+                  }) == offsets.end())
+      offsets.push_back(d);
+
+  std::vector<uint64_t> chunk_pairs(
+      Parallel::Thread_Pool::get_chunk_ct(p.size(), PM_GRAIN), 0);
+  m_pool.parallel_for(
+      0, p.size(), PM_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        uint64_t n_pairs = 0;
+        for (size_t i = b; i < e; i++) {
+          const Math::vec_d3 q = wrap_into_box(p[i]);
+          uint32_t c[3];
+          get_cell(q, c);
+
+          Math::vec_d3 sum = {0.0, 0.0, 0.0};
+          for (const int32_t ox : offsets)
+            for (const int32_t oy : offsets)
+              for (const int32_t oz : offsets) {
+                const int32_t o[3] = {ox, oy, oz};
+                uint32_t cell = 0;
+                Math::vec_d3 shift = {0.0, 0.0, 0.0};
+                for (int d = 0; d < 3; d++) {
+                  const int32_t raw = static_cast<int32_t>(c[d]) + o[d];
+                  shift[d] = raw < 0 ? -m_box : raw >= nc_i ? m_box : 0.0;
+                  cell = cell * nc + static_cast<uint32_t>((raw + nc_i) % nc_i);
+                }
+
+                for (uint32_t k = m_start[cell]; k < m_start[cell + 1]; k++) {
+                  Math::vec_d3 d = sorted_p[k] - q;
+                  if (small)
+                    d -= m_box * simd_make_double3(std::round(d.x / m_box),
+                                                   std::round(d.y / m_box),
+                                                   std::round(d.z / m_box));
+                  else
+                    d += shift;
+
+                  const double r2 = simd_dot(d, d);
+                  if (r2 <= 0.0 || r2 >= r_cut2)
+                    continue;
+
+                  const double u = r2 * inv_r_cut2 * SHORT_TABLE;
+                  const uint32_t t = static_cast<uint32_t>(u);
+                  const double f =
+                      table[t] + (u - t) * (table[t + 1] - table[t]);
+                  sum += d * (sorted_gm[k] * f / (r2 * std::sqrt(r2)));
+                  n_pairs++;
+                }
+              }
+
+          a[i] += sum;
+        }
+        chunk_pairs[chunk] = n_pairs;
+      });
+
+  for (const uint64_t n_pairs : chunk_pairs)
+    m_stats.n_short_pairs += n_pairs;
+}
+
+} // namespace CTNM::Sim
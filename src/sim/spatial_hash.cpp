@@ -0,0 +1,254 @@
+#include "sim/spatial_hash.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static constexpr size_t HASH_GRAIN = 1 << 14;
+static constexpr size_t PAIR_GRAIN = 1 << 10;
+static constexpr uint32_t MAX_BITS = 30;
+static constexpr size_t PREFETCH = 16; // Slots ahead in the gather
+
+Spatial_Hash::Spatial_Hash(Parallel::Thread_Pool &pool) : m_pool(pool) {}
+
+/* Two buckets per point keeps chains short without a load factor check */
+void Spatial_Hash::build(std::span<const Math::vec_d3> p, const double cell) {
+  if (!(cell > 0.0) || !std::isfinite(cell))
+    throw std::runtime_error("Failed: Spatial_Hash cell must be positive");
+  if (p.size() >= UINT32_MAX)
+    throw std::runtime_error("Failed: Spatial_Hash, too many points");
+
+  const size_t n = p.size();
+  m_cell = cell;
+  m_inv_cell = 1.0 / cell;
+  m_bits = std::clamp<uint32_t>(std::bit_width(2 * n), 1, MAX_BITS);
+  const size_t n_buckets = size_t(1) << m_bits;
+  m_stats = Spatial_Hash_Stats{n, n_buckets};
+
+  const auto t0 = std::chrono::steady_clock::now();
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, HASH_GRAIN);
+  std::vector<Math::vec_d3> chunk_lo(n_chunks), chunk_hi(n_chunks);
+  m_keys.resize(n);
+  m_order.resize(n);
+  m_pool.parallel_for(
+      0, n, HASH_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        Math::vec_d3 lo = p[b], hi = p[b];
+        for (size_t i = b; i < e; i++) {
+          int64_t c[3];
+          get_cell(p[i], c);
+          m_keys[i] = get_bucket(get_cell_code(c[0], c[1], c[2]));
+          m_order[i] = static_cast<uint32_t>(i);
+          lo = simd_min(lo, p[i]);
+          hi = simd_max(hi, p[i]);
+        }
+        chunk_lo[chunk] = lo;
+        chunk_hi[chunk] = hi;
+      });
+  m_lo = n == 0 ? Math::vec_d3{0.0, 0.0, 0.0} : chunk_lo[0];
+  m_hi = m_lo;
+  for (size_t chunk = 0; chunk < n && chunk < n_chunks; chunk++) {
+    m_lo = simd_min(m_lo, chunk_lo[chunk]);
+    m_hi = simd_max(m_hi, chunk_hi[chunk]);
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  Parallel::radix_sort(m_pool, m_keys, m_order);
+  const auto t2 = std::chrono::steady_clock::now();
+
+  // Each bucket's start is written by the first slot at or past it
+  m_points.resize(n);
+  m_cells.resize(n);
+  m_bucket_start.resize(n_buckets + 1);
+  m_pool.parallel_for(
+      0, n, HASH_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t k = b; k < e; k++) {
+          if (k + PREFETCH < e)
+            __builtin_prefetch(&p[m_order[k + PREFETCH]]);
+          const Math::vec_d3 q = p[m_order[k]];
+          int64_t c[3];
+          get_cell(q, c);
+          m_points[k] = q;
+          m_cells[k] = get_cell_code(c[0], c[1], c[2]);
+
+          const uint32_t first = k == 0 ? 0 : m_keys[k - 1] + 1;
+          for (uint32_t bucket = first; bucket <= m_keys[k]; bucket++)
+            m_bucket_start[bucket] = static_cast<uint32_t>(k);
+        }
+      });
+  const uint32_t tail = n == 0 ? 0 : m_keys[n - 1] + 1;
+  std::fill(m_bucket_start.begin() + tail, m_bucket_start.end(),
+            static_cast<uint32_t>(n));
+  const auto t3 = std::chrono::steady_clock::now();
+
+  m_stats.ms_keys = ms_t(t1 - t0).count();
+  m_stats.ms_sort = ms_t(t2 - t1).count();
+  m_stats.ms_ranges = ms_t(t3 - t2).count();
+}
+
+size_t Spatial_Hash::size() const { return m_points.size(); }
+
+bool Spatial_Hash::empty() const { return m_points.empty(); }
+
+double Spatial_Hash::get_cell() const { return m_cell; }
+
+const Spatial_Hash_Stats &Spatial_Hash::get_stats() const { return m_stats; }
+
+std::span<const uint32_t> Spatial_Hash::get_order() const { return m_order; }
+
+std::span<const Math::vec_d3> Spatial_Hash::get_points() const {
+  return m_points;
+}
+
+uint32_t Spatial_Hash::find_nearest(const Math::vec_d3 &q,
+                                    const double radius) const {
+  uint32_t best = SPATIAL_HASH_NONE;
+  double best_r2 = std::numeric_limits<double>::infinity();
+  for_each_in_radius(q, radius, [&](const uint32_t k, const double r2) {
+    if (r2 < best_r2 || (r2 == best_r2 && k < best)) {
+      best = k;
+      best_r2 = r2;
+    }
+  });
+
+  return best;
+}
+
+/* Walks the cells the ray crosses inside the padded bounds in order of
+ * entry, testing every cell within radius of each. A sphere hit at t is
+ * found from the cell holding the ray at t, so the walk ends once cells are
+ * entered past the best hit */
+uint32_t Spatial_Hash::cast_ray(const Math::vec_d3 &origin,
+                                const Math::vec_d3 &dir, const double max_t,
+                                const double radius, double *t_hit) const {
+  uint32_t best = SPATIAL_HASH_NONE;
+  double best_t = max_t;
+  const double a = simd_dot(dir, dir);
+  if (m_points.empty() || !(a > 0.0) || !(max_t >= 0.0))
+    return best;
+
+  double t_lo = 0.0, t_hi = max_t;
+  for (int d = 0; d < 3; d++) {
+    const double lo = m_lo[d] - radius, hi = m_hi[d] + radius;
+    if (dir[d] == 0.0) {
+      if (origin[d] < lo || origin[d] > hi)
+        return best;
+      continue;
+    }
+
+    const double t0 = (lo - origin[d]) / dir[d], t1 = (hi - origin[d]) / dir[d];
+    t_lo = std::max(t_lo, std::min(t0, t1));
+    t_hi = std::min(t_hi, std::max(t0, t1));
+  }
+  if (t_lo > t_hi)
+    return best;
+
+  const auto test = [&](const uint32_t k) {
+    const Math::vec_d3 oc = origin - m_points[k];
+    const double b = simd_dot(dir, oc);
+    const double c = simd_dot(oc, oc) - radius * radius;
+    const double disc = b * b - a * c;
+    if (disc < 0.0)
+      return;
+
+    const double t = c <= 0.0 ? 0.0 : (-b - std::sqrt(disc)) / a;
+    if (t >= 0.0 && (t < best_t || (t == best_t && k < best))) {
+      best = k;
+      best_t = t;
+    }
+  };
+
+  // Cells are unit sized in s = p / cell, t is shared with the caller
+  const Math::vec_d3 start = origin + t_lo * dir;
+  const Math::vec_d3 s0 = start * m_inv_cell, ds = dir * m_inv_cell;
+  const double crossings =
+      (std::fabs(ds.x) + std::fabs(ds.y) + std::fabs(ds.z)) * (t_hi - t_lo) +
+      1.0;
+  if (!(crossings <= static_cast<double>(m_bucket_start.size()))) {
+    for (uint32_t k = 0; k < m_points.size(); k++)
+      test(k);
+  } else {
+    int64_t c[3];
+    get_cell(start, c);
+    int64_t step[3];
+    double t_next[3], t_delta[3];
+    for (int d = 0; d < 3; d++) {
+      step[d] = ds[d] > 0.0 ? 1 : -1;
+      t_delta[d] = ds[d] != 0.0 ? 1.0 / std::fabs(ds[d])
+                                : std::numeric_limits<double>::infinity();
+      const double edge = static_cast<double>(c[d] + (ds[d] > 0.0 ? 1 : 0));
+      t_next[d] = ds[d] != 0.0 ? t_lo + (edge - s0[d]) / ds[d]
+                               : std::numeric_limits<double>::infinity();
+    }
+
+    // Covers every sphere the ray can touch inside the cell
+    const double reach = radius + 0.5 * std::sqrt(3.0) * m_cell;
+    double t_enter = t_lo;
+    while (t_enter <= std::min(best_t, t_hi)) {
+      const Math::vec_d3 centre =
+          (simd_make_double3(static_cast<double>(c[0]),
+                             static_cast<double>(c[1]),
+                             static_cast<double>(c[2])) +
+           0.5) *
+          m_cell;
+      for_each_candidate(centre, reach, test);
+
+      const int d = t_next[0] < t_next[1]
+                        ? (t_next[0] < t_next[2] ? 0 : 2)
+                        : (t_next[1] < t_next[2] ? 1 : 2);
+      t_enter = t_next[d];
+      t_next[d] += t_delta[d];
+      c[d] += step[d];
+      if (std::fabs(static_cast<double>(c[d])) > CELL_LIMIT)
+        break;
+    }
+  }
+
+  if (best != SPATIAL_HASH_NONE && t_hit)
+    *t_hit = best_t;
+  return best;
+}
+
+void Spatial_Hash::find_pairs(
+    const double radius,
+    std::vector<std::pair<uint32_t, uint32_t>> &out) const {
+  const size_t n = m_points.size();
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, PAIR_GRAIN);
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> chunk_pairs(
+      n_chunks);
+  // Kept from the lower slot only, whether or not either query fell back
+  m_pool.parallel_for(
+      0, n, PAIR_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        auto &pairs = chunk_pairs[chunk];
+        for (size_t i = b; i < e; i++) {
+          const uint32_t k = static_cast<uint32_t>(i);
+          const Math::vec_d3 q = m_points[i];
+          for_each_candidate(q, radius, [&](const uint32_t j) {
+            const Math::vec_d3 d = m_points[j] - q;
+            if (j > k && simd_dot(d, d) <= radius * radius)
+              pairs.emplace_back(k, j);
+          });
+        }
+      });
+
+  out.clear();
+  for (const auto &pairs : chunk_pairs)
+    out.insert(out.end(), pairs.begin(), pairs.end());
+}
+
+} // namespace CTNM::Sim
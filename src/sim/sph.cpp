@@ -0,0 +1,390 @@
+#include "sim/sph.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+#include <simd/simd.h>
+
+namespace CTNM::Sim {
+
+using ms_t = std::chrono::duration<double, std::milli>;
+
+static constexpr size_t SPH_GRAIN = 256;
+static constexpr uint32_t H_ITERATIONS = 8;
+static constexpr double H_TOLERANCE = 1e-2; // On the neighbour count
+static constexpr double H_GROWTH = 1.25;    // Per round
+static constexpr uint32_t H_ROUNDS = 8;     // Of neighbour gathering
+
+/* Kernels as W = norm / h^3 w(q) with q = r / h */
+template <SPH_Kernel K> static constexpr double get_kernel_norm() {
+  if constexpr (K == SPH_Kernel::Cubic_Spline)
+    return 1.0 / std::numbers::pi;
+  else
+    return 21.0 / (16.0 * std::numbers::pi);
+}
+
+// Branch free so the neighbour loops vectorise
+template <SPH_Kernel K> static inline double get_w(const double q) {
+  if constexpr (K == SPH_Kernel::Cubic_Spline) {
+    const double a = std::max(2.0 - q, 0.0), b = std::max(1.0 - q, 0.0);
+    return 0.25 * a * a * a - b * b * b;
+  } else {
+    const double t = std::max(1.0 - 0.5 * q, 0.0), t2 = t * t;
+    return t2 * t2 * (1.0 + 2.0 * q);
+  }
+}
+
+/* dw / dq */
+template <SPH_Kernel K> static inline double get_dw(const double q) {
+  if constexpr (K == SPH_Kernel::Cubic_Spline) {
+    const double a = std::max(2.0 - q, 0.0), b = std::max(1.0 - q, 0.0);
+    return -0.75 * a * a + 3.0 * b * b;
+  } else {
+    const double t = std::max(1.0 - 0.5 * q, 0.0);
+    return -5.0 * q * t * t * t;
+  }
+}
+
+SPH_Solver::SPH_Solver(Parallel::Thread_Pool &pool)
+    : m_pool(pool), m_hash(pool) {}
+
+void SPH_Solver::set_config(const SPH_Config &config) {
+  if (config.n_neighbours < 8)
+    throw std::runtime_error("Failed: SPH needs at least 8 neighbours");
+  if (config.gamma <= 1.0)
+    throw std::runtime_error("Failed: SPH adiabatic index must exceed 1");
+
+  m_config = config;
+}
+
+const SPH_Config &SPH_Solver::get_config() const { return m_config; }
+
+const SPH_Stats &SPH_Solver::get_stats() const { return m_stats; }
+
+void SPH_Solver::compute(std::span<const Math::vec_d3> p,
+                         std::span<const Math::vec_d3> v,
+                         std::span<const double> m, std::span<const double> u,
+                         std::span<double> h, std::span<double> rho,
+                         std::span<Math::vec_d3> a, std::span<double> du_dt) {
+  const size_t n = p.size();
+  if (v.size() != n || m.size() != n || u.size() != n || h.size() != n ||
+      rho.size() != n || a.size() != n || du_dt.size() != n)
+    throw std::runtime_error("Failed: SPH_Solver, span size mismatch");
+
+  m_stats = SPH_Stats{n};
+  if (n == 0)
+    return;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  build_grid(p, v, m, u, h);
+  const auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t round = 0; round < H_ROUNDS; round++) {
+    const bool first = round == 0, last = round + 1 == H_ROUNDS;
+    if (m_config.kernel == SPH_Kernel::Cubic_Spline
+            ? !density<SPH_Kernel::Cubic_Spline>(first, last)
+            : !density<SPH_Kernel::Wendland_C2>(first, last))
+      break;
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+  build_neighbours();
+  const auto t3 = std::chrono::steady_clock::now();
+  if (m_config.kernel == SPH_Kernel::Cubic_Spline)
+    force<SPH_Kernel::Cubic_Spline>();
+  else
+    force<SPH_Kernel::Wendland_C2>();
+  const auto t4 = std::chrono::steady_clock::now();
+
+  // Back to the caller's order
+  m_pool.parallel_for(0, n, SPH_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t k = b; k < e; k++) {
+                          const uint32_t i = m_hash.get_order()[k];
+                          h[i] = m_h[k];
+                          rho[i] = m_rho[k];
+                          a[i] += simd_make_double3(m_ax[k], m_ay[k], m_az[k]);
+                          du_dt[i] = m_du[k];
+                        }
+                      });
+
+  m_stats.ms_grid = ms_t(t1 - t0).count();
+  m_stats.ms_density = ms_t(t2 - t1).count();
+  m_stats.ms_neighbours = ms_t(t3 - t2).count();
+  m_stats.ms_force = ms_t(t4 - t3).count();
+  m_stats.mean_neighbours = static_cast<double>(m_stats.n_pairs) / n;
+  m_stats.particles_per_s = n / std::max(m_stats.get_ms() * 1e-3, 1e-9);
+}
+
+/* Cells 2 h wide for the mean h, particles with larger support visit more
+ * cells */
+void SPH_Solver::build_grid(std::span<const Math::vec_d3> p,
+                            std::span<const Math::vec_d3> v,
+                            std::span<const double> m,
+                            std::span<const double> u,
+                            std::span<const double> h) {
+  const size_t n = p.size();
+  Math::vec_d3 lo = p[0], hi = p[0];
+  for (size_t i = 0; i < n; i++) {
+    lo = simd_min(lo, p[i]);
+    hi = simd_max(hi, p[i]);
+  }
+  const Math::vec_d3 extent = hi - lo;
+
+  // Without a guess, the h that holds n_neighbours at the mean density
+  const double side = std::max({extent.x, extent.y, extent.z, 1e-100});
+  const double volume = std::max(extent.x, side * 1e-3) *
+                        std::max(extent.y, side * 1e-3) *
+                        std::max(extent.z, side * 1e-3);
+  const double h_guess =
+      0.5 * std::cbrt(3.0 * volume * m_config.n_neighbours /
+                      (4.0 * std::numbers::pi * static_cast<double>(n)));
+  const double h_sum = Parallel::reduce_sum(m_pool, n, [&](const size_t i) {
+    return h[i] > 0.0 ? h[i] : h_guess;
+  });
+
+  m_hash.build(p, 2.0 * h_sum / static_cast<double>(n));
+  const std::span<const uint32_t> order = m_hash.get_order();
+
+  for (auto *arr : {&m_x, &m_y, &m_z, &m_vx, &m_vy, &m_vz, &m_m, &m_u, &m_h,
+                    &m_rho, &m_p_rho2, &m_c, &m_ax, &m_ay, &m_az, &m_du})
+    arr->resize(n);
+  m_pool.parallel_for(0, n, SPH_GRAIN * 16,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t k = b; k < e; k++) {
+                          const uint32_t i = order[k];
+                          m_x[k] = p[i].x;
+                          m_y[k] = p[i].y;
+                          m_z[k] = p[i].z;
+                          m_vx[k] = v[i].x;
+                          m_vy[k] = v[i].y;
+                          m_vz[k] = v[i].z;
+                          m_m[k] = m[i];
+                          m_u[k] = u[i];
+                          m_h[k] = h[i] > 0.0 ? h[i] : -h_guess;
+                        }
+                      });
+}
+
+/* Smoothing lengths by fixed point iteration on the kernel weighted
+ * neighbour count, (4 pi / 3) (2h)^3 sum W = n_neighbours. Candidates
+ * within reach of H_GROWTH h are gathered once, then each particle
+ * iterates on its own compact list. A particle that needs more reach is
+ * left negative for another round, returns whether any was */
+template <SPH_Kernel K>
+bool SPH_Solver::density(const bool first, const bool last) {
+  constexpr double norm = get_kernel_norm<K>();
+  const double target = m_config.n_neighbours;
+  const std::span<const Math::vec_d3> points = m_hash.get_points();
+
+  std::vector<uint8_t> chunk_unsettled(
+      Parallel::Thread_Pool::get_chunk_ct(m_x.size(), SPH_GRAIN), 0);
+  m_pool.parallel_for(
+      0, m_x.size(), SPH_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        std::vector<double> r2s, ms;
+        for (size_t i = b; i < e; i++) {
+          // Negative when guessed or still growing
+          if (!first && m_h[i] >= 0.0)
+            continue;
+
+          double h = std::fabs(m_h[i]);
+          const double h_cap = h * H_GROWTH;
+
+          const double reach2 = 4.0 * h_cap * h_cap;
+          r2s.clear();
+          ms.clear();
+          m_hash.for_each_candidate(
+              points[i], 2.0 * h_cap, [&](const uint32_t j) {
+                const double dx = m_x[i] - m_x[j], dy = m_y[i] - m_y[j],
+                             dz = m_z[i] - m_z[j];
+                const double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 < reach2) {
+                  r2s.push_back(r2);
+                  ms.push_back(m_m[j]);
+                }
+              });
+
+          double sum_mw = 0.0, count = 0.0;
+          for (uint32_t it = 0; it < H_ITERATIONS; it++) {
+            const double inv_h = 1.0 / h;
+            double sum_w = 0.0;
+            sum_mw = 0.0;
+            for (size_t k = 0; k < r2s.size(); k++) {
+              const double w = get_w<K>(std::sqrt(r2s[k]) * inv_h);
+              sum_w += w;
+              sum_mw += ms[k] * w;
+            }
+
+            count = 32.0 * std::numbers::pi / 3.0 * norm * sum_w;
+            if (std::fabs(count - target) <= H_TOLERANCE * target ||
+                it + 1 == H_ITERATIONS)
+              break;
+
+            const double h_next =
+                std::min(h * std::clamp(std::cbrt(target / count), 0.7, 1.3),
+                         h_cap);
+            if (h_next == h)
+              break;
+            h = h_next;
+          }
+
+          const bool unsettled =
+              !last && h == h_cap && count < (1.0 - H_TOLERANCE) * target;
+          m_h[i] = unsettled ? -h : h;
+          m_rho[i] = norm / (h * h * h) * sum_mw;
+          chunk_unsettled[chunk] |= unsettled ? 1 : 0;
+        }
+      });
+
+  return std::any_of(chunk_unsettled.begin(), chunk_unsettled.end(),
+                     [](const uint8_t u) { return u != 0; });
+}
+
+/* Every j with r < 2 max(h_i, h_j), in compact per particle runs. Each
+ * particle gathers within its own 2 h_i, pairs only j's support covers are
+ * mirrored back from j's gather */
+void SPH_Solver::build_neighbours() {
+  const size_t n = m_x.size();
+  const std::span<const Math::vec_d3> points = m_hash.get_points();
+  const size_t n_chunks = Parallel::Thread_Pool::get_chunk_ct(n, SPH_GRAIN);
+  std::vector<std::vector<uint64_t>> chunk_mirrored(n_chunks);
+  const auto gather = [&](const size_t i, uint32_t *out,
+                          std::vector<uint64_t> *mirrored) {
+    uint32_t ct = 0;
+    const double s = 2.0 * m_h[i];
+    m_hash.for_each_candidate(points[i], s, [&](const uint32_t j) {
+      const double dx = m_x[i] - m_x[j], dy = m_y[i] - m_y[j],
+                   dz = m_z[i] - m_z[j];
+      const double r2 = dx * dx + dy * dy + dz * dz;
+      if (j == i || r2 >= s * s)
+        return;
+
+      if (out)
+        out[ct] = j;
+      if (mirrored && r2 >= 4.0 * m_h[j] * m_h[j])
+        mirrored->push_back(static_cast<uint64_t>(j) << 32 | i);
+      ct++;
+    });
+    return ct;
+  };
+
+  std::vector<uint32_t> counts(n);
+  m_pool.parallel_for(
+      0, n, SPH_GRAIN, [&](const size_t b, const size_t e, const size_t chunk) {
+        for (size_t i = b; i < e; i++)
+          counts[i] = gather(i, nullptr, &chunk_mirrored[chunk]);
+      });
+
+  std::vector<uint64_t> mirrored;
+  for (const auto &pairs : chunk_mirrored)
+    mirrored.insert(mirrored.end(), pairs.begin(), pairs.end());
+  Parallel::radix_sort(m_pool, mirrored);
+  std::vector<uint32_t> mirror_start(n + 1, 0);
+  for (const uint64_t pair : mirrored)
+    mirror_start[(pair >> 32) + 1]++;
+  for (size_t i = 0; i < n; i++) {
+    mirror_start[i + 1] += mirror_start[i];
+    counts[i] += mirror_start[i + 1] - mirror_start[i];
+  }
+
+  m_ngb_start.resize(n + 1);
+  const uint32_t total = Parallel::exclusive_scan<uint32_t>(
+      m_pool, counts, std::span(m_ngb_start).first(n));
+  m_ngb_start[n] = total;
+  m_ngb.resize(total);
+  m_pool.parallel_for(0, n, SPH_GRAIN,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          uint32_t *out = m_ngb.data() + m_ngb_start[i];
+                          out += gather(i, out, nullptr);
+                          for (uint32_t k = mirror_start[i];
+                               k < mirror_start[i + 1]; k++)
+                            *out++ = static_cast<uint32_t>(mirrored[k]);
+                        }
+                      });
+  m_stats.n_pairs = total;
+}
+
+/* Pressure and Monaghan viscosity,
+ *   dv_i/dt = -sum m_j (P_i / rho_i^2 + P_j / rho_j^2 + Pi_ij) grad W_ij
+ *   du_i/dt = 1/2 sum m_j (P_i / rho_i^2 + P_j / rho_j^2 + Pi_ij) v_ij .
+ *             grad W_ij */
+template <SPH_Kernel K> void SPH_Solver::force() {
+  constexpr double norm = get_kernel_norm<K>();
+  const size_t n = m_x.size();
+  const double gamma = m_config.gamma;
+  const double alpha = m_config.alpha, beta = m_config.beta;
+
+  m_pool.parallel_for(0, n, SPH_GRAIN * 16,
+                      [&](const size_t b, const size_t e, size_t) {
+                        for (size_t i = b; i < e; i++) {
+                          // rho is 0 only for massless, isolated particles
+                          const double rho = m_rho[i];
+                          const double pressure =
+                              (gamma - 1.0) * rho * std::max(m_u[i], 0.0);
+                          m_p_rho2[i] =
+                              rho > 0.0 ? pressure / (rho * rho) : 0.0;
+                          m_c[i] =
+                              rho > 0.0 ? std::sqrt(gamma * pressure / rho)
+                                        : 0.0;
+                        }
+                      });
+
+  m_pool.parallel_for(
+      0, n, SPH_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t i = b; i < e; i++) {
+          const double inv_hi = 1.0 / m_h[i];
+          const double grad_i = norm * inv_hi * inv_hi * inv_hi * inv_hi;
+          double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, sum_du = 0.0;
+          for (uint32_t k = m_ngb_start[i]; k < m_ngb_start[i + 1]; k++) {
+            const uint32_t j = m_ngb[k];
+            const double dx = m_x[i] - m_x[j], dy = m_y[i] - m_y[j],
+                         dz = m_z[i] - m_z[j];
+            const double dvx = m_vx[i] - m_vx[j], dvy = m_vy[i] - m_vy[j],
+                         dvz = m_vz[i] - m_vz[j];
+            const double r2 = dx * dx + dy * dy + dz * dz;
+            const double r = std::sqrt(r2), inv_r = r > 0.0 ? 1.0 / r : 0.0;
+            const double inv_hj = 1.0 / m_h[j];
+
+            // grad W_ij = g r_ij, averaged over both smoothing lengths
+            const double g =
+                0.5 * inv_r *
+                (grad_i * get_dw<K>(r * inv_hi) +
+                 norm * inv_hj * inv_hj * inv_hj * inv_hj *
+                     get_dw<K>(r * inv_hj));
+
+            const double vr = dvx * dx + dvy * dy + dvz * dz;
+            const double h_mean = 0.5 * (m_h[i] + m_h[j]);
+            const double mu =
+                std::min(vr, 0.0) * h_mean / (r2 + 0.01 * h_mean * h_mean);
+            const double rho_mean = 0.5 * (m_rho[i] + m_rho[j]);
+            const double visc =
+                rho_mean > 0.0 ? (-alpha * 0.5 * (m_c[i] + m_c[j]) * mu +
+                                  beta * mu * mu) /
+                                     rho_mean
+                               : 0.0;
+
+            const double f = m_m[j] * (m_p_rho2[i] + m_p_rho2[j] + visc) * g;
+            sum_x -= f * dx;
+            sum_y -= f * dy;
+            sum_z -= f * dz;
+            sum_du += 0.5 * f * vr;
+          }
+
+          m_ax[i] = sum_x;
+          m_ay[i] = sum_y;
+          m_az[i] = sum_z;
+          m_du[i] = sum_du;
+        }
+      });
+}
+
+} // namespace CTNM::Sim
@@ -0,0 +1,147 @@
+#include "sim/time_warp.hpp"
+#include "simulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include <entt/entt.hpp>
+
+namespace CTNM::Sim {
+
+/* Fourth order matches the leapfrog error of a substep at about four times
+ * its length for orbits resolved by a few hundred substeps */
+static constexpr double YOSHIDA_STRETCH = 4.0;
+static constexpr double EVAL_COST_SMOOTHING = 0.2;
+static constexpr double RECOVER_FRACTION = 0.5; // Of the budget
+static constexpr uint32_t REMEASURE_FRAMES = 120; // While degraded
+
+struct Plan {
+  Integrator integrator;
+  uint32_t n_substeps;
+  double n_evals;
+};
+
+static Plan make_plan(const Integrator integrator, const double sim_dt,
+                      const double max_substep) {
+  const double n = std::clamp(std::ceil(sim_dt / max_substep), 1.0,
+                              static_cast<double>(UINT32_MAX));
+  const double n_evals = integrator == Integrator::Leapfrog
+                             ? n + 1.0
+                             : n * get_force_evals(integrator);
+  return Plan{integrator, static_cast<uint32_t>(n), n_evals};
+}
+
+Time_Warp::Time_Warp(const Time_Warp_Config &config) : m_config(config) {}
+
+void Time_Warp::set_warp(const double warp) {
+  m_warp = std::clamp(warp, 1.0, MAX_WARP);
+}
+
+double Time_Warp::get_warp() const { return m_warp; }
+
+const Time_Warp_Stats &Time_Warp::get_stats() const { return m_stats; }
+
+void Time_Warp::update(entt::registry &reg, Simulator &sim) {
+  if (first_update) {
+    m_tp_last = std::chrono::steady_clock::now();
+    first_update = false;
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> wall_dt = now - m_tp_last;
+  m_tp_last = now;
+
+  advance(reg, sim, wall_dt.count());
+}
+
+void Time_Warp::advance(entt::registry &reg, Simulator &sim,
+                        const double wall_dt) {
+  using ms_t = std::chrono::duration<double, std::milli>;
+  const double sim_dt = m_warp * wall_dt;
+  if (sim_dt <= 0.0)
+    return;
+
+  const Plan leapfrog =
+      make_plan(Integrator::Leapfrog, sim_dt, m_config.max_substep);
+  const Plan yoshida = make_plan(Integrator::Yoshida, sim_dt,
+                                 m_config.max_substep * YOSHIDA_STRETCH);
+  Plan plan = yoshida.n_evals < leapfrog.n_evals ? yoshida : leapfrog;
+
+  /* Recovery is judged on the cost with perturbed orbits integrated, as
+   * last measured, with some headroom so the controller does not flip
+   * between modes every frame */
+  const double ms_per_eval =
+      m_stats.degraded ? m_ms_per_eval_full : m_stats.ms_per_eval;
+  const double budget =
+      m_config.budget_ms * (m_stats.degraded ? RECOVER_FRACTION : 1.0);
+  const bool fits = plan.n_substeps <= m_config.max_substeps &&
+                    plan.n_evals * ms_per_eval <= budget;
+
+  /* Orbits are handed off as a step ends, so handoff is enabled a frame
+   * before the one whose cost is taken as the full cost */
+  bool remeasure = false;
+  if (!fits) {
+    if (!m_stats.degraded) {
+      m_ms_per_eval_full = m_stats.ms_per_eval;
+      m_n_degraded = 0;
+      sim.set_handoff(false);
+      sim.restore_orbits(reg);
+      m_stats.degraded = true;
+    } else if (++m_n_degraded == REMEASURE_FRAMES - 1) {
+      sim.set_handoff(true);
+    } else if (m_n_degraded >= REMEASURE_FRAMES) {
+      remeasure = true;
+    }
+
+    // As many fourth order substeps as the budget allows, at least one
+    const double affordable =
+        m_stats.ms_per_eval > 0.0
+            ? std::floor(m_config.budget_ms /
+                         (get_force_evals(Integrator::Yoshida) *
+                          m_stats.ms_per_eval))
+            : static_cast<double>(m_config.max_substeps);
+    const uint32_t n = static_cast<uint32_t>(std::clamp(
+        affordable, 1.0,
+        static_cast<double>(
+            std::min(m_config.max_substeps, yoshida.n_substeps))));
+    plan = Plan{Integrator::Yoshida, n,
+                static_cast<double>(n * get_force_evals(Integrator::Yoshida))};
+  } else if (m_stats.degraded) {
+    sim.set_handoff(true);
+    m_stats.degraded = false;
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  sim.set_integrator(plan.integrator);
+  sim.step(reg, sim_dt, plan.n_substeps);
+  const double ms_frame = ms_t(std::chrono::steady_clock::now() - t0).count();
+
+  const Simulator_Stats &sim_stats = sim.get_stats();
+  if (remeasure) {
+    if (sim_stats.n_force_evals > 0)
+      m_ms_per_eval_full = sim_stats.ms_step / sim_stats.n_force_evals;
+    m_n_degraded = 0;
+    sim.set_handoff(false);
+    sim.restore_orbits(reg);
+  } else if (sim_stats.n_force_evals > 0) {
+    const double sample = sim_stats.ms_step / sim_stats.n_force_evals;
+    m_stats.ms_per_eval =
+        m_stats.ms_per_eval <= 0.0
+            ? sample
+            : m_stats.ms_per_eval +
+                  EVAL_COST_SMOOTHING * (sample - m_stats.ms_per_eval);
+  }
+
+  m_stats.warp = m_warp;
+  m_stats.sim_dt = sim_dt;
+  m_stats.substep = sim_dt / plan.n_substeps;
+  m_stats.n_substeps = plan.n_substeps;
+  m_stats.integrator = plan.integrator;
+  m_stats.ms_frame = ms_frame;
+  m_stats.sim_per_wall = ms_frame > 0.0 ? sim_dt * 1e3 / ms_frame : 0.0;
+}
+
+} // namespace CTNM::Sim
@@ -1,10 +1,52 @@
 #include "simulator.hpp"
 #include "components.hpp"
+#include "cpu/scene.hpp"
+#include "math_utils.hpp"
+#include "parallel/primitives.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/gravity.hpp"
+#include "sim/kepler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 #include <entt/entt.hpp>
+#include <simd/simd.h>
 
 namespace CTNM {
 
+// Fourth order symplectic coefficients, Yoshida 1990
+static const double YOSHIDA_W1 = 1.0 / (2.0 - std::cbrt(2.0)),
+                    YOSHIDA_W0 = -std::cbrt(2.0) * YOSHIDA_W1;
+static const double YOSHIDA_C[4] = {
+    0.5 * YOSHIDA_W1, 0.5 * (YOSHIDA_W0 + YOSHIDA_W1),
+    0.5 * (YOSHIDA_W0 + YOSHIDA_W1), 0.5 * YOSHIDA_W1};
+static const double YOSHIDA_D[3] = {YOSHIDA_W1, YOSHIDA_W0, YOSHIDA_W1};
+
+static constexpr size_t BODY_GRAIN = 4096;
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+static constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+static uint64_t hash_bytes(uint64_t h, const void *data, const size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++)
+    h = (h ^ bytes[i]) * FNV_PRIME;
+  return h;
+}
+
+static uint64_t hash_vec(const uint64_t h, const Math::vec_d3 &v) {
+  const double xyz[3] = {v.x, v.y, v.z}; // Not the padding lane
+  return hash_bytes(h, xyz, sizeof(xyz));
+}
+
+Simulator::Simulator(Parallel::Thread_Pool &pool)
+    : m_pool(pool), m_pm(pool), m_fmm(pool), m_sph(pool), m_collision(pool),
+      m_hash(pool) {}
+
 void Simulator::update(entt::registry &reg) {
   if (first_update) {
     m_tp_last = std::chrono::steady_clock::now();
@@ -17,13 +59,578 @@ void Simulator::update(entt::registry &reg) {
   const float dt = _dt.count();
   m_tp_last = now;
 
-  const auto &physics_entities =
-      reg.view<Components::Transform, Components::Physics>();
-  for (const auto e : physics_entities) {
+  step(reg, dt);
+}
+
+void Simulator::step(entt::registry &reg, const double dt,
+                     const uint32_t n_substeps) {
+  using ms_t = std::chrono::duration<double, std::milli>;
+  const auto t0 = std::chrono::steady_clock::now();
+  m_stats.n_force_evals = 0;
+
+  gather(reg);
+  const uint32_t n = std::max(n_substeps, 1u);
+  const double h = dt / n, t_start = m_time;
+  for (uint32_t s = 0; s < n && !m_bodies.empty(); s++) {
+    const double t = t_start + h * s;
+    for (size_t k = 0; k < m_colliders.size(); k++)
+      m_col_p0[k] = m_p[m_colliders[k]];
+
+    switch (m_integrator) {
+    case Integrator::Euler: // Semi-implicit
+      get_accelerations(reg, t);
+      kick(h);
+      drift(h);
+      break;
+    case Integrator::Leapfrog: // Kick-drift-kick
+      if (s == 0)
+        get_accelerations(reg, t);
+      kick(0.5 * h);
+      drift(h);
+      get_accelerations(reg, t + h);
+      kick(0.5 * h);
+      break;
+    case Integrator::Yoshida: {
+      double tau = t;
+      for (int k = 0; k < 3; k++) {
+        drift(YOSHIDA_C[k] * h);
+        tau += YOSHIDA_C[k] * h;
+        get_accelerations(reg, tau);
+        kick(YOSHIDA_D[k] * h);
+      }
+      drift(YOSHIDA_C[3] * h);
+      break;
+    }
+    }
+
+    if (m_colliders.size() > 1)
+      collide();
+  }
+
+  m_time = t_start + dt;
+  evaluate_orbits(reg, m_time);
+  m_stats.checksum = m_deterministic ? get_checksum() : 0;
+  scatter(reg);
+  for (const entt::entity e : m_absorbed)
+    reg.destroy(e);
+  m_absorbed.clear();
+
+  m_stats.ms_step = ms_t(std::chrono::steady_clock::now() - t0).count();
+}
+
+double Simulator::get_time() const { return m_time; }
+
+void Simulator::set_time(const double time) { m_time = time; }
+
+const Simulator_Stats &Simulator::get_stats() const { return m_stats; }
+
+void Simulator::set_integrator(const Integrator integrator) {
+  m_integrator = integrator;
+}
+
+Integrator Simulator::get_integrator() const { return m_integrator; }
+
+void Simulator::set_force_backend(const Force_Backend backend) {
+  m_force_backend = backend;
+}
+
+Force_Backend Simulator::get_force_backend() const { return m_force_backend; }
+
+Sim::PM_Solver &Simulator::get_pm_solver() { return m_pm; }
+
+Sim::FMM_Solver &Simulator::get_fmm_solver() { return m_fmm; }
+
+Sim::SPH_Solver &Simulator::get_sph_solver() { return m_sph; }
+
+Sim::Collision_Detector &Simulator::get_collision_detector() {
+  return m_collision;
+}
+
+void Simulator::set_perturbation_threshold(const double ratio) {
+  m_perturbation_threshold = ratio;
+}
+
+void Simulator::set_handoff(const bool enabled) { m_handoff = enabled; }
+
+void Simulator::set_collisions(const bool enabled) { m_collisions = enabled; }
+
+void Simulator::set_deterministic(const bool enabled) {
+  m_deterministic = enabled;
+}
+
+bool Simulator::is_deterministic() const { return m_deterministic; }
+
+size_t Simulator::restore_orbits(entt::registry &reg) {
+  size_t n_restored = 0;
+  const auto &orbit_entities =
+      reg.view<Components::Transform, Components::Physics,
+               Components::Orbit>();
+  for (const auto e : orbit_entities) {
+    auto &&[transform, physics, orbit] =
+        reg.get<Components::Transform, Components::Physics,
+                Components::Orbit>(e);
+    if (orbit.analytic || orbit.mu <= 0.0)
+      continue;
+
+    Sim::Orbit_State state = {simd_double(transform.p),
+                              simd_double(physics.v)};
+    if (orbit.parent != entt::null && reg.valid(orbit.parent)) {
+      if (const auto *t = reg.try_get<Components::Transform>(orbit.parent))
+        state.p -= simd_double(t->p);
+      if (const auto *p = reg.try_get<Components::Physics>(orbit.parent))
+        state.v -= simd_double(p->v);
+    }
+
+    try {
+      orbit = Sim::make_orbit(state, orbit.mu, m_time, orbit.parent);
+      n_restored++;
+    } catch (const std::runtime_error &) {
+      continue; // Radial, leave it numeric
+    }
+  }
+
+  return n_restored;
+}
+
+entt::entity Simulator::pick(const entt::registry &reg,
+                             const Math::vec_d3 &origin,
+                             const Math::vec_d3 &dir, const double radius) {
+  if (!(radius > 0.0))
+    throw std::runtime_error("Failed: pick radius must be positive");
+
+  m_hash_entities.clear();
+  m_hash_p.clear();
+  for (const auto e : reg.view<Components::Transform>()) {
+    m_hash_entities.push_back(e);
+    m_hash_p.push_back(simd_double(reg.get<Components::Transform>(e).p));
+  }
+
+  m_hash.build(m_hash_p, 2.0 * radius);
+  const uint32_t k = m_hash.cast_ray(
+      origin, dir, std::numeric_limits<double>::infinity(), radius);
+  return k == Sim::SPATIAL_HASH_NONE ? entt::null
+                                     : m_hash_entities[m_hash.get_order()[k]];
+}
+
+/* Storage order depends on when components were added and removed, entity
+ * order only on the entities */
+template <typename View> void Simulator::collect(const View &view) {
+  m_entities.clear();
+  for (const auto e : view)
+    m_entities.push_back(e);
+  if (m_deterministic)
+    std::sort(m_entities.begin(), m_entities.end());
+}
+
+void Simulator::gather(entt::registry &reg) {
+  m_orbit_entities.clear();
+  m_orbits.clear();
+  m_orbit_gm.clear();
+  m_orbit_index.clear();
+  collect(reg.view<Components::Transform, Components::Orbit>());
+  for (const auto e : m_entities) {
+    const auto &orbit = reg.get<Components::Orbit>(e);
+    if (!orbit.analytic)
+      continue;
+
+    const auto *physics = reg.try_get<Components::Physics>(e);
+    m_orbit_index.emplace(e, m_orbits.size());
+    m_orbit_entities.push_back(e);
+    m_orbits.push_back(orbit);
+    m_orbit_gm.push_back(physics ? GRAVITATIONAL_CONSTANT * physics->m : 0.0);
+  }
+
+  const size_t n_orbits = m_orbits.size();
+  m_local.resize(n_orbits);
+  m_world.resize(n_orbits);
+  m_resolved.resize(n_orbits);
+
+  m_bodies.clear();
+  m_p.clear();
+  m_v.clear();
+  m_body_index.clear();
+  m_gas.clear();
+  m_gas_m.clear();
+  m_gas_u.clear();
+  m_gas_h.clear();
+  m_colliders.clear();
+  m_col_r.clear();
+  m_col_meshes.clear();
+  m_col_frames.clear();
+  collect(reg.view<Components::Transform, Components::Physics>());
+  for (const auto e : m_entities) {
+    if (m_orbit_index.contains(e))
+      continue;
+
     auto &&[transform, physics] =
         reg.get<Components::Transform, Components::Physics>(e);
-    transform.p += physics.v * dt;
+    const auto *orbit = reg.try_get<Components::Orbit>(e);
+    m_body_index.emplace(e, m_bodies.size());
+    m_bodies.push_back(Body{e, orbit ? orbit->parent : entt::null,
+                            GRAVITATIONAL_CONSTANT * physics.m,
+                            orbit ? orbit->mu : 0.0,
+                            simd_double(physics.a)});
+    m_p.push_back(simd_double(transform.p));
+    m_v.push_back(simd_double(physics.v));
+
+    if (const auto *gas = reg.try_get<Components::Gas>(e)) {
+      m_gas.push_back(m_bodies.size() - 1);
+      m_gas_m.push_back(physics.m);
+      m_gas_u.push_back(gas->u);
+      m_gas_h.push_back(gas->h);
+    } else if (const auto *collider = reg.try_get<Components::Collider>(e);
+               collider && m_collisions) {
+      // Without a radius, the mesh's furthest vertex from its origin
+      const auto *mesh = reg.try_get<Components::Mesh>(e);
+      const CPU::Affine frame = CPU::make_affine(transform);
+      double r = collider->r;
+      if (r <= 0.0 && mesh)
+        for (const auto &vertex : mesh->verticies)
+          r = std::max(r, static_cast<double>(Math::magnitude(
+                              CPU::transform_vector(frame, vertex.p))));
+      if (r <= 0.0)
+        continue;
+
+      m_colliders.push_back(m_bodies.size() - 1);
+      m_col_r.push_back(r);
+      m_col_meshes.push_back(mesh);
+      m_col_frames.push_back(frame);
+    }
+  }
+
+  m_col_r0 = m_col_r;
+  m_col_p0.resize(m_colliders.size());
+  m_col_p1.resize(m_colliders.size());
+  m_alive.assign(m_bodies.size(), 1);
+
+  const size_t n_gas = m_gas.size();
+  m_gas_p.resize(n_gas);
+  m_gas_v.resize(n_gas);
+  m_gas_a.resize(n_gas);
+  m_gas_rho.resize(n_gas);
+  m_gas_du.assign(n_gas, 0.0);
+
+  m_orbits_midstep =
+      std::any_of(m_orbit_gm.begin(), m_orbit_gm.end(),
+                  [](const double gm) { return gm > 0.0; }) ||
+      std::any_of(m_bodies.begin(), m_bodies.end(), [&](const Body &body) {
+        return m_orbit_index.contains(body.parent);
+      });
+
+  m_a.resize(m_bodies.size());
+  m_stats.n_analytic = n_orbits;
+  m_stats.n_numeric = m_bodies.size();
+  m_stats.n_gas = n_gas;
+  m_stats.n_colliders = m_colliders.size();
+}
+
+void Simulator::scatter(entt::registry &reg) {
+  for (size_t i = 0; i < m_bodies.size(); i++) {
+    if (!m_alive[i])
+      continue;
+
+    auto &&[transform, physics] =
+        reg.get<Components::Transform, Components::Physics>(m_bodies[i].e);
+    transform.p = simd_float(m_p[i]);
+    physics.v = simd_float(m_v[i]);
   }
+
+  // Survivors of a merger grow, meshes scaled to match
+  for (size_t k = 0; k < m_colliders.size(); k++) {
+    if (m_col_r[k] == m_col_r0[k])
+      continue;
+
+    const Body &body = m_bodies[m_colliders[k]];
+    auto &&[transform, physics, collider] =
+        reg.get<Components::Transform, Components::Physics,
+                Components::Collider>(body.e);
+    physics.m = static_cast<float>(body.gm / GRAVITATIONAL_CONSTANT);
+    if (collider.r > 0.0f)
+      collider.r = static_cast<float>(m_col_r[k]);
+    if (m_col_meshes[k])
+      transform.s *= static_cast<float>(m_col_r[k] / m_col_r0[k]);
+  }
+
+  for (size_t k = 0; k < m_gas.size(); k++) {
+    auto &gas = reg.get<Components::Gas>(m_bodies[m_gas[k]].e);
+    gas.h = static_cast<float>(m_gas_h[k]);
+    gas.u = static_cast<float>(m_gas_u[k]);
+    gas.rho = static_cast<float>(m_gas_rho[k]);
+  }
+
+  gather_masses();
+  for (size_t i = 0; i < m_orbits.size(); i++) {
+    const entt::entity e = m_orbit_entities[i], parent = m_orbits[i].parent;
+    const Sim::Orbit_State &world = m_world[i];
+    auto &transform = reg.get<Components::Transform>(e);
+    auto *physics = reg.try_get<Components::Physics>(e);
+    transform.p = simd_float(world.p);
+    if (physics)
+      physics->v = simd_float(world.v);
+    if (!m_handoff)
+      continue;
+
+    /* Pull of every other mass on the body, less its pull on the parent,
+     * against the parent's own pull */
+    const Math::vec_d3 parent_p = world.p - m_local[i].p;
+    Math::vec_d3 perturbation =
+        get_gravity(world.p, e, parent) - get_gravity(parent_p, e, parent);
+    if (physics)
+      perturbation += simd_double(physics->a);
+
+    const double r2 = simd_dot(m_local[i].p, m_local[i].p);
+    if (Math::magnitude(perturbation) * r2 >
+        m_perturbation_threshold * m_orbits[i].mu) {
+      // Numeric integration needs somewhere to keep the velocity
+      reg.get<Components::Orbit>(e).analytic = false;
+      reg.get_or_emplace<Components::Physics>(e).v = simd_float(world.v);
+      m_stats.n_handoffs++;
+    }
+  }
+}
+
+/* FNV-1a over the time and every body's state, hashed in fixed chunks so
+ * it can run in parallel and still not depend on the thread count */
+uint64_t Simulator::get_checksum() const {
+  const size_t n = m_bodies.size(), n_orbits = m_orbits.size();
+  std::vector<uint64_t> chunk_hashes(
+      Parallel::Thread_Pool::get_chunk_ct(n + n_orbits, BODY_GRAIN));
+  m_pool.parallel_for(
+      0, n + n_orbits, BODY_GRAIN,
+      [&](const size_t b, const size_t e, const size_t chunk) {
+        uint64_t h = FNV_OFFSET;
+        for (size_t i = b; i < e; i++) {
+          if (i < n && !m_alive[i])
+            continue;
+
+          const entt::entity entity =
+              i < n ? m_bodies[i].e : m_orbit_entities[i - n];
+          h = hash_bytes(h, &entity, sizeof(entity));
+          h = hash_vec(h, i < n ? m_p[i] : m_world[i - n].p);
+          h = hash_vec(h, i < n ? m_v[i] : m_world[i - n].v);
+        }
+        chunk_hashes[chunk] = h;
+      });
+
+  uint64_t h = hash_bytes(FNV_OFFSET, &m_time, sizeof(m_time));
+  for (const uint64_t chunk_hash : chunk_hashes)
+    h = hash_bytes(h, &chunk_hash, sizeof(chunk_hash));
+  return h;
+}
+
+void Simulator::gather_masses() {
+  m_masses.clear();
+  for (size_t i = 0; i < m_bodies.size(); i++)
+    if (m_bodies[i].gm > 0.0)
+      m_masses.push_back(Mass_Point{m_bodies[i].e, m_p[i], m_bodies[i].gm});
+  for (size_t i = 0; i < m_orbits.size(); i++)
+    if (m_orbit_gm[i] > 0.0)
+      m_masses.push_back(
+          Mass_Point{m_orbit_entities[i], m_world[i].p, m_orbit_gm[i]});
+
+  m_src_p.resize(m_masses.size());
+  m_src_gm.resize(m_masses.size());
+  for (size_t i = 0; i < m_masses.size(); i++) {
+    m_src_p[i] = m_masses[i].p;
+    m_src_gm[i] = m_masses[i].gm;
+  }
+}
+
+void Simulator::evaluate_orbits(entt::registry &reg, const double t) {
+  if (m_orbits.empty())
+    return;
+
+  Sim::get_orbit_states(m_pool, m_orbits, t, m_local);
+  std::fill(m_resolved.begin(), m_resolved.end(), 0);
+  for (size_t i = 0; i < m_orbits.size(); i++)
+    resolve_orbit(reg, i);
+}
+
+Sim::Orbit_State Simulator::get_parent_state(entt::registry &reg,
+                                             const entt::entity parent) {
+  Sim::Orbit_State state;
+  if (parent == entt::null || !reg.valid(parent))
+    return state;
+
+  if (const auto it = m_orbit_index.find(parent); it != m_orbit_index.end())
+    return resolve_orbit(reg, it->second);
+  if (const auto it = m_body_index.find(parent); it != m_body_index.end())
+    return Sim::Orbit_State{m_p[it->second], m_v[it->second]};
+
+  if (const auto *transform = reg.try_get<Components::Transform>(parent))
+    state.p = simd_double(transform->p);
+  return state;
+}
+
+/* Parents resolve first, a cycle falls back to orbiting the origin */
+const Sim::Orbit_State &Simulator::resolve_orbit(entt::registry &reg,
+                                                 const size_t i) {
+  if (m_resolved[i] == 0) {
+    m_resolved[i] = 1;
+    const Sim::Orbit_State parent = get_parent_state(reg, m_orbits[i].parent);
+    m_world[i] = Sim::Orbit_State{parent.p + m_local[i].p,
+                                  parent.v + m_local[i].v};
+    m_resolved[i] = 2;
+  } else if (m_resolved[i] == 1) {
+    m_world[i] = m_local[i];
+  }
+
+  return m_world[i];
+}
+
+Math::vec_d3 Simulator::get_gravity(const Math::vec_d3 &p,
+                                    const entt::entity skip_a,
+                                    const entt::entity skip_b) const {
+  Math::vec_d3 a = {0.0, 0.0, 0.0};
+  for (const auto &mass : m_masses) {
+    if (mass.e == skip_a || mass.e == skip_b)
+      continue;
+
+    const Math::vec_d3 d = mass.p - p;
+    const double r2 = simd_dot(d, d);
+    if (r2 > 0.0)
+      a += d * (mass.gm / (r2 * std::sqrt(r2)));
+  }
+
+  return a;
+}
+
+double Simulator::get_gm(const entt::entity e) const {
+  if (const auto it = m_body_index.find(e); it != m_body_index.end())
+    return m_bodies[it->second].gm;
+  if (const auto it = m_orbit_index.find(e); it != m_orbit_index.end())
+    return m_orbit_gm[it->second];
+  return 0.0;
+}
+
+/* Analytic bodies are placed at t so numeric ones feel them where they are
+ * mid-step. Bodies handed off from an orbit keep the parent's pull through
+ * mu, so the backend's pull of the parent's mass is swapped for it */
+void Simulator::get_accelerations(entt::registry &reg, const double t) {
+  if (m_orbits_midstep)
+    evaluate_orbits(reg, t);
+  gather_masses();
+
+  for (size_t i = 0; i < m_bodies.size(); i++)
+    m_a[i] = m_bodies[i].a_ext;
+
+  switch (m_force_backend) {
+  case Force_Backend::Direct:
+    Sim::accumulate_direct(m_pool, m_src_p,
+                           m_src_gm, m_p, m_a, m_deterministic);
+    break;
+  case Force_Backend::PM:
+    m_pm.accumulate(m_src_p, m_src_gm, m_p, m_a);
+    break;
+  case Force_Backend::FMM:
+    m_fmm.accumulate(m_src_p, m_src_gm, m_p, m_a);
+    break;
+  }
+
+  for (size_t i = 0; i < m_bodies.size(); i++) {
+    const Body &body = m_bodies[i];
+    if (body.mu <= 0.0)
+      continue;
+
+    const double gm = body.mu - get_gm(body.parent);
+    const Math::vec_d3 d = get_parent_state(reg, body.parent).p - m_p[i];
+    const double r2 = simd_dot(d, d);
+    if (r2 > 0.0)
+      m_a[i] += d * (gm / (r2 * std::sqrt(r2)));
+  }
+
+  if (!m_gas.empty()) {
+    for (size_t k = 0; k < m_gas.size(); k++) {
+      m_gas_p[k] = m_p[m_gas[k]];
+      m_gas_v[k] = m_v[m_gas[k]];
+      m_gas_a[k] = Math::vec_d3{0.0, 0.0, 0.0};
+    }
+    m_sph.compute(m_gas_p, m_gas_v, m_gas_m, m_gas_u, m_gas_h, m_gas_rho,
+                  m_gas_a, m_gas_du);
+    for (size_t k = 0; k < m_gas.size(); k++)
+      m_a[m_gas[k]] += m_gas_a[k];
+  }
+
+  m_stats.n_force_evals++;
+}
+
+void Simulator::drift(const double h) {
+  m_pool.parallel_for(
+      0, m_p.size(), BODY_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t i = b; i < e; i++)
+          m_p[i] += m_v[i] * h;
+      });
+}
+
+/* Contacts in order of first touch, so a body that merges twice in a
+ * substep does so at its merged state */
+void Simulator::collide() {
+  for (size_t k = 0; k < m_colliders.size(); k++)
+    m_col_p1[k] = m_p[m_colliders[k]];
+  m_collision.detect(m_col_p0, m_col_p1, m_col_r, m_col_meshes, m_col_frames,
+                     m_contacts);
+  if (m_contacts.empty())
+    return;
+
+  for (const Sim::Contact &contact : m_contacts)
+    if (m_alive[m_colliders[contact.i]] && m_alive[m_colliders[contact.j]])
+      merge(contact.i, contact.j);
+
+  // Drop the absorbed so later substeps skip them
+  size_t n_kept = 0;
+  for (size_t k = 0; k < m_colliders.size(); k++) {
+    if (!m_alive[m_colliders[k]])
+      continue;
+
+    m_colliders[n_kept] = m_colliders[k];
+    m_col_r[n_kept] = m_col_r[k];
+    m_col_r0[n_kept] = m_col_r0[k];
+    m_col_meshes[n_kept] = m_col_meshes[k];
+    m_col_frames[n_kept] = m_col_frames[k];
+    n_kept++;
+  }
+  m_colliders.resize(n_kept);
+  m_col_r.resize(n_kept);
+  m_col_r0.resize(n_kept);
+  m_col_meshes.resize(n_kept);
+  m_col_frames.resize(n_kept);
+  m_col_p0.resize(n_kept);
+  m_col_p1.resize(n_kept);
+}
+
+/* The heavier of colliders a and b, the first on a tie, takes the other's
+ * mass and momentum at their centre of mass. Radii add by volume */
+void Simulator::merge(const size_t a, const size_t b) {
+  const double gm_a = m_bodies[m_colliders[a]].gm,
+               gm_b = m_bodies[m_colliders[b]].gm;
+  const size_t keep = gm_a >= gm_b ? a : b;
+  const size_t lose = keep == a ? b : a;
+  const size_t i = m_colliders[keep], j = m_colliders[lose];
+  Body &survivor = m_bodies[i], &absorbed = m_bodies[j];
+
+  const double gm = survivor.gm + absorbed.gm;
+  const double w = gm > 0.0 ? survivor.gm / gm : 0.5;
+  m_p[i] = w * m_p[i] + (1.0 - w) * m_p[j];
+  m_v[i] = w * m_v[i] + (1.0 - w) * m_v[j];
+  m_a[i] = w * m_a[i] + (1.0 - w) * m_a[j];
+  survivor.gm = gm;
+  m_col_r[keep] = std::cbrt(m_col_r[keep] * m_col_r[keep] * m_col_r[keep] +
+                            m_col_r[lose] * m_col_r[lose] * m_col_r[lose]);
+
+  absorbed.gm = 0.0;
+  m_alive[j] = 0;
+  m_absorbed.push_back(absorbed.e);
+  m_stats.n_mergers++;
+}
+
+void Simulator::kick(const double h) {
+  m_pool.parallel_for(
+      0, m_v.size(), BODY_GRAIN, [&](const size_t b, const size_t e, size_t) {
+        for (size_t i = b; i < e; i++)
+          m_v[i] += m_a[i] * h;
+      });
+  for (size_t k = 0; k < m_gas.size(); k++)
+    m_gas_u[k] = std::max(m_gas_u[k] + m_gas_du[k] * h, 0.0);
 }
 
 } // namespace CTNM
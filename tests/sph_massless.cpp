@@ -0,0 +1,76 @@
+#include "math_utils.hpp"
+#include "parallel/thread_pool.hpp"
+#include "sim/sph.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace CTNM;
+
+/* Massless gas particles, alone and in an approaching pair, with and
+ * without a massive cloud to find. Every output must stay finite, and with
+ * nothing massive in reach their density is 0 */
+
+static uint32_t check(Sim::SPH_Solver &sph, const char *name,
+                      const std::vector<Math::vec_d3> &p,
+                      const std::vector<double> &m) {
+  const size_t n = p.size();
+  std::vector<Math::vec_d3> v(n, Math::vec_d3{0.0, 0.0, 0.0});
+  v[n - 1] = Math::vec_d3{0.0, -1.0, 0.0}; // Approaching, for viscosity
+  std::vector<Math::vec_d3> a(n, Math::vec_d3{0.0, 0.0, 0.0});
+  std::vector<double> u(n, 1.0), h(n, 0.0), rho(n), du_dt(n);
+  sph.compute(p, v, m, u, h, rho, a, du_dt);
+
+  bool any_mass = false;
+  for (const double mass : m)
+    any_mass |= mass > 0.0;
+
+  uint32_t n_failed = 0;
+  for (size_t i = 0; i < n; i++) {
+    const bool finite = std::isfinite(rho[i]) && std::isfinite(h[i]) &&
+                        std::isfinite(du_dt[i]) && std::isfinite(a[i].x) &&
+                        std::isfinite(a[i].y) && std::isfinite(a[i].z);
+    if (!finite || (!any_mass && rho[i] != 0.0)) {
+      std::printf("Failed: %s particle %zu, rho %g, du_dt %g, a %g %g %g\n",
+                  name, i, rho[i], du_dt[i], a[i].x, a[i].y, a[i].z);
+      n_failed++;
+    }
+  }
+
+  return n_failed;
+}
+
+int main() {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  const std::vector<Math::vec_d3> massless = {
+      Math::vec_d3{100.0, 100.0, 100.0}, Math::vec_d3{-100.0, 0.0, 0.0},
+      Math::vec_d3{-100.0, 0.01, 0.0}};
+  std::vector<Math::vec_d3> p;
+  std::vector<double> m;
+  for (uint32_t i = 0; i < 512; i++) {
+    p.push_back(Math::vec_d3{unit(rng), unit(rng), unit(rng)});
+    m.push_back(1.0 / 512.0);
+  }
+  p.insert(p.end(), massless.begin(), massless.end());
+  m.resize(p.size(), 0.0);
+
+  Parallel::Thread_Pool pool(2);
+  Sim::SPH_Solver sph(pool);
+  uint32_t n_failed = 0;
+  for (const Sim::SPH_Kernel kernel :
+       {Sim::SPH_Kernel::Cubic_Spline, Sim::SPH_Kernel::Wendland_C2}) {
+    Sim::SPH_Config config;
+    config.kernel = kernel;
+    sph.set_config(config);
+    n_failed += check(sph, "alone", massless,
+                      std::vector<double>(massless.size(), 0.0));
+    n_failed += check(sph, "beside cloud", p, m);
+  }
+
+  return n_failed == 0 ? 0 : 1;
+}